@@ -0,0 +1,152 @@
+/**
+ *  @file     cal_api_id.h
+ *  @brief    CAL entry point identifiers
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_API_ID_H__
+#define __CAL_API_ID_H__
+
+#include "cal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#define CALAPI
+#else
+#define CALAPI extern
+#endif
+
+#ifdef _WIN32
+#define CALAPIENTRY  __stdcall
+#else
+#define CALAPIENTRY
+#endif
+
+/**
+ * One identifier per CAL entry point: every export of the runtime and
+ * compiler libraries followed by the extension procs that are commonly on
+ * the hot path. Values are stored in trace files, keep them stable and only
+ * append.
+ */
+typedef enum CALapiIdEnum {
+    CAL_API_NONE = 0,
+
+    /* aticalrt exports */
+    CAL_API_INIT,                       /**< calInit */
+    CAL_API_GET_VERSION,                /**< calGetVersion */
+    CAL_API_SHUTDOWN,                   /**< calShutdown */
+    CAL_API_DEVICE_GET_COUNT,           /**< calDeviceGetCount */
+    CAL_API_DEVICE_GET_INFO,            /**< calDeviceGetInfo */
+    CAL_API_DEVICE_GET_ATTRIBS,         /**< calDeviceGetAttribs */
+    CAL_API_DEVICE_GET_STATUS,          /**< calDeviceGetStatus */
+    CAL_API_DEVICE_OPEN,                /**< calDeviceOpen */
+    CAL_API_DEVICE_CLOSE,               /**< calDeviceClose */
+    CAL_API_RES_ALLOC_LOCAL_2D,         /**< calResAllocLocal2D */
+    CAL_API_RES_ALLOC_REMOTE_2D,        /**< calResAllocRemote2D */
+    CAL_API_RES_ALLOC_LOCAL_1D,         /**< calResAllocLocal1D */
+    CAL_API_RES_ALLOC_REMOTE_1D,        /**< calResAllocRemote1D */
+    CAL_API_RES_FREE,                   /**< calResFree */
+    CAL_API_RES_MAP,                    /**< calResMap */
+    CAL_API_RES_UNMAP,                  /**< calResUnmap */
+    CAL_API_CTX_CREATE,                 /**< calCtxCreate */
+    CAL_API_CTX_DESTROY,                /**< calCtxDestroy */
+    CAL_API_CTX_GET_MEM,                /**< calCtxGetMem */
+    CAL_API_CTX_RELEASE_MEM,            /**< calCtxReleaseMem */
+    CAL_API_CTX_SET_MEM,                /**< calCtxSetMem */
+    CAL_API_CTX_RUN_PROGRAM,            /**< calCtxRunProgram */
+    CAL_API_CTX_IS_EVENT_DONE,          /**< calCtxIsEventDone */
+    CAL_API_CTX_FLUSH,                  /**< calCtxFlush */
+    CAL_API_MEM_COPY,                   /**< calMemCopy */
+    CAL_API_IMAGE_READ,                 /**< calImageRead */
+    CAL_API_IMAGE_FREE,                 /**< calImageFree */
+    CAL_API_MODULE_LOAD,                /**< calModuleLoad */
+    CAL_API_MODULE_UNLOAD,              /**< calModuleUnload */
+    CAL_API_MODULE_GET_ENTRY,           /**< calModuleGetEntry */
+    CAL_API_MODULE_GET_NAME,            /**< calModuleGetName */
+    CAL_API_GET_ERROR_STRING,           /**< calGetErrorString */
+    CAL_API_CTX_RUN_PROGRAM_GRID,       /**< calCtxRunProgramGrid */
+    CAL_API_MODULE_GET_FUNC_INFO,       /**< calModuleGetFuncInfo */
+    CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY, /**< calCtxRunProgramGridArray */
+    CAL_API_EXT_SUPPORTED,              /**< calExtSupported */
+    CAL_API_EXT_GET_VERSION,            /**< calExtGetVersion */
+    CAL_API_EXT_GET_PROC,               /**< calExtGetProc */
+
+    /* aticalcl exports */
+    CAL_API_CL_GET_VERSION,             /**< calclGetVersion */
+    CAL_API_CL_COMPILE,                 /**< calclCompile */
+    CAL_API_CL_LINK,                    /**< calclLink */
+    CAL_API_CL_FREE_OBJECT,             /**< calclFreeObject */
+    CAL_API_CL_FREE_IMAGE,              /**< calclFreeImage */
+    CAL_API_CL_DISASSEMBLE_IMAGE,       /**< calclDisassembleImage */
+    CAL_API_CL_ASSEMBLE_OBJECT,         /**< calclAssembleObject */
+    CAL_API_CL_DISASSEMBLE_OBJECT,      /**< calclDisassembleObject */
+    CAL_API_CL_IMAGE_GET_SIZE,          /**< calclImageGetSize */
+    CAL_API_CL_IMAGE_WRITE,             /**< calclImageWrite */
+    CAL_API_CL_GET_ERROR_STRING,        /**< calclGetErrorString */
+    CAL_API_CL_EXT_SUPPORTED,           /**< calclExtSupported */
+    CAL_API_CL_EXT_GET_PROC,            /**< calclExtGetProc */
+
+    /* extension procs */
+    CAL_API_RES_CREATE_2D,              /**< calResCreate2D */
+    CAL_API_RES_CREATE_1D,              /**< calResCreate1D */
+    CAL_API_RES_ALLOC_VIEW,             /**< calResAllocView */
+    CAL_API_RES_ALLOC,                  /**< calResAlloc */
+    CAL_API_RES_GET_HEAP,               /**< calResGetHeap */
+    CAL_API_CTX_WAIT_FOR_EVENTS,        /**< calCtxWaitForEvents */
+    CAL_API_CTX_FLUSH_CACHE,            /**< calCtxFlushCache */
+    CAL_API_MEM_COPY_RAW,               /**< calMemCopyRaw */
+    CAL_API_MEM_COPY_PARTIAL,           /**< calMemCopyPartial */
+
+    CAL_API_COUNT
+} CALapiId;
+
+/**
+ * @fn calApiName(CALapiId id)
+ *
+ * @brief Return the entry point name of id, e.g. "calCtxRunProgram".
+ *
+ * @return Returns the name, or "unknown" for an out of range id.
+ */
+CALAPI const CALchar* CALAPIENTRY calApiName(CALapiId id);
+
+/**
+ * @fn calApiIdFromName(const CALchar* name)
+ *
+ * @brief Look up the identifier of an entry point or extension proc name.
+ *
+ * @return Returns the identifier, CAL_API_NONE if the name is not known.
+ */
+CALAPI CALapiId CALAPIENTRY calApiIdFromName(const CALchar* name);
+
+#ifdef __cplusplus
+}      /* extern "C" { */
+#endif
+
+#endif // __CAL_API_ID_H__
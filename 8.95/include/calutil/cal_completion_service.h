@@ -0,0 +1,140 @@
+/**
+ *  @file     cal_completion_service.h
+ *  @brief    Completion callbacks for CAL events, one poller thread per device
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_COMPLETION_SERVICE_H__
+#define __CAL_COMPLETION_SERVICE_H__
+
+#include "cal.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace cal {
+
+struct DevicePoller;
+
+/**
+ * Invoked once per registration with the event and the calCtxIsEventDone
+ * result that ended the wait: CAL_RESULT_OK, or the error polling returned.
+ */
+typedef std::function<void(CALevent event, CALresult result)> EventCallback;
+
+/**
+ * @brief Runs callbacks when CAL events complete.
+ *
+ * Instead of every caller polling calCtxIsEventDone in its own loop,
+ * callers attach their contexts and register callbacks on events. One
+ * background thread per device polls every registered event of the
+ * device's contexts in one sweep and dispatches the callbacks of the
+ * completed ones. Between sweeps the thread yields briefly and then sleeps
+ * for the poll interval; with nothing registered it sleeps until the next
+ * registration.
+ *
+ * Polling happens off the thread that created the context, so the runtime
+ * must not run with CAL_CONFIG_THREAD_SAFE_OFF. Callbacks run on the poller
+ * thread; they may register further callbacks but must not block for long
+ * or call detach().
+ */
+class CompletionService
+{
+public:
+    CompletionService();
+
+    /** Runs shutdown(). */
+    ~CompletionService();
+
+    CompletionService(const CompletionService&) = delete;
+    CompletionService& operator=(const CompletionService&) = delete;
+
+    /**
+     * @brief Make ctx, created on dev, eligible for notify().
+     *
+     * Starts the poller thread of dev on first use.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_INVALID_PARAMETER for a 0 handle or
+     *         a context already attached to another device, CAL_RESULT_ERROR
+     *         after shutdown().
+     */
+    CALresult attach(CALcontext ctx, CALdevice dev);
+
+    /**
+     * @brief Wait until every callback registered on ctx ran and forget ctx.
+     *
+     * Callbacks that register further callbacks on ctx keep it attached
+     * until the chain ends. Call before calCtxDestroy.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_BAD_HANDLE if ctx is not attached.
+     */
+    CALresult detach(CALcontext ctx);
+
+    /**
+     * @brief Run callback once event of ctx is done.
+     *
+     * The event must have been flushed, or polling flushes it.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_INVALID_PARAMETER for a 0 event or an
+     *         empty callback, CAL_RESULT_BAD_HANDLE if ctx is not attached.
+     */
+    CALresult notify(CALcontext ctx, CALevent event, const EventCallback& callback);
+
+    /** Sleep between sweeps while events are outstanding; default 50 µs. */
+    void setPollInterval(CALuint microseconds);
+
+    /** Run the remaining callbacks and stop every poller thread. */
+    void shutdown();
+
+    /** Sweeps over outstanding events, summed over all devices. */
+    CALuint64 sweepCount() const { return m_sweeps.load(std::memory_order_relaxed); }
+
+    /** Callbacks dispatched so far. */
+    CALuint64 dispatchCount() const { return m_dispatched.load(std::memory_order_relaxed); }
+
+private:
+    friend struct DevicePoller;
+
+    std::mutex                                                  m_lock;
+    std::unordered_map<CALdevice, std::unique_ptr<DevicePoller>> m_devices;
+    std::unordered_map<CALcontext, DevicePoller*>               m_contexts;
+    bool                                                        m_shutdown;
+
+    std::atomic<CALuint>                                        m_pollIntervalUs;
+    std::atomic<CALuint64>                                      m_sweeps;
+    std::atomic<CALuint64>                                      m_dispatched;
+};
+
+} // namespace cal
+
+#endif // __CAL_COMPLETION_SERVICE_H__
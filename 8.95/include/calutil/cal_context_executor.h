@@ -0,0 +1,189 @@
+/**
+ *  @file     cal_context_executor.h
+ *  @brief    CAL context owned by a dedicated submission thread
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_CONTEXT_EXECUTOR_H__
+#define __CAL_CONTEXT_EXECUTOR_H__
+
+#include "cal.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cal {
+
+class ContextExecutor;
+struct ExecutorWork;
+struct ExecutorCompletion;
+
+/**
+ * @brief Handle to one work item queued on a ContextExecutor.
+ *
+ * Work that produces a CALevent (grids and copies) completes when the event
+ * does; everything else completes once the call returned. Handles are cheap
+ * to copy and stay valid after the executor is closed.
+ */
+class Completion
+{
+public:
+    Completion() {}
+
+    /** False for a default constructed handle. */
+    bool valid() const { return m_state != 0; }
+
+    /** True once the work finished, successfully or not. */
+    bool done() const;
+
+    /** Result of the call, or of the event wait; CAL_RESULT_PENDING until done. */
+    CALresult result() const;
+
+    /** Event returned by the call, 0 for work without an event or before submission. */
+    CALevent event() const;
+
+    /** Block until done and return result(). */
+    CALresult wait() const;
+
+private:
+    friend class ContextExecutor;
+
+    explicit Completion(const std::shared_ptr<ExecutorCompletion>& state) : m_state(state) {}
+
+    std::shared_ptr<ExecutorCompletion> m_state;
+};
+
+/**
+ * @brief Owns a CALcontext on a dedicated thread and accepts work from any
+ * thread.
+ *
+ * CAL contexts must be used from the thread that created them
+ * (CAL_RESULT_INVALID_THREAD). The executor creates its context on its own
+ * thread and feeds it from a lock-free multi producer queue, so producers
+ * never serialize on a lock. Each wake-up drains every queued item as one
+ * batch; flushes requested within a batch are merged into one calCtxFlush
+ * at its end, and the batch is flushed automatically when it submitted work.
+ *
+ * Handles that belong to the context (CALmem, CALname, CALfunc) are created
+ * through invoke(), which runs arbitrary code on the executor thread.
+ */
+class ContextExecutor
+{
+public:
+    ContextExecutor();
+    ~ContextExecutor();
+
+    ContextExecutor(const ContextExecutor&) = delete;
+    ContextExecutor& operator=(const ContextExecutor&) = delete;
+
+    /**
+     * @brief Start the executor thread and create the context on it.
+     *
+     * @return the calCtxCreate result; the thread is stopped again on failure.
+     */
+    CALresult open(CALdevice dev);
+
+    /**
+     * @brief Run the remaining work, wait for its events and destroy the
+     * context. Work queued once close has started fails with
+     * CAL_RESULT_ERROR.
+     */
+    void close();
+
+    /** Context owned by the executor; only use it from invoke(). */
+    CALcontext context() const { return m_ctx; }
+
+    Completion setMem(CALname name, CALmem mem);
+    Completion runProgramGrid(const CALprogramGrid& grid);
+    Completion memCopy(CALmem srcMem, CALmem dstMem, CALuint flags = 0);
+    Completion flush();
+
+    /**
+     * @brief Run fn(context) on the executor thread, in queue order.
+     *
+     * The completion carries the CALresult fn returned.
+     */
+    Completion invoke(const std::function<CALresult(CALcontext)>& fn);
+
+    /** Drain cycles executed so far. */
+    CALuint64 batchCount() const { return m_batches.load(std::memory_order_relaxed); }
+
+    /** Work items executed so far. */
+    CALuint64 workCount() const { return m_executed.load(std::memory_order_relaxed); }
+
+    /** calCtxFlush calls issued so far. */
+    CALuint64 flushCount() const { return m_flushes.load(std::memory_order_relaxed); }
+
+private:
+    friend class Completion;
+
+    Completion enqueue(ExecutorWork* work);
+    ExecutorWork* pop();
+    bool queueEmpty() const;
+
+    void threadMain(CALdevice dev);
+    bool runBatch();
+    void execute(ExecutorWork& work, bool& submitted, std::vector<ExecutorWork*>& flushes);
+    void pollEvents();
+    void retire(ExecutorCompletion& state, CALresult result);
+    void waitFor(const ExecutorCompletion& state);
+
+    // Intrusive multi producer, single consumer queue with a stub node
+    std::atomic<ExecutorWork*>  m_head;         // producers push here
+    ExecutorWork*               m_tail;         // consumer pops here
+    ExecutorWork*               m_stub;
+
+    std::atomic<bool>           m_sleeping;     // executor thread waits on m_wake
+    std::atomic<CALuint>        m_waiters;      // threads waiting on m_done
+    std::atomic<CALuint>        m_producers;    // enqueue() calls between the m_accepting check and the link
+    std::atomic<bool>           m_accepting;
+    bool                        m_exit;
+    std::mutex                  m_lock;
+    std::condition_variable     m_wake;         // executor thread
+    std::condition_variable     m_done;         // waiters on completions
+
+    std::thread                 m_thread;
+    CALcontext                  m_ctx;
+    CALresult                   m_openResult;
+    std::vector<ExecutorWork*>  m_inFlight;     // submitted, event not done
+
+    std::atomic<CALuint64>      m_batches;
+    std::atomic<CALuint64>      m_executed;
+    std::atomic<CALuint64>      m_flushes;
+};
+
+} // namespace cal
+
+#endif // __CAL_CONTEXT_EXECUTOR_H__
@@ -0,0 +1,99 @@
+/**
+ *  @file     cal_copy.h
+ *  @brief    CAL utility pitch-aware copies to and from mapped surfaces
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_COPY_H__
+#define __CAL_COPY_H__
+
+#include "cal.h"
+
+#include <cstddef>
+
+namespace cal {
+
+/** Options of the surface copies. */
+enum CopyFlags
+{
+    CopyDefault     = 0,
+    CopyStreaming   = 1 << 0,   ///< non-temporal stores; for write-combined (remote, uncached) destinations
+    CopyParallel    = 1 << 1    ///< split large copies by rows over ThreadPool::shared()
+};
+
+/** Instruction set of the streaming copy kernels; cached copies always use memcpy. */
+enum CopyIsa
+{
+    CopyIsaScalar = 0,          ///< memcpy per row, no streaming stores
+    CopyIsaSse2,
+    CopyIsaAvx2,
+    CopyIsaAvx512
+};
+
+/**
+ * @brief Copy rows bytes long rows between two pitched images.
+ *
+ * Rows that are packed on both sides are copied as one block. Streaming
+ * stores bypass the cache, which is what write-combined memory wants and
+ * what a destination the CPU will not read back soon benefits from; they
+ * are fenced before returning. Parallel copies only split copies large
+ * enough to outweigh the hand-off, at least a few hundred kilobytes.
+ */
+void copyPitched(CALvoid* dst, size_t dstPitchBytes, const CALvoid* src, size_t srcPitchBytes,
+                 size_t rowBytes, CALuint rows, CALuint flags = CopyDefault);
+
+/**
+ * @brief Copy a packed width x height host array of format to a surface
+ * mapped with calResMap.
+ *
+ * @param pitch (in) - surface pitch in elements, as returned by calResMap.
+ *
+ * @return CAL_RESULT_OK, or CAL_RESULT_INVALID_PARAMETER for a NULL pointer
+ *         or a pitch below width. A height of 0 copies one row.
+ */
+CALresult copyToSurface(CALvoid* surface, CALuint pitch, const CALvoid* host, CALuint width, CALuint height,
+                        CALformat format, CALuint flags = CopyStreaming);
+
+/** Copy a mapped surface to a packed host array; the reverse of copyToSurface. */
+CALresult copyFromSurface(CALvoid* host, const CALvoid* surface, CALuint pitch, CALuint width, CALuint height,
+                          CALformat format, CALuint flags = CopyDefault);
+
+/** Best instruction set the CPU supports. */
+CopyIsa copyIsaSupported();
+
+/** Instruction set the copies use; the best supported one by default. */
+CopyIsa copyIsa();
+
+/** Force a lower instruction set, for comparisons; clamped to the supported one. */
+void setCopyIsa(CopyIsa isa);
+
+} // namespace cal
+
+#endif // __CAL_COPY_H__
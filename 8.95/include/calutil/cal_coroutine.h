@@ -0,0 +1,225 @@
+/**
+ *  @file     cal_coroutine.h
+ *  @brief    C++20 coroutine awaitables for CAL events, copies and dispatches
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_COROUTINE_H__
+#define __CAL_COROUTINE_H__
+
+#if !defined(__cpp_impl_coroutine)
+#error "cal_coroutine.h needs a compiler with C++20 coroutines (-std=c++20)"
+#endif
+
+#include "cal.h"
+#include "cal_ext.h"
+#include "cal_completion_service.h"
+
+#include <coroutine>
+#include <exception>
+
+namespace cal {
+
+class AsyncContext;
+
+/**
+ * @brief Awaitable CALevent of an AsyncContext.
+ *
+ * co_await yields the CALresult of the work: the submission error if the
+ * call that produced the event failed, otherwise CAL_RESULT_OK or the
+ * error calCtxIsEventDone reported. An event may be awaited more than
+ * once; awaiting a completed event does not suspend.
+ */
+class Event
+{
+public:
+    Event() : m_owner(0), m_event(0), m_result(CAL_RESULT_ERROR) {}
+    Event(AsyncContext& owner, CALevent event, CALresult result) : m_owner(&owner), m_event(event), m_result(result) {}
+
+    CALevent  event() const { return m_event; }
+
+    /** Result of the call that produced the event. */
+    CALresult submitResult() const { return m_result; }
+
+    class Awaiter
+    {
+    public:
+        Awaiter(AsyncContext* owner, CALevent event, CALresult result) : m_owner(owner), m_event(event), m_result(result) {}
+
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> handle);
+        CALresult await_resume() const { return m_result; }
+
+    private:
+        AsyncContext*   m_owner;
+        CALevent        m_event;
+        CALresult       m_result;
+    };
+
+    Awaiter operator co_await() const { return Awaiter(m_owner, m_event, m_result); }
+
+private:
+    AsyncContext*   m_owner;
+    CALevent        m_event;
+    CALresult       m_result;
+};
+
+/**
+ * @brief CALcontext whose events are awaited from coroutines.
+ *
+ * run() and copy() submit immediately and return an Event; a coroutine
+ * that awaits it is suspended without holding a thread and is resumed from
+ * the CompletionService poller of the context's device once the event is
+ * done. One reactor thread per device thus drives any number of in-flight
+ * coroutines:
+ *
+ *     cal::Task pipeline(cal::AsyncContext& ctx, ...)
+ *     {
+ *         if (co_await ctx.copy(hostIn, devIn) != CAL_RESULT_OK) co_return;
+ *         co_await ctx.run(grid);
+ *         co_await ctx.copy(devOut, hostOut);
+ *     }
+ *
+ * Coroutines resume on the poller thread and go on to call CAL from it,
+ * so the runtime must not run with CAL_CONFIG_THREAD_SAFE_OFF. A suspending
+ * await flushes the context.
+ */
+class AsyncContext
+{
+public:
+    /** Attach ctx, created on dev, to service. */
+    AsyncContext(CompletionService& service, CALcontext ctx, CALdevice dev)
+        : m_service(service), m_ctx(ctx)
+    {
+        m_attachResult = m_service.attach(ctx, dev);
+    }
+
+    /** Waits for outstanding awaits of the context, see CompletionService::detach. */
+    ~AsyncContext()
+    {
+        if (m_attachResult == CAL_RESULT_OK)
+        {
+            m_service.detach(m_ctx);
+        }
+    }
+
+    AsyncContext(const AsyncContext&) = delete;
+    AsyncContext& operator=(const AsyncContext&) = delete;
+
+    CALcontext context() const { return m_ctx; }
+    CompletionService& service() const { return m_service; }
+
+    /** CAL_RESULT_OK when the context could be attached to the service. */
+    CALresult attachResult() const { return m_attachResult; }
+
+    /** calCtxRunProgramGrid */
+    Event run(const CALprogramGrid& grid)
+    {
+        CALevent event = 0;
+        CALresult result = calCtxRunProgramGrid(&event, m_ctx, const_cast<CALprogramGrid*>(&grid));
+        return Event(*this, event, result);
+    }
+
+    /** calMemCopy */
+    Event copy(CALmem src, CALmem dst, CALuint flags = 0)
+    {
+        CALevent event = 0;
+        CALresult result = calMemCopy(&event, m_ctx, src, dst, flags);
+        return Event(*this, event, result);
+    }
+
+    /** Await an event obtained from another call on the context. */
+    Event wrap(CALevent event) { return Event(*this, event, CAL_RESULT_OK); }
+
+private:
+    CompletionService&  m_service;
+    CALcontext          m_ctx;
+    CALresult           m_attachResult;
+};
+
+inline bool
+Event::Awaiter::await_ready()
+{
+    if (m_result != CAL_RESULT_OK || !m_owner)
+    {
+        return true;
+    }
+    CALresult result = calCtxIsEventDone(m_owner->context(), m_event);
+    if (result == CAL_RESULT_PENDING)
+    {
+        return false;
+    }
+    m_result = result;
+    return true;
+}
+
+inline bool
+Event::Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    calCtxFlush(m_owner->context());
+
+    // The callback may resume the coroutine before notify returns; nothing
+    // of this awaiter is touched after a successful registration
+    CALresult* result = &m_result;
+    CALresult registered = m_owner->service().notify(m_owner->context(), m_event,
+        [result, handle](CALevent, CALresult done)
+        {
+            *result = done;
+            handle.resume();
+        });
+    if (registered != CAL_RESULT_OK)
+    {
+        m_result = registered;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Fire-and-forget coroutine type for CAL pipelines.
+ *
+ * Starts running when called and frees its frame when it finishes.
+ * Exceptions escaping the coroutine terminate the process.
+ */
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return Task(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+} // namespace cal
+
+#endif // __CAL_COROUTINE_H__
@@ -0,0 +1,181 @@
+/**
+ *  @file     cal_error.h
+ *  @brief    CAL utility per-thread error records
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_ERROR_H__
+#define __CAL_ERROR_H__
+
+#include "cal.h"
+#include "calcl.h"
+#include "cal_api_id.h"
+
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#define CALAPI
+#else
+#define CALAPI extern
+#endif
+
+#ifdef _WIN32
+#define CALAPIENTRY  __stdcall
+#else
+#define CALAPIENTRY
+#endif
+
+/*
+ * calGetErrorString and calclGetErrorString return one string for the whole
+ * process, so concurrent threads overwrite each other's diagnostics. Every
+ * thread additionally owns a CALerrorRecord describing the last error it
+ * raised. Records live in fixed size thread local storage: setting and
+ * reading them takes no lock and does not allocate.
+ *
+ * A thread may also keep a ring of its last CAL_ERROR_RING_SIZE records for
+ * post-mortem inspection. The ring is off by default; it is enabled per
+ * thread with calErrorEnableRing, or for every thread by setting the
+ * environment variable CAL_ERROR_RING=1. Enabling allocates the ring once.
+ */
+
+#define CAL_ERROR_MESSAGE_SIZE  256
+#define CAL_ERROR_RING_SIZE     16
+
+typedef struct CALerrorRecordRec {
+    CALresult result;                           /**< Error code, CAL_RESULT_OK if the thread raised none */
+    CALapiId  api;                              /**< Entry point that failed, CAL_API_NONE if unknown */
+    CALuint   handle;                           /**< Offending handle, 0 if none or unknown */
+    CALuint   thread;                           /**< OS thread id */
+    CALuint64 sequence;                         /**< Per thread count of errors raised, starting at 1 */
+    CALuint64 timeNs;                           /**< Steady clock when the error was raised */
+    CALchar   message[CAL_ERROR_MESSAGE_SIZE];  /**< NUL terminated, truncated to fit */
+} CALerrorRecord;
+
+/**
+ * @fn calErrorSet(CALresult result, CALapiId api, CALuint handle, const CALchar* fmt, ...)
+ *
+ * @brief Record an error for the calling thread.
+ *
+ * @param result (in) - error code.
+ * @param api (in) - failing entry point, CAL_API_NONE if not known yet.
+ * @param handle (in) - offending handle, 0 if none.
+ * @param fmt (in) - printf style message.
+ *
+ * @return Returns result, so error paths can return calErrorSet(...).
+ *
+ * @sa calErrorAnnotate calErrorGetLast
+ */
+CALAPI CALresult CALAPIENTRY calErrorSet(CALresult result, CALapiId api, CALuint handle, const CALchar* fmt, ...);
+
+/** va_list variant of calErrorSet */
+CALAPI CALresult CALAPIENTRY calErrorSetV(CALresult result, CALapiId api, CALuint handle, const CALchar* fmt, va_list args);
+
+/**
+ * @fn calErrorSequence(void)
+ *
+ * @brief Return the number of errors the calling thread raised so far.
+ *
+ * Taken before a call and passed to calErrorAnnotate afterwards, it tells
+ * which records the call itself produced.
+ */
+CALAPI CALuint64 CALAPIENTRY calErrorSequence(void);
+
+/**
+ * @fn calErrorAnnotate(CALuint64 since, CALresult result, CALapiId api, CALuint handle, const CALchar* message)
+ *
+ * @brief Attach the entry point and handle to the error an inner layer
+ * recorded during a call.
+ *
+ * The last record is amended when its sequence is above <i>since</i> and
+ * it carries result; fields that are already set are kept. Otherwise no
+ * inner layer reported the failure and a new record is created with
+ * message, which may be NULL.
+ *
+ * @param since (in) - calErrorSequence() taken before the call.
+ *
+ * @return Returns result.
+ */
+CALAPI CALresult CALAPIENTRY calErrorAnnotate(CALuint64 since, CALresult result, CALapiId api, CALuint handle, const CALchar* message);
+
+/**
+ * @fn calErrorGetLast(void)
+ *
+ * @brief Return the last error raised by the calling thread.
+ *
+ * The record stays valid until the thread exits and is only changed by the
+ * calling thread.
+ *
+ * @return Returns a record with result CAL_RESULT_OK if the thread raised no
+ * error since it started or last called calErrorClear.
+ */
+CALAPI const CALerrorRecord* CALAPIENTRY calErrorGetLast(void);
+
+/**
+ * @fn calErrorClear(void)
+ *
+ * @brief Reset the last error of the calling thread. The ring is kept.
+ */
+CALAPI void CALAPIENTRY calErrorClear(void);
+
+/**
+ * @fn calErrorEnableRing(CALboolean enable)
+ *
+ * @brief Start or stop keeping the error ring of the calling thread.
+ *
+ * @return Returns CAL_RESULT_OK, CAL_RESULT_ERROR if the ring could not be allocated.
+ */
+CALAPI CALresult CALAPIENTRY calErrorEnableRing(CALboolean enable);
+
+/**
+ * @fn calErrorGetRing(CALerrorRecord* records, CALuint count)
+ *
+ * @brief Copy the ring of the calling thread, newest record first.
+ *
+ * @return Returns the number of records copied.
+ */
+CALAPI CALuint CALAPIENTRY calErrorGetRing(CALerrorRecord* records, CALuint count);
+
+/**
+ * @fn calErrorDumpRings(CALLogFunction log)
+ *
+ * @brief Write the rings of every thread that has one, one line per record,
+ * oldest first.
+ *
+ * Meant for post-mortem use such as a crash or abort handler; records a
+ * thread writes while the dump runs may appear torn.
+ */
+CALAPI void CALAPIENTRY calErrorDumpRings(CALLogFunction log);
+
+#ifdef __cplusplus
+}      /* extern "C" { */
+#endif
+
+#endif // __CAL_ERROR_H__
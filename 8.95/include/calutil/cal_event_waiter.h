@@ -0,0 +1,158 @@
+/**
+ *  @file     cal_event_waiter.h
+ *  @brief    Adaptive spin-then-block waiting for CAL events
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_EVENT_WAITER_H__
+#define __CAL_EVENT_WAITER_H__
+
+#include "cal.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace cal {
+
+/**
+ * @brief Waits for events of one context by spinning for as long as the
+ * work is expected to take, then blocking.
+ *
+ * calCtxWaitForEvents offers a fixed choice: CAL_WAIT_POLLING burns a core
+ * for the whole wait and CAL_WAIT_LOW_CPU_UTILIZATION adds the wake-up
+ * latency of a blocked thread. The waiter keeps a running estimate of the
+ * completion time of every CALfunc, measured from submitted() to the event
+ * being seen done while spinning. A completion noticed by a late wait or
+ * after blocking is only known to come after the last poll that saw the
+ * event pending, so that poll is taken as the sample. A wait polls calCtxIsEventDone until the estimate (plus
+ * its deviation) has passed, and then blocks in
+ * calCtxWaitForEvents(CAL_WAIT_LOW_CPU_UTILIZATION). Work expected to run
+ * longer than the spin limit blocks right away. waitAny cannot block on
+ * one event without missing the others, so past its spin it polls all of
+ * them with growing sleeps.
+ *
+ * Like the context itself, a waiter must only be used from the thread that
+ * created the context. Blocking needs CAL_PRIVATE_EXT_SYNC_OBJECT resolved
+ * through calExtTableInit; without it the waiter polls with growing sleeps.
+ */
+class EventWaiter
+{
+public:
+    explicit EventWaiter(CALcontext ctx = 0);
+
+    void setContext(CALcontext ctx) { m_ctx = ctx; }
+    CALcontext context() const { return m_ctx; }
+
+    /**
+     * Longest expected wait that is spun rather than blocked; default 200 µs,
+     * 0 on single processor hosts where spinning starves the device thread.
+     */
+    void setSpinLimit(CALuint64 ns) { m_spinLimitNs = ns; }
+    CALuint64 spinLimit() const { return m_spinLimitNs; }
+
+    /**
+     * @brief Note that event was just returned for work running func.
+     *
+     * Untracked events are waited for with a short default spin.
+     * func may be 0 for copies; they share one estimate.
+     */
+    void submitted(CALevent event, CALfunc func);
+
+    /**
+     * @brief Wait until event is done.
+     *
+     * @return CAL_RESULT_OK, or the error calCtxIsEventDone or
+     *         calCtxWaitForEvents returned.
+     */
+    CALresult wait(CALevent event);
+
+    /** Wait until every event is done. */
+    CALresult waitAll(const CALevent* events, CALuint n);
+
+    /**
+     * @brief Wait until at least one event is done.
+     *
+     * @param index (out) - position in events of a completed event, the
+     *                      lowest one if several are done.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_INVALID_PARAMETER for an empty list,
+     *         or the first error returned while polling.
+     */
+    CALresult waitAny(const CALevent* events, CALuint n, CALuint* index);
+
+    /** Running completion time estimate of func in ns, 0 before the first sample. */
+    CALuint64 estimate(CALfunc func) const;
+
+    /** Waits that finished while spinning. */
+    CALuint64 spinHits() const { return m_spinHits; }
+
+    /** Waits that had to block. */
+    CALuint64 blocks() const { return m_blocks; }
+
+    /** Total time spent spinning, ns. */
+    CALuint64 spinTime() const { return m_spinNs; }
+
+private:
+    struct Estimate
+    {
+        CALuint64 meanNs;
+        CALuint64 devNs;        ///< mean absolute deviation
+        CALuint   samples;
+    };
+
+    struct Tracked
+    {
+        CALevent  event;
+        CALfunc   func;
+        CALuint64 submitNs;
+        CALuint64 pendingNs;    ///< last untimed poll that saw it pending, 0 if none
+    };
+
+    CALresult poll(CALevent event, bool timed);
+    CALuint64 deadline(CALevent event, CALuint64 now) const;
+    bool spinUntil(const CALevent* events, CALuint n, CALuint64 until, CALuint* index, CALresult* result);
+    CALresult block(CALevent event);
+    CALresult blockAny(const CALevent* events, CALuint n, CALuint* index);
+    void pending(CALevent event, CALuint64 now);
+    void retire(CALevent event, CALuint64 now, bool timed);
+
+    CALcontext                              m_ctx;
+    CALuint64                               m_spinLimitNs;
+    std::vector<Tracked>                    m_tracked;
+    std::unordered_map<CALfunc, Estimate>   m_estimates;
+
+    CALuint64                               m_spinHits;
+    CALuint64                               m_blocks;
+    CALuint64                               m_spinNs;
+};
+
+} // namespace cal
+
+#endif // __CAL_EVENT_WAITER_H__
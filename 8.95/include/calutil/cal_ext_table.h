@@ -0,0 +1,275 @@
+/**
+ *  @file     cal_ext_table.h
+ *  @brief    CAL pre-resolved extension dispatch table
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_EXT_TABLE_H__
+#define __CAL_EXT_TABLE_H__
+
+#include "cal.h"
+#include "cal_ext.h"
+#include "cal_ext_counter.h"
+#include "calcl_ext.h"
+#include "cal_private_ext.h"
+#include "calcl_private_ext.h"
+
+#ifdef __cplusplus
+extern "C" {
+#define CALAPI
+#else
+#define CALAPI extern
+#endif
+
+#ifdef _WIN32
+#define CALAPIENTRY  __stdcall
+#else
+#define CALAPIENTRY
+#endif
+
+/** Bit index of every extension the table resolves */
+typedef enum CALextCapEnum {
+    CAL_EXTCAP_COUNTERS = 0,                            /**< CAL_EXT_COUNTERS */
+    CAL_EXTCAP_DOMAIN_PARAMS,                           /**< CAL_EXT_DOMAIN_PARAMS */
+    CAL_EXTCAP_RES_CREATE,                              /**< CAL_EXT_RES_CREATE */
+    CAL_EXTCAP_COMPUTE_SHADER,                          /**< CAL_EXT_COMPUTE_SHADER */
+    CAL_EXTCAP_SAMPLER_PARAM,                           /**< CAL_EXT_SAMPLER_PARAM */
+    CAL_EXTCAP_PRIVATE_PM4CAP,                          /**< CAL_PRIVATE_EXT_PM4CAP */
+    CAL_EXTCAP_PRIVATE_SAMPLER_PARAM,                   /**< CAL_PRIVATE_EXT_SAMPLER_PARAM */
+    CAL_EXTCAP_PRIVATE_DOMAIN_PARAMS,                   /**< CAL_PRIVATE_EXT_DOMAIN_PARAMS */
+    CAL_EXTCAP_PRIVATE_INTERNAL_COUNTERS,               /**< CAL_PRIVATE_EXT_INTERNAL_COUNTERS */
+    CAL_EXTCAP_PRIVATE_RUNTIME_CONFIG,                  /**< CAL_PRIVATE_EXT_RUNTIME_CONFIG */
+    CAL_EXTCAP_PRIVATE_RESOURCES,                       /**< CAL_PRIVATE_EXT_RESOURCES */
+    CAL_EXTCAP_PRIVATE_SYNC_OBJECT,                     /**< CAL_PRIVATE_EXT_SYNC_OBJECT */
+    CAL_EXTCAP_PRIVATE_DEVICE_CLOCKUP,                  /**< CAL_PRIVATE_EXT_DEVICE_CLOCKUP */
+    CAL_EXTCAP_PRIVATE_MEMCOPY_RAW,                     /**< CAL_PRIVATE_EXT_MEMCOPY_RAW */
+    CAL_EXTCAP_PRIVATE_EXTENDED_RUNPROGRAMGRID,         /**< CAL_PRIVATE_EXT_EXTENDED_RUNPROGRAMGRID */
+    CAL_EXTCAP_PRIVATE_OPENGL,                          /**< CAL_PRIVATE_EXT_OPENGL */
+    CAL_EXTCAP_PRIVATE_RES_ALLOC,                       /**< CAL_PRIVATE_EXT_RES_ALLOC */
+    CAL_EXTCAP_PRIVATE_RES_ALLOC_SLICE_VIEW,            /**< CAL_PRIVATE_EXT_RES_ALLOC_SLICE_VIEW */
+    CAL_EXTCAP_PRIVATE_HEAP,                            /**< CAL_PRIVATE_EXT_HEAP */
+    CAL_EXTCAP_PRIVATE_ATOMIC_COUNTER,                  /**< CAL_PRIVATE_EXT_ATOMIC_COUNTER */
+    CAL_EXTCAP_PRIVATE_VIDEO,                           /**< CAL_PRIVATE_EXT_VIDEO */
+    CAL_EXTCAP_PRIVATE_COMPILER,                        /**< CAL_PRIVATE_EXT_COMPILER */
+    CAL_EXTCAP_PRIVATE_EXTENDED_RUNPROGRAMGRID_CB_OFFSET,/**< CAL_PRIVATE_EXT_EXTENDED_RUNPROGRAMGRID_CB_OFFSET */
+    CAL_EXTCAP_PRIVATE_EXTENDED_DEVICEATTRIBS,          /**< CAL_PRIVATE_EXT_EXTENDED_DEVICEATTRIBS */
+    CAL_EXTCAP_PRIVATE_FLUSH_CACHE,                     /**< CAL_PRIVATE_EXT_FLUSH_CACHE */
+    CAL_EXTCAP_PRIVATE_MEMCOPY_PARTIAL,                 /**< CAL_PRIVATE_EXT_MEMCOPY_PARTIAL */
+    CAL_EXTCAP_CL_COMPILER_CONFIG,                      /**< CALCL_PRIVATE_EXT_COMPILER_CONFIG */
+    CAL_EXTCAP_CL_ISA_FUNCTIONS,                        /**< CALCL_PRIVATE_EXT_ISA_FUNCTIONS */
+    CAL_EXTCAP_COUNT
+} CALextCap;
+
+/** Version reported by calExtGetVersion, zero when the extension is absent */
+typedef struct CALextVersionRec {
+    CALuint major;
+    CALuint minor;
+} CALextVersion;
+
+/**
+ * Typed entry points of every extension proc. A pointer is NULL when the
+ * driver does not export it, so test the capability bit or the pointer
+ * before calling.
+ */
+typedef struct CALextTableRec {
+    CALuint64                               caps;                           /**< Bit (1 << CALextCap) set per supported extension */
+    CALextVersion                           version[CAL_EXTCAP_COUNT];      /**< Version per extension */
+
+    /* CAL_EXT_COUNTERS */
+    PFNCALCTXCREATECOUNTER                  ctxCreateCounter;
+    PFNCALCTXDESTROYCOUNTER                 ctxDestroyCounter;
+    PFNCALCTXBEGINCOUNTER                   ctxBeginCounter;
+    PFNCALCTXENDCOUNTER                     ctxEndCounter;
+    PFNCALCTXGETCOUNTER                     ctxGetCounter;
+
+    /* CAL_EXT_DOMAIN_PARAMS */
+    PFNCALCTXRUNPROGRAMPARAMS               ctxRunProgramParams;
+
+    /* CAL_EXT_RES_CREATE */
+    PFNCALRESCREATE2D                       resCreate2D;
+    PFNCALRESCREATE1D                       resCreate1D;
+
+    /* CAL_EXT_COMPUTE_SHADER */
+    PFNCALCTXRUNPROGRAMGRID                 ctxRunProgramGrid;
+    PFNCALMODULEGETFUNCINFO                 moduleGetFuncInfo;
+    PFNCALCTXRUNPROGRAMGRIDARRAY            ctxRunProgramGridArray;
+
+    /* CAL_EXT_SAMPLER_PARAM */
+    PFNCALSETSAMPLERPARAMS                  ctxSetSamplerParams;
+    PFNCALGETSAMPLERPARAMS                  ctxGetSamplerParams;
+
+    /* CAL_PRIVATE_EXT_PM4CAP */
+    PFNCALENABLELOGGINGPROC                 enableLogging;
+    PFNCALLOGGINGCAPTUREMEMPROC             loggingCaptureMem;
+
+    /* CAL_PRIVATE_EXT_SAMPLER_PARAM (deprecated) */
+    PFNCALSETSAMPLERPARAMETER               ctxSetSamplerParameter;
+
+    /* CAL_PRIVATE_EXT_INTERNAL_COUNTERS */
+    PFNCALCTXCREATEPRIVATECOUNTER           ctxCreatePrivateCounter;
+    PFNCALCTXCONFIGPRIVATECOUNTER           ctxConfigPrivateCounter;
+    PFNCALCTXGETPRIVATECOUNTER              ctxGetPrivateCounter;
+
+    /* CAL_PRIVATE_EXT_RUNTIME_CONFIG */
+    PFNCALCONFIG                            config;
+    PFNCALCLEARCONFIG                       clearConfig;
+
+    /* CAL_PRIVATE_EXT_RESOURCES */
+    PFNCALRESALLOCVIEW                      resAllocView;
+    PFNCALRESQUERYINFO                      resQueryInfo;
+    PFNCALRESMEMCOPY                        resMemCopy;
+
+    /* CAL_PRIVATE_EXT_SYNC_OBJECT */
+    PFNCALCTXWAITFOREVENTS                  ctxWaitForEvents;
+
+    /* CAL_PRIVATE_EXT_DEVICE_CLOCKUP */
+    PFNCALDEVICECLOCKUP                     deviceClockUp;
+
+    /* CAL_PRIVATE_EXT_MEMCOPY_RAW */
+    PFNCALMEMCOPYRAW                        memCopyRaw;
+
+    /* CAL_PRIVATE_EXT_RES_ALLOC */
+    PFNCALRESALLOC                          resAlloc;
+
+    /* CAL_PRIVATE_EXT_RES_ALLOC_SLICE_VIEW */
+    PFNCALRESALLOCSLICEVIEW                 resAllocSliceView;
+
+    /* CAL_PRIVATE_EXT_HEAP */
+    PFNCALRESGETHEAP                        resGetHeap;
+
+    /* CAL_PRIVATE_EXT_ATOMIC_COUNTER */
+    PFNCALREADATOMICCOUNTER                 readAtomicCounter;
+    PFNCALWRITEATOMICCOUNTER                writeAtomicCounter;
+    PFNCALBINDATOMICCOUNTER                 bindAtomicCounter;
+    PFNCALSYNCATOMICCOUNTER                 syncAtomicCounter;
+
+    /* CAL_PRIVATE_EXT_VIDEO */
+    PFNCALCTXPROPERTIESCREATE               ctxCreateProperties;
+    PFNCALCTXRUNPROGRAMVIDEO                ctxRunProgramVideo;
+    PFNCALDEVICEGETVIDEOATTRIBS             deviceGetVideoAttribs;
+    PFNCALDEVICEGETCTXPROPERTIES            deviceGetCtxProperties;
+    PFNCALGETCTXPROPERTIES                  getCtxProperties;
+    PFNCALENCODECREATEVCE                   encodeCreateVCE;
+    PFNCALENCODEDESTROYVCE                  encodeDestroyVCE;
+    PFNCALENCODEGETDEVICEINFO               encodeGetDeviceInfo;
+    PFNCALENCODEGETNUMBEROFMODES            encodeGetNumberOfModes;
+    PFNCALENCODEGETMODES                    encodeGetModes;
+    PFNCALENCODEGETDEVICECAP                encodeGetDeviceCAP;
+    PFNCALENCODECREATESESSION               encodeCreateSession;
+    PFNCALENCODECLOSESESSION                encodeCloseSession;
+    PFNCALENCODESETSTATE                    encodeSetState;
+    PFNCALENCODEGETPICTURECONTROLCONFIG     encodeGetPictureControlConfig;
+    PFNCALENCODEGETRATECONTROLCONFIG        encodeGetRateControlConfig;
+    PFNCALENCODEGETMOTIONESTIMATIONCONFIG   encodeGetMotionEstimationConfig;
+    PFNCALENCODEGETRDOCONTROLCONFIG         encodeGetRDOControlConfig;
+    PFNCALENCODESENDCONFIG                  encodeSendConfig;
+    PFNCALENCODEPICTURE                     encodePicture;
+    PFNCALENCODEQUERYTASKDESCRIPTION        encodeQueryTaskDescription;
+    PFNCALENCODERELEASEOUTPUTRESOURCE       encodeReleaseOutputResource;
+
+    /* CAL_PRIVATE_EXT_COMPILER */
+    PFNGETFUNCINFOFROMIMAGE                 getFuncInfoFromImage;
+    PFNCALCONVERTTEXTTOBINARY               convertTextToBinary;
+    PFNCONVERTBINARYTOTEXT                  convertBinaryToText;
+    PFNCALFREETEXTBINARY                    freeTextBinary;
+
+    /* CAL_PRIVATE_EXT_EXTENDED_DEVICEATTRIBS */
+    PFNCALDEVICEGETATTRIBSEXT               deviceGetAttribsExt;
+
+    /* CAL_PRIVATE_EXT_FLUSH_CACHE */
+    PFNCALCTXFLUSHCACHE                     ctxFlushCache;
+
+    /* CAL_PRIVATE_EXT_MEMCOPY_PARTIAL */
+    PFNCALMEMCOPYPARTIAL                    memCopyPartial;
+
+    /* CALCL_PRIVATE_EXT_COMPILER_CONFIG, resolved through calclExtGetProc */
+    PFNCALCLCONFIG                          clConfig;
+    PFNCALCLCLEARCONFIG                     clClearConfig;
+
+    /* CALCL_PRIVATE_EXT_ISA_FUNCTIONS, resolved through calclExtGetProc */
+    PFNCALCLASSEMBLE                        clAssemble;
+    PFNCALCLDISASSEMBLE                     clDisassemble;
+} CALextTable;
+
+/** Test a capability bit of a populated table */
+#define CAL_EXT_TABLE_HAS(table, cap) ((((table)->caps) >> (cap)) & 1)
+
+/**
+ * @fn calExtTableInit(void)
+ *
+ * @brief Initialize CAL and resolve the shared extension table.
+ *
+ * Calls calInit and, when it succeeds or CAL was already initialized,
+ * queries calExtSupported, calExtGetVersion and calExtGetProc (or their
+ * calcl equivalents) once for every extension and proc. Use it in place of
+ * calInit. Every call publishes a newly resolved table to calExtTableGet;
+ * tables returned earlier are never modified or freed, so threads reading
+ * them race with nothing.
+ *
+ * @return Returns the result of calInit, CAL_RESULT_OK when CAL was already initialized.
+ *
+ * @sa calExtTableGet calExtTableLoad
+ */
+CALAPI CALresult CALAPIENTRY calExtTableInit(void);
+
+/**
+ * @fn calExtTableGet(void)
+ *
+ * @brief Return the shared table resolved by calExtTableInit.
+ *
+ * Before calExtTableInit every pointer is NULL and caps is zero. The
+ * table is immutable; call again after calExtTableInit for the new one.
+ *
+ * @return Returns a pointer to the shared table.
+ *
+ * @sa calExtTableInit
+ */
+CALAPI const CALextTable* CALAPIENTRY calExtTableGet(void);
+
+/**
+ * @fn calExtTableLoad(CALextTable* table)
+ *
+ * @brief Resolve every extension into a caller owned table.
+ *
+ * CAL must already be initialized.
+ *
+ * @param table (out) - table to fill, cleared first.
+ *
+ * @return Returns CAL_RESULT_OK on success, CAL_RESULT_INVALID_PARAMETER if table is NULL.
+ *
+ * @sa calExtTableInit
+ */
+CALAPI CALresult CALAPIENTRY calExtTableLoad(CALextTable* table);
+
+#ifdef __cplusplus
+}      /* extern "C" { */
+#endif
+
+#endif // __CAL_EXT_TABLE_H__
@@ -0,0 +1,170 @@
+/**
+ *  @file     cal_flush_policy.h
+ *  @brief    Per-context calCtxFlush coalescing policy
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_FLUSH_POLICY_H__
+#define __CAL_FLUSH_POLICY_H__
+
+#include "cal.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cal {
+
+/** Why a FlushPolicy flushed. */
+enum FlushReason
+{
+    FlushCommands = 0,      ///< maxCommands commands were queued
+    FlushDelay,             ///< the oldest queued command waited maxDelayUs
+    FlushIdle,              ///< nothing was submitted for idleUs
+    FlushWait,              ///< a caller started waiting on a queued event
+    FlushExplicit,          ///< flush() was called
+    FlushReasonCount
+};
+
+/** Tunables of a FlushPolicy; 0 disables a trigger. */
+struct FlushPolicyParams
+{
+    CALuint maxCommands;    ///< flush once this many commands are queued
+    CALuint maxDelayUs;     ///< flush once the oldest queued command is this old
+    CALuint idleUs;         ///< flush once no command was submitted for this long
+    bool    flushOnWait;    ///< flush when waiting on an event that is still queued
+
+    FlushPolicyParams() : maxCommands(32), maxDelayUs(500), idleUs(50), flushOnWait(true) {}
+};
+
+/** Counters since the policy was created or resetStats() was called. */
+struct FlushStats
+{
+    CALuint64   flushes;
+    CALuint64   commands;                       ///< commands submitted
+    CALuint64   byReason[FlushReasonCount];     ///< flushes per FlushReason
+    double      seconds;                        ///< covered by the counters
+    double      flushesPerSecond;
+    double      commandsPerFlush;
+};
+
+/**
+ * @brief Decides when to call calCtxFlush for one context.
+ *
+ * Commands only reach the device when the context is flushed. Flushing
+ * after every command pays the submission overhead each time, while
+ * flushing too late adds latency. Report every command with submitted()
+ * and route event polls through isEventDone() (or call aboutToWait()
+ * before waiting); the policy flushes when maxCommands are queued, when
+ * the oldest queued command is maxDelayUs old, when the queue has been
+ * idle for idleUs, or when a caller waits on a queued event.
+ *
+ * The time based triggers fire on the next call into the policy, or from a
+ * background thread started with startTimer(). The timer calls calCtxFlush
+ * from its own thread, so it needs a runtime that does not run with
+ * CAL_CONFIG_THREAD_SAFE_OFF. All methods may be called from any thread;
+ * parameters can be changed at any time.
+ */
+class FlushPolicy
+{
+public:
+    explicit FlushPolicy(CALcontext ctx = 0, const FlushPolicyParams& params = FlushPolicyParams());
+
+    /** Stops the timer; queued commands are not flushed. */
+    ~FlushPolicy();
+
+    FlushPolicy(const FlushPolicy&) = delete;
+    FlushPolicy& operator=(const FlushPolicy&) = delete;
+
+    void setContext(CALcontext ctx);
+    CALcontext context() const;
+
+    void setParams(const FlushPolicyParams& params);
+    FlushPolicyParams params() const;
+
+    /**
+     * @brief Count a command that was just queued and produced event.
+     *
+     * @return the calCtxFlush result if this flushed, else CAL_RESULT_OK.
+     */
+    CALresult submitted(CALevent event);
+
+    /** Flush if flushOnWait is set and event is still queued. */
+    CALresult aboutToWait(CALevent event);
+
+    /** aboutToWait(event) followed by calCtxIsEventDone. */
+    CALresult isEventDone(CALevent event);
+
+    /** Flush now if anything is queued. */
+    CALresult flush();
+
+    /** Apply the time based triggers. */
+    CALresult poll();
+
+    /** Start a thread that applies the time based triggers on time. */
+    void startTimer();
+    void stopTimer();
+
+    FlushStats stats() const;
+    void resetStats();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    CALresult aboutToWait(CALevent event, CALcontext& ctx);
+    CALcontext takeLocked(FlushReason reason);
+    CALcontext dueLocked(Clock::time_point now);
+    static CALresult flushContext(CALcontext ctx);
+    Clock::time_point deadlineLocked() const;
+    void timerMain();
+
+    mutable std::mutex          m_lock;
+    std::condition_variable     m_wake;         // timer: new queue or stop
+    CALcontext                  m_ctx;
+    FlushPolicyParams           m_params;
+
+    std::vector<CALevent>       m_queued;       // submitted since the last flush
+    Clock::time_point           m_firstQueued;
+    Clock::time_point           m_lastQueued;
+
+    std::thread                 m_timer;
+    bool                        m_stop;
+
+    Clock::time_point           m_statsStart;
+    CALuint64                   m_flushes;
+    CALuint64                   m_commands;
+    CALuint64                   m_byReason[FlushReasonCount];
+};
+
+} // namespace cal
+
+#endif // __CAL_FLUSH_POLICY_H__
@@ -0,0 +1,292 @@
+/**
+ *  @file     cal_format.h
+ *  @brief    CAL utility format helpers
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_FORMAT_H__
+#define __CAL_FORMAT_H__
+
+#include "cal.h"
+
+#include <type_traits>
+
+namespace cal {
+
+/** How the components of a format are encoded. */
+enum FormatClass
+{
+    FormatInvalid = 0,      ///< not a CALformat
+    FormatUnorm,            ///< unsigned integers read as [0, 1]
+    FormatSnorm,            ///< signed integers read as [-1, 1]
+    FormatUnsigned,
+    FormatSigned,
+    FormatFloat,
+    FormatPacked            ///< unsigned normalized fields packed into one 16 or 32 bit word
+};
+
+/** Layout of a CALformat. */
+struct FormatTraits
+{
+    CALformat   format;
+    FormatClass type;
+    CALuint     components;     ///< the fields of the packed formats count as components
+    CALuint     componentBits;  ///< 0 for the packed formats
+    CALuint     elementSize;    ///< bytes per element
+};
+
+/**
+ * Traits of every CALformat, indexed by its value; the deprecated aliases
+ * such as CAL_FORMAT_FLOAT_4 share the entry of the value they stand for.
+ */
+inline constexpr FormatTraits FormatTable[] =
+{
+    { CAL_FORMAT_UNORM_INT8_1,      FormatUnorm,    1,  8,  1 },
+    { CAL_FORMAT_UNORM_INT8_2,      FormatUnorm,    2,  8,  2 },
+    { CAL_FORMAT_UNORM_INT8_4,      FormatUnorm,    4,  8,  4 },
+    { CAL_FORMAT_UNORM_INT16_1,     FormatUnorm,    1, 16,  2 },
+    { CAL_FORMAT_UNORM_INT16_2,     FormatUnorm,    2, 16,  4 },
+    { CAL_FORMAT_UNORM_INT16_4,     FormatUnorm,    4, 16,  8 },
+    { CAL_FORMAT_UNORM_INT32_4,     FormatUnorm,    4, 32, 16 },
+    { CAL_FORMAT_SNORM_INT8_4,      FormatSnorm,    4,  8,  4 },
+    { CAL_FORMAT_SNORM_INT16_1,     FormatSnorm,    1, 16,  2 },
+    { CAL_FORMAT_SNORM_INT16_2,     FormatSnorm,    2, 16,  4 },
+    { CAL_FORMAT_SNORM_INT16_4,     FormatSnorm,    4, 16,  8 },
+    { CAL_FORMAT_FLOAT32_1,         FormatFloat,    1, 32,  4 },
+    { CAL_FORMAT_FLOAT32_2,         FormatFloat,    2, 32,  8 },
+    { CAL_FORMAT_FLOAT32_4,         FormatFloat,    4, 32, 16 },
+    { CAL_FORMAT_FLOAT64_1,         FormatFloat,    1, 64,  8 },
+    { CAL_FORMAT_FLOAT64_2,         FormatFloat,    2, 64, 16 },
+    { CAL_FORMAT_UNORM_INT32_1,     FormatUnorm,    1, 32,  4 },
+    { CAL_FORMAT_UNORM_INT32_2,     FormatUnorm,    2, 32,  8 },
+    { CAL_FORMAT_SNORM_INT8_1,      FormatSnorm,    1,  8,  1 },
+    { CAL_FORMAT_SNORM_INT8_2,      FormatSnorm,    2,  8,  2 },
+    { CAL_FORMAT_SNORM_INT32_1,     FormatSnorm,    1, 32,  4 },
+    { CAL_FORMAT_SNORM_INT32_2,     FormatSnorm,    2, 32,  8 },
+    { CAL_FORMAT_SNORM_INT32_4,     FormatSnorm,    4, 32, 16 },
+    { CAL_FORMAT_UNSIGNED_INT8_1,   FormatUnsigned, 1,  8,  1 },
+    { CAL_FORMAT_UNSIGNED_INT8_2,   FormatUnsigned, 2,  8,  2 },
+    { CAL_FORMAT_UNSIGNED_INT8_4,   FormatUnsigned, 4,  8,  4 },
+    { CAL_FORMAT_SIGNED_INT8_1,     FormatSigned,   1,  8,  1 },
+    { CAL_FORMAT_SIGNED_INT8_2,     FormatSigned,   2,  8,  2 },
+    { CAL_FORMAT_SIGNED_INT8_4,     FormatSigned,   4,  8,  4 },
+    { CAL_FORMAT_UNSIGNED_INT16_1,  FormatUnsigned, 1, 16,  2 },
+    { CAL_FORMAT_UNSIGNED_INT16_2,  FormatUnsigned, 2, 16,  4 },
+    { CAL_FORMAT_UNSIGNED_INT16_4,  FormatUnsigned, 4, 16,  8 },
+    { CAL_FORMAT_SIGNED_INT16_1,    FormatSigned,   1, 16,  2 },
+    { CAL_FORMAT_SIGNED_INT16_2,    FormatSigned,   2, 16,  4 },
+    { CAL_FORMAT_SIGNED_INT16_4,    FormatSigned,   4, 16,  8 },
+    { CAL_FORMAT_UNSIGNED_INT32_1,  FormatUnsigned, 1, 32,  4 },
+    { CAL_FORMAT_UNSIGNED_INT32_2,  FormatUnsigned, 2, 32,  8 },
+    { CAL_FORMAT_UNSIGNED_INT32_4,  FormatUnsigned, 4, 32, 16 },
+    { CAL_FORMAT_SIGNED_INT32_1,    FormatSigned,   1, 32,  4 },
+    { CAL_FORMAT_SIGNED_INT32_2,    FormatSigned,   2, 32,  8 },
+    { CAL_FORMAT_SIGNED_INT32_4,    FormatSigned,   4, 32, 16 },
+    { CAL_FORMAT_UNORM_SHORT_565,   FormatPacked,   3,  0,  2 },
+    { CAL_FORMAT_UNORM_SHORT_555,   FormatPacked,   4,  0,  2 },
+    { CAL_FORMAT_UNORM_INT10_3,     FormatPacked,   4,  0,  4 },
+    { CAL_FORMAT_FLOAT16_1,         FormatFloat,    1, 16,  2 },
+    { CAL_FORMAT_FLOAT16_2,         FormatFloat,    2, 16,  4 },
+    { CAL_FORMAT_FLOAT16_4,         FormatFloat,    4, 16,  8 }
+};
+
+inline constexpr CALuint FormatCount = sizeof(FormatTable) / sizeof(FormatTable[0]);
+
+inline constexpr FormatTraits InvalidFormatTraits = { CAL_FORMAT_UNORM_INT8_1, FormatInvalid, 0, 0, 0 };
+
+/** Traits of format; type is FormatInvalid and every size 0 for values that are not formats. */
+constexpr const FormatTraits&
+formatTraits(CALformat format)
+{
+    return (static_cast<CALuint>(format) < FormatCount) ? FormatTable[format] : InvalidFormatTraits;
+}
+
+/** Bytes per element of format; 4 for values that are not formats. */
+constexpr CALuint
+formatElementSize(CALformat format)
+{
+    return formatTraits(format).type != FormatInvalid ? formatTraits(format).elementSize : 4;
+}
+
+/** Components per element of format; the fields of the packed formats count as components. */
+constexpr CALuint
+formatComponents(CALformat format)
+{
+    return formatTraits(format).type != FormatInvalid ? formatTraits(format).components : 1;
+}
+
+/** Whether format holds negative values. */
+constexpr bool
+formatSigned(CALformat format)
+{
+    return formatTraits(format).type == FormatSnorm || formatTraits(format).type == FormatSigned ||
+           formatTraits(format).type == FormatFloat;
+}
+
+/** Whether format reads as [0, 1] or [-1, 1] in a kernel. */
+constexpr bool
+formatNormalized(CALformat format)
+{
+    return formatTraits(format).type == FormatUnorm || formatTraits(format).type == FormatSnorm ||
+           formatTraits(format).type == FormatPacked;
+}
+
+/**
+ * Index of the first format of type with components of bits each,
+ * FormatCount when there is none.
+ */
+constexpr CALuint
+formatIndexOf(FormatClass type, CALuint bits, CALuint components)
+{
+    for (CALuint i = 0; i < FormatCount; ++i)
+    {
+        if (FormatTable[i].type == type && FormatTable[i].componentBits == bits &&
+            FormatTable[i].components == components)
+        {
+            return i;
+        }
+    }
+    return FormatCount;
+}
+
+constexpr bool
+formatTableInOrder()
+{
+    for (CALuint i = 0; i < FormatCount; ++i)
+    {
+        if (static_cast<CALuint>(FormatTable[i].format) != i)
+        {
+            return false;
+        }
+    }
+    return FormatCount == static_cast<CALuint>(CAL_FORMAT_LAST) + 1;
+}
+
+static_assert(formatTableInOrder(), "FormatTable must list every CALformat in enum order");
+static_assert(formatElementSize(CAL_FORMAT_FLOAT_4) == 16 && formatComponents(CAL_FORMAT_UINT_2) == 2,
+              "aliases share the traits of their format");
+
+/*---- Host types ----*/
+
+/** A FLOAT16 component, kept as its bits. */
+struct Half
+{
+    CALushort bits;
+};
+
+/** N packed components of T, the host layout of a multi component format. */
+template <typename T, CALuint N>
+struct Vector
+{
+    T v[N];
+
+    T& operator[](CALuint i) { return v[i]; }
+    const T& operator[](CALuint i) const { return v[i]; }
+};
+
+/**
+ * @brief The CALformat of host type T, in value.
+ *
+ * Defined for the component types, CALubyte, signed char, CALushort,
+ * CALshort, CALuint, CALint, Half, float and double, and for Vector of 2
+ * or 4 of them, mapping to the unnormalized integer and the float formats.
+ * Types without a format do not compile.
+ */
+template <typename T>
+struct FormatOf;
+
+template <CALformat F>
+struct FormatConstant
+{
+    static constexpr CALformat value = F;
+};
+
+template <> struct FormatOf<CALubyte>       : FormatConstant<CAL_FORMAT_UNSIGNED_INT8_1> {};
+template <> struct FormatOf<signed char>    : FormatConstant<CAL_FORMAT_SIGNED_INT8_1> {};
+template <> struct FormatOf<CALushort>      : FormatConstant<CAL_FORMAT_UNSIGNED_INT16_1> {};
+template <> struct FormatOf<CALshort>       : FormatConstant<CAL_FORMAT_SIGNED_INT16_1> {};
+template <> struct FormatOf<CALuint>        : FormatConstant<CAL_FORMAT_UNSIGNED_INT32_1> {};
+template <> struct FormatOf<CALint>         : FormatConstant<CAL_FORMAT_SIGNED_INT32_1> {};
+template <> struct FormatOf<Half>           : FormatConstant<CAL_FORMAT_FLOAT16_1> {};
+template <> struct FormatOf<float>          : FormatConstant<CAL_FORMAT_FLOAT32_1> {};
+template <> struct FormatOf<double>         : FormatConstant<CAL_FORMAT_FLOAT64_1> {};
+
+template <typename T, CALuint N>
+struct FormatOf<Vector<T, N> >
+{
+    static constexpr CALuint index = formatIndexOf(formatTraits(FormatOf<T>::value).type,
+                                                   formatTraits(FormatOf<T>::value).componentBits, N);
+    static_assert(index < FormatCount, "no CALformat has this many components of T");
+    static constexpr CALformat value = static_cast<CALformat>(index);
+};
+
+/** Storage type of one component of type and bits; packed formats by their word size. */
+template <FormatClass Type, CALuint Bits>
+struct ComponentType;
+
+template <> struct ComponentType<FormatUnorm, 8>        { typedef CALubyte type; };
+template <> struct ComponentType<FormatUnorm, 16>       { typedef CALushort type; };
+template <> struct ComponentType<FormatUnorm, 32>       { typedef CALuint type; };
+template <> struct ComponentType<FormatSnorm, 8>        { typedef signed char type; };
+template <> struct ComponentType<FormatSnorm, 16>       { typedef CALshort type; };
+template <> struct ComponentType<FormatSnorm, 32>       { typedef CALint type; };
+template <> struct ComponentType<FormatUnsigned, 8>     { typedef CALubyte type; };
+template <> struct ComponentType<FormatUnsigned, 16>    { typedef CALushort type; };
+template <> struct ComponentType<FormatUnsigned, 32>    { typedef CALuint type; };
+template <> struct ComponentType<FormatSigned, 8>       { typedef signed char type; };
+template <> struct ComponentType<FormatSigned, 16>      { typedef CALshort type; };
+template <> struct ComponentType<FormatSigned, 32>      { typedef CALint type; };
+template <> struct ComponentType<FormatFloat, 16>       { typedef Half type; };
+template <> struct ComponentType<FormatFloat, 32>       { typedef float type; };
+template <> struct ComponentType<FormatFloat, 64>       { typedef double type; };
+template <> struct ComponentType<FormatPacked, 16>      { typedef CALushort type; };
+template <> struct ComponentType<FormatPacked, 32>      { typedef CALuint type; };
+
+/**
+ * @brief Host type of one element of format F, in type: the component
+ * type, or a Vector of them. Normalized formats use their integer storage
+ * and the packed formats a single 16 or 32 bit word.
+ */
+template <CALformat F>
+struct FormatType
+{
+    static constexpr FormatTraits traits = formatTraits(F);
+    static constexpr bool packed = traits.type == FormatPacked;
+
+    typedef typename ComponentType<traits.type, packed ? traits.elementSize * 8 : traits.componentBits>::type Component;
+    typedef typename std::conditional<packed || traits.components == 1, Component,
+                                      Vector<Component, traits.components> >::type type;
+
+    static_assert(sizeof(type) == traits.elementSize, "host type must match the element size");
+};
+
+} // namespace cal
+
+#endif // __CAL_FORMAT_H__
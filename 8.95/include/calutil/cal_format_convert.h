@@ -0,0 +1,89 @@
+/**
+ *  @file     cal_format_convert.h
+ *  @brief    CAL utility float32 to CALformat conversions fused with pitched copies
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_FORMAT_CONVERT_H__
+#define __CAL_FORMAT_CONVERT_H__
+
+#include "cal.h"
+#include "cal_copy.h"
+#include "cal_format.h"
+
+#include <cstddef>
+
+namespace cal {
+
+/**
+ * @brief Convert count host floats to count components of format.
+ *
+ * Normalized formats clamp to [0, 1] or [-1, 1] and round to nearest;
+ * integer formats round to nearest and saturate; FLOAT16 rounds to nearest
+ * even. Packed formats take their components in order, most significant
+ * field first after the unused bits:
+ *
+ *     CAL_FORMAT_UNORM_SHORT_565   r, g, b      as r:5 g:6 b:5
+ *     CAL_FORMAT_UNORM_SHORT_555   x, r, g, b   as x:1 r:5 g:5 b:5
+ *     CAL_FORMAT_UNORM_INT10_3     x, r, g, b   as x:2 r:10 g:10 b:10
+ *
+ * so count must be a multiple of 3 or 4 for them.
+ *
+ * The kernels use AVX-512, AVX2 with F16C, or scalar code, up to copyIsa().
+ */
+void convertFromFloat(CALvoid* dst, const float* src, size_t count, CALformat format);
+
+/** The reverse of convertFromFloat. */
+void convertToFloat(float* dst, const CALvoid* src, size_t count, CALformat format);
+
+/**
+ * @brief Convert a packed host array of width x height elements of
+ * floats (formatComponents() floats each) straight into a surface of format
+ * mapped with calResMap, one row at a time.
+ *
+ * Every byte is read and written once; there is no intermediate packed
+ * copy of the converted data. CopyParallel splits the rows like
+ * copyPitched; CopyStreaming is ignored.
+ *
+ * @param pitch (in) - surface pitch in elements, as returned by calResMap.
+ *
+ * @return CAL_RESULT_OK, or CAL_RESULT_INVALID_PARAMETER for a NULL pointer
+ *         or a pitch below width. A height of 0 converts one row.
+ */
+CALresult convertToSurface(CALvoid* surface, CALuint pitch, const float* host, CALuint width, CALuint height,
+                           CALformat format, CALuint flags = CopyDefault);
+
+/** Read a mapped surface of format back into packed host floats. */
+CALresult convertFromSurface(float* host, const CALvoid* surface, CALuint pitch, CALuint width, CALuint height,
+                             CALformat format, CALuint flags = CopyDefault);
+
+} // namespace cal
+
+#endif // __CAL_FORMAT_CONVERT_H__
@@ -0,0 +1,220 @@
+/**
+ *  @file     cal_graph.h
+ *  @brief    Dependency graph executor for CAL kernels, copies and maps
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_GRAPH_H__
+#define __CAL_GRAPH_H__
+
+#include "cal.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cal {
+
+/**
+ * @brief How a graph node uses a resource.
+ */
+enum GraphAccess
+{
+    GraphRead       = 1,
+    GraphWrite      = 2,
+    GraphReadWrite  = GraphRead | GraphWrite
+};
+
+/** Module variable bound to a resource for one kernel node. */
+struct GraphBinding
+{
+    std::string     name;       ///< "i0", "o0", "cb0", "uav0", "g[]", ...
+    CALresource     res;
+    GraphAccess     access;
+};
+
+/**
+ * @brief One frame of work: kernels, copies and host maps with their
+ * resource dependencies.
+ *
+ * Nodes name resources rather than CALmem, CALfunc or CALname handles,
+ * which belong to one context; the executor resolves them per context.
+ * Dependencies follow from the resources each node reads and writes, in
+ * the order the nodes were added (read after write, write after read,
+ * write after write); depend() adds explicit edges on top.
+ */
+class Graph
+{
+public:
+    typedef CALuint NodeId;
+
+    /** calCtxRunProgramGrid of entry in image, after binding every resource. */
+    NodeId kernel(CALimage image, const std::string& entry, const CALdomain3D& gridBlock, const CALdomain3D& gridSize,
+                  const std::vector<GraphBinding>& bindings, CALuint flags = 0);
+
+    /** calMemCopy */
+    NodeId copy(CALresource src, CALresource dst, CALuint flags = 0);
+
+    /** calMemCopyRaw; needs CAL_PRIVATE_EXT_MEMCOPY_RAW resolved by calExtTableInit. */
+    NodeId copyRaw(CALresource src, CALuint srcOffset, CALresource dst, CALuint dstOffset, CALuint size, CALuint flags = 0);
+
+    /**
+     * calResMap, fn(ptr, pitch) on the host and calResUnmap, once every node
+     * the map depends on has completed. access says what fn does to res.
+     */
+    NodeId map(CALresource res, GraphAccess access, const std::function<void(CALvoid* ptr, CALuint pitch)>& fn);
+
+    /** Run node after before, which must have been added earlier; other edges are ignored. */
+    void depend(NodeId node, NodeId before);
+
+    CALuint size() const { return static_cast<CALuint>(m_nodes.size()); }
+
+    void clear();
+
+private:
+    friend class GraphExecutor;
+
+    enum Type
+    {
+        Kernel,
+        Copy,
+        CopyRaw,
+        Map
+    };
+
+    struct Node
+    {
+        Type                                            type;
+        CALimage                                        image;
+        std::string                                     entry;
+        CALdomain3D                                     gridBlock;
+        CALdomain3D                                     gridSize;
+        std::vector<GraphBinding>                       bindings;
+        CALresource                                     src;
+        CALresource                                     dst;
+        CALuint                                         srcOffset;
+        CALuint                                         dstOffset;
+        CALuint                                         bytes;
+        CALuint                                         flags;
+        std::function<void(CALvoid*, CALuint)>          fn;
+        std::vector<NodeId>                             deps;
+    };
+
+    struct ResourceState
+    {
+        NodeId                  lastWriter;     ///< node + 1, 0 for none
+        std::vector<NodeId>     readers;        ///< since lastWriter
+    };
+
+    NodeId add(const Node& node);
+    void use(NodeId id, CALresource res, GraphAccess access);
+
+    std::vector<Node>                               m_nodes;
+    std::unordered_map<CALresource, ResourceState>  m_resources;
+};
+
+/**
+ * @brief Runs Graphs over a set of contexts on one device.
+ *
+ * Nodes are scheduled in waves. A wave takes every node whose predecessors
+ * were either submitted to the context the node is placed on, which
+ * executes in order, or have completed; a node prefers the context of its
+ * predecessors, and otherwise the least loaded one. Only dependencies that
+ * cross contexts wait for an event, and each context touched by a wave is
+ * flushed once at its end. When no node is ready the executor waits for
+ * the oldest cross-context dependency.
+ *
+ * Contexts are created by open() on the calling thread; use the executor
+ * from that thread only.
+ */
+class GraphExecutor
+{
+public:
+    GraphExecutor();
+    ~GraphExecutor();
+
+    GraphExecutor(const GraphExecutor&) = delete;
+    GraphExecutor& operator=(const GraphExecutor&) = delete;
+
+    /** Create contextCount contexts on dev. */
+    CALresult open(CALdevice dev, CALuint contextCount);
+
+    /** Release every cached CALmem and module and destroy the contexts. */
+    void close();
+
+    /**
+     * @brief Run graph to completion.
+     *
+     * @return CAL_RESULT_OK, or the first error; nodes depending on a
+     *         failed node are not run.
+     */
+    CALresult run(const Graph& graph);
+
+    CALuint contextCount() const { return static_cast<CALuint>(m_contexts.size()); }
+
+    /** Waves issued so far. */
+    CALuint64 waveCount() const { return m_waves; }
+
+    /** calCtxFlush calls issued so far. */
+    CALuint64 flushCount() const { return m_flushes; }
+
+    /** Dependencies that had to wait for an event of another context. */
+    CALuint64 crossWaitCount() const { return m_crossWaits; }
+
+private:
+    struct Context
+    {
+        CALcontext                                          ctx;
+        std::unordered_map<CALresource, CALmem>             mems;
+        std::map<CALimage, CALmodule>                       modules;
+        std::map<std::pair<CALimage, std::string>, CALfunc> funcs;
+        std::map<std::pair<CALmodule, std::string>, CALname> names;
+        CALuint                                             load;   ///< nodes placed in the current run
+    };
+
+    CALresult mem(Context& context, CALresource res, CALmem* mem);
+    CALresult func(Context& context, CALimage image, const std::string& entry, CALmodule* module, CALfunc* func);
+    CALresult submit(Context& context, const Graph::Node& node, CALevent* event);
+    CALresult runMap(const Graph::Node& node);
+
+    CALdevice               m_dev;
+    std::vector<Context>    m_contexts;
+
+    CALuint64               m_waves;
+    CALuint64               m_flushes;
+    CALuint64               m_crossWaits;
+};
+
+} // namespace cal
+
+#endif // __CAL_GRAPH_H__
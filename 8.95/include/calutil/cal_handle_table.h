@@ -0,0 +1,337 @@
+/**
+ *  @file     cal_handle_table.h
+ *  @brief    CAL utility generational handle table
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_HANDLE_TABLE_H__
+#define __CAL_HANDLE_TABLE_H__
+
+#include "cal.h"
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace cal {
+
+/**
+ * @brief Maps CAL handles (CALresource, CALmem, CALevent, CALmodule, ...)
+ * to values without locks.
+ *
+ * A handle packs a slot index into its low <i>IndexBits</i> bits and the
+ * slot's generation into the rest. Freeing a handle bumps the generation,
+ * so a stale handle whose slot was reused no longer matches and lookups
+ * report CAL_RESULT_BAD_HANDLE instead of returning the new occupant.
+ * Handles are never 0.
+ *
+ * Slots live in fixed size slabs that are allocated on demand and never
+ * move, so get() is a couple of loads with no lock and no retry loop.
+ * Freed slots are reused most recently freed first, which keeps the
+ * working set of a steady alloc/free pattern in a few cache lines.
+ *
+ * Values must be trivially copyable and lock-free as std::atomic<T>
+ * (pointers and integers); store owning pointers and keep ownership
+ * elsewhere.
+ */
+template <typename T, typename Handle = CALuint, CALuint IndexBits = 20>
+class HandleTable
+{
+    static_assert(std::is_trivially_copyable<T>::value, "HandleTable values must be trivially copyable");
+    static_assert(IndexBits >= 10 && IndexBits < 32, "HandleTable needs 10 to 31 index bits");
+
+public:
+    /** Most handles that can be live at once. */
+    static const CALuint Capacity = 1u << IndexBits;
+
+    HandleTable() : m_used(0)
+    {
+        m_freeHead.store(0, std::memory_order_relaxed);
+        for (CALuint i = 0; i < SlabCount; ++i)
+        {
+            m_slabs[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~HandleTable()
+    {
+        for (CALuint i = 0; i < SlabCount; ++i)
+        {
+            delete[] m_slabs[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    /**
+     * @brief Store value under a new handle.
+     *
+     * @return the handle, or 0 when the table is full or out of memory.
+     */
+    Handle add(const T& value)
+    {
+        CALuint index;
+        if (!popFree(index) && !claim(index))
+        {
+            return 0;
+        }
+
+        Slot& s = slot(index);
+        CALuint generation = s.generation;
+        Handle handle = static_cast<Handle>((generation << IndexBits) | index);
+        s.value.store(value, std::memory_order_relaxed);
+        s.handle.store(static_cast<CALuint>(handle), std::memory_order_release);
+        return handle;
+    }
+
+    /**
+     * @brief Look up a handle.
+     *
+     * @return CAL_RESULT_OK and the value in out, or CAL_RESULT_BAD_HANDLE for
+     *         0, never issued, freed or stale handles.
+     */
+    CALresult get(Handle handle, T& out) const
+    {
+        const Slot* s = slotOf(handle);
+        if (!s || s->handle.load(std::memory_order_acquire) != static_cast<CALuint>(handle))
+        {
+            return CAL_RESULT_BAD_HANDLE;
+        }
+        T value = s->value.load(std::memory_order_relaxed);
+
+        // The slot may have been freed and reused while the value was read
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->handle.load(std::memory_order_relaxed) != static_cast<CALuint>(handle))
+        {
+            return CAL_RESULT_BAD_HANDLE;
+        }
+        out = value;
+        return CAL_RESULT_OK;
+    }
+
+    /**
+     * @brief Slot index of a handle, below Capacity.
+     *
+     * A live handle owns its index until it is removed, so callers can keep
+     * per-slot state next to the table indexed by it.
+     */
+    static CALuint indexOf(Handle handle)
+    {
+        return static_cast<CALuint>(handle) & IndexMask;
+    }
+
+    /** Value of handle, or a value initialized T for a bad handle. */
+    T find(Handle handle, const T& missing = T()) const
+    {
+        T value;
+        return (get(handle, value) == CAL_RESULT_OK) ? value : missing;
+    }
+
+    /**
+     * @brief Free a handle and return its value in out.
+     *
+     * Exactly one of several concurrent removes of the same handle succeeds.
+     *
+     * @return CAL_RESULT_OK, or CAL_RESULT_BAD_HANDLE when the handle is not live.
+     */
+    CALresult remove(Handle handle, T* out = 0)
+    {
+        Slot* s = const_cast<Slot*>(slotOf(handle));
+        CALuint expected = static_cast<CALuint>(handle);
+        if (!s || !s->handle.compare_exchange_strong(expected, 0, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            return CAL_RESULT_BAD_HANDLE;
+        }
+        if (out)
+        {
+            *out = s->value.load(std::memory_order_relaxed);
+        }
+
+        // Generation 0 is skipped so handles are never 0
+        s->generation = (s->generation + 1) & GenerationMask;
+        if (s->generation == 0)
+        {
+            s->generation = 1;
+        }
+        pushFree(static_cast<CALuint>(handle) & IndexMask);
+        return CAL_RESULT_OK;
+    }
+
+    /**
+     * @brief Live handles at the time of the call.
+     *
+     * Handles added or removed concurrently may or may not be included.
+     */
+    std::vector<Handle> handles() const
+    {
+        std::vector<Handle> result;
+        CALuint used = m_used.load(std::memory_order_acquire);
+        used = (used < Capacity) ? used : Capacity;
+        for (CALuint index = 0; index < used; ++index)
+        {
+            const Slot* s = slabSlot(index);
+            CALuint handle = s ? s->handle.load(std::memory_order_acquire) : 0;
+            if (handle != 0)
+            {
+                result.push_back(static_cast<Handle>(handle));
+            }
+        }
+        return result;
+    }
+
+    /** Free every handle. Not safe against concurrent use of the table. */
+    void clear()
+    {
+        for (Handle handle : handles())
+        {
+            remove(handle);
+        }
+    }
+
+private:
+    static const CALuint SlabShift      = 10;
+    static const CALuint SlabSize       = 1u << SlabShift;
+    static const CALuint SlabCount      = Capacity / SlabSize;
+    static const CALuint IndexMask      = Capacity - 1;
+    static const CALuint GenerationMask = (1u << (32 - IndexBits)) - 1;
+
+    struct Slot
+    {
+        std::atomic<CALuint>    handle;         // handle while live, 0 while free
+        CALuint                 generation;     // of the next handle, owned by the allocating thread
+        std::atomic<CALuint>    nextFree;       // free list link, index + 1
+        std::atomic<T>          value;
+    };
+
+    Slot* slab(CALuint slabIndex, bool create)
+    {
+        Slot* slots = m_slabs[slabIndex].load(std::memory_order_acquire);
+        if (slots || !create)
+        {
+            return slots;
+        }
+
+        Slot* fresh = new (std::nothrow) Slot[SlabSize];
+        if (!fresh)
+        {
+            return 0;
+        }
+        for (CALuint i = 0; i < SlabSize; ++i)
+        {
+            fresh[i].handle.store(0, std::memory_order_relaxed);
+            fresh[i].generation = 1;
+            fresh[i].nextFree.store(0, std::memory_order_relaxed);
+        }
+        if (!m_slabs[slabIndex].compare_exchange_strong(slots, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            // Another thread installed the slab first
+            delete[] fresh;
+            return slots;
+        }
+        return fresh;
+    }
+
+    // A never used slot. Its slab is created before the index is claimed, so
+    // a failed allocation has nothing to roll back and no index is handed
+    // out twice.
+    bool claim(CALuint& index)
+    {
+        CALuint used = m_used.load(std::memory_order_relaxed);
+        do
+        {
+            if (used >= Capacity || !slab(used >> SlabShift, true))
+            {
+                return false;
+            }
+        } while (!m_used.compare_exchange_weak(used, used + 1, std::memory_order_relaxed, std::memory_order_relaxed));
+        index = used;
+        return true;
+    }
+
+    Slot& slot(CALuint index)
+    {
+        return m_slabs[index >> SlabShift].load(std::memory_order_acquire)[index & (SlabSize - 1)];
+    }
+
+    const Slot* slabSlot(CALuint index) const
+    {
+        const Slot* slots = m_slabs[index >> SlabShift].load(std::memory_order_acquire);
+        return slots ? &slots[index & (SlabSize - 1)] : 0;
+    }
+
+    const Slot* slotOf(Handle handle) const
+    {
+        CALuint index = static_cast<CALuint>(handle) & IndexMask;
+        return (handle != 0) ? slabSlot(index) : 0;
+    }
+
+    // Free list: Treiber stack of index + 1 with a pop counter against ABA
+    void pushFree(CALuint index)
+    {
+        Slot& s = slot(index);
+        CALuint64 head = m_freeHead.load(std::memory_order_relaxed);
+        CALuint64 next;
+        do
+        {
+            s.nextFree.store(static_cast<CALuint>(head), std::memory_order_relaxed);
+            next = (head & ~static_cast<CALuint64>(0xffffffffu)) | (index + 1);
+        } while (!m_freeHead.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool popFree(CALuint& index)
+    {
+        CALuint64 head = m_freeHead.load(std::memory_order_acquire);
+        for (;;)
+        {
+            CALuint top = static_cast<CALuint>(head);
+            if (top == 0)
+            {
+                return false;
+            }
+            CALuint   link = slot(top - 1).nextFree.load(std::memory_order_relaxed);
+            CALuint64 next = ((head >> 32) + 1) << 32 | link;
+            if (m_freeHead.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                index = top - 1;
+                return true;
+            }
+        }
+    }
+
+    std::atomic<Slot*>      m_slabs[SlabCount];
+    std::atomic<CALuint>    m_used;         // slots ever handed out
+    std::atomic<CALuint64>  m_freeHead;
+};
+
+} // namespace cal
+
+#endif // __CAL_HANDLE_TABLE_H__
@@ -0,0 +1,191 @@
+/**
+ *  @file     cal_heap_allocator.h
+ *  @brief    CAL utility buddy sub-allocator over the global heap
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_HEAP_ALLOCATOR_H__
+#define __CAL_HEAP_ALLOCATOR_H__
+
+#include "cal.h"
+
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace cal {
+
+class HeapAllocator;
+
+/**
+ * @brief Move-only owner of a typed view carved out of a HeapAllocator.
+ *
+ * Destroying or resetting the buffer frees the view and returns its block
+ * to the allocator. The view must no longer be mapped or bound to a
+ * context by then; a buffer must not outlive its allocator.
+ */
+class HeapBuffer
+{
+public:
+    HeapBuffer() : m_heap(0), m_res(0), m_offset(0), m_bytes(0), m_width(0), m_format(CAL_FORMAT_UNSIGNED_INT32_1) {}
+    ~HeapBuffer() { reset(); }
+
+    HeapBuffer(HeapBuffer&& other);
+    HeapBuffer& operator=(HeapBuffer&& other);
+
+    HeapBuffer(const HeapBuffer&) = delete;
+    HeapBuffer& operator=(const HeapBuffer&) = delete;
+
+    /** The view; use it like any other resource with calCtxGetMem. */
+    CALresource get() const { return m_res; }
+    explicit operator bool() const { return m_res != 0; }
+
+    /** Byte offset of the view in the heap resource. */
+    CALuint64 offset() const { return m_offset; }
+
+    /** Bytes reserved for the view, a power of two. */
+    CALuint64 capacity() const { return m_bytes; }
+
+    /** Elements in the view, rounded up to the device pitch alignment. */
+    CALuint width() const { return m_width; }
+
+    CALformat format() const { return m_format; }
+
+    void reset();
+
+private:
+    friend class HeapAllocator;
+
+    HeapAllocator*  m_heap;
+    CALresource     m_res;
+    CALuint64       m_offset;
+    CALuint64       m_bytes;
+    CALuint         m_width;
+    CALformat       m_format;
+};
+
+/** Counters of a HeapAllocator. */
+struct HeapAllocatorStats
+{
+    CALuint64   heapBytes;          ///< bytes managed
+    CALuint64   usedBytes;          ///< bytes in live blocks
+    CALuint64   requestedBytes;     ///< bytes the live views cover
+    CALuint64   peakBytes;          ///< most usedBytes so far
+    CALuint64   largestFree;        ///< largest block that can be allocated now
+    CALuint64   allocs;             ///< views allocated so far
+    CALuint64   failures;           ///< allocations that found no block
+    CALuint     liveViews;
+};
+
+/**
+ * @brief Sub-allocates typed 1D views from the device's global heap.
+ *
+ * Small buffers allocated one by one each cost a driver allocation and
+ * waste memory to surface alignment. The allocator takes the heap resource
+ * from calResGetHeap(CAL_HEAP_GLOBAL) once and aliases blocks of it with
+ * calResAllocView, so allocating a buffer is a buddy allocator operation
+ * plus the view. Blocks are powers of two no smaller than the device's
+ * surface_alignment, so every view starts aligned; view widths are rounded
+ * up to pitch_alignment elements. Freed blocks merge with their buddies
+ * right away, lowest address first allocation keeps the top of the heap
+ * free for large requests.
+ *
+ * Needs CAL_PRIVATE_EXT_HEAP and CAL_PRIVATE_EXT_RESOURCES resolved by
+ * calExtTableInit. The heap belongs to the device and is never freed; all
+ * methods may be called from any thread.
+ */
+class HeapAllocator
+{
+public:
+    HeapAllocator();
+
+    /** close() */
+    ~HeapAllocator();
+
+    HeapAllocator(const HeapAllocator&) = delete;
+    HeapAllocator& operator=(const HeapAllocator&) = delete;
+
+    /**
+     * @brief Take the global heap of dev and manage its first bytes.
+     *
+     * @param dev     - device opened from ordinal.
+     * @param ordinal - for calDeviceGetAttribs.
+     * @param bytes   - bytes to manage, 0 for the whole heap.
+     *
+     * @return CAL_RESULT_NOT_SUPPORTED without the heap extensions, else the
+     *         result of the attribute and heap queries.
+     */
+    CALresult open(CALdevice dev, CALuint ordinal, CALuint64 bytes = 0);
+
+    /** Stop managing the heap; every HeapBuffer must be reset before. */
+    void close();
+
+    /**
+     * @brief Allocate a view of width elements of format.
+     *
+     * @param flags - calResAllocView flags.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_ERROR when no block is large enough,
+     *         or the calResAllocView result.
+     */
+    CALresult alloc(HeapBuffer& out, CALformat format, CALuint width, CALuint flags = CAL_RESALLOC_GLOBAL_BUFFER);
+
+    /** The heap resource, 0 before open. */
+    CALresource heap() const { return m_heap; }
+
+    HeapAllocatorStats stats() const;
+
+private:
+    friend class HeapBuffer;
+
+    bool reserve(CALuint order, CALuint64& offset);
+    void release(CALuint64 offset, CALuint64 requested);
+
+    mutable std::mutex                      m_lock;
+    CALdevice                               m_dev;
+    CALresource                             m_heap;
+    CALuint                                 m_heapElementSize;
+    CALuint                                 m_pitchAlignment;   // elements
+    CALuint                                 m_minShift;         // log2 of the smallest block
+    std::vector<std::set<CALuint64> >       m_free;             // free block offsets per order
+    std::unordered_map<CALuint64, CALuint>  m_live;             // block offset to order
+
+    CALuint64                               m_heapBytes;
+    CALuint64                               m_usedBytes;
+    CALuint64                               m_requestedBytes;
+    CALuint64                               m_peakBytes;
+    CALuint64                               m_allocs;
+    CALuint64                               m_failures;
+};
+
+} // namespace cal
+
+#endif // __CAL_HEAP_ALLOCATOR_H__
@@ -0,0 +1,179 @@
+/**
+ *  @file     cal_huge_page_allocator.h
+ *  @brief    CAL utility huge page host buffers imported with calResCreate1D/2D
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+
+
+
+#ifndef __CAL_HUGE_PAGE_ALLOCATOR_H__
+#define __CAL_HUGE_PAGE_ALLOCATOR_H__
+
+#include "cal.h"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+namespace cal {
+
+/** Pages backing a host buffer. */
+enum HostPageKind
+{
+    HostPageSmall = 0,          ///< regular pages
+    HostPageTransparent,        ///< 2 MB aligned and advised for transparent huge pages
+    HostPage2M,                 ///< explicit 2 MB huge pages
+    HostPage1G                  ///< explicit 1 GB huge pages
+};
+
+/** Counters of a HugePageAllocator. */
+struct HugePageStats
+{
+    CALuint64   bytes;              ///< host memory held now
+    CALuint     buffers;            ///< buffers held now
+    CALuint64   allocs[HostPage1G + 1];     ///< buffers allocated so far by page kind
+    CALuint64   registrations;      ///< calResCreate1D/2D calls
+    CALuint64   cacheHits;          ///< resource requests served from the registration cache
+    CALuint     liveResources;
+};
+
+/**
+ * @brief Host buffers on huge pages that kernels read in place through
+ * calResCreate1D/2D.
+ *
+ * Ingest data received into a regular host buffer is copied once more
+ * into a remote resource before a kernel can read it. The allocator hands
+ * out buffers the device can use directly: alloc() maps explicit 1 GB or
+ * 2 MB huge pages where the system has them reserved, and otherwise 2 MB
+ * aligned memory advised for transparent huge pages, so multi-gigabyte
+ * datasets take few TLB entries. resource1D()/resource2D() wrap any
+ * surface_alignment aligned range of a buffer with calResCreate1D/2D and
+ * cache the resource by range, format and shape, so a buffer filled over
+ * and over is registered once. calResCreate1D/2D take a 32 bit size, so
+ * one resource covers less than 4 GB; callers register larger buffers in
+ * several ranges themselves.
+ *
+ * Needs CAL_EXT_RES_CREATE resolved by calExtTableInit. Freeing a buffer
+ * frees its resources, which must no longer be used by a context by then.
+ * All methods may be called from any thread.
+ */
+class HugePageAllocator
+{
+public:
+    HugePageAllocator();
+
+    /** close() */
+    ~HugePageAllocator();
+
+    HugePageAllocator(const HugePageAllocator&) = delete;
+    HugePageAllocator& operator=(const HugePageAllocator&) = delete;
+
+    /**
+     * @brief Register buffers with dev; ordinal is dev's for
+     * calDeviceGetAttribs, which supplies surface_alignment.
+     *
+     * @return CAL_RESULT_NOT_SUPPORTED without calResCreate1D/2D, else
+     *         the calDeviceGetAttribs result.
+     */
+    CALresult open(CALdevice dev, CALuint ordinal);
+
+    /** Free every buffer and resource. */
+    void close();
+
+    /**
+     * @brief Allocate bytes of host memory on the largest pages up to
+     * maxPage that the system provides.
+     *
+     * The buffer is rounded up to whole pages. 1 GB pages are only used
+     * for buffers of at least 1 GB. Explicit huge pages come from the
+     * reserved pool (vm.nr_hugepages, or large pages with the "Lock pages
+     * in memory" right on Windows); the fallback is 2 MB aligned on Linux.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_INVALID_PARAMETER for 0 bytes, or
+     *         CAL_RESULT_ERROR when no memory could be mapped.
+     */
+    CALresult alloc(CALvoid** ptr, size_t bytes, HostPageKind maxPage = HostPage1G);
+
+    /** Free a buffer from alloc() and its resources. */
+    CALresult free(CALvoid* ptr);
+
+    /** Pages backing the buffer that holds ptr; HostPageSmall for foreign pointers. */
+    HostPageKind pageKind(const CALvoid* ptr) const;
+
+    /**
+     * @brief A resource reading width elements of format at ptr, which
+     * must lie in a buffer from alloc() and be surface_alignment aligned.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_INVALID_PARAMETER when the range
+     *         is not inside a buffer, misaligned or 4 GB or larger, or the
+     *         calResCreate1D result.
+     */
+    CALresult resource1D(CALresource* res, CALvoid* ptr, CALuint width, CALformat format);
+
+    /** As resource1D, for width x height packed elements. */
+    CALresult resource2D(CALresource* res, CALvoid* ptr, CALuint width, CALuint height, CALformat format);
+
+    HugePageStats stats() const;
+
+private:
+    struct Registration
+    {
+        size_t      offset;
+        CALuint     width;
+        CALuint     height;     // 0 for 1D
+        CALformat   format;
+
+        bool operator<(const Registration& other) const;
+    };
+
+    struct Mapping
+    {
+        size_t                                  bytes;      // mapped
+        HostPageKind                            kind;
+        std::map<Registration, CALresource>     resources;
+    };
+
+    typedef std::map<size_t, Mapping> MappingMap;   // by address
+
+    CALresult resource(CALresource* res, CALvoid* ptr, CALuint width, CALuint height, CALformat format);
+    MappingMap::iterator find(const CALvoid* ptr);
+    void release(MappingMap::iterator it);
+
+    mutable std::mutex  m_lock;
+    CALdevice           m_dev;
+    CALuint             m_alignment;
+    MappingMap          m_buffers;
+    HugePageStats       m_stats;
+};
+
+} // namespace cal
+
+#endif // __CAL_HUGE_PAGE_ALLOCATOR_H__
@@ -0,0 +1,122 @@
+/**
+ *  @file     cal_mem_usage.h
+ *  @brief    CAL utility minimal memory usage lists for extended dispatches
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+
+
+
+#ifndef __CAL_MEM_USAGE_H__
+#define __CAL_MEM_USAGE_H__
+
+#include "cal.h"
+#include "cal_private_ext.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace cal {
+
+/**
+ * @brief Builds the memUsage list of CAL_RUNPROGRAMGRID_EXTENDED_MEMORY_USAGE
+ * dispatches from what the kernel actually references.
+ *
+ * With the global heap, the runtime pages in exactly the CALmems a
+ * dispatch lists, so a hand written list that names every buffer of the
+ * application pages in far more than the kernel touches. The tracker
+ * shadows calCtxSetMem to know which CALmem is bound to each CALname, and
+ * finds the names a module declares by resolving every variable CAL IL
+ * can declare (i0-i127, o0-o7, cb0-cb15, uav0-uav11, g[]) with
+ * calModuleGetName once per module. prepare() then lists the distinct
+ * CALmems bound to the module's names, in an array kept per module and
+ * refilled on every dispatch.
+ *
+ * Bindings made with calCtxSetMem directly are not seen; route them all
+ * through setMem(). Like the context, a tracker must only be used from the
+ * thread that created the context.
+ */
+class MemUsageTracker
+{
+public:
+    explicit MemUsageTracker(CALcontext ctx = 0) : m_ctx(ctx) {}
+
+    MemUsageTracker(const MemUsageTracker&) = delete;
+    MemUsageTracker& operator=(const MemUsageTracker&) = delete;
+
+    /** Switch to ctx, forgetting every binding and module. */
+    void setContext(CALcontext ctx);
+    CALcontext context() const { return m_ctx; }
+
+    /** calCtxSetMem, remembering the binding; a mem of 0 unbinds name. */
+    CALresult setMem(CALname name, CALmem mem);
+
+    /** Drop the bindings of mem before calCtxReleaseMem. */
+    void forgetMem(CALmem mem);
+
+    /** Drop what is known about module before calModuleUnload. */
+    void forgetModule(CALmodule module);
+
+    /**
+     * @brief The names module declares, resolved on the first call.
+     *
+     * @return CAL_RESULT_OK, or CAL_RESULT_BAD_HANDLE when calModuleGetName
+     *         does not know the module.
+     */
+    CALresult names(CALmodule module, const std::vector<CALname>** names);
+
+    /**
+     * @brief Point grid.memUsage at the CALmems bound to the names of
+     * module, and set the extended structure and memory usage flags.
+     *
+     * Names without a binding are skipped. The list stays valid until the
+     * next prepare() for the same module; the other fields of grid are
+     * left alone, struct_size is filled in when 0.
+     */
+    CALresult prepare(CALprogramGridExtended& grid, CALmodule module);
+
+private:
+    struct ModuleUsage
+    {
+        std::vector<CALname>    names;
+        std::vector<CALmem>     mems;
+        CALmemusage             usage;
+    };
+
+    CALresult lookup(CALmodule module, ModuleUsage** usage);
+
+    CALcontext                                  m_ctx;
+    std::unordered_map<CALname, CALmem>         m_bound;
+    std::unordered_map<CALmodule, ModuleUsage>  m_modules;
+};
+
+} // namespace cal
+
+#endif // __CAL_MEM_USAGE_H__
@@ -0,0 +1,185 @@
+/**
+ *  @file     cal_numa.h
+ *  @brief    CAL utility NUMA placement of remote resources
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_NUMA_H__
+#define __CAL_NUMA_H__
+
+#include "cal.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace cal {
+
+/** PCI location packed in CALdeviceattribs::pciTopologyInformation. */
+struct PciLocation
+{
+    CALuint     bus;
+    CALuint     device;
+    CALuint     function;
+};
+
+/**
+ * Bus in bits 15:8, device in bits 7:3 and function in bits 2:0.
+ *
+ * cal.h only says the field holds the bus, device and function number. The
+ * layout assumed here is the PCI routing ID (requester ID) of the PCI
+ * Express base specification, which is also what the Linux PCI_BUS_NUM,
+ * PCI_SLOT and PCI_FUNC macros take apart. A runtime that packs the field
+ * differently matches no sysfs entry, or the wrong one, and should be
+ * overridden with NumaPlacement::setNode().
+ */
+inline constexpr PciLocation
+pciLocation(CALuint topology)
+{
+    return PciLocation{ (topology >> 8) & 0xff, (topology >> 3) & 0x1f, topology & 0x7 };
+}
+
+/** Remote resource traffic counted by a NumaPlacement. */
+struct NumaTrafficStats
+{
+    CALuint64   allocs;             ///< remote resources allocated through the placement
+    CALuint64   bindFailures;       ///< resources whose pages could not be bound to the node
+    CALuint64   localBytes;         ///< recorded bytes in pages on the device's node
+    CALuint64   crossBytes;         ///< recorded bytes in pages on another node
+    CALuint64   unplacedBytes;      ///< recorded bytes in pages not touched yet
+    CALuint64   crossThreadBytes;   ///< recorded bytes moved by a thread running on another node
+};
+
+/**
+ * @brief Keeps the remote resources of a device, and the host threads that
+ * fill them, on the NUMA node the device is attached to.
+ *
+ * On multi-socket hosts remote memory on the far node costs every DMA
+ * transfer an extra socket hop. open() looks the device up in
+ * /sys/bus/pci/devices by the bus, device and function of its
+ * pciTopologyInformation. allocRemote1D/2D() allocate on the device alone
+ * with the calling thread's memory policy set to prefer that node, so the
+ * pages the driver allocates or pins come from it; when the policy cannot
+ * be set, the whole pages inside the resource are moved there with mbind.
+ * bindThread() restricts the calling thread to the node's CPUs and prefers
+ * its memory. The preferred policy falls back to other nodes instead of
+ * failing when the node runs out of memory.
+ *
+ * record() counts the bytes of a transfer through a resource by the node
+ * its pages are on, sampled with move_pages, and by the node of the
+ * calling thread, so stats() shows how much traffic still crosses nodes.
+ * Without NUMA information (single node hosts, devices without a sysfs
+ * entry, other platforms) node() is -1 and the calls pass through.
+ *
+ * All methods may be called from any thread.
+ */
+class NumaPlacement
+{
+public:
+    NumaPlacement();
+
+    /** Free the resources allocated through the placement. */
+    ~NumaPlacement();
+
+    NumaPlacement(const NumaPlacement&) = delete;
+    NumaPlacement& operator=(const NumaPlacement&) = delete;
+
+    /**
+     * @brief NUMA node of the device with the given ordinal, -1 when unknown.
+     */
+    static CALint deviceNode(CALuint ordinal);
+
+    /**
+     * @brief Place for the device with the given ordinal.
+     *
+     * @return the calDeviceGetAttribs result; an unknown node is not an error.
+     */
+    CALresult open(CALuint ordinal);
+
+    /** Place for node, overriding what sysfs reports; -1 disables placement. */
+    void setNode(CALint node);
+
+    CALint node() const;
+
+    /**
+     * @brief calResAllocRemote1D on dev alone, preferring node() for its pages.
+     *
+     * @return the calResAllocRemote1D or calResMap result, the resource
+     *         is freed when the map fails; a failed bind only counts in
+     *         bindFailures.
+     */
+    CALresult allocRemote1D(CALresource* res, CALdevice dev, CALuint width, CALformat format, CALuint flags);
+
+    /** As allocRemote1D, for a 2D resource. */
+    CALresult allocRemote2D(CALresource* res, CALdevice dev, CALuint width, CALuint height,
+                            CALformat format, CALuint flags);
+
+    /** Free a resource from allocRemote1D/2D. */
+    CALresult free(CALresource res);
+
+    /**
+     * @brief Run the calling thread on the CPUs of node() and prefer its
+     * memory for the thread's allocations.
+     *
+     * @return CAL_RESULT_OK, also without placement, or CAL_RESULT_ERROR
+     *         when the kernel refused the affinity.
+     */
+    CALresult bindThread();
+
+    /**
+     * @brief Count bytes moved through res by the calling thread, e.g. by
+     * a fill of the mapped resource or a calMemCopy from or to it.
+     *
+     * @return CAL_RESULT_INVALID_PARAMETER for resources not allocated here.
+     */
+    CALresult record(CALresource res, CALuint64 bytes);
+
+    NumaTrafficStats stats() const;
+
+private:
+    struct Placed
+    {
+        CALvoid*    ptr;
+        CALuint64   bytes;
+    };
+
+    CALresult place(CALresource res, CALuint64 height, CALformat format, bool preferred);
+    bool pageNodes(const Placed& placed, CALuint& local, CALuint& cross, CALuint& unplaced) const;
+
+    mutable std::mutex              m_lock;
+    CALint                          m_node;
+    std::vector<CALuint>            m_cpus;     // CPUs of m_node
+    std::map<CALresource, Placed>   m_placed;
+    NumaTrafficStats                m_stats;
+};
+
+} // namespace cal
+
+#endif // __CAL_NUMA_H__
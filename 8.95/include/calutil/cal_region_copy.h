@@ -0,0 +1,207 @@
+/**
+ *  @file     cal_region_copy.h
+ *  @brief    CAL utility chunked copies of resource regions
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_REGION_COPY_H__
+#define __CAL_REGION_COPY_H__
+
+#include "cal.h"
+#include "cal_event_waiter.h"
+
+#include <deque>
+#include <vector>
+
+namespace cal {
+
+/** A box copied between two resources, in elements. */
+struct CopyRegion
+{
+    CALuint     srcOffset[3];       ///< x, y and z slice
+    CALuint     dstOffset[3];
+    CALuint     size[3];            ///< width, height and depth; a height or depth of 0 counts as 1
+};
+
+/**
+ * One transfer of a copy plan, with the arguments of calMemCopyRaw (byte
+ * offsets and size in [0]) or calMemCopyPartial (x, y and z in elements).
+ */
+struct CopyChunk
+{
+    bool        raw;
+    CALuint     srcOffset[3];
+    CALuint     dstOffset[3];
+    CALuint     size[3];
+};
+
+/** Planning and issuing parameters of a RegionCopier. */
+struct RegionCopyParams
+{
+    CALuint64   chunkBytes;         ///< largest single transfer
+    CALuint     depth;              ///< transfers in flight per context
+    CALuint64   mergeGapBytes;      ///< linear gap a raw copy may also copy to join two regions
+    CALuint     srcSliceRows;       ///< rows per z slice of the source, 0 for the resource height
+    CALuint     dstSliceRows;       ///< rows per z slice of the destination, 0 for the resource height
+
+    RegionCopyParams()
+        : chunkBytes(4 * 1024 * 1024), depth(2), mergeGapBytes(0), srcSliceRows(0), dstSliceRows(0) {}
+};
+
+/** Counters of a RegionCopier. */
+struct RegionCopyStats
+{
+    CALuint64   regions;            ///< regions planned, counting each z slice
+    CALuint64   merged;             ///< regions joined to a neighbour
+    CALuint64   rawCopies;
+    CALuint64   partialCopies;
+    CALuint64   bytes;              ///< bytes transferred, including merged gaps
+    double      seconds;            ///< spent in copy()
+};
+
+/**
+ * @brief Copies lists of 1D, 2D and 3D regions between two resources with
+ * calMemCopyPartial and calMemCopyRaw instead of whole-resource calMemCopy.
+ *
+ * plan() turns the regions into transfers: a 3D box becomes one rectangle
+ * per z slice, with slices stacked srcSliceRows/dstSliceRows rows apart.
+ * Rectangles that touch with the same source to destination displacement
+ * are joined, and rectangles that are contiguous in memory on both sides
+ * (single rows, or full rows of equal pitch) become byte spans that are
+ * joined across rows. mergeGapBytes lets a raw copy also copy a short gap
+ * between two spans to save a transfer; the gap is overwritten in the
+ * destination, so this is only for destinations that mirror the source.
+ * Transfers above chunkBytes are split into bands of rows, or pieces of a
+ * row, so the engine works on one chunk while the next is queued.
+ *
+ * copy() issues the chunks round-robin over the contexts given to open(),
+ * keeping up to depth chunks in flight on each, and waits for all of them.
+ * Resources of different pitches are fine; elements must be of one size.
+ * Raw copies are only used between linear surfaces below 4 GB, and the
+ * extension a plan needs falls back to the other one when it is missing.
+ *
+ * Needs CAL_PRIVATE_EXT_RESOURCES and one of CAL_PRIVATE_EXT_MEMCOPY_RAW or
+ * CAL_PRIVATE_EXT_MEMCOPY_PARTIAL resolved by calExtTableInit. All calls
+ * must come from the thread that created the contexts.
+ */
+class RegionCopier
+{
+public:
+    RegionCopier();
+
+    /** close() */
+    ~RegionCopier();
+
+    RegionCopier(const RegionCopier&) = delete;
+    RegionCopier& operator=(const RegionCopier&) = delete;
+
+    /**
+     * @brief Copy from src to dst, binding both to every context in ctxs.
+     *
+     * @return CAL_RESULT_NOT_SUPPORTED without the extensions,
+     *         CAL_RESULT_INVALID_PARAMETER for no contexts, a depth of 0 or
+     *         resources of different element sizes, else the first failing
+     *         calResQueryInfo or calCtxGetMem result.
+     */
+    CALresult open(const CALcontext* ctxs, CALuint ctxCount, CALresource src, CALresource dst,
+                   const RegionCopyParams& params = RegionCopyParams());
+
+    /** Release the memory handles; copies must have completed. */
+    void close();
+
+    /**
+     * @brief The transfers copying regions, without issuing them.
+     *
+     * @return CAL_RESULT_OK, or CAL_RESULT_INVALID_PARAMETER for an empty
+     *         region or one outside either resource.
+     */
+    CALresult plan(const CopyRegion* regions, CALuint count, std::vector<CopyChunk>& chunks);
+
+    /**
+     * @brief Copy regions and wait for the copies.
+     *
+     * @return CAL_RESULT_OK, the plan() result, or the first failing copy
+     *         or wait result; the chunks in flight are waited for first.
+     */
+    CALresult copy(const CopyRegion* regions, CALuint count);
+
+    RegionCopyStats stats() const { return m_stats; }
+
+private:
+    struct Surface
+    {
+        CALuint     width;
+        CALuint     height;
+        CALuint     pitch;
+        CALuint     sliceRows;
+        bool        linear;         // raw byte offsets address it
+    };
+
+    struct Rect
+    {
+        CALuint     sx, sy, dx, dy, w, h;
+    };
+
+    struct Span
+    {
+        CALuint64   src, dst, bytes;
+    };
+
+    struct Lane
+    {
+        CALcontext              ctx;
+        CALmem                  src;
+        CALmem                  dst;
+        EventWaiter             waiter;
+        std::deque<CALevent>    inFlight;
+    };
+
+    CALresult surface(Surface& out, CALresource res, CALuint sliceRows, CALuint& elementSize);
+    bool spanOf(const Rect& rect, Span& span) const;
+    void mergeRects(std::vector<Rect>& rects);
+    void mergeSpans(std::vector<Span>& spans);
+    void chunkRect(const Rect& rect, std::vector<CopyChunk>& chunks) const;
+    void chunkSpan(const Span& span, std::vector<CopyChunk>& chunks) const;
+    CALresult issue(Lane& lane, const CopyChunk& chunk);
+    CALresult drain();
+
+    RegionCopyParams    m_params;
+    Surface             m_src;
+    Surface             m_dst;
+    CALuint             m_elementSize;
+    bool                m_raw;          // calMemCopyRaw usable for spans
+    bool                m_partial;      // calMemCopyPartial available
+    std::vector<Lane>   m_lanes;
+    RegionCopyStats     m_stats;
+};
+
+} // namespace cal
+
+#endif // __CAL_REGION_COPY_H__
@@ -0,0 +1,140 @@
+/**
+ *  @file     cal_replay.h
+ *  @brief    CAL command stream capture file format
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_REPLAY_H__
+#define __CAL_REPLAY_H__
+
+#include "cal.h"
+#include "cal_api_id.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A capture file is one CALreplayHeader followed by packets in the order the
+ * calls returned. Every packet starts 8 byte aligned with a CALreplayPacket,
+ * followed by argCount 64 bit arguments and payloadSize bytes of payload;
+ * size covers all of it plus padding, so a mapped file is walked by adding
+ * size. Only calls that returned CAL_RESULT_OK are captured.
+ *
+ * Handles are the values seen by the captured process and must be remapped
+ * on replay. Arguments and payload per api:
+ *
+ *     calDeviceOpen              dev, ordinal
+ *     calDeviceClose             dev
+ *     calResAllocLocal2D         res, dev, width, height, format, flags
+ *     calResAllocRemote2D        res, deviceCount, width, height, format, flags      payload CALdevice[deviceCount]
+ *     calResAllocLocal1D         res, dev, width, format, flags
+ *     calResAllocRemote1D        res, deviceCount, width, format, flags             payload CALdevice[deviceCount]
+ *     calResCreate2D             res, dev, width, height, format, size, flags
+ *     calResCreate1D             res, dev, width, format, size, flags
+ *     calResAllocView            view, res, dev, width, height, depth, x, y,        (offset is a CALdomain)
+ *                                offset width, offset height, format, channel order,
+ *                                dimension, flags
+ *     calResAlloc                res, deviceCount, type, width, height, depth,      payload CALdevice[deviceCount]
+ *                                format, channel order, dimension, mip levels,
+ *                                flags, system memory size (0 without system memory)
+ *     calResGetHeap              res, deviceCount, type, size                       payload CALdevice[deviceCount]
+ *     calResFree                 res
+ *     calResUnmap                res, element size, pitch in bytes, bytes per row, rows  payload CALreplayWrite runs
+ *     calCtxCreate               ctx, dev
+ *     calCtxDestroy              ctx
+ *     calCtxGetMem               mem, ctx, res
+ *     calCtxReleaseMem           ctx, mem
+ *     calCtxSetMem               ctx, name, mem
+ *     calModuleLoad              module, ctx                                        payload image (calclImageWrite)
+ *     calModuleUnload            ctx, module
+ *     calModuleGetEntry          func, ctx, module                                  payload NUL terminated name
+ *     calModuleGetName           name, ctx, module                                  payload NUL terminated name
+ *     calCtxRunProgram           event, ctx, func, x, y, width, height
+ *     calCtxRunProgramGrid       event, ctx                                         payload CALprogramGrid, or with
+ *                                                                                    CAL_RUNPROGRAMGRID_EXTENDED_STRUCTURE
+ *                                                                                    CALprogramGridExtended and CALmem[]
+ *     calCtxRunProgramGridArray  event, ctx, num, flags                             payload CALprogramGrid[num]
+ *     calMemCopy                 event, ctx, srcMem, dstMem, flags
+ *     calMemCopyRaw              event, ctx, srcMem, srcOffset, dstMem, dstOffset, size, flags
+ *     calMemCopyPartial          event, ctx, srcMem, dstMem, flags                  payload CALuint srcOffset[3], dstOffset[3], size[3]
+ *     calCtxFlush                ctx
+ *     calCtxFlushCache           ctx, flags
+ *     calCtxIsEventDone          ctx, event
+ *     calCtxWaitForEvents        ctx, n, flags                                      payload CALevent[n]
+ *
+ * calResUnmap carries the bytes the host changed while the resource was
+ * mapped, as a list of CALreplayWrite runs: each run header is followed by
+ * size bytes of data, padded to 4 bytes. Runs never cross a row, so they
+ * can be applied to a resource mapped with a different pitch.
+ *
+ * The device reads host memory without an unmap in two cases: resources
+ * that stay mapped (a persistently mapped staging ring) and resources on
+ * process memory (calResCreate1D/2D, calResAlloc with system memory). Before
+ * every copy and run the capture therefore diffs all such resources and
+ * writes the changes as extra calResUnmap packets, without unmapping.
+ * Process memory is diffed against zeros, as replays start from zeroed
+ * host memory.
+ *
+ * calCtxIsEventDone is only captured when it reported completion; a replayer
+ * waits for the event at that point.
+ */
+
+#define CAL_REPLAY_MAGIC     "CALRPLAY"
+#define CAL_REPLAY_VERSION   1
+
+typedef struct CALreplayHeaderRec {
+    CALchar   magic[8];     /**< CAL_REPLAY_MAGIC, not NUL terminated */
+    CALuint   version;      /**< CAL_REPLAY_VERSION */
+    CALuint   pid;          /**< Captured process */
+    CALuint64 startTimeNs;  /**< Wall clock when capturing started, nanoseconds since the epoch */
+    CALuint64 reserved;
+} CALreplayHeader;
+
+typedef struct CALreplayPacketRec {
+    CALuint   size;         /**< Bytes of this packet including arguments, payload and padding */
+    CALushort api;          /**< CALapiId */
+    CALushort argCount;     /**< Number of 64 bit arguments following the packet */
+    CALuint64 time;         /**< Nanoseconds since capturing started, taken when the call returned */
+    CALuint   thread;       /**< OS thread id of the caller */
+    CALuint   payloadSize;  /**< Bytes of payload following the arguments */
+} CALreplayPacket;
+
+typedef struct CALreplayWriteRec {
+    CALuint   row;          /**< Row of the resource */
+    CALuint   offset;       /**< Byte offset within the row */
+    CALuint   size;         /**< Bytes of data following this header */
+} CALreplayWrite;
+
+#ifdef __cplusplus
+}      /* extern "C" { */
+#endif
+
+#endif // __CAL_REPLAY_H__
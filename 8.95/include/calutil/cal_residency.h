@@ -0,0 +1,230 @@
+/**
+ *  @file     cal_residency.h
+ *  @brief    CAL utility residency manager placing resources by free device memory
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+
+
+
+#ifndef __CAL_RESIDENCY_H__
+#define __CAL_RESIDENCY_H__
+
+#include "cal.h"
+#include "cal_event_waiter.h"
+#include "cal_resource_pool.h"
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+namespace cal {
+
+/** Memory a managed resource lives in. */
+enum ResidencyHeap
+{
+    ResidencyLocal = 0,         ///< local GPU RAM, visible or invisible heap
+    ResidencyRemote,            ///< uncached remote memory
+    ResidencyRemoteCached,      ///< CAL_RESALLOC_CACHEABLE remote memory
+    ResidencyHeapCount
+};
+
+/** Handle of a resource owned by a ResidencyManager; never 0. */
+typedef CALuint ResidentId;
+
+/**
+ * @brief Free space of a heap as of the last calDeviceGetStatus poll, less
+ * what the manager allocated since.
+ */
+struct ResidencyHeapStatus
+{
+    CALuint64   totalBytes;     ///< from calDeviceGetAttribs
+    CALuint64   availBytes;
+    CALuint64   largestBlock;   ///< largest allocation that can succeed
+    CALuint64   trackedBytes;   ///< bytes of the manager's resources in the heap
+    CALuint     trackedCount;
+};
+
+/** Tunables of a ResidencyManager. */
+struct ResidencyParams
+{
+    CALuint pollInterval;       ///< allocations and frees between calDeviceGetStatus polls
+    CALuint pollMs;             ///< poll before allocating when the status is older than this
+    CALuint headroomMB;         ///< local RAM left free for allocations outside the manager
+    bool    remoteFallback;     ///< place local requests in remote memory when eviction does not make room
+
+    ResidencyParams()
+        : pollInterval(16), pollMs(100), headroomMB(64), remoteFallback(true) {}
+};
+
+/** Counters since open(). */
+struct ResidencyStats
+{
+    CALuint64   allocs;
+    CALuint64   fallbacks;      ///< local requests placed in remote memory
+    CALuint64   failures;       ///< allocations no heap could take
+    CALuint64   evictions;      ///< resources moved out of local memory
+    CALuint64   evictedBytes;
+    CALuint64   pageIns;        ///< evicted resources moved back by pin()
+    CALuint64   polls;
+};
+
+/**
+ * @brief Places resources by free memory and moves cold ones out of local
+ * memory instead of failing allocations.
+ *
+ * The manager tracks the bytes of every resource it owns per heap, and
+ * polls calDeviceGetStatus every pollInterval allocations and frees, or
+ * when the last poll is older than pollMs; between polls, its own
+ * allocations are subtracted from the polled figures. A local request goes
+ * to local memory when the largest free local block holds it with
+ * headroomMB to spare. Otherwise the least recently pinned unpinned local
+ * resources are evicted, copied with calMemCopy into remote resources of
+ * the same shape, until it fits; when that is not enough the request is
+ * placed in the remote heap with the largest free block. A failing
+ * allocation forces a poll and goes through the same steps once more.
+ * pin() moves evicted resources back when local memory has room again.
+ *
+ * Resources are addressed by ResidentId because eviction replaces the
+ * CALresource. The resource returned by pin() stays valid until unpin();
+ * get CALmems for it only while pinned and release them before unpinning.
+ *
+ * All calls must come from the thread that created the context; the
+ * eviction copies run on it and are waited for before returning.
+ */
+class ResidencyManager
+{
+public:
+    explicit ResidencyManager(const ResidencyParams& params = ResidencyParams());
+
+    /** close() */
+    ~ResidencyManager();
+
+    ResidencyManager(const ResidencyManager&) = delete;
+    ResidencyManager& operator=(const ResidencyManager&) = delete;
+
+    /**
+     * @brief Manage resources of dev, copying on ctx; ordinal is dev's for
+     * calDeviceGetAttribs.
+     *
+     * @return the calDeviceGetAttribs or calDeviceGetStatus result.
+     */
+    CALresult open(CALcontext ctx, CALdevice dev, CALuint ordinal);
+
+    /** Free every managed resource; none may be pinned. */
+    void close();
+
+    void setParams(const ResidencyParams& params) { m_params = params; }
+    const ResidencyParams& params() const { return m_params; }
+
+    /**
+     * @brief Allocate a resource of shape on the opened device.
+     *
+     * shape.remote asks for remote memory, which is never evicted or
+     * substituted; other requests are placed as described above.
+     *
+     * @return CAL_RESULT_OK, or the last allocation result with *id 0.
+     */
+    CALresult alloc(ResidentId* id, const ResourceShape& shape);
+
+    /** Free a resource; it must not be pinned. */
+    CALresult free(ResidentId id);
+
+    /**
+     * @brief Mark id used, move it back to local memory when it was
+     * evicted and there is room, and keep it in place until unpin().
+     *
+     * Pins nest. A failed page-in leaves the resource where it is.
+     *
+     * @return CAL_RESULT_OK and the resource, or CAL_RESULT_BAD_HANDLE.
+     */
+    CALresult pin(ResidentId id, CALresource* res);
+
+    CALresult unpin(ResidentId id);
+
+    /**
+     * @brief Evict unpinned local resources, least recently pinned first,
+     * until bytes were moved or none is left. A resource goes to the
+     * other remote heap when its own has no room.
+     *
+     * @return CAL_RESULT_OK, or the first failing allocation, copy or wait.
+     */
+    CALresult evict(CALuint64 bytes, CALuint64* evicted = 0);
+
+    /** Refresh the heap status from calDeviceGetStatus now. */
+    CALresult poll();
+
+    /** Heap id lives in, ResidencyHeapCount for a bad handle. */
+    ResidencyHeap heapOf(ResidentId id) const;
+
+    ResidencyHeapStatus heapStatus(ResidencyHeap heap) const { return m_heaps[heap]; }
+    ResidencyStats stats() const { return m_stats; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Resident
+    {
+        ResourceShape   shape;      // as requested
+        CALresource     res;
+        ResidencyHeap   heap;
+        CALuint64       bytes;
+        CALuint64       lastUse;
+        CALuint         pins;
+    };
+
+    CALresult maybePoll();
+    bool fits(ResidencyHeap heap, CALuint64 bytes) const;
+    ResidencyHeap remoteHeap(const ResourceShape& shape) const;
+    CALresult allocate(const ResourceShape& shape, ResidencyHeap heap, CALresource& res);
+    CALresult place(const ResourceShape& shape, CALuint64 bytes, ResidencyHeap& heap, CALresource& res);
+    CALuint64 evictable() const;
+    CALresult move(Resident& r, ResidencyHeap to);
+    void track(ResidencyHeap heap, CALuint64 bytes);
+    void untrack(ResidencyHeap heap, CALuint64 bytes);
+
+    ResidencyParams     m_params;
+    CALcontext          m_ctx;
+    CALdevice           m_dev;
+    EventWaiter         m_waiter;
+
+    std::unordered_map<ResidentId, Resident> m_residents;
+    ResidentId          m_nextId;
+    CALuint64           m_clock;        // pin() count, orders resources by last use
+
+    ResidencyHeapStatus m_heaps[ResidencyHeapCount];
+    CALuint             m_sincePoll;
+    Clock::time_point   m_lastPoll;
+    ResidencyStats      m_stats;
+};
+
+} // namespace cal
+
+#endif // __CAL_RESIDENCY_H__
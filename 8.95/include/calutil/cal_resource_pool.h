@@ -0,0 +1,243 @@
+/**
+ *  @file     cal_resource_pool.h
+ *  @brief    CAL utility size-bucketed resource pool
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_RESOURCE_POOL_H__
+#define __CAL_RESOURCE_POOL_H__
+
+#include "cal.h"
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace cal {
+
+class ResourcePool;
+
+/**
+ * @brief Allocation parameters of a pooled resource.
+ *
+ * Resources with equal shapes are interchangeable, so the shape is the key
+ * of a pool bucket.
+ */
+struct ResourceShape
+{
+    CALdevice   dev;
+    bool        remote;     ///< calResAllocRemote* on dev alone, else calResAllocLocal*
+    CALformat   format;
+    CALuint     width;
+    CALuint     height;     ///< 0 for a 1D resource
+    CALuint     flags;      ///< CALresallocflags
+
+    ResourceShape()
+        : dev(0), remote(false), format(CAL_FORMAT_UNORM_INT8_1), width(0), height(0), flags(0) {}
+
+    ResourceShape(CALdevice d, bool r, CALformat f, CALuint w, CALuint h = 0, CALuint fl = 0)
+        : dev(d), remote(r), format(f), width(w), height(h), flags(fl) {}
+
+    /** Bytes the resource occupies, ignoring pitch padding. */
+    CALuint64 bytes() const;
+
+    bool operator<(const ResourceShape& other) const;
+    bool operator==(const ResourceShape& other) const;
+};
+
+/**
+ * @brief Move-only owner of a resource taken from a ResourcePool.
+ *
+ * Destroying or resetting the handle gives the resource back to the pool
+ * instead of freeing it. The resource must be unmapped and no longer be
+ * used by a context (calCtxReleaseMem) by then; a handle must not outlive
+ * its pool.
+ */
+class PooledResource
+{
+public:
+    PooledResource() : m_pool(0), m_res(0) {}
+    ~PooledResource() { reset(); }
+
+    PooledResource(PooledResource&& other);
+    PooledResource& operator=(PooledResource&& other);
+
+    PooledResource(const PooledResource&) = delete;
+    PooledResource& operator=(const PooledResource&) = delete;
+
+    CALresource get() const { return m_res; }
+    const ResourceShape& shape() const { return m_shape; }
+    explicit operator bool() const { return m_res != 0; }
+
+    /** Give the resource back to the pool. */
+    void reset();
+
+    /** Take ownership away from the pool; the caller calls calResFree. */
+    CALresource detach();
+
+private:
+    friend class ResourcePool;
+
+    PooledResource(ResourcePool* pool, const ResourceShape& shape, CALresource res)
+        : m_pool(pool), m_res(res), m_shape(shape) {}
+
+    ResourcePool*   m_pool;
+    CALresource     m_res;
+    ResourceShape   m_shape;
+};
+
+/** Tunables of a ResourcePool; 0 disables a limit. */
+struct ResourcePoolParams
+{
+    CALuint maxCachedMB;        ///< idle resources kept across all shapes
+    CALuint maxPerShape;        ///< idle resources kept per shape
+    CALuint minFreeLocalMB;     ///< trim a device's local cache when less local RAM is free
+    CALuint minFreeRemoteMB;    ///< trim a device's remote cache when less remote RAM is free
+    CALuint checkInterval;      ///< allocations between calDeviceGetStatus checks
+
+    ResourcePoolParams()
+        : maxCachedMB(256), maxPerShape(16), minFreeLocalMB(64), minFreeRemoteMB(64), checkInterval(32) {}
+};
+
+/** Counters since the pool was created. */
+struct ResourcePoolStats
+{
+    CALuint64   hits;           ///< acquires served from the cache
+    CALuint64   misses;         ///< acquires that allocated
+    CALuint64   retries;        ///< failed allocations retried after trimming
+    CALuint64   trims;          ///< resources freed by the limits and memory pressure
+    CALuint64   cachedBytes;    ///< idle resources held now
+    CALuint     cachedCount;
+    CALuint     outstanding;    ///< resources handed out now
+};
+
+/**
+ * @brief Recycles calResAllocLocal1D/2D and calResAllocRemote1D/2D
+ * allocations.
+ *
+ * Allocating and freeing resources goes through the kernel driver and is
+ * far more expensive than the work done on small resources. The pool keeps
+ * released resources in buckets keyed by ResourceShape and hands them out
+ * again, most recently released first. Idle resources are freed least
+ * recently released first when the pool exceeds maxCachedMB or maxPerShape,
+ * and when calDeviceGetStatus reports less than minFreeLocalMB or
+ * minFreeRemoteMB free on their device; the status is checked every
+ * checkInterval allocations and whenever an allocation fails, in which
+ * case the allocation is retried once after trimming.
+ *
+ * Remote resources are allocated for their device alone. All methods may
+ * be called from any thread; resource allocation is not bound to a
+ * context, so no runtime thread restriction applies.
+ */
+class ResourcePool
+{
+public:
+    explicit ResourcePool(const ResourcePoolParams& params = ResourcePoolParams());
+
+    /** Frees the idle resources; handed out resources must be back by now. */
+    ~ResourcePool();
+
+    ResourcePool(const ResourcePool&) = delete;
+    ResourcePool& operator=(const ResourcePool&) = delete;
+
+    void setParams(const ResourcePoolParams& params);
+    ResourcePoolParams params() const;
+
+    /**
+     * @brief Take a resource of the given shape, allocating one on a miss.
+     *
+     * @return CAL_RESULT_OK, or the allocation result with out left empty.
+     */
+    CALresult acquire(PooledResource& out, const ResourceShape& shape);
+
+    CALresult local1D(PooledResource& out, CALdevice dev, CALuint width, CALformat format, CALuint flags = 0);
+    CALresult local2D(PooledResource& out, CALdevice dev, CALuint width, CALuint height, CALformat format, CALuint flags = 0);
+    CALresult remote1D(PooledResource& out, CALdevice dev, CALuint width, CALformat format, CALuint flags = 0);
+    CALresult remote2D(PooledResource& out, CALdevice dev, CALuint width, CALuint height, CALformat format, CALuint flags = 0);
+
+    /**
+     * @brief Allocate idle resources until count of the shape are cached.
+     *
+     * Pre-warming the shapes a frame uses moves the allocations out of the
+     * first frame. Limits apply as usual.
+     */
+    CALresult prewarm(const ResourceShape& shape, CALuint count);
+
+    /** Free idle resources until at most targetBytes are cached; returns bytes freed. */
+    CALuint64 trim(CALuint64 targetBytes);
+
+    /**
+     * @brief Query calDeviceGetStatus for dev and free its idle resources
+     * as far as needed to get back above the free memory thresholds.
+     */
+    CALresult checkPressure(CALdevice dev);
+
+    /** Free every idle resource. */
+    void clear();
+
+    ResourcePoolStats stats() const;
+
+private:
+    friend class PooledResource;
+
+    struct Idle
+    {
+        CALresource res;
+        CALuint64   stamp;      // release order, for least recently released first
+    };
+
+    typedef std::map<ResourceShape, std::vector<Idle> > Buckets;
+    typedef std::function<bool(const ResourceShape&)> ShapeFilter;
+
+    void release(const ResourceShape& shape, CALresource res);
+    void forget(const ResourceShape& shape);
+    CALresult allocate(const ResourceShape& shape, CALresource& res);
+    CALuint64 takeLocked(CALuint64 bytes, const ShapeFilter& filter, std::vector<std::pair<ResourceShape, Idle> >& victims);
+    void freeVictims(std::vector<std::pair<ResourceShape, Idle> >& victims);
+
+    mutable std::mutex  m_lock;
+    ResourcePoolParams  m_params;
+    Buckets             m_idle;
+    CALuint64           m_stamp;
+    CALuint64           m_cachedBytes;
+    CALuint             m_cachedCount;
+    CALuint             m_outstanding;
+    CALuint             m_sinceCheck;   // allocations since the last pressure check
+
+    CALuint64           m_hits;
+    CALuint64           m_misses;
+    CALuint64           m_retries;
+    CALuint64           m_trims;
+};
+
+} // namespace cal
+
+#endif // __CAL_RESOURCE_POOL_H__
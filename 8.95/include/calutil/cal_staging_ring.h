@@ -0,0 +1,186 @@
+/**
+ *  @file     cal_staging_ring.h
+ *  @brief    CAL utility persistent-mapped upload staging ring
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_STAGING_RING_H__
+#define __CAL_STAGING_RING_H__
+
+#include "cal.h"
+
+#include <atomic>
+#include <memory>
+
+namespace cal {
+
+struct StagingSlot;
+
+/** Byte range reserved in a StagingRing; write size bytes at ptr, then commit. */
+struct StagingRange
+{
+    CALvoid*    ptr;        ///< mapped address of the range
+    CALuint     offset;     ///< byte offset of the range in the ring resource
+    CALuint     size;
+    CALuint     ticket;     ///< reservation order, identifies the range to the ring
+};
+
+/** Counters of a StagingRing. */
+struct StagingRingStats
+{
+    CALuint64   reserves;       ///< ranges reserved
+    CALuint64   full;           ///< reserves refused for lack of space
+    CALuint64   copies;         ///< calMemCopyRaw calls issued
+    CALuint64   bytes;          ///< bytes copied
+    CALuint64   paddingBytes;   ///< bytes skipped at the end of the ring to keep ranges contiguous
+};
+
+/**
+ * @brief Streams host data to device memory through a ring in remote
+ * memory that stays mapped.
+ *
+ * Mapping and unmapping a resource per upload costs more than copying a
+ * few kilobytes. The ring allocates one CAL_RESALLOC_PERSISTENT remote
+ * buffer, maps it once for its whole lifetime and hands out byte ranges of
+ * it. Producers reserve a range without locks, write it in place and
+ * commit it with a destination; flush() copies committed ranges to their
+ * destinations with calMemCopyRaw, in reservation order, and reclaims the
+ * space of ranges whose copy event is done.
+ *
+ * reserve(), commit() and cancel() may be called from any thread. open(),
+ * flush(), reclaim() and close() use the context and must be called from
+ * one thread at a time; the runtime must not run with
+ * CAL_CONFIG_THREAD_SAFE_OFF if that is not the thread that created the
+ * context. Needs CAL_PRIVATE_EXT_MEMCOPY_RAW resolved by calExtTableInit.
+ */
+class StagingRing
+{
+public:
+    StagingRing();
+
+    /** close() */
+    ~StagingRing();
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    /**
+     * @brief Allocate and map the ring.
+     *
+     * @param bytes     - ring size, rounded up to a power of two (at most 2 GB).
+     * @param slots     - ranges in flight at once, rounded up to a power of two.
+     * @param alignment - of every range, a power of two; 64 keeps producers
+     *                    off each other's cache lines.
+     *
+     * @return CAL_RESULT_NOT_SUPPORTED without calMemCopyRaw, else the first
+     *         failing allocation, map or calCtxGetMem result.
+     */
+    CALresult open(CALcontext ctx, CALdevice dev, CALuint bytes, CALuint slots = 1024, CALuint alignment = 64);
+
+    /** Copy everything committed, wait for all copies and free the ring. */
+    void close();
+
+    /**
+     * @brief Reserve size contiguous bytes.
+     *
+     * @return CAL_RESULT_OK, CAL_RESULT_BUSY while the ring or the slots are
+     *         full (flush and retry), or CAL_RESULT_INVALID_PARAMETER for a
+     *         size of 0 or larger than the ring.
+     */
+    CALresult reserve(CALuint size, StagingRange& range);
+
+    /** Queue the range for a copy of size bytes to dstOffset in dstMem, a CALmem of the ring's context. */
+    void commit(const StagingRange& range, CALmem dstMem, CALuint dstOffset);
+
+    /** Give up a reserved range without copying it. */
+    void cancel(const StagingRange& range);
+
+    /**
+     * @brief reserve, memcpy and commit in one call.
+     *
+     * @return the reserve result.
+     */
+    CALresult upload(const CALvoid* data, CALuint size, CALmem dstMem, CALuint dstOffset);
+
+    /**
+     * @brief Issue copies for the committed ranges, flush the context if
+     * any were issued, then reclaim().
+     *
+     * Copies go out in reservation order, so a range that is reserved but
+     * not yet committed holds back the ones after it.
+     *
+     * @return CAL_RESULT_OK, or the first failing calMemCopyRaw result; the
+     *         failed range is dropped.
+     */
+    CALresult flush();
+
+    /** Free the space of ranges whose copy completed; returns bytes freed. */
+    CALuint64 reclaim();
+
+    /** Event of the last copy issued, 0 before the first. */
+    CALevent lastEvent() const { return m_lastEvent; }
+
+    /** Ring size in bytes, 0 while closed. */
+    CALuint capacity() const { return m_capacity; }
+
+    /** Bytes reserved and not yet reclaimed, including padding. */
+    CALuint64 used() const;
+
+    StagingRingStats stats() const;
+
+private:
+    CALuint64 reclaimRanges(bool wait);
+
+    CALcontext                      m_ctx;
+    CALresource                     m_res;
+    CALmem                          m_mem;
+    CALubyte*                       m_base;
+    CALuint                         m_capacity;     // power of two
+    CALuint                         m_alignment;
+    CALuint                         m_slotCount;    // power of two
+    std::unique_ptr<StagingSlot[]>  m_slots;
+
+    // Reservations: ticket in the high bits, ring position in the low bits
+    std::atomic<CALuint64>          m_head;
+    std::atomic<CALuint64>          m_tail;         // ring position reclaimed up to
+    std::atomic<CALuint>            m_reclaimed;    // ticket reclaimed up to
+    CALuint                         m_issued;       // ticket issued up to; flush thread only
+    CALevent                        m_lastEvent;
+
+    std::atomic<CALuint64>          m_reserves;
+    std::atomic<CALuint64>          m_full;
+    std::atomic<CALuint64>          m_padding;
+    std::atomic<CALuint64>          m_copies;
+    std::atomic<CALuint64>          m_bytes;
+};
+
+} // namespace cal
+
+#endif // __CAL_STAGING_RING_H__
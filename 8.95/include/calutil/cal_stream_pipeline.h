@@ -0,0 +1,200 @@
+/**
+ *  @file     cal_stream_pipeline.h
+ *  @brief    CAL utility upload, compute and download pipeline
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_STREAM_PIPELINE_H__
+#define __CAL_STREAM_PIPELINE_H__
+
+#include "cal.h"
+#include "cal_event_waiter.h"
+#include "cal_resource_pool.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace cal {
+
+/** Stages an item passes through in a StreamPipeline. */
+enum PipelineStage
+{
+    StageFill = 0,          ///< host writes the mapped input
+    StageCompute,           ///< device runs the work issued by the compute function
+    StageDownload,          ///< device copies the output to the readback buffer
+    StageConsume,           ///< host reads the mapped readback buffer
+    StageCount
+};
+
+/** Buffers of one pipeline slot; slot index handles items index, index + depth, ... */
+struct PipelineSlot
+{
+    CALuint     index;
+    CALuint64   item;           ///< item currently in the slot, counted from 0
+    CALresource input;          ///< remote, mapped for the fill function
+    CALresource output;         ///< written by the compute work
+    CALresource readback;       ///< remote copy of output, mapped for the consume function
+    CALmem      inputMem;
+    CALmem      outputMem;
+    CALmem      readbackMem;
+};
+
+/** Shape of a StreamPipeline. */
+struct PipelineConfig
+{
+    CALuint         depth;      ///< slots, at least 2; 3 overlaps all stages
+    ResourceShape   input;      ///< dev is taken from open()
+    ResourceShape   output;     ///< readback buffers are remote resources of the same shape
+    CALfunc         func;       ///< the kernel the compute function runs, for wait estimates
+
+    PipelineConfig() : depth(3), func(0) {}
+};
+
+/** Timing of the last StreamPipeline::run. */
+struct PipelineStats
+{
+    CALuint64       items;
+    double          seconds;
+    double          occupancy[StageCount];      ///< fraction of the run a stage held at least one item
+    double          meanItems[StageCount];      ///< items in a stage, averaged over the run
+    double          waitSeconds;                ///< run() blocked with nothing to do
+    PipelineStage   bottleneck;                 ///< stage with the highest occupancy
+};
+
+/** Fill the mapped input of slot; return false at the end of the stream. */
+typedef std::function<bool(PipelineSlot& slot, CALvoid* ptr, CALuint pitch)> PipelineFill;
+
+/** Issue the work of slot (calCtxSetMem, calCtxRunProgramGrid) and return its event. */
+typedef std::function<CALresult(PipelineSlot& slot, CALevent& event)> PipelineCompute;
+
+/** Read the mapped readback buffer of slot. */
+typedef std::function<void(const PipelineSlot& slot, const CALvoid* ptr, CALuint pitch)> PipelineConsume;
+
+/**
+ * @brief Overlaps host fill, device compute and readback of a stream of
+ * items over a ring of buffer slots.
+ *
+ * While the device computes item N, the host fills item N + 1 and the
+ * readback copy of item N - 1 runs. Stages hand items over through
+ * CALevents only: a slot moves on once the event of its current stage is
+ * done, items stay in order in every stage, and run() blocks in an
+ * EventWaiter only when no stage can make progress. The stats show which
+ * stage held items for the largest part of the run; that stage limits the
+ * throughput.
+ *
+ * A device stage ends when its event completes, not when run() gets to
+ * it. run() polls every event in flight right before and after each fill,
+ * and dates a completion halfway between the last poll that saw the event
+ * pending and the one that saw it done, so a slow fill does not lengthen
+ * the compute and download times.
+ *
+ * All calls must come from the thread that created the context.
+ */
+class StreamPipeline
+{
+public:
+    StreamPipeline();
+
+    /** close() */
+    ~StreamPipeline();
+
+    StreamPipeline(const StreamPipeline&) = delete;
+    StreamPipeline& operator=(const StreamPipeline&) = delete;
+
+    /**
+     * @brief Allocate the slot buffers on dev and bind them to ctx.
+     *
+     * @return CAL_RESULT_INVALID_PARAMETER for a depth below 2, else the
+     *         first failing allocation or calCtxGetMem result.
+     */
+    CALresult open(CALcontext ctx, CALdevice dev, const PipelineConfig& config);
+
+    /** Release the slot buffers. */
+    void close();
+
+    /**
+     * @brief Stream items until fill returns false and every item was consumed.
+     *
+     * @return CAL_RESULT_OK, or the first failing compute, copy, map or
+     *         event result; the items in flight are waited for first.
+     */
+    CALresult run(const PipelineFill& fill, const PipelineCompute& compute, const PipelineConsume& consume);
+
+    const PipelineConfig& config() const { return m_config; }
+    PipelineStats stats() const { return m_stats; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum SlotState
+    {
+        SlotFree = 0,
+        SlotFilled,
+        SlotComputing,
+        SlotDownloading
+    };
+
+    struct Slot
+    {
+        PipelineSlot    buffers;
+        SlotState       state;
+        CALevent        event;
+        bool            finished;       // event seen done
+        Clock::time_point since;        // entered the current stage
+        Clock::time_point pending;      // event last seen pending
+        Clock::time_point finishedAt;   // estimated completion of the event
+        PooledResource  input;
+        PooledResource  output;
+        PooledResource  readback;
+    };
+
+    CALresult poll(Slot& slot);
+    CALresult observe();
+    CALresult done(Slot& slot, bool& finished);
+    void issued(Slot& slot, SlotState state);
+    void leave(PipelineStage stage, Clock::time_point since, Clock::time_point until);
+    CALresult drain();
+
+    CALcontext          m_ctx;
+    PipelineConfig      m_config;
+    ResourcePool        m_pool;
+    std::vector<Slot>   m_slots;
+    EventWaiter         m_waiter;
+
+    double              m_busy[StageCount];     // seconds with an item in the stage
+    double              m_itemSeconds[StageCount];
+    Clock::time_point   m_lastLeave[StageCount];
+    PipelineStats       m_stats;
+};
+
+} // namespace cal
+
+#endif // __CAL_STREAM_PIPELINE_H__
@@ -0,0 +1,102 @@
+/**
+ *  @file     cal_thread_pool.h
+ *  @brief    CAL utility worker thread pool
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_THREAD_POOL_H__
+#define __CAL_THREAD_POOL_H__
+
+#include "cal.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cal {
+
+/**
+ * @brief Fixed size pool of worker threads used for data parallel loops.
+ *
+ * Several threads may call parallelFor concurrently; their jobs share the
+ * workers and the calling thread always participates in its own job, so a
+ * pool with zero workers degenerates to a serial loop.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @param threadCount (in) - number of workers. Zero selects the number
+     *        of hardware threads minus one (the caller is the last worker).
+     */
+    explicit ThreadPool(CALuint threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Number of worker threads, not counting callers of parallelFor. */
+    CALuint threadCount() const { return static_cast<CALuint>(m_workers.size()); }
+
+    /**
+     * @brief Invoke fn(i) for every i in [0, count) and wait for completion.
+     *
+     * Indices are claimed in chunks of <i>grain</i> so cheap bodies do not
+     * bounce the shared counter between cores.
+     */
+    void parallelFor(CALuint count, const std::function<void(CALuint)>& fn, CALuint grain = 1);
+
+    /**
+     * @brief Process wide pool.
+     *
+     * Sized by the CAL_THREAD_POOL_SIZE environment variable when set,
+     * otherwise by the hardware thread count.
+     */
+    static ThreadPool& shared();
+
+private:
+    struct Job;
+
+    void workerMain();
+    static void runChunks(Job& job);
+
+    std::vector<std::thread> m_workers;
+    std::deque<Job*>         m_jobs;
+    std::mutex               m_lock;
+    std::condition_variable  m_wake;
+    bool                     m_exit;
+};
+
+} // namespace cal
+
+#endif // __CAL_THREAD_POOL_H__
@@ -0,0 +1,93 @@
+/**
+ *  @file     cal_trace.h
+ *  @brief    CAL call trace file format
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_TRACE_H__
+#define __CAL_TRACE_H__
+
+#include "cal.h"
+#include "cal_api_id.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A trace file is one CALtraceHeader followed by CALtraceRecord entries.
+ * Records of one thread are in call order; records of different threads
+ * are interleaved in drain order, so sort by begin when a global order is
+ * needed.
+ *
+ * args[] hold the parameters in declaration order, 64 bit each. Out
+ * parameters hold the value the call wrote (the new handle or event), or
+ * zero when the call failed. Pointers to input structures are summarised:
+ *
+ *     calCtxRunProgram           event, ctx, func, width | height << 32, x | y << 32
+ *     calCtxRunProgramGrid       event, ctx, func, groups (product of gridSize), threads per group
+ *     calCtxRunProgramGridArray  event, ctx, num, func of the first grid, flags
+ *     calCtxWaitForEvents        ctx, n, flags, newest event in the list
+ *     calMemCopyRaw              event, ctx, srcMem, dstMem, size
+ *     calMemCopyPartial          event, ctx, srcMem, dstMem, width | height << 32
+ *     calResMap                  mapped pointer, pitch, res, flags
+ *
+ * Records with api CAL_API_NONE are markers: args[0] is the number of
+ * records the thread dropped because its ring was full.
+ */
+
+#define CAL_TRACE_MAGIC     "CALTRACE"
+#define CAL_TRACE_VERSION   1
+
+typedef struct CALtraceHeaderRec {
+    CALchar   magic[8];     /**< CAL_TRACE_MAGIC, not NUL terminated */
+    CALuint   version;      /**< CAL_TRACE_VERSION */
+    CALuint   recordSize;   /**< sizeof(CALtraceRecord) */
+    CALuint64 tscHz;        /**< Timestamp ticks per second */
+    CALuint64 startTsc;     /**< Timestamp when tracing started */
+    CALuint64 startTimeNs;  /**< Wall clock at startTsc, nanoseconds since the epoch */
+    CALuint   pid;          /**< Traced process */
+    CALuint   reserved;
+} CALtraceHeader;
+
+typedef struct CALtraceRecordRec {
+    CALuint64 begin;        /**< Timestamp before forwarding the call */
+    CALuint64 end;          /**< Timestamp after the call returned */
+    CALuint   thread;       /**< OS thread id of the caller */
+    CALushort api;          /**< CALapiId */
+    CALushort result;       /**< CALresult of the call */
+    CALuint64 args[5];      /**< See above */
+} CALtraceRecord;
+
+#ifdef __cplusplus
+}      /* extern "C" { */
+#endif
+
+#endif // __CAL_TRACE_H__
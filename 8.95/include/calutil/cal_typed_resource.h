@@ -0,0 +1,219 @@
+/**
+ *  @file     cal_typed_resource.h
+ *  @brief    CAL utility resources typed by their host element type
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+
+
+
+#ifndef __CAL_TYPED_RESOURCE_H__
+#define __CAL_TYPED_RESOURCE_H__
+
+#include "cal.h"
+#include "cal_copy.h"
+#include "cal_format.h"
+
+#include <cstddef>
+
+namespace cal {
+
+/**
+ * @brief Move-only owner of a resource of elements of host type T.
+ *
+ * The resource format is FormatOf<T>, fixed at compile time, so the width
+ * passed to the allocation is always a count of T and the copies move
+ * sizeof(T) byte elements without looking the format up. Base of Buffer
+ * and Image2D, which add the allocation.
+ */
+template <typename T>
+class TypedResource
+{
+public:
+    static constexpr CALformat format = FormatOf<T>::value;
+    static_assert(sizeof(T) == formatElementSize(FormatOf<T>::value), "T must be packed like its format");
+
+    ~TypedResource() { reset(); }
+
+    TypedResource(const TypedResource&) = delete;
+    TypedResource& operator=(const TypedResource&) = delete;
+
+    CALresource get() const { return m_res; }
+    explicit operator bool() const { return m_res != 0; }
+
+    CALuint width() const { return m_width; }
+    CALuint height() const { return m_height; }
+
+    /** Bytes of the elements, without row padding. */
+    size_t bytes() const { return static_cast<size_t>(m_width) * m_height * sizeof(T); }
+
+    /** calResMap, with the pitch in elements of T. */
+    CALresult map(T** data, CALuint* pitch)
+    {
+        return calResMap(reinterpret_cast<CALvoid**>(data), pitch, m_res, 0);
+    }
+
+    CALresult unmap() { return calResUnmap(m_res); }
+
+    /**
+     * @brief Copy width x height packed elements from src into the resource
+     * through a map; flags as for copyPitched, CopyStreaming for remote
+     * uncached resources.
+     */
+    CALresult write(const T* src, CALuint flags = CopyDefault)
+    {
+        T*      data;
+        CALuint pitch;
+        CALresult result = map(&data, &pitch);
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        copyPitched(data, pitch * sizeof(T), src, m_width * sizeof(T), m_width * sizeof(T), m_height, flags);
+        return unmap();
+    }
+
+    /** Copy the elements back into packed dst. */
+    CALresult read(T* dst, CALuint flags = CopyDefault)
+    {
+        T*      data;
+        CALuint pitch;
+        CALresult result = map(&data, &pitch);
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        copyPitched(dst, m_width * sizeof(T), data, pitch * sizeof(T), m_width * sizeof(T), m_height, flags);
+        return unmap();
+    }
+
+    void reset()
+    {
+        if (m_res)
+        {
+            calResFree(m_res);
+        }
+        m_res    = 0;
+        m_width  = 0;
+        m_height = 0;
+    }
+
+protected:
+    TypedResource() : m_res(0), m_width(0), m_height(0) {}
+
+    TypedResource(TypedResource&& other) : m_res(other.m_res), m_width(other.m_width), m_height(other.m_height)
+    {
+        other.m_res = 0;
+    }
+
+    TypedResource& operator=(TypedResource&& other)
+    {
+        if (this != &other)
+        {
+            reset();
+            m_res       = other.m_res;
+            m_width     = other.m_width;
+            m_height    = other.m_height;
+            other.m_res = 0;
+        }
+        return *this;
+    }
+
+    // Take res when it was allocated
+    CALresult adopt(CALresult result, CALresource res, CALuint width, CALuint height)
+    {
+        if (result == CAL_RESULT_OK)
+        {
+            reset();
+            m_res    = res;
+            m_width  = width;
+            m_height = height;
+        }
+        return result;
+    }
+
+    CALresource m_res;
+    CALuint     m_width;
+    CALuint     m_height;
+};
+
+/** 1D resource of count elements of T. */
+template <typename T>
+class Buffer : public TypedResource<T>
+{
+public:
+    Buffer() {}
+    Buffer(Buffer&&) = default;
+    Buffer& operator=(Buffer&&) = default;
+
+    CALresult allocLocal(CALdevice dev, CALuint count, CALuint flags = 0)
+    {
+        CALresource res = 0;
+        CALresult result = calResAllocLocal1D(&res, dev, count, this->format, flags);
+        return this->adopt(result, res, count, 1);
+    }
+
+    CALresult allocRemote(CALdevice dev, CALuint count, CALuint flags = 0)
+    {
+        CALresource res = 0;
+        CALresult result = calResAllocRemote1D(&res, &dev, 1, count, this->format, flags);
+        return this->adopt(result, res, count, 1);
+    }
+
+    CALuint size() const { return this->m_width; }
+};
+
+/** 2D resource of width x height elements of T. */
+template <typename T>
+class Image2D : public TypedResource<T>
+{
+public:
+    Image2D() {}
+    Image2D(Image2D&&) = default;
+    Image2D& operator=(Image2D&&) = default;
+
+    CALresult allocLocal(CALdevice dev, CALuint width, CALuint height, CALuint flags = 0)
+    {
+        CALresource res = 0;
+        CALresult result = calResAllocLocal2D(&res, dev, width, height, this->format, flags);
+        return this->adopt(result, res, width, height);
+    }
+
+    CALresult allocRemote(CALdevice dev, CALuint width, CALuint height, CALuint flags = 0)
+    {
+        CALresource res = 0;
+        CALresult result = calResAllocRemote2D(&res, &dev, 1, width, height, this->format, flags);
+        return this->adopt(result, res, width, height);
+    }
+};
+
+} // namespace cal
+
+#endif // __CAL_TYPED_RESOURCE_H__
@@ -0,0 +1,164 @@
+/**
+ *  @file     calsw.h
+ *  @brief    CAL Software Driver Interface Header
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CALSW_H__
+#define __CALSW_H__
+
+#include <string.h>
+
+#include "calddi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#define CALAPI
+#else
+#define CALAPI extern
+#endif
+
+#ifdef _WIN32
+#define CALAPIENTRY  __stdcall
+#else
+#define CALAPIENTRY
+#endif
+
+/*
+ * The software driver implements every calddi_if export against host memory.
+ * Built as libaticaldd.so (aticaldd.dll) it is picked up by the stock runtime
+ * and compiler libraries, so calInit, resources, contexts, modules, events and
+ * copies all work on hosts without a GPU.
+ *
+ * Kernels cannot be executed from IL, so every IL entry point is bound to a
+ * native CPU function registered with calswRegisterKernel. The binding is
+ * declared with a comment line in the IL source:
+ *
+ *     ; @calsw kernel <registered name>
+ *
+ * Module variable names ("i0", "o0", "cb0", "uav0", "g[]") are taken from the
+ * IL declarations so calModuleGetName and calCtxSetMem behave as on hardware.
+ *
+ * Environment:
+ *     CALSW_DEVICE_COUNT - number of devices reported (default 1)
+ *     CALSW_LOCAL_RAM_MB - local RAM reported per device (default 1024)
+ *     CALSW_HEAP_MB      - size of the CAL_HEAP_GLOBAL heap (default 64)
+ *     CAL_THREAD_POOL_SIZE - kernel worker threads (default hardware threads)
+ */
+
+/** Memory bound to one module variable for the duration of a dispatch */
+typedef struct CALswBindingRec {
+    const CALchar* name;            /**< Module variable name, e.g. "i0", "o0", "cb0", "uav0", "g[]" */
+    CALvoid*       data;            /**< Host address of element (0,0) */
+    CALuint        width;           /**< Width in elements */
+    CALuint        height;          /**< Height in rows */
+    CALuint        pitch;           /**< Row pitch in elements */
+    CALuint        elementSize;     /**< Size of one element in bytes */
+    CALformat      format;          /**< Element format */
+} CALswBinding;
+
+/** Description of the thread group a native kernel is invoked for */
+typedef struct CALswDispatchRec {
+    CALuint             groupId[3];     /**< Index of the thread group being executed */
+    CALuint             groupSize[3];   /**< Threads per group (CALprogramGrid::gridBlock) */
+    CALuint             gridSize[3];    /**< Groups in the dispatch (CALprogramGrid::gridSize) */
+    CALuint             origin[3];      /**< Domain origin for calCtxRunProgram, zero for grids */
+    const CALswBinding* bindings;       /**< Memory bound to the module variables */
+    CALuint             bindingCount;   /**< Number of entries in bindings */
+} CALswDispatch;
+
+/**
+ * Native kernel entry point. Invoked once per thread group, possibly from
+ * several pool threads at the same time.
+ */
+typedef CALvoid (*CALswKernel)(const CALswDispatch* dispatch, CALvoid* userData);
+
+/**
+ * @fn calswRegisterKernel(const CALchar* name, CALswKernel kernel, CALvoid* userData)
+ *
+ * @brief Register a native kernel that IL entry points can be bound to.
+ *
+ * Registering an existing name replaces the previous kernel. Registration
+ * may happen before calInit and is resolved when a program is dispatched.
+ *
+ * @param name (in) - name used by the "; @calsw kernel" IL annotation.
+ * @param kernel (in) - native entry point.
+ * @param userData (in) - opaque pointer passed back to the kernel.
+ *
+ * @return Returns CAL_RESULT_OK on success, CAL_RESULT_INVALID_PARAMETER if name or kernel is NULL.
+ *
+ * @sa calswUnregisterKernel
+ */
+CALAPI CALresult CALAPIENTRY calswRegisterKernel(const CALchar* name, CALswKernel kernel, CALvoid* userData);
+
+/**
+ * @fn calswUnregisterKernel(const CALchar* name)
+ *
+ * @brief Remove a native kernel registration.
+ *
+ * @return Returns CAL_RESULT_OK on success, CAL_RESULT_ERROR if the name was not registered.
+ *
+ * @sa calswRegisterKernel
+ */
+CALAPI CALresult CALAPIENTRY calswUnregisterKernel(const CALchar* name);
+
+/**
+ * @fn calswGetInterface(void)
+ *
+ * @brief Return the full DDI export table of the software driver.
+ *
+ * Lets tools drive the software driver directly instead of through
+ * libaticalrt, e.g. a replayer or an interposer stand-in.
+ *
+ * @return Returns a pointer to a static calddi_if table.
+ */
+CALAPI const calddi_if* CALAPIENTRY calswGetInterface(void);
+
+/**
+ * Find the binding of a module variable inside a dispatch, NULL if unbound.
+ */
+static __inline const CALswBinding* calswFindBinding(const CALswDispatch* dispatch, const CALchar* name)
+{
+    CALuint i;
+    for (i = 0; i < dispatch->bindingCount; ++i)
+    {
+        if (strcmp(dispatch->bindings[i].name, name) == 0)
+        {
+            return &dispatch->bindings[i];
+        }
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}      /* extern "C" { */
+#endif
+
+#endif // __CALSW_H__
@@ -0,0 +1,267 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+//
+// calbench_copy [-w width] [-h height] [-f bytes] [-n reps] [-r]
+//
+// Measures packed host to pitched surface copies through cal::copyPitched,
+// cached and with the streaming kernels of every supported instruction
+// set, each with and without row partitioning, against a plain memcpy per
+// row. The surface is
+// host memory padded like a calResMap pitch, or with -r a remote resource
+// mapped through calResMap on device 0.
+//
+
+#include "cal_copy.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    CALuint width;
+    CALuint height;
+    CALuint elementSize;
+    CALuint reps;
+    bool    remote;
+};
+
+struct Surface
+{
+    CALubyte*               base;
+    size_t                  pitchBytes;
+    std::vector<CALubyte>   host;       // backing store without -r
+    CALdevice               dev;
+    CALresource             res;
+};
+
+CALformat
+formatOf(CALuint elementSize)
+{
+    switch (elementSize)
+    {
+    case 1:  return CAL_FORMAT_UNSIGNED_INT8_1;
+    case 2:  return CAL_FORMAT_UNSIGNED_INT16_1;
+    case 8:  return CAL_FORMAT_UNSIGNED_INT32_2;
+    case 16: return CAL_FORMAT_UNSIGNED_INT32_4;
+    default: return CAL_FORMAT_UNSIGNED_INT32_1;
+    }
+}
+
+bool
+openSurface(const Options& options, Surface& surface)
+{
+    surface.dev = 0;
+    surface.res = 0;
+    if (!options.remote)
+    {
+        // Pad rows to 256 elements like a typical pitch_alignment
+        CALuint pitch      = (options.width + 255) & ~255u;
+        surface.pitchBytes = static_cast<size_t>(pitch) * options.elementSize;
+        surface.host.resize(surface.pitchBytes * options.height + 64);
+        surface.base       = &surface.host[0] + ((64 - (reinterpret_cast<size_t>(&surface.host[0]) & 63)) & 63);
+        return true;
+    }
+
+    CALvoid* ptr;
+    CALuint  pitch;
+    if (calInit() != CAL_RESULT_OK || calDeviceOpen(&surface.dev, 0) != CAL_RESULT_OK ||
+        calResAllocRemote2D(&surface.res, &surface.dev, 1, options.width, options.height,
+                            formatOf(options.elementSize), 0) != CAL_RESULT_OK ||
+        calResMap(&ptr, &pitch, surface.res, 0) != CAL_RESULT_OK)
+    {
+        std::fprintf(stderr, "calbench_copy: cannot map a remote %ux%u surface: %s\n",
+                     options.width, options.height, calGetErrorString());
+        return false;
+    }
+    surface.base       = static_cast<CALubyte*>(ptr);
+    surface.pitchBytes = static_cast<size_t>(pitch) * options.elementSize;
+    return true;
+}
+
+void
+closeSurface(Surface& surface)
+{
+    if (surface.res)
+    {
+        calResUnmap(surface.res);
+        calResFree(surface.res);
+        calDeviceClose(surface.dev);
+        calShutdown();
+    }
+}
+
+// Best of reps, in GB/s; -1 when the copy was wrong
+double
+measure(const Options& options, Surface& surface, const std::vector<CALubyte>& src, bool plain, CALuint flags)
+{
+    size_t rowBytes = static_cast<size_t>(options.width) * options.elementSize;
+    double best     = 0;
+    for (CALuint rep = 0; rep < options.reps; ++rep)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (plain)
+        {
+            for (CALuint row = 0; row < options.height; ++row)
+            {
+                std::memcpy(surface.base + row * surface.pitchBytes, &src[row * rowBytes], rowBytes);
+            }
+        }
+        else
+        {
+            cal::copyPitched(surface.base, surface.pitchBytes, &src[0], rowBytes, rowBytes, options.height, flags);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate    = static_cast<double>(rowBytes) * options.height / seconds / 1e9;
+        best = (rate > best) ? rate : best;
+    }
+
+    for (CALuint row = 0; row < options.height; ++row)
+    {
+        if (std::memcmp(surface.base + row * surface.pitchBytes, &src[row * rowBytes], rowBytes) != 0)
+        {
+            return -1;
+        }
+    }
+    std::memset(surface.base, 0, surface.pitchBytes * options.height);
+    return best;
+}
+
+bool
+parseOptions(int argc, char** argv, Options& options)
+{
+    options.width       = 4096;
+    options.height      = 4096;
+    options.elementSize = 4;
+    options.reps        = 10;
+    options.remote      = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+        {
+            options.width = static_cast<CALuint>(std::strtoul(argv[++i], 0, 10));
+        }
+        else if (std::strcmp(argv[i], "-h") == 0 && i + 1 < argc)
+        {
+            options.height = static_cast<CALuint>(std::strtoul(argv[++i], 0, 10));
+        }
+        else if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            options.elementSize = static_cast<CALuint>(std::strtoul(argv[++i], 0, 10));
+        }
+        else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            options.reps = static_cast<CALuint>(std::strtoul(argv[++i], 0, 10));
+        }
+        else if (std::strcmp(argv[i], "-r") == 0)
+        {
+            options.remote = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    CALuint e = options.elementSize;
+    return options.width && options.height && options.reps && (e == 1 || e == 2 || e == 4 || e == 8 || e == 16);
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr, "usage: %s [-w width] [-h height] [-f bytes] [-n reps] [-r]\n"
+                             "  -w, -h  surface size in elements (default 4096 x 4096)\n"
+                             "  -f      element size: 1, 2, 4, 8 or 16 bytes (default 4)\n"
+                             "  -n      repetitions, the best one is reported (default 10)\n"
+                             "  -r      copy into a mapped remote resource instead of host memory\n", argv[0]);
+        return 2;
+    }
+
+    Surface surface;
+    if (!openSurface(options, surface))
+    {
+        return 1;
+    }
+
+    size_t rowBytes = static_cast<size_t>(options.width) * options.elementSize;
+    std::vector<CALubyte> src(rowBytes * options.height);
+    for (size_t i = 0; i < src.size(); ++i)
+    {
+        src[i] = static_cast<CALubyte>(i * 131 + (i >> 12));
+    }
+
+    static const char* isaNames[] = { "scalar", "sse2 stream", "avx2 stream", "avx512 stream" };
+    std::printf("%u x %u x %u bytes, pitch %zu bytes, %s\n", options.width, options.height, options.elementSize,
+                surface.pitchBytes, options.remote ? "remote surface" : "host surface");
+    std::printf("%-24s %8s\n", "copy", "GB/s");
+
+    double memcpyRate = measure(options, surface, src, true, 0);
+    std::printf("%-24s %8.2f\n", "memcpy per row", memcpyRate);
+
+    bool failed = memcpyRate < 0;
+    struct Variant
+    {
+        int     isa;
+        CALuint flags;
+    };
+    std::vector<Variant> variants;
+    variants.push_back(Variant{ cal::CopyIsaScalar, cal::CopyDefault });
+    variants.push_back(Variant{ cal::CopyIsaScalar, cal::CopyParallel });
+    for (int isa = cal::CopyIsaSse2; isa <= cal::copyIsaSupported(); ++isa)
+    {
+        variants.push_back(Variant{ isa, cal::CopyStreaming });
+        variants.push_back(Variant{ isa, cal::CopyStreaming | cal::CopyParallel });
+    }
+
+    for (size_t v = 0; v < variants.size(); ++v)
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "%s%s", (variants[v].flags & cal::CopyStreaming) ? isaNames[variants[v].isa] : "cached",
+                      (variants[v].flags & cal::CopyParallel) ? " parallel" : "");
+        cal::setCopyIsa(static_cast<cal::CopyIsa>(variants[v].isa));
+        double rate = measure(options, surface, src, false, variants[v].flags);
+        if (rate < 0)
+        {
+            std::printf("%-24s %8s\n", name, "WRONG");
+            failed = true;
+        }
+        else
+        {
+            std::printf("%-24s %8.2f  %5.2fx\n", name, rate, rate / memcpyRate);
+        }
+    }
+
+    closeSurface(surface);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,883 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+//
+// calreplay [-d driver] [-t] [-v] <capture.bin>
+//
+// Re-issues a command stream captured with CALTRACE_CAPTURE directly
+// through the calddi_if of a driver (libaticaldd.so unless -d is given),
+// back to back or, with -t, at the captured inter-call times. Handles are
+// remapped to the ones the driver returns.
+//
+
+#include "cal_replay.h"
+#include "cal_private_ext.h"
+#include "calddi.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+typedef std::unordered_map<CALuint64, CALuint64> HandleMap;
+
+struct Options
+{
+    const char* driver;
+    const char* file;
+    bool        timing;
+    bool        verbose;
+};
+
+struct ApiStats
+{
+    CALuint64 calls;
+    CALuint64 failures;
+    CALuint64 ns;
+};
+
+CALuint64
+steadyNs()
+{
+    return static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//
+// Read-only mapping of the capture file
+//
+class MappedFile
+{
+public:
+    MappedFile() : m_data(0), m_size(0) {}
+    ~MappedFile()
+    {
+        if (m_data)
+        {
+            munmap(m_data, m_size);
+        }
+    }
+
+    bool open(const char* path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return false;
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        m_data = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m_data == MAP_FAILED)
+        {
+            m_data = 0;
+            return false;
+        }
+        return true;
+    }
+
+    const CALubyte* data() const { return static_cast<const CALubyte*>(m_data); }
+    size_t size() const { return m_size; }
+
+private:
+    void*  m_data;
+    size_t m_size;
+};
+
+//
+// Arguments each captured api carries, see cal_replay.h; 0 for apis that
+// are never captured
+//
+CALuint
+argCount(CALuint api)
+{
+    switch (api)
+    {
+    case CAL_API_DEVICE_CLOSE:
+    case CAL_API_RES_FREE:
+    case CAL_API_CTX_DESTROY:
+    case CAL_API_CTX_FLUSH:                     return 1;
+    case CAL_API_DEVICE_OPEN:
+    case CAL_API_CTX_CREATE:
+    case CAL_API_CTX_RELEASE_MEM:
+    case CAL_API_MODULE_LOAD:
+    case CAL_API_MODULE_UNLOAD:
+    case CAL_API_CTX_RUN_PROGRAM_GRID:
+    case CAL_API_CTX_IS_EVENT_DONE:
+    case CAL_API_CTX_FLUSH_CACHE:               return 2;
+    case CAL_API_CTX_GET_MEM:
+    case CAL_API_CTX_SET_MEM:
+    case CAL_API_MODULE_GET_ENTRY:
+    case CAL_API_MODULE_GET_NAME:
+    case CAL_API_CTX_WAIT_FOR_EVENTS:           return 3;
+    case CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY:
+    case CAL_API_RES_GET_HEAP:                  return 4;
+    case CAL_API_RES_ALLOC_LOCAL_1D:
+    case CAL_API_RES_ALLOC_REMOTE_1D:
+    case CAL_API_RES_UNMAP:
+    case CAL_API_MEM_COPY:
+    case CAL_API_MEM_COPY_PARTIAL:              return 5;
+    case CAL_API_RES_ALLOC_LOCAL_2D:
+    case CAL_API_RES_ALLOC_REMOTE_2D:
+    case CAL_API_RES_CREATE_1D:                 return 6;
+    case CAL_API_RES_CREATE_2D:
+    case CAL_API_CTX_RUN_PROGRAM:               return 7;
+    case CAL_API_MEM_COPY_RAW:                  return 8;
+    case CAL_API_RES_ALLOC:                     return 12;
+    case CAL_API_RES_ALLOC_VIEW:                return 14;
+    default:                                    return 0;
+    }
+}
+
+class Replayer
+{
+public:
+    Replayer() : m_packets(0), m_failures(0), m_elapsedNs(0) { std::memset(m_stats, 0, sizeof(m_stats)); }
+
+    bool loadDriver(const char* path);
+    bool run(const MappedFile& file, bool timing);
+    void report(FILE* out, bool verbose) const;
+
+private:
+    CALresult replay(const CALreplayPacket& packet, const CALuint64* a, const CALubyte* payload);
+    CALresult applyWrites(CALresource res, const CALuint64* a, const CALubyte* payload, CALuint size);
+    CALresult waitEvent(CALcontext ctx, CALevent event);
+    bool devices(std::vector<CALdevice>& devs, const CALreplayPacket& packet, const CALubyte* payload, CALuint count) const;
+    CALextproc extProc(CALextid extid, const CALchar* name);
+
+    // Look up a captured handle, 0 when the capture never created it
+    static CALuint64 find(const HandleMap& map, CALuint64 handle)
+    {
+        HandleMap::const_iterator it = map.find(handle);
+        return (it != map.end()) ? it->second : 0;
+    }
+    static CALuint64 eventKey(CALuint64 ctx, CALuint64 event) { return (ctx << 32) | event; }
+
+    calddi_if                                   m_ddi;
+    HandleMap                                   m_devices;
+    HandleMap                                   m_resources;
+    HandleMap                                   m_contexts;
+    HandleMap                                   m_mems;
+    HandleMap                                   m_modules;
+    HandleMap                                   m_funcs;
+    HandleMap                                   m_names;
+    HandleMap                                   m_events;       // eventKey(ctx, event)
+    std::unordered_map<CALuint64, CALimage>     m_images;       // per replayed module
+    std::unordered_map<CALuint64, CALvoid*>     m_hostMemory;   // per replayed calResCreate resource
+    CALuint64                                   m_packets;
+    CALuint64                                   m_failures;
+    CALuint64                                   m_elapsedNs;
+    ApiStats                                    m_stats[CAL_API_COUNT];
+};
+
+bool
+Replayer::loadDriver(const char* path)
+{
+    void* lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!lib)
+    {
+        std::fprintf(stderr, "calreplay: %s\n", dlerror());
+        return false;
+    }
+
+    typedef int (*PFNDDIINIT)(unsigned int);
+    typedef void* (*PFNDDIGETEXPORT)(unsigned int);
+    PFNDDIINIT      ddiInit      = reinterpret_cast<PFNDDIINIT>(dlsym(lib, "calddiInit"));
+    PFNDDIGETEXPORT ddiGetExport = reinterpret_cast<PFNDDIGETEXPORT>(dlsym(lib, "calddiGetExport"));
+    if (!ddiInit || !ddiGetExport || !ddiInit(CALDDI_VERSION))
+    {
+        std::fprintf(stderr, "calreplay: %s is not a CAL driver\n", path);
+        return false;
+    }
+
+    void** slots = reinterpret_cast<void**>(&m_ddi);
+    for (unsigned int i = 0; i < sizeof(calddi_if) / sizeof(void*); ++i)
+    {
+        slots[i] = ddiGetExport(i);
+    }
+    return static_cast<CALresult>(m_ddi.ddiifInit()) == CAL_RESULT_OK;
+}
+
+CALextproc
+Replayer::extProc(CALextid extid, const CALchar* name)
+{
+    CALextproc proc = 0;
+    return (static_cast<CALresult>(m_ddi.ddiifExtGetProc(&proc, extid, name)) == CAL_RESULT_OK) ? proc : 0;
+}
+
+CALresult
+Replayer::waitEvent(CALcontext ctx, CALevent event)
+{
+    CALresult result;
+    while ((result = static_cast<CALresult>(m_ddi.ddiifCtxIsEventDone(ctx, event))) == CAL_RESULT_PENDING)
+    {
+        std::this_thread::yield();
+    }
+    return result;
+}
+
+//
+// Map the replayed resource and apply the captured runs row by row, so a
+// different pitch on the replaying driver does not matter.
+//
+CALresult
+Replayer::applyWrites(CALresource res, const CALuint64* a, const CALubyte* payload, CALuint size)
+{
+    CALvoid* ptr   = 0;
+    CALuint  pitch = 0;
+    CALresult result = static_cast<CALresult>(m_ddi.ddiifResMap(&ptr, &pitch, res, 0));
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    size_t pitchBytes = static_cast<size_t>(pitch) * a[1];
+    CALuint rowBytes  = static_cast<CALuint>(a[3]);
+    CALuint rows      = static_cast<CALuint>(a[4]);
+    CALuint offset    = 0;
+    while (offset + sizeof(CALreplayWrite) <= size)
+    {
+        CALreplayWrite write;
+        std::memcpy(&write, payload + offset, sizeof(write));
+        offset += sizeof(write);
+        if (write.row >= rows || static_cast<CALuint64>(write.offset) + write.size > rowBytes ||
+            static_cast<CALuint64>(offset) + write.size > size)
+        {
+            result = CAL_RESULT_INVALID_PARAMETER;
+            break;
+        }
+        std::memcpy(static_cast<CALubyte*>(ptr) + write.row * pitchBytes + write.offset, payload + offset, write.size);
+        offset += (write.size + 3) & ~3u;
+    }
+
+    CALresult unmap = static_cast<CALresult>(m_ddi.ddiifResUnmap(res));
+    return (result != CAL_RESULT_OK) ? result : unmap;
+}
+
+//
+// Remap the count captured device handles in the payload; false when the
+// payload is too short to hold them.
+//
+bool
+Replayer::devices(std::vector<CALdevice>& devs, const CALreplayPacket& packet, const CALubyte* payload, CALuint count) const
+{
+    if (static_cast<CALuint64>(count) * sizeof(CALdevice) > packet.payloadSize)
+    {
+        return false;
+    }
+    devs.resize(count);
+    for (CALuint i = 0; i < count; ++i)
+    {
+        CALdevice captured;
+        std::memcpy(&captured, payload + i * sizeof(CALdevice), sizeof(captured));
+        devs[i] = static_cast<CALdevice>(find(m_devices, captured));
+    }
+    return true;
+}
+
+CALresult
+Replayer::replay(const CALreplayPacket& packet, const CALuint64* a, const CALubyte* payload)
+{
+    switch (packet.api)
+    {
+    case CAL_API_DEVICE_OPEN:
+    {
+        CALdevice dev = 0;
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifDeviceOpen(&dev, static_cast<CALuint>(a[1])));
+        m_devices[a[0]] = dev;
+        return result;
+    }
+    case CAL_API_DEVICE_CLOSE:
+        return static_cast<CALresult>(m_ddi.ddiifDeviceClose(static_cast<CALdevice>(find(m_devices, a[0]))));
+    case CAL_API_RES_ALLOC_LOCAL_2D:
+    case CAL_API_RES_ALLOC_LOCAL_1D:
+    {
+        bool        is2D   = packet.api == CAL_API_RES_ALLOC_LOCAL_2D;
+        CALdevice   dev    = static_cast<CALdevice>(find(m_devices, a[1]));
+        CALuint     width  = static_cast<CALuint>(a[2]);
+        CALformat   format = static_cast<CALformat>(a[is2D ? 4 : 3]);
+        CALuint     flags  = static_cast<CALuint>(a[is2D ? 5 : 4]);
+        CALresource res    = 0;
+        CALresult   result = is2D ? static_cast<CALresult>(m_ddi.ddiifResAllocLocal2D(&res, dev, width, static_cast<CALuint>(a[3]), format, flags))
+                                  : static_cast<CALresult>(m_ddi.ddiifResAllocLocal1D(&res, dev, width, format, flags));
+        m_resources[a[0]] = res;
+        return result;
+    }
+    case CAL_API_RES_ALLOC_REMOTE_2D:
+    case CAL_API_RES_ALLOC_REMOTE_1D:
+    {
+        bool       is2D  = packet.api == CAL_API_RES_ALLOC_REMOTE_2D;
+        CALuint    count = static_cast<CALuint>(a[1]);
+        std::vector<CALdevice> devs;
+        if (!devices(devs, packet, payload, count))
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        CALuint     width  = static_cast<CALuint>(a[2]);
+        CALformat   format = static_cast<CALformat>(a[is2D ? 4 : 3]);
+        CALuint     flags  = static_cast<CALuint>(a[is2D ? 5 : 4]);
+        CALresource res    = 0;
+        CALdevice*  list   = count ? &devs[0] : 0;
+        CALresult   result = is2D ? static_cast<CALresult>(m_ddi.ddiifResAllocRemote2D(&res, list, count, width, static_cast<CALuint>(a[3]), format, flags))
+                                  : static_cast<CALresult>(m_ddi.ddiifResAllocRemote1D(&res, list, count, width, format, flags));
+        m_resources[a[0]] = res;
+        return result;
+    }
+    case CAL_API_RES_CREATE_2D:
+    case CAL_API_RES_CREATE_1D:
+    {
+        // The captured process owned the memory; replay on zeroed host memory
+        bool      is2D  = packet.api == CAL_API_RES_CREATE_2D;
+        CALuint   size  = static_cast<CALuint>(a[is2D ? 5 : 4]);
+        CALvoid*  mem   = 0;
+        if (posix_memalign(&mem, 4096, size ? size : 1) != 0)
+        {
+            return CAL_RESULT_ERROR;
+        }
+        std::memset(mem, 0, size);
+
+        CALdevice   dev    = static_cast<CALdevice>(find(m_devices, a[1]));
+        CALuint     width  = static_cast<CALuint>(a[2]);
+        CALformat   format = static_cast<CALformat>(a[is2D ? 4 : 3]);
+        CALuint     flags  = static_cast<CALuint>(a[is2D ? 6 : 5]);
+        CALresource res    = 0;
+        CALresult   result = CAL_RESULT_NOT_SUPPORTED;
+        if (is2D)
+        {
+            PFNCALRESCREATE2D create = reinterpret_cast<PFNCALRESCREATE2D>(extProc(CAL_EXT_RES_CREATE, "calResCreate2D"));
+            result = create ? create(&res, dev, mem, width, static_cast<CALuint>(a[3]), format, size, flags) : result;
+        }
+        else
+        {
+            PFNCALRESCREATE1D create = reinterpret_cast<PFNCALRESCREATE1D>(extProc(CAL_EXT_RES_CREATE, "calResCreate1D"));
+            result = create ? create(&res, dev, mem, width, format, size, flags) : result;
+        }
+        if (result != CAL_RESULT_OK)
+        {
+            std::free(mem);
+            return result;
+        }
+        m_resources[a[0]]   = res;
+        m_hostMemory[res]   = mem;
+        return result;
+    }
+    case CAL_API_RES_ALLOC_VIEW:
+    {
+        PFNCALRESALLOCVIEW alloc = reinterpret_cast<PFNCALRESALLOCVIEW>(extProc(static_cast<CALextid>(CAL_PRIVATE_EXT_RESOURCES), "calResAllocView"));
+        if (!alloc)
+        {
+            return CAL_RESULT_NOT_SUPPORTED;
+        }
+        CALdomain3D size   = { static_cast<CALuint>(a[3]), static_cast<CALuint>(a[4]), static_cast<CALuint>(a[5]) };
+        CALdomain   offset = { static_cast<CALuint>(a[6]), static_cast<CALuint>(a[7]), static_cast<CALuint>(a[8]), static_cast<CALuint>(a[9]) };
+        CALresource view   = 0;
+        CALresult   result = alloc(&view, static_cast<CALresource>(find(m_resources, a[1])), static_cast<CALdevice>(find(m_devices, a[2])),
+                                   size, offset, static_cast<CALformat>(a[10]), static_cast<CALchannelorder>(a[11]),
+                                   static_cast<CALdimension>(a[12]), static_cast<CALuint>(a[13]));
+        m_resources[a[0]] = view;
+        return result;
+    }
+    case CAL_API_RES_ALLOC:
+    {
+        PFNCALRESALLOC alloc = reinterpret_cast<PFNCALRESALLOC>(extProc(static_cast<CALextid>(CAL_PRIVATE_EXT_RES_ALLOC), "calResAlloc"));
+        std::vector<CALdevice> devs;
+        if (!alloc)
+        {
+            return CAL_RESULT_NOT_SUPPORTED;
+        }
+        if (!devices(devs, packet, payload, static_cast<CALuint>(a[1])))
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+
+        // System memory is replayed on zeroed host memory as for calResCreate
+        CALuint  hostSize = static_cast<CALuint>(a[11]);
+        CALvoid* mem      = 0;
+        if (hostSize)
+        {
+            if (posix_memalign(&mem, 4096, hostSize) != 0)
+            {
+                return CAL_RESULT_ERROR;
+            }
+            std::memset(mem, 0, hostSize);
+        }
+
+        CALdeviceDesc   devDesc = { devs.empty() ? 0 : &devs[0], static_cast<CALuint>(devs.size()) };
+        CALresourceDesc resDesc;
+        std::memset(&resDesc, 0, sizeof(resDesc));
+        resDesc.type             = static_cast<CALresallocType>(a[2]);
+        resDesc.size.width       = static_cast<CALuint>(a[3]);
+        resDesc.size.height      = static_cast<CALuint>(a[4]);
+        resDesc.size.depth       = static_cast<CALuint>(a[5]);
+        resDesc.format           = static_cast<CALformat>(a[6]);
+        resDesc.channelOrder     = static_cast<CALchannelorder>(a[7]);
+        resDesc.dimension        = static_cast<CALdimension>(a[8]);
+        resDesc.mipLevels        = static_cast<CALuint>(a[9]);
+        resDesc.flags            = static_cast<CALuint>(a[10]);
+        resDesc.systemMemory     = mem;
+        resDesc.systemMemorySize = hostSize;
+
+        CALresource res    = 0;
+        CALresult   result = alloc(&devDesc, &resDesc, &res);
+        if (result != CAL_RESULT_OK)
+        {
+            std::free(mem);
+            return result;
+        }
+        m_resources[a[0]] = res;
+        if (mem)
+        {
+            m_hostMemory[res] = mem;
+        }
+        return result;
+    }
+    case CAL_API_RES_GET_HEAP:
+    {
+        PFNCALRESGETHEAP getHeap = reinterpret_cast<PFNCALRESGETHEAP>(extProc(static_cast<CALextid>(CAL_PRIVATE_EXT_HEAP), "calResGetHeap"));
+        std::vector<CALdevice> devs;
+        if (!getHeap)
+        {
+            return CAL_RESULT_NOT_SUPPORTED;
+        }
+        if (!devices(devs, packet, payload, static_cast<CALuint>(a[1])))
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        CALdeviceDesc devDesc = { devs.empty() ? 0 : &devs[0], static_cast<CALuint>(devs.size()) };
+        CALresource   res     = 0;
+        CALresult     result  = getHeap(&res, &devDesc, static_cast<CALheapType>(a[2]), static_cast<CALuint>(a[3]));
+        m_resources[a[0]] = res;
+        return result;
+    }
+    case CAL_API_RES_FREE:
+    {
+        CALresource res = static_cast<CALresource>(find(m_resources, a[0]));
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifResFree(res));
+        m_resources.erase(a[0]);
+        std::unordered_map<CALuint64, CALvoid*>::iterator mem = m_hostMemory.find(res);
+        if (mem != m_hostMemory.end())
+        {
+            std::free(mem->second);
+            m_hostMemory.erase(mem);
+        }
+        return result;
+    }
+    case CAL_API_RES_UNMAP:
+        return applyWrites(static_cast<CALresource>(find(m_resources, a[0])), a, payload, packet.payloadSize);
+    case CAL_API_CTX_CREATE:
+    {
+        CALcontext ctx = 0;
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifCtxCreate(&ctx, static_cast<CALdevice>(find(m_devices, a[1]))));
+        m_contexts[a[0]] = ctx;
+        return result;
+    }
+    case CAL_API_CTX_DESTROY:
+    {
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifCtxDestory(static_cast<CALcontext>(find(m_contexts, a[0]))));
+        m_contexts.erase(a[0]);
+        return result;
+    }
+    case CAL_API_CTX_GET_MEM:
+    {
+        CALmem mem = 0;
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifCtxGetMem(&mem, static_cast<CALcontext>(find(m_contexts, a[1])),
+                                                                       static_cast<CALresource>(find(m_resources, a[2]))));
+        m_mems[a[0]] = mem;
+        return result;
+    }
+    case CAL_API_CTX_RELEASE_MEM:
+    {
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifCtxReleaseMem(static_cast<CALcontext>(find(m_contexts, a[0])),
+                                                                           static_cast<CALmem>(find(m_mems, a[1]))));
+        m_mems.erase(a[1]);
+        return result;
+    }
+    case CAL_API_CTX_SET_MEM:
+        return static_cast<CALresult>(m_ddi.ddiifCtxSetMem(static_cast<CALcontext>(find(m_contexts, a[0])),
+                                                           static_cast<CALname>(find(m_names, a[1])),
+                                                           static_cast<CALmem>(find(m_mems, a[2]))));
+    case CAL_API_MODULE_LOAD:
+    {
+        CALimage image = 0;
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifImageRead(&image, payload, packet.payloadSize));
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        CALmodule module = 0;
+        result = static_cast<CALresult>(m_ddi.ddiifModuleLoad(&module, static_cast<CALcontext>(find(m_contexts, a[1])), image));
+        if (result != CAL_RESULT_OK)
+        {
+            m_ddi.ddiifImageFree(image);
+            return result;
+        }
+        m_modules[a[0]] = module;
+        m_images[module] = image;
+        return result;
+    }
+    case CAL_API_MODULE_UNLOAD:
+    {
+        CALmodule module = static_cast<CALmodule>(find(m_modules, a[1]));
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifModuleUnload(static_cast<CALcontext>(find(m_contexts, a[0])), module));
+        m_modules.erase(a[1]);
+        std::unordered_map<CALuint64, CALimage>::iterator image = m_images.find(module);
+        if (image != m_images.end())
+        {
+            m_ddi.ddiifImageFree(image->second);
+            m_images.erase(image);
+        }
+        return result;
+    }
+    case CAL_API_MODULE_GET_ENTRY:
+    case CAL_API_MODULE_GET_NAME:
+    {
+        CALcontext ctx    = static_cast<CALcontext>(find(m_contexts, a[1]));
+        CALmodule  module = static_cast<CALmodule>(find(m_modules, a[2]));
+        const CALchar* name = reinterpret_cast<const CALchar*>(payload);
+        if (!std::memchr(payload, 0, packet.payloadSize))
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        if (packet.api == CAL_API_MODULE_GET_ENTRY)
+        {
+            CALfunc func = 0;
+            CALresult result = static_cast<CALresult>(m_ddi.ddiifModuleGetEntry(&func, ctx, module, name));
+            m_funcs[a[0]] = func;
+            return result;
+        }
+        CALname varName = 0;
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifModuleGetName(&varName, ctx, module, name));
+        m_names[a[0]] = varName;
+        return result;
+    }
+    case CAL_API_CTX_RUN_PROGRAM:
+    {
+        CALdomain domain = { static_cast<CALuint>(a[3]), static_cast<CALuint>(a[4]), static_cast<CALuint>(a[5]), static_cast<CALuint>(a[6]) };
+        CALevent  event  = 0;
+        CALcontext ctx   = static_cast<CALcontext>(find(m_contexts, a[1]));
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifCtxRunProgram(&event, ctx, static_cast<CALfunc>(find(m_funcs, a[2])), &domain));
+        m_events[eventKey(a[1], a[0])] = event;
+        return result;
+    }
+    case CAL_API_CTX_RUN_PROGRAM_GRID:
+    case CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY:
+    {
+        bool    isArray = packet.api == CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY;
+        CALuint num     = isArray ? static_cast<CALuint>(a[2]) : 1;
+        if (static_cast<CALuint64>(num) * sizeof(CALprogramGrid) > packet.payloadSize)
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        std::vector<CALprogramGrid> grids(num);
+        if (num)
+        {
+            std::memcpy(&grids[0], payload, num * sizeof(CALprogramGrid));
+        }
+        for (CALprogramGrid& grid : grids)
+        {
+            grid.func = static_cast<CALfunc>(find(m_funcs, grid.func));
+        }
+
+        CALevent   event = 0;
+        CALcontext ctx   = static_cast<CALcontext>(find(m_contexts, a[1]));
+        CALresult  result;
+        if (!isArray && (grids[0].flags & CAL_RUNPROGRAMGRID_EXTENDED_STRUCTURE))
+        {
+            // The extended structure is followed by the memUsage handles
+            if (packet.payloadSize < sizeof(CALprogramGridExtended))
+            {
+                return CAL_RESULT_INVALID_PARAMETER;
+            }
+            CALprogramGridExtended extended;
+            std::memcpy(&extended, payload, sizeof(extended));
+            extended.programGrid.func = grids[0].func;
+
+            std::vector<CALmem> mems((packet.payloadSize - sizeof(extended)) / sizeof(CALmem));
+            for (size_t i = 0; i < mems.size(); ++i)
+            {
+                CALmem captured;
+                std::memcpy(&captured, payload + sizeof(extended) + i * sizeof(CALmem), sizeof(captured));
+                mems[i] = static_cast<CALmem>(find(m_mems, captured));
+            }
+            CALmemusage usage;
+            usage.mem      = mems.empty() ? 0 : &mems[0];
+            usage.memCount = static_cast<CALuint>(mems.size());
+            extended.memUsage = (extended.extendedFlags & CAL_RUNPROGRAMGRID_EXTENDED_MEMORY_USAGE) ? &usage : 0;
+            result = static_cast<CALresult>(m_ddi.ddiifCtxRunProgramGrid(&event, ctx, &extended.programGrid));
+        }
+        else if (isArray)
+        {
+            CALprogramGridArray array;
+            array.gridArray = num ? &grids[0] : 0;
+            array.num       = num;
+            array.flags     = static_cast<CALuint>(a[3]);
+            result = static_cast<CALresult>(m_ddi.ddiifCtxRunProgramGridArray(&event, ctx, &array));
+        }
+        else
+        {
+            result = static_cast<CALresult>(m_ddi.ddiifCtxRunProgramGrid(&event, ctx, &grids[0]));
+        }
+        m_events[eventKey(a[1], a[0])] = event;
+        return result;
+    }
+    case CAL_API_MEM_COPY:
+    {
+        CALevent  event = 0;
+        CALresult result = static_cast<CALresult>(m_ddi.ddiifMemCopy(&event, static_cast<CALcontext>(find(m_contexts, a[1])),
+                                                                     static_cast<CALmem>(find(m_mems, a[2])),
+                                                                     static_cast<CALmem>(find(m_mems, a[3])),
+                                                                     static_cast<CALuint>(a[4])));
+        m_events[eventKey(a[1], a[0])] = event;
+        return result;
+    }
+    case CAL_API_MEM_COPY_RAW:
+    {
+        PFNCALMEMCOPYRAW copy = reinterpret_cast<PFNCALMEMCOPYRAW>(extProc(static_cast<CALextid>(CAL_PRIVATE_EXT_MEMCOPY_RAW), "calMemCopyRaw"));
+        if (!copy)
+        {
+            return CAL_RESULT_NOT_SUPPORTED;
+        }
+        CALevent  event = 0;
+        CALresult result = copy(&event, static_cast<CALcontext>(find(m_contexts, a[1])),
+                                static_cast<CALmem>(find(m_mems, a[2])), static_cast<CALuint>(a[3]),
+                                static_cast<CALmem>(find(m_mems, a[4])), static_cast<CALuint>(a[5]),
+                                static_cast<CALuint>(a[6]), static_cast<CALuint>(a[7]));
+        m_events[eventKey(a[1], a[0])] = event;
+        return result;
+    }
+    case CAL_API_MEM_COPY_PARTIAL:
+    {
+        PFNCALMEMCOPYPARTIAL copy = reinterpret_cast<PFNCALMEMCOPYPARTIAL>(extProc(static_cast<CALextid>(CAL_PRIVATE_EXT_MEMCOPY_PARTIAL), "calMemCopyPartial"));
+        if (!copy)
+        {
+            return CAL_RESULT_NOT_SUPPORTED;
+        }
+        CALuint region[9];
+        if (packet.payloadSize < sizeof(region))
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        std::memcpy(region, payload, sizeof(region));
+        CALevent  event = 0;
+        CALresult result = copy(&event, static_cast<CALcontext>(find(m_contexts, a[1])),
+                                static_cast<CALmem>(find(m_mems, a[2])), region,
+                                static_cast<CALmem>(find(m_mems, a[3])), region + 3,
+                                region + 6, static_cast<CALuint>(a[4]));
+        m_events[eventKey(a[1], a[0])] = event;
+        return result;
+    }
+    case CAL_API_CTX_FLUSH_CACHE:
+    {
+        PFNCALCTXFLUSHCACHE flush = reinterpret_cast<PFNCALCTXFLUSHCACHE>(extProc(static_cast<CALextid>(CAL_PRIVATE_EXT_FLUSH_CACHE), "calCtxFlushCache"));
+        return flush ? flush(static_cast<CALcontext>(find(m_contexts, a[0])), static_cast<CALuint>(a[1])) : CAL_RESULT_NOT_SUPPORTED;
+    }
+    case CAL_API_CTX_FLUSH:
+        return static_cast<CALresult>(m_ddi.ddiifCtxFlush(static_cast<CALcontext>(find(m_contexts, a[0]))));
+    case CAL_API_CTX_IS_EVENT_DONE:
+        return waitEvent(static_cast<CALcontext>(find(m_contexts, a[0])), static_cast<CALevent>(find(m_events, eventKey(a[0], a[1]))));
+    case CAL_API_CTX_WAIT_FOR_EVENTS:
+    {
+        CALcontext ctx = static_cast<CALcontext>(find(m_contexts, a[0]));
+        if (a[1] > packet.payloadSize / sizeof(CALevent))
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        for (CALuint64 i = 0; i < a[1]; ++i)
+        {
+            CALevent captured;
+            std::memcpy(&captured, payload + i * sizeof(CALevent), sizeof(captured));
+            CALresult result = waitEvent(ctx, static_cast<CALevent>(find(m_events, eventKey(a[0], captured))));
+            if (result != CAL_RESULT_OK)
+            {
+                return result;
+            }
+        }
+        return CAL_RESULT_OK;
+    }
+    default:
+        return CAL_RESULT_NOT_SUPPORTED;
+    }
+}
+
+bool
+Replayer::run(const MappedFile& file, bool timing)
+{
+    const CALubyte* data = file.data();
+    size_t          size = file.size();
+
+    CALreplayHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, CAL_REPLAY_MAGIC, sizeof(header.magic)) != 0 || header.version != CAL_REPLAY_VERSION)
+    {
+        std::fprintf(stderr, "calreplay: not a version %u capture\n", CAL_REPLAY_VERSION);
+        return false;
+    }
+
+    CALuint64 start = steadyNs();
+    for (size_t offset = sizeof(header); offset + sizeof(CALreplayPacket) <= size;)
+    {
+        // Arguments and payload must fit the packet, and packets stay 8 byte
+        // aligned so the arguments can be read in place
+        const CALreplayPacket& packet = *reinterpret_cast<const CALreplayPacket*>(data + offset);
+        CALuint64 body = sizeof(packet) + static_cast<CALuint64>(packet.argCount) * sizeof(CALuint64) + packet.payloadSize;
+        if (packet.size < sizeof(packet) || (packet.size & 7) != 0 || body > packet.size ||
+            offset + packet.size > size || packet.api >= CAL_API_COUNT || packet.argCount < argCount(packet.api))
+        {
+            std::fprintf(stderr, "calreplay: corrupt packet at offset %zu\n", offset);
+            return false;
+        }
+        const CALuint64* args    = reinterpret_cast<const CALuint64*>(data + offset + sizeof(packet));
+        const CALubyte*  payload = reinterpret_cast<const CALubyte*>(args + packet.argCount);
+
+        if (timing)
+        {
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(start + packet.time)));
+        }
+
+        CALuint64 begin = steadyNs();
+        CALresult result = replay(packet, args, payload);
+        ApiStats& stats = m_stats[packet.api];
+        stats.calls++;
+        stats.ns += steadyNs() - begin;
+        if (result != CAL_RESULT_OK)
+        {
+            stats.failures++;
+            m_failures++;
+            std::fprintf(stderr, "calreplay: %s failed with %d: %s\n",
+                         calApiName(static_cast<CALapiId>(packet.api)), result, m_ddi.ddiifGetErrorString());
+        }
+        m_packets++;
+        offset += packet.size;
+    }
+    m_elapsedNs = steadyNs() - start;
+
+    m_ddi.ddiifShutdown();
+    return true;
+}
+
+void
+Replayer::report(FILE* out, bool verbose) const
+{
+    std::fprintf(out, "%llu calls replayed in %.3f ms, %llu failed\n",
+                 static_cast<unsigned long long>(m_packets), m_elapsedNs / 1e6,
+                 static_cast<unsigned long long>(m_failures));
+    if (!verbose)
+    {
+        return;
+    }
+    for (int api = CAL_API_NONE + 1; api < CAL_API_COUNT; ++api)
+    {
+        const ApiStats& stats = m_stats[api];
+        if (stats.calls)
+        {
+            std::fprintf(out, "  %-28s %10llu calls %12.3f us %6llu failed\n", calApiName(static_cast<CALapiId>(api)),
+                         static_cast<unsigned long long>(stats.calls), stats.ns / 1e3,
+                         static_cast<unsigned long long>(stats.failures));
+        }
+    }
+}
+
+bool
+parseOptions(int argc, char** argv, Options& options)
+{
+    options.driver  = "libaticaldd.so";
+    options.file    = 0;
+    options.timing  = false;
+    options.verbose = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            options.driver = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-t") == 0)
+        {
+            options.timing = true;
+        }
+        else if (std::strcmp(argv[i], "-v") == 0)
+        {
+            options.verbose = true;
+        }
+        else if (argv[i][0] != '-' && !options.file)
+        {
+            options.file = argv[i];
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.file != 0;
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr, "usage: %s [-d driver] [-t] [-v] <capture.bin>\n"
+                             "  -d  calddi_if driver to replay on (default libaticaldd.so)\n"
+                             "  -t  keep the captured time between calls instead of replaying back to back\n"
+                             "  -v  per call statistics\n", argv[0]);
+        return 2;
+    }
+
+    MappedFile file;
+    if (!file.open(options.file))
+    {
+        std::fprintf(stderr, "calreplay: cannot map %s\n", options.file);
+        return 1;
+    }
+
+    Replayer replayer;
+    if (!replayer.loadDriver(options.driver) || !replayer.run(file, options.timing))
+    {
+        return 1;
+    }
+    replayer.report(stdout, options.verbose);
+    return 0;
+}
@@ -0,0 +1,816 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "calsw_internal.h"
+#include "cal_thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace calsw {
+
+namespace {
+
+//
+// Everything a queued kernel needs once the issuing call has returned.
+// Bindings are captured at issue time, as on hardware.
+//
+struct KernelLaunch
+{
+    KernelEntry                             entry;
+    std::shared_ptr<Program>                program;
+    std::vector<CALprogramGrid>             grids;
+    CALuint                                 origin[3];
+    std::vector<std::string>                varNames;
+    std::vector<std::shared_ptr<Resource> > resources;
+};
+
+void
+contextMain(Context* context)
+{
+    std::unique_lock<std::mutex> lock(context->lock);
+
+    for (;;)
+    {
+        context->wake.wait(lock, [context] { return context->exit || !context->queue.empty(); });
+        if (context->queue.empty())
+        {
+            return;
+        }
+
+        Command command = context->queue.front();
+        context->queue.pop_front();
+        lock.unlock();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        command.run();
+        context->busyNs += static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+        lock.lock();
+        context->retiredEvent.store(command.event, std::memory_order_release);
+        context->idle.notify_all();
+    }
+}
+
+CALevent
+submit(Context& context, const std::function<void()>& run)
+{
+    std::lock_guard<std::mutex> guard(context.lock);
+    Command command;
+    command.event = ++context.nextEvent;
+    command.run   = run;
+    context.pending.push_back(command);
+    return command.event;
+}
+
+void
+flushLocked(Context& context)
+{
+    if (context.pending.empty())
+    {
+        return;
+    }
+    for (size_t i = 0; i < context.pending.size(); ++i)
+    {
+        context.queue.push_back(context.pending[i]);
+    }
+    context.pending.clear();
+    context.flushedEvent = context.nextEvent;
+    context.wake.notify_one();
+}
+
+std::shared_ptr<Mem>
+lookupMem(CALcontext ctx, CALmem mem)
+{
+    std::shared_ptr<Mem> m = driver().mems.get(mem);
+    return (m && m->ctx == ctx) ? m : std::shared_ptr<Mem>();
+}
+
+// Work groups of a grid; empty dimensions count as 1
+CALuint64
+gridGroups(const CALprogramGrid& grid)
+{
+    return static_cast<CALuint64>(std::max(grid.gridSize.width, 1u)) *
+           std::max(grid.gridSize.height, 1u) * std::max(grid.gridSize.depth, 1u);
+}
+
+void
+runKernel(const KernelLaunch& launch)
+{
+    std::vector<CALswBinding> bindings(launch.resources.size());
+    for (size_t i = 0; i < bindings.size(); ++i)
+    {
+        const Resource& r       = *launch.resources[i];
+        bindings[i].name        = launch.varNames[i].c_str();
+        bindings[i].data        = r.base;
+        bindings[i].width       = r.width;
+        bindings[i].height      = r.height;
+        bindings[i].pitch       = r.pitch;
+        bindings[i].elementSize = r.elementSize;
+        bindings[i].format      = r.format;
+    }
+
+    for (size_t g = 0; g < launch.grids.size(); ++g)
+    {
+        const CALprogramGrid& grid = launch.grids[g];
+
+        CALswDispatch base;
+        std::memset(&base, 0, sizeof(base));
+        base.groupSize[0] = std::max(grid.gridBlock.width, 1u);
+        base.groupSize[1] = std::max(grid.gridBlock.height, 1u);
+        base.groupSize[2] = std::max(grid.gridBlock.depth, 1u);
+        base.gridSize[0]  = std::max(grid.gridSize.width, 1u);
+        base.gridSize[1]  = std::max(grid.gridSize.height, 1u);
+        base.gridSize[2]  = std::max(grid.gridSize.depth, 1u);
+        base.origin[0]    = launch.origin[0];
+        base.origin[1]    = launch.origin[1];
+        base.origin[2]    = launch.origin[2];
+        base.bindings     = bindings.empty() ? 0 : &bindings[0];
+        base.bindingCount = static_cast<CALuint>(bindings.size());
+
+        // ctxRunProgramGridArray rejected grids of more than 2^32 - 1 groups
+        CALuint groups = static_cast<CALuint>(gridGroups(grid));
+        cal::ThreadPool::shared().parallelFor(groups, [&base, &launch](CALuint index) {
+            CALswDispatch dispatch = base;
+            dispatch.groupId[0] = index % base.gridSize[0];
+            dispatch.groupId[1] = (index / base.gridSize[0]) % base.gridSize[1];
+            dispatch.groupId[2] = index / (base.gridSize[0] * base.gridSize[1]);
+            launch.entry.kernel(&dispatch, launch.entry.userData);
+        });
+    }
+}
+
+//
+// Resolve func, its native kernel and the current bindings of its module.
+//
+CALresult
+prepareLaunch(KernelLaunch& launch, CALcontext ctx, Context& context, CALfunc func)
+{
+    Driver& drv = driver();
+    std::shared_ptr<Func> f = drv.funcs.get(func);
+    if (!f || f->ctx != ctx)
+    {
+        return setHandleError(func, "Invalid function handle %u", func);
+    }
+    std::shared_ptr<Module> module = drv.modules.get(f->module);
+    if (!module)
+    {
+        return setError(CAL_RESULT_ERROR, "Function %u belongs to an unloaded module", func);
+    }
+
+    const std::string& kernel = f->program->kernels[f->entry];
+    {
+        std::lock_guard<std::mutex> guard(drv.kernelLock);
+        std::map<std::string, KernelEntry>::iterator it = drv.kernels.find(kernel);
+        if (kernel.empty() || it == drv.kernels.end())
+        {
+            return setError(CAL_RESULT_NOT_SUPPORTED, "Entry \"%s\" has no registered native kernel%s%s",
+                            f->program->entries[f->entry].c_str(), kernel.empty() ? "" : " ", kernel.c_str());
+        }
+        launch.entry = it->second;
+    }
+    launch.program = f->program;
+
+    std::lock_guard<std::mutex> guard(context.lock);
+    for (size_t i = 0; i < module->names.size(); ++i)
+    {
+        std::map<CALname, CALmem>::iterator binding = context.bindings.find(module->names[i]);
+        std::shared_ptr<Mem> mem = (binding == context.bindings.end()) ? std::shared_ptr<Mem>() : drv.mems.get(binding->second);
+        if (!mem)
+        {
+            return setError(CAL_RESULT_ERROR, "Module variable %s is not set up", f->program->names[i].c_str());
+        }
+        if (mem->res->busyMapped())
+        {
+            return setError(CAL_RESULT_ERROR, "Memory bound to %s is mapped", f->program->names[i].c_str());
+        }
+        launch.varNames.push_back(f->program->names[i]);
+        launch.resources.push_back(mem->res);
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+checkCopy(const std::shared_ptr<Mem>& src, const std::shared_ptr<Mem>& dst, CALmem srcMem, CALmem dstMem)
+{
+    if (!src || !dst)
+    {
+        CALmem bad = !src ? srcMem : dstMem;
+        return setHandleError(bad, "Invalid memory handle %u", bad);
+    }
+    if (src->res->busyMapped() || dst->res->busyMapped())
+    {
+        return setError(CAL_RESULT_ERROR, "Mapped memory cannot be copied");
+    }
+    return CAL_RESULT_OK;
+}
+
+void
+copyRect(const Resource& src, CALuint srcX, CALuint srcY, const Resource& dst, CALuint dstX, CALuint dstY,
+         CALuint width, CALuint height)
+{
+    CALuint64 rowBytes = static_cast<CALuint64>(width) * src.elementSize;
+    for (CALuint y = 0; y < height; ++y)
+    {
+        const CALubyte* s = src.base + (static_cast<CALuint64>(srcY + y) * src.pitch + srcX) * src.elementSize;
+        CALubyte*       d = dst.base + (static_cast<CALuint64>(dstY + y) * dst.pitch + dstX) * dst.elementSize;
+        std::memmove(d, s, static_cast<size_t>(rowBytes));
+    }
+}
+
+} // anonymous namespace
+
+Context::Context()
+    : dev(0), exit(false), nextEvent(0), flushedEvent(0), retiredEvent(0), busyNs(0)
+{
+}
+
+std::shared_ptr<Context>
+lookupContext(CALcontext ctx, CALresult* result)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        *result = setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+        return std::shared_ptr<Context>();
+    }
+    std::shared_ptr<Context> context = drv.contexts.get(ctx);
+    if (!context)
+    {
+        *result = setHandleError(ctx, "Invalid context handle %u", ctx);
+        return context;
+    }
+    if (drv.checkThread && context->owner != std::this_thread::get_id())
+    {
+        *result = setError(static_cast<CALresult>(CAL_RESULT_INVALID_THREAD), "Context %u used outside its creating thread", ctx);
+        return std::shared_ptr<Context>();
+    }
+    *result = CAL_RESULT_OK;
+    return context;
+}
+
+/*----------------------------------------------------------------------------
+ * Contexts
+ *----------------------------------------------------------------------------*/
+
+CALresult
+ctxCreate(CALcontext* ctx, CALdevice dev)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!ctx)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "ctx is NULL");
+    }
+    *ctx = 0;
+    if (dev == 0 || dev > drv.devices.size() || !drv.devices[dev - 1].open)
+    {
+        return setHandleError(dev, "Invalid device handle %u", dev);
+    }
+
+    std::shared_ptr<Context> context = std::make_shared<Context>();
+    context->dev    = dev;
+    context->owner  = std::this_thread::get_id();
+    context->worker = std::thread(contextMain, context.get());
+    *ctx = drv.contexts.add(context);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxDestroy(CALcontext ctx)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    Driver& drv = driver();
+    drv.contexts.remove(ctx);
+
+    {
+        // Flushed work still retires, unflushed work is dropped
+        std::lock_guard<std::mutex> guard(context->lock);
+        context->pending.clear();
+        context->exit = true;
+        context->wake.notify_one();
+    }
+    context->worker.join();
+
+    std::vector<CALmodule> modules;
+    std::vector<CALmem> mems;
+    {
+        std::lock_guard<std::mutex> guard(context->lock);
+        modules.swap(context->modules);
+        mems.swap(context->mems);
+        context->bindings.clear();
+    }
+    for (size_t i = 0; i < modules.size(); ++i)
+    {
+        std::shared_ptr<Module> module = drv.modules.remove(modules[i]);
+        if (module)
+        {
+            releaseModule(*module);
+        }
+    }
+    for (size_t i = 0; i < mems.size(); ++i)
+    {
+        drv.mems.remove(mems[i]);
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxGetMem(CALmem* mem, CALcontext ctx, CALresource res)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    if (!mem)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "mem is NULL");
+    }
+    *mem = 0;
+
+    std::shared_ptr<Resource> r = driver().resources.get(res);
+    if (!r)
+    {
+        return setHandleError(res, "Invalid resource handle %u", res);
+    }
+
+    std::shared_ptr<Mem> m = std::make_shared<Mem>();
+    m->ctx = ctx;
+    m->res = r;
+    *mem = driver().mems.add(m);
+
+    std::lock_guard<std::mutex> guard(context->lock);
+    context->mems.push_back(*mem);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxReleaseMem(CALcontext ctx, CALmem mem)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    if (!lookupMem(ctx, mem))
+    {
+        return setHandleError(mem, "Invalid memory handle %u", mem);
+    }
+    driver().mems.remove(mem);
+
+    std::lock_guard<std::mutex> guard(context->lock);
+    context->mems.erase(std::remove(context->mems.begin(), context->mems.end(), mem), context->mems.end());
+    for (std::map<CALname, CALmem>::iterator it = context->bindings.begin(); it != context->bindings.end(); )
+    {
+        if (it->second == mem)
+        {
+            context->bindings.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxSetMem(CALcontext ctx, CALname name, CALmem mem)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    std::shared_ptr<Name> n = driver().names.get(name);
+    if (!n || n->ctx != ctx)
+    {
+        return setHandleError(name, "Invalid name handle %u", name);
+    }
+    if (mem != 0 && !lookupMem(ctx, mem))
+    {
+        return setHandleError(mem, "Invalid memory handle %u", mem);
+    }
+
+    std::lock_guard<std::mutex> guard(context->lock);
+    if (mem == 0)
+    {
+        context->bindings.erase(name);
+    }
+    else
+    {
+        context->bindings[name] = mem;
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxRunProgram(CALevent* event, CALcontext ctx, CALfunc func, const CALdomain* domain)
+{
+    if (!event || !domain)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "event or domain is NULL");
+    }
+    *event = 0;
+
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+
+    // A pixel domain runs as one group per row
+    std::shared_ptr<KernelLaunch> launch = std::make_shared<KernelLaunch>();
+    result = prepareLaunch(*launch, ctx, *context, func);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    CALprogramGrid grid;
+    std::memset(&grid, 0, sizeof(grid));
+    grid.func             = func;
+    grid.gridBlock.width  = domain->width;
+    grid.gridBlock.height = 1;
+    grid.gridBlock.depth  = 1;
+    grid.gridSize.width   = 1;
+    grid.gridSize.height  = domain->height;
+    grid.gridSize.depth   = 1;
+    launch->grids.push_back(grid);
+    launch->origin[0] = domain->x;
+    launch->origin[1] = domain->y;
+    launch->origin[2] = 0;
+
+    *event = submit(*context, [launch] { runKernel(*launch); });
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxRunProgramGridArray(CALevent* event, CALcontext ctx, CALprogramGridArray* gridArray)
+{
+    if (!event || !gridArray || !gridArray->gridArray || gridArray->num == 0)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Invalid grid array");
+    }
+    *event = 0;
+
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+
+    std::vector<std::shared_ptr<KernelLaunch> > launches;
+    for (CALuint i = 0; i < gridArray->num; ++i)
+    {
+        CALprogramGrid* grid = &gridArray->gridArray[i];
+        if (gridGroups(*grid) > 0xffffffffu)
+        {
+            return setError(CAL_RESULT_INVALID_PARAMETER, "Grid %u has more than 2^32 - 1 groups", i);
+        }
+        std::shared_ptr<KernelLaunch> launch = std::make_shared<KernelLaunch>();
+        result = prepareLaunch(*launch, ctx, *context, grid->func);
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+
+        if (grid->flags & CAL_RUNPROGRAMGRID_EXTENDED_STRUCTURE)
+        {
+            // Paging is a no-op in host memory, but the usage list must name real memory
+            const CALprogramGridExtended* ext = reinterpret_cast<const CALprogramGridExtended*>(grid);
+            if ((ext->extendedFlags & CAL_RUNPROGRAMGRID_EXTENDED_MEMORY_USAGE) && ext->memUsage)
+            {
+                for (CALuint m = 0; m < ext->memUsage->memCount; ++m)
+                {
+                    if (!lookupMem(ctx, ext->memUsage->mem[m]))
+                    {
+                        return setHandleError(ext->memUsage->mem[m], "Invalid memory handle %u in memUsage", ext->memUsage->mem[m]);
+                    }
+                }
+            }
+        }
+
+        launch->grids.push_back(*grid);
+        launch->origin[0] = launch->origin[1] = launch->origin[2] = 0;
+        launches.push_back(launch);
+    }
+
+    *event = submit(*context, [launches] {
+        for (size_t i = 0; i < launches.size(); ++i)
+        {
+            runKernel(*launches[i]);
+        }
+    });
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxRunProgramGrid(CALevent* event, CALcontext ctx, CALprogramGrid* grid)
+{
+    CALprogramGridArray gridArray;
+    gridArray.gridArray = grid;
+    gridArray.num       = grid ? 1 : 0;
+    gridArray.flags     = 0;
+    return ctxRunProgramGridArray(event, ctx, &gridArray);
+}
+
+CALresult
+ctxIsEventDone(CALcontext ctx, CALevent event)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    if (context->retiredEvent.load(std::memory_order_acquire) >= event && event != 0)
+    {
+        return CAL_RESULT_OK;
+    }
+
+    std::lock_guard<std::mutex> guard(context->lock);
+    if (event == 0 || event > context->nextEvent)
+    {
+        return setError(CAL_RESULT_ERROR, "Invalid event %u", event);
+    }
+    if (event > context->flushedEvent)
+    {
+        flushLocked(*context);
+    }
+    return (context->retiredEvent.load(std::memory_order_acquire) >= event) ? CAL_RESULT_OK : CAL_RESULT_PENDING;
+}
+
+CALresult
+ctxFlush(CALcontext ctx)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    std::lock_guard<std::mutex> guard(context->lock);
+    flushLocked(*context);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxWaitForEvents(CALcontext ctx, CALevent* events, CALuint n, CALuint flags)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    if (n != 0 && !events)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "events is NULL");
+    }
+
+    // Events retire in order, so waiting for the newest covers the list
+    CALevent last = 0;
+    for (CALuint i = 0; i < n; ++i)
+    {
+        last = std::max(last, events[i]);
+    }
+
+    std::unique_lock<std::mutex> lock(context->lock);
+    if (last > context->nextEvent)
+    {
+        return setError(CAL_RESULT_ERROR, "Invalid event %u", last);
+    }
+    flushLocked(*context);
+
+    if (flags == CAL_WAIT_POLLING)
+    {
+        lock.unlock();
+        while (context->retiredEvent.load(std::memory_order_acquire) < last)
+        {
+            std::this_thread::yield();
+        }
+        return CAL_RESULT_OK;
+    }
+
+    context->idle.wait(lock, [&context, last] { return context->retiredEvent.load(std::memory_order_acquire) >= last; });
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ctxFlushCache(CALcontext ctx, CALuint flags)
+{
+    (void)flags;
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    CALevent last;
+    {
+        std::lock_guard<std::mutex> guard(context->lock);
+        last = context->nextEvent;
+    }
+    return ctxWaitForEvents(ctx, &last, 1, CAL_WAIT_LOW_CPU_UTILIZATION);
+}
+
+CALresult
+ctxBusyTime(CALcontext ctx, CALuint64* busyNs)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    *busyNs = context->busyNs;
+    return CAL_RESULT_OK;
+}
+
+/*----------------------------------------------------------------------------
+ * Copies
+ *----------------------------------------------------------------------------*/
+
+CALresult
+memCopy(CALevent* event, CALcontext ctx, CALmem srcMem, CALmem dstMem, CALuint flags)
+{
+    (void)flags;
+    if (!event)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "event is NULL");
+    }
+    *event = 0;
+
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    std::shared_ptr<Mem> src = lookupMem(ctx, srcMem);
+    std::shared_ptr<Mem> dst = lookupMem(ctx, dstMem);
+    result = checkCopy(src, dst, srcMem, dstMem);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    if (src->res->format != dst->res->format)
+    {
+        return setError(CAL_RESULT_ERROR, "Source and destination formats differ");
+    }
+    if (dst->res->width < src->res->width || dst->res->height < src->res->height)
+    {
+        return setError(CAL_RESULT_ERROR, "Destination %ux%u is smaller than source %ux%u",
+                        dst->res->width, dst->res->height, src->res->width, src->res->height);
+    }
+
+    std::shared_ptr<Resource> s = src->res;
+    std::shared_ptr<Resource> d = dst->res;
+    *event = submit(*context, [s, d] { copyRect(*s, 0, 0, *d, 0, 0, s->width, s->height); });
+    return CAL_RESULT_OK;
+}
+
+CALresult
+memCopyRaw(CALevent* event, CALcontext ctx, CALmem srcMem, CALuint srcOffset, CALmem dstMem, CALuint dstOffset, CALuint size, CALuint flags)
+{
+    (void)flags;
+    if (!event)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "event is NULL");
+    }
+    *event = 0;
+
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    std::shared_ptr<Mem> src = lookupMem(ctx, srcMem);
+    std::shared_ptr<Mem> dst = lookupMem(ctx, dstMem);
+    result = checkCopy(src, dst, srcMem, dstMem);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    if (static_cast<CALuint64>(srcOffset) + size > src->res->byteSize ||
+        static_cast<CALuint64>(dstOffset) + size > dst->res->byteSize)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Raw copy of %u bytes is out of bounds", size);
+    }
+
+    std::shared_ptr<Resource> s = src->res;
+    std::shared_ptr<Resource> d = dst->res;
+    *event = submit(*context, [s, d, srcOffset, dstOffset, size] {
+        std::memmove(d->base + dstOffset, s->base + srcOffset, size);
+    });
+    return CAL_RESULT_OK;
+}
+
+CALresult
+memCopyPartial(CALevent* event, CALcontext ctx, CALmem srcMem, CALuint* srcOffset, CALmem dstMem, CALuint* dstOffset, CALuint* size, CALuint flags)
+{
+    (void)flags;
+    if (!event || !srcOffset || !dstOffset || !size)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Invalid partial copy parameters");
+    }
+    *event = 0;
+
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    std::shared_ptr<Mem> src = lookupMem(ctx, srcMem);
+    std::shared_ptr<Mem> dst = lookupMem(ctx, dstMem);
+    result = checkCopy(src, dst, srcMem, dstMem);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    // Offsets and sizes are {x, y, z} in elements; resources are at most 2D
+    std::shared_ptr<Resource> s = src->res;
+    std::shared_ptr<Resource> d = dst->res;
+    CALuint w = size[0];
+    CALuint h = std::max(size[1], 1u);
+    if (s->elementSize != d->elementSize)
+    {
+        return setError(CAL_RESULT_ERROR, "Source and destination element sizes differ");
+    }
+    if (std::max(size[2], 1u) != 1 || srcOffset[2] != 0 || dstOffset[2] != 0 ||
+        static_cast<CALuint64>(srcOffset[0]) + w > s->pitch || static_cast<CALuint64>(srcOffset[1]) + h > s->height ||
+        static_cast<CALuint64>(dstOffset[0]) + w > d->pitch || static_cast<CALuint64>(dstOffset[1]) + h > d->height)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Partial copy region is out of bounds");
+    }
+
+    CALuint sx = srcOffset[0], sy = srcOffset[1], dx = dstOffset[0], dy = dstOffset[1];
+    *event = submit(*context, [s, d, sx, sy, dx, dy, w, h] { copyRect(*s, sx, sy, *d, dx, dy, w, h); });
+    return CAL_RESULT_OK;
+}
+
+CALresult
+resMemCopy(CALresource srcRes, CALresource dstRes, CALuint flags)
+{
+    (void)flags;
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    std::shared_ptr<Resource> s = drv.resources.get(srcRes);
+    std::shared_ptr<Resource> d = drv.resources.get(dstRes);
+    if (!s || !d)
+    {
+        CALresource bad = !s ? srcRes : dstRes;
+        return setHandleError(bad, "Invalid resource handle %u", bad);
+    }
+    if (s->elementSize != d->elementSize || d->width < s->width || d->height < s->height)
+    {
+        return setError(CAL_RESULT_ERROR, "Incompatible resources for copy");
+    }
+    copyRect(*s, 0, 0, *d, 0, 0, s->width, s->height);
+    return CAL_RESULT_OK;
+}
+
+} // namespace calsw
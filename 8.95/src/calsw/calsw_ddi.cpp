@@ -0,0 +1,533 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "calsw_internal.h"
+
+using namespace calsw;
+
+namespace {
+
+const unsigned int DriverVersionMajor = 2;
+const unsigned int DriverVersionMinor = 4;
+const unsigned int DriverVersionImp   = 0;
+
+//
+// Tags a failure with the entry point on this thread's error record; the
+// failing lookup already named the offending handle. Ddi(api) is evaluated
+// before the wrapped call (the callee of a call is sequenced before its
+// arguments), so only a record raised by that call is amended.
+//
+class Ddi
+{
+public:
+    explicit Ddi(CALapiId api) : m_api(api), m_since(calErrorSequence()) {}
+
+    DDIresult operator()(CALresult result) const
+    {
+        if (result != CAL_RESULT_OK && result != CAL_RESULT_PENDING)
+        {
+            calErrorAnnotate(m_since, result, m_api, 0, 0);
+        }
+        return static_cast<DDIresult>(result);
+    }
+
+private:
+    CALapiId    m_api;
+    CALuint64   m_since;
+};
+
+/*----------------------------------------------------------------------------
+ * calddi_if entries, in export order
+ *----------------------------------------------------------------------------*/
+
+DDIresult CALAPIENTRY
+ddiInit(void)
+{
+    return Ddi(CAL_API_INIT)(init());
+}
+
+DDIresult CALAPIENTRY
+ddiGetVersion(unsigned int* major, unsigned int* minor, unsigned int* imp)
+{
+    if (!major || !minor || !imp)
+    {
+        return Ddi(CAL_API_GET_VERSION)(setError(CAL_RESULT_INVALID_PARAMETER, "Version pointer is NULL"));
+    }
+    *major = DriverVersionMajor;
+    *minor = DriverVersionMinor;
+    *imp   = DriverVersionImp;
+    return DDI_RESULT_OK;
+}
+
+DDIresult CALAPIENTRY
+ddiShutdown(void)
+{
+    return Ddi(CAL_API_SHUTDOWN)(shutdown());
+}
+
+DDIresult CALAPIENTRY
+ddiDeviceGetCount(CALuint* count)
+{
+    return Ddi(CAL_API_DEVICE_GET_COUNT)(deviceGetCount(count));
+}
+
+DDIresult CALAPIENTRY
+ddiDeviceGetInfo(CALdeviceinfo* info, CALuint ordinal)
+{
+    return Ddi(CAL_API_DEVICE_GET_INFO)(deviceGetInfo(info, ordinal));
+}
+
+DDIresult CALAPIENTRY
+ddiDeviceGetAttribs(CALdeviceattribs* attribs, CALuint ordinal)
+{
+    return Ddi(CAL_API_DEVICE_GET_ATTRIBS)(deviceGetAttribs(attribs, ordinal));
+}
+
+DDIresult CALAPIENTRY
+ddiDeviceGetStatus(CALdevicestatus* status, CALdevice dev)
+{
+    return Ddi(CAL_API_DEVICE_GET_STATUS)(deviceGetStatus(status, dev));
+}
+
+DDIresult CALAPIENTRY
+ddiDeviceOpen(CALdevice* dev, CALuint ordinal)
+{
+    return Ddi(CAL_API_DEVICE_OPEN)(deviceOpen(dev, ordinal));
+}
+
+DDIresult CALAPIENTRY
+ddiDeviceClose(CALdevice dev)
+{
+    return Ddi(CAL_API_DEVICE_CLOSE)(deviceClose(dev));
+}
+
+DDIresult CALAPIENTRY
+ddiResAllocLocal2D(CALresource* res, CALdevice dev, CALuint width, CALuint height, CALformat format, CALuint flags)
+{
+    return Ddi(CAL_API_RES_ALLOC_LOCAL_2D)(resAlloc(res, &dev, 1, CAL_RESALLOC_TYPE_LOCAL, CAL_DIM_2D, width, height, format, flags, 0, 0));
+}
+
+DDIresult CALAPIENTRY
+ddiResAllocRemote2D(CALresource* res, CALdevice* devs, CALuint devCount, CALuint width, CALuint height, CALformat format, CALuint flags)
+{
+    return Ddi(CAL_API_RES_ALLOC_REMOTE_2D)(resAlloc(res, devs, devCount, CAL_RESALLOC_TYPE_REMOTE, CAL_DIM_2D, width, height, format, flags, 0, 0));
+}
+
+DDIresult CALAPIENTRY
+ddiResAllocLocal1D(CALresource* res, CALdevice dev, CALuint width, CALformat format, CALuint flags)
+{
+    return Ddi(CAL_API_RES_ALLOC_LOCAL_1D)(resAlloc(res, &dev, 1, CAL_RESALLOC_TYPE_LOCAL, CAL_DIM_1D, width, 1, format, flags, 0, 0));
+}
+
+DDIresult CALAPIENTRY
+ddiResAllocRemote1D(CALresource* res, CALdevice* devs, CALuint devCount, CALuint width, CALformat format, CALuint flags)
+{
+    return Ddi(CAL_API_RES_ALLOC_REMOTE_1D)(resAlloc(res, devs, devCount, CAL_RESALLOC_TYPE_REMOTE, CAL_DIM_1D, width, 1, format, flags, 0, 0));
+}
+
+DDIresult CALAPIENTRY
+ddiResFree(CALresource res)
+{
+    return Ddi(CAL_API_RES_FREE)(resFree(res));
+}
+
+DDIresult CALAPIENTRY
+ddiResMap(CALvoid** ptr, CALuint* pitch, CALresource res, CALuint flags)
+{
+    return Ddi(CAL_API_RES_MAP)(resMap(ptr, pitch, res, flags));
+}
+
+DDIresult CALAPIENTRY
+ddiResUnmap(CALresource res)
+{
+    return Ddi(CAL_API_RES_UNMAP)(resUnmap(res));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxCreate(CALcontext* ctx, CALdevice dev)
+{
+    return Ddi(CAL_API_CTX_CREATE)(ctxCreate(ctx, dev));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxDestroy(CALcontext ctx)
+{
+    return Ddi(CAL_API_CTX_DESTROY)(ctxDestroy(ctx));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxGetMem(CALmem* mem, CALcontext ctx, CALresource res)
+{
+    return Ddi(CAL_API_CTX_GET_MEM)(ctxGetMem(mem, ctx, res));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxReleaseMem(CALcontext ctx, CALmem mem)
+{
+    return Ddi(CAL_API_CTX_RELEASE_MEM)(ctxReleaseMem(ctx, mem));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxSetMem(CALcontext ctx, CALname name, CALmem mem)
+{
+    return Ddi(CAL_API_CTX_SET_MEM)(ctxSetMem(ctx, name, mem));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxRunProgram(CALevent* event, CALcontext ctx, CALfunc func, const CALdomain* domain)
+{
+    return Ddi(CAL_API_CTX_RUN_PROGRAM)(ctxRunProgram(event, ctx, func, domain));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxIsEventDone(CALcontext ctx, CALevent event)
+{
+    return Ddi(CAL_API_CTX_IS_EVENT_DONE)(ctxIsEventDone(ctx, event));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxFlush(CALcontext ctx)
+{
+    return Ddi(CAL_API_CTX_FLUSH)(ctxFlush(ctx));
+}
+
+DDIresult CALAPIENTRY
+ddiMemCopy(CALevent* event, CALcontext ctx, CALmem src, CALmem dst, CALuint flags)
+{
+    return Ddi(CAL_API_MEM_COPY)(memCopy(event, ctx, src, dst, flags));
+}
+
+DDIresult CALAPIENTRY
+ddiImageRead(CALimage* image, const CALvoid* buffer, CALuint size)
+{
+    return Ddi(CAL_API_IMAGE_READ)(imageRead(image, buffer, size));
+}
+
+DDIresult CALAPIENTRY
+ddiImageFree(CALimage image)
+{
+    return Ddi(CAL_API_IMAGE_FREE)(freeImage(image));
+}
+
+DDIresult CALAPIENTRY
+ddiModuleLoad(CALmodule* module, CALcontext ctx, CALimage image)
+{
+    return Ddi(CAL_API_MODULE_LOAD)(moduleLoad(module, ctx, image));
+}
+
+DDIresult CALAPIENTRY
+ddiModuleUnload(CALcontext ctx, CALmodule module)
+{
+    return Ddi(CAL_API_MODULE_UNLOAD)(moduleUnload(ctx, module));
+}
+
+DDIresult CALAPIENTRY
+ddiModuleGetEntry(CALfunc* func, CALcontext ctx, CALmodule module, const CALchar* procName)
+{
+    return Ddi(CAL_API_MODULE_GET_ENTRY)(moduleGetEntry(func, ctx, module, procName));
+}
+
+DDIresult CALAPIENTRY
+ddiModuleGetName(CALname* name, CALcontext ctx, CALmodule module, const CALchar* varName)
+{
+    return Ddi(CAL_API_MODULE_GET_NAME)(moduleGetName(name, ctx, module, varName));
+}
+
+const char* CALAPIENTRY
+ddiGetErrorString()
+{
+    return errorString();
+}
+
+DDIresult CALAPIENTRY
+ddiCtxRunProgramGrid(CALevent* event, CALcontext ctx, CALprogramGrid* grid)
+{
+    return Ddi(CAL_API_CTX_RUN_PROGRAM_GRID)(ctxRunProgramGrid(event, ctx, grid));
+}
+
+DDIresult CALAPIENTRY
+ddiModuleGetFuncInfo(CALfuncInfo* info, CALcontext ctx, CALmodule module, CALfunc func)
+{
+    return Ddi(CAL_API_MODULE_GET_FUNC_INFO)(moduleGetFuncInfo(info, ctx, module, func));
+}
+
+DDIresult CALAPIENTRY
+ddiCtxRunProgramGridArray(CALevent* event, CALcontext ctx, CALprogramGridArray* gridArray)
+{
+    return Ddi(CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY)(ctxRunProgramGridArray(event, ctx, gridArray));
+}
+
+DDIresult CALAPIENTRY
+ddiExtSupported(CALextid extid)
+{
+    return Ddi(CAL_API_EXT_SUPPORTED)(extSupported(extid));
+}
+
+DDIresult CALAPIENTRY
+ddiExtGetVersion(CALuint* major, CALuint* minor, CALextid extid)
+{
+    return Ddi(CAL_API_EXT_GET_VERSION)(extGetVersion(major, minor, extid));
+}
+
+DDIresult CALAPIENTRY
+ddiExtGetProc(CALextproc* proc, CALextid extid, const CALchar* procname)
+{
+    return Ddi(CAL_API_EXT_GET_PROC)(extGetProc(proc, extid, procname));
+}
+
+DDIresult CALAPIENTRY
+ddiCompile(CALobject* obj, CALlanguage language, const CALchar* source, CALtarget target)
+{
+    return Ddi(CAL_API_CL_COMPILE)(compile(obj, language, source, target));
+}
+
+DDIresult CALAPIENTRY
+ddiLink(CALimage* image, CALobject* objs, CALuint count)
+{
+    return Ddi(CAL_API_CL_LINK)(link(image, objs, count));
+}
+
+DDIresult CALAPIENTRY
+ddiFreeObject(CALobject obj)
+{
+    return Ddi(CAL_API_CL_FREE_OBJECT)(freeObject(obj));
+}
+
+DDIresult CALAPIENTRY
+ddiFreeImage(CALimage image)
+{
+    return Ddi(CAL_API_CL_FREE_IMAGE)(freeImage(image));
+}
+
+void CALAPIENTRY
+ddiDisassembleImage(const CALimage image, CALLogFunction logfunc)
+{
+    disassembleImage(image, logfunc);
+}
+
+DDIresult CALAPIENTRY
+ddiAssembleObject(CALobject* obj, CALCLprogramType type, const CALchar* source, CALtarget target)
+{
+    return Ddi(CAL_API_CL_ASSEMBLE_OBJECT)(assemble(obj, CAL_LANGUAGE_IL, type, source, target));
+}
+
+void CALAPIENTRY
+ddiDisassembleObject(const CALobject* obj, CALLogFunction logfunc)
+{
+    disassembleObject(obj, logfunc);
+}
+
+DDIresult CALAPIENTRY
+ddiImageGetSize(CALuint* size, CALimage image)
+{
+    return Ddi(CAL_API_CL_IMAGE_GET_SIZE)(imageGetSize(size, image));
+}
+
+DDIresult CALAPIENTRY
+ddiImageWrite(CALvoid* buffer, CALuint size, CALimage image)
+{
+    return Ddi(CAL_API_CL_IMAGE_WRITE)(imageWrite(buffer, size, image));
+}
+
+const char* CALAPIENTRY
+ddiclGetErrorString()
+{
+    return compilerErrorString();
+}
+
+DDIresult CALAPIENTRY
+ddiConfig(const CALchar* key, const CALchar* value)
+{
+    return Ddi(CAL_API_NONE)(config(key, value));
+}
+
+CALvoid CALAPIENTRY
+ddiClearConfig()
+{
+    clearConfig();
+}
+
+DDIresult CALAPIENTRY
+ddiAssemble(CALobject* obj, CALlanguage language, CALCLprogramType type, const CALchar* source, CALtarget target)
+{
+    return Ddi(CAL_API_CL_ASSEMBLE_OBJECT)(assemble(obj, language, type, source, target));
+}
+
+void CALAPIENTRY
+ddiDisassemble(const CALobject* obj, CALlanguage language, CALLogFunction logfunc)
+{
+    (void)language;
+    disassembleObject(obj, logfunc);
+}
+
+DDIresult CALAPIENTRY
+ddiclExtGetProc(CALCLextproc* proc, CALCLextid extid, const CALchar* procname)
+{
+    return Ddi(CAL_API_CL_EXT_GET_PROC)(clExtGetProc(proc, extid, procname));
+}
+
+DDIresult CALAPIENTRY
+ddiclExtSupported(CALCLextid extid)
+{
+    return Ddi(CAL_API_CL_EXT_SUPPORTED)(clExtSupported(extid));
+}
+
+DDIresult CALAPIENTRY
+ddiDeviceClockUp(CALdevice dev, CALuint flag)
+{
+    return Ddi(CAL_API_NONE)(deviceClockUp(dev, flag));
+}
+
+DDIresult CALAPIENTRY
+ddiGetFuncInfoFromImage(CALimage image, CALfuncInfo* info)
+{
+    return Ddi(CAL_API_NONE)(getFuncInfoFromImage(image, info));
+}
+
+const calddi_if s_interface = {
+    ddiInit,
+    ddiGetVersion,
+    ddiShutdown,
+    ddiDeviceGetCount,
+    ddiDeviceGetInfo,
+    ddiDeviceGetAttribs,
+    ddiDeviceGetStatus,
+    ddiDeviceOpen,
+    ddiDeviceClose,
+    ddiResAllocLocal2D,
+    ddiResAllocRemote2D,
+    ddiResAllocLocal1D,
+    ddiResAllocRemote1D,
+    ddiResFree,
+    ddiResMap,
+    ddiResUnmap,
+    ddiCtxCreate,
+    ddiCtxDestroy,
+    ddiCtxGetMem,
+    ddiCtxReleaseMem,
+    ddiCtxSetMem,
+    ddiCtxRunProgram,
+    ddiCtxIsEventDone,
+    ddiCtxFlush,
+    ddiMemCopy,
+    ddiImageRead,
+    ddiImageFree,
+    ddiModuleLoad,
+    ddiModuleUnload,
+    ddiModuleGetEntry,
+    ddiModuleGetName,
+    ddiGetErrorString,
+    ddiCtxRunProgramGrid,
+    ddiModuleGetFuncInfo,
+    ddiCtxRunProgramGridArray,
+    ddiExtSupported,
+    ddiExtGetVersion,
+    ddiExtGetProc,
+    ddiCompile,
+    ddiLink,
+    ddiFreeObject,
+    ddiFreeImage,
+    ddiDisassembleImage,
+    ddiAssembleObject,
+    ddiDisassembleObject,
+    ddiImageGetSize,
+    ddiImageWrite,
+    ddiclGetErrorString,
+    ddiConfig,
+    ddiClearConfig,
+    ddiAssemble,
+    ddiDisassemble,
+    ddiclExtGetProc,
+    ddiclExtSupported,
+    ddiDeviceClockUp,
+    ddiGetFuncInfoFromImage,
+};
+
+const unsigned int s_exportCount = sizeof(calddi_if) / sizeof(void*);
+
+} // anonymous namespace
+
+/*----------------------------------------------------------------------------
+ * Driver exports
+ *----------------------------------------------------------------------------*/
+
+extern "C" {
+
+CALAPI int CALAPIENTRY
+calddiInit(unsigned int ddi_version)
+{
+    return (ddi_version == CALDDI_VERSION) ? 1 : 0;
+}
+
+CALAPI void* CALAPIENTRY
+calddiGetExport(unsigned int export_num)
+{
+    if (export_num >= s_exportCount)
+    {
+        return 0;
+    }
+    const void* const* exports = reinterpret_cast<const void* const*>(&s_interface);
+    return const_cast<void*>(exports[export_num]);
+}
+
+CALAPI unsigned int CALAPIENTRY
+calddiGetVersion()
+{
+    return CALDDI_VERSION;
+}
+
+CALAPI const calddi_if* CALAPIENTRY
+calswGetInterface(void)
+{
+    return &s_interface;
+}
+
+CALAPI CALresult CALAPIENTRY
+calswRegisterKernel(const CALchar* name, CALswKernel kernel, CALvoid* userData)
+{
+    if (!name || !kernel)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    Driver& drv = driver();
+    std::lock_guard<std::mutex> guard(drv.kernelLock);
+    KernelEntry& entry = drv.kernels[name];
+    entry.kernel   = kernel;
+    entry.userData = userData;
+    return CAL_RESULT_OK;
+}
+
+CALAPI CALresult CALAPIENTRY
+calswUnregisterKernel(const CALchar* name)
+{
+    if (!name)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    Driver& drv = driver();
+    std::lock_guard<std::mutex> guard(drv.kernelLock);
+    return drv.kernels.erase(name) ? CAL_RESULT_OK : CAL_RESULT_ERROR;
+}
+
+} // extern "C"
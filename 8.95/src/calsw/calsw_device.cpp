@@ -0,0 +1,845 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "calsw_internal.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace calsw {
+
+namespace {
+
+const CALuint MaxResource1DWidth  = 16384;
+const CALuint MaxResource2DWidth  = 16384;
+const CALuint MaxResource2DHeight = 16384;
+const CALuint MaxGlobalBuffer     = 1u << 28;
+const CALuint64 MB                = 1024 * 1024;
+
+std::mutex s_errorLock;                  // process wide copies, only ever try-locked
+CALchar    s_errorString[1024];
+CALchar    s_compilerErrorString[1024];
+
+thread_local CALchar t_errorString[1024];
+thread_local CALchar t_compilerErrorString[1024];
+
+CALuint
+envUint(const char* name, CALuint defaultValue)
+{
+    const char* value = std::getenv(name);
+    return (value && *value) ? static_cast<CALuint>(std::strtoul(value, 0, 10)) : defaultValue;
+}
+
+CALubyte*
+allocAligned(CALuint64 size)
+{
+    void* ptr = 0;
+    size_t bytes = static_cast<size_t>(size ? size : 1);
+#ifdef _WIN32
+    ptr = _aligned_malloc(bytes, SurfaceAlignment);
+#else
+    if (posix_memalign(&ptr, SurfaceAlignment, bytes) != 0)
+    {
+        ptr = 0;
+    }
+#endif
+    if (ptr)
+    {
+        std::memset(ptr, 0, bytes);
+    }
+    return static_cast<CALubyte*>(ptr);
+}
+
+void
+freeAligned(void* ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+CALuint
+alignUp(CALuint value, CALuint alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+Device*
+lookupDevice(CALdevice dev)
+{
+    Driver& drv = driver();
+    if (dev == 0 || dev > drv.devices.size() || !drv.devices[dev - 1].open)
+    {
+        return 0;
+    }
+    return &drv.devices[dev - 1];
+}
+
+std::atomic<CALuint64>&
+usage(Device& device, CALresallocType type)
+{
+    return (type == CAL_RESALLOC_TYPE_LOCAL) ? device.localBytes : device.remoteBytes;
+}
+
+// Add bytes to used unless that exceeds budget; concurrent allocations
+// cannot both pass the check
+bool
+reserve(std::atomic<CALuint64>& used, CALuint64 bytes, CALuint64 budget)
+{
+    CALuint64 current = used.load();
+    do
+    {
+        if (bytes > budget || current > budget - bytes)
+        {
+            return false;
+        }
+    } while (!used.compare_exchange_weak(current, current + bytes));
+    return true;
+}
+
+CALuint
+toMB(CALuint64 bytes)
+{
+    return static_cast<CALuint>(bytes / MB);
+}
+
+//
+// Copy a thread's message to the process wide string. A thread that finds
+// another one publishing skips the copy instead of waiting; its message is
+// still in its own record.
+//
+void
+publishError(CALchar* global, const CALchar* message)
+{
+    std::unique_lock<std::mutex> guard(s_errorLock, std::try_to_lock);
+    if (guard.owns_lock())
+    {
+        strcpy(global, message);
+    }
+}
+
+} // anonymous namespace
+
+Driver&
+driver()
+{
+    static Driver s_driver;
+    return s_driver;
+}
+
+CALresult
+setError(CALresult result, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(t_errorString, sizeof(t_errorString), fmt, args);
+    va_end(args);
+    calErrorSet(result, CAL_API_NONE, 0, "%s", t_errorString);
+    publishError(s_errorString, t_errorString);
+    return result;
+}
+
+CALresult
+setHandleError(CALuint handle, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(t_errorString, sizeof(t_errorString), fmt, args);
+    va_end(args);
+    calErrorSet(CAL_RESULT_BAD_HANDLE, CAL_API_NONE, handle, "%s", t_errorString);
+    publishError(s_errorString, t_errorString);
+    return CAL_RESULT_BAD_HANDLE;
+}
+
+CALresult
+setCompilerError(CALresult result, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(t_compilerErrorString, sizeof(t_compilerErrorString), fmt, args);
+    va_end(args);
+    calErrorSet(result, CAL_API_NONE, 0, "%s", t_compilerErrorString);
+    publishError(s_compilerErrorString, t_compilerErrorString);
+    return result;
+}
+
+const CALchar*
+errorString()
+{
+    return t_errorString[0] ? t_errorString : s_errorString;
+}
+
+const CALchar*
+compilerErrorString()
+{
+    return t_compilerErrorString[0] ? t_compilerErrorString : s_compilerErrorString;
+}
+
+Resource::Resource()
+    : dev(0), type(CAL_RESALLOC_TYPE_LOCAL), dimension(CAL_DIM_2D), format(CAL_FORMAT_UNORM_INT8_1), elementSize(0),
+      width(0), height(0), depth(1), pitch(0), flags(0), byteSize(0), base(0), ownsMemory(false), isHeap(false), mapped(false)
+{
+}
+
+Resource::~Resource()
+{
+    if (ownsMemory)
+    {
+        freeAligned(base);
+        Device* device = lookupDevice(dev);
+        if (device)
+        {
+            usage(*device, type) -= byteSize;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------
+ * Subsystem
+ *----------------------------------------------------------------------------*/
+
+CALresult
+init()
+{
+    Driver& drv = driver();
+    std::lock_guard<std::mutex> guard(drv.lock);
+
+    if (drv.initialized)
+    {
+        return setError(CAL_RESULT_ALREADY, "CAL has already been initialized");
+    }
+
+    drv.deviceCount = envUint("CALSW_DEVICE_COUNT", 1);
+    drv.localRAM    = envUint("CALSW_LOCAL_RAM_MB", 1024);
+    drv.heapSize    = envUint("CALSW_HEAP_MB", 64);
+    drv.devices     = std::vector<Device>(drv.deviceCount);
+    for (CALuint i = 0; i < drv.deviceCount; ++i)
+    {
+        drv.devices[i].ordinal = i;
+    }
+    drv.checkThread = false;
+    drv.initialized = true;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+shutdown()
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+
+    // Contexts own worker threads, so tear them down before the objects
+    // they reference disappear.
+    std::vector<CALcontext> contexts = drv.contexts.handles();
+    for (size_t i = 0; i < contexts.size(); ++i)
+    {
+        ctxDestroy(contexts[i]);
+    }
+
+    std::lock_guard<std::mutex> guard(drv.lock);
+    drv.counters.clear();
+    drv.funcs.clear();
+    drv.names.clear();
+    drv.modules.clear();
+    drv.mems.clear();
+    drv.contexts.clear();
+    drv.resources.clear();
+    drv.devices.clear();
+    drv.initialized = false;
+    return CAL_RESULT_OK;
+}
+
+/*----------------------------------------------------------------------------
+ * Devices
+ *----------------------------------------------------------------------------*/
+
+CALresult
+deviceGetCount(CALuint* count)
+{
+    if (!driver().initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!count)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "count is NULL");
+    }
+    *count = driver().deviceCount;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+deviceGetInfo(CALdeviceinfo* info, CALuint ordinal)
+{
+    if (!driver().initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!info || ordinal >= driver().deviceCount)
+    {
+        return setError(CAL_RESULT_ERROR, "Invalid device ordinal %u", ordinal);
+    }
+    info->target              = CAL_TARGET_CYPRESS;
+    info->maxResource1DWidth  = MaxResource1DWidth;
+    info->maxResource2DWidth  = MaxResource2DWidth;
+    info->maxResource2DHeight = MaxResource2DHeight;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+deviceGetAttribs(CALdeviceattribs* attribs, CALuint ordinal)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!attribs || ordinal >= drv.deviceCount)
+    {
+        return setError(CAL_RESULT_ERROR, "Invalid device ordinal %u", ordinal);
+    }
+
+    // Only fill as much as the client said it has room for
+    CALdeviceattribs a;
+    std::memset(&a, 0, sizeof(a));
+    a.struct_size                   = sizeof(a);
+    a.target                        = CAL_TARGET_CYPRESS;
+    a.localRAM                      = drv.localRAM;
+    a.uncachedRemoteRAM             = envUint("CALSW_REMOTE_RAM_MB", 2048);
+    a.cachedRemoteRAM               = a.uncachedRemoteRAM;
+    a.engineClock                   = 1000;
+    a.memoryClock                   = 1000;
+    a.wavefrontSize                 = 64;
+    a.numberOfSIMD                  = std::max(1u, std::thread::hardware_concurrency());
+    a.doublePrecision               = CAL_TRUE;
+    a.localDataShare                = CAL_TRUE;
+    a.globalDataShare               = CAL_TRUE;
+    a.globalGPR                     = CAL_TRUE;
+    a.computeShader                 = CAL_TRUE;
+    a.memExport                     = CAL_TRUE;
+    a.pitch_alignment               = PitchAlignment;
+    a.surface_alignment             = SurfaceAlignment;
+    a.numberOfUAVs                  = 12;
+    a.bUAVMemExport                 = CAL_FALSE;
+    a.b3dProgramGrid                = CAL_TRUE;
+    a.numberOfShaderEngines         = 1;
+    a.targetRevision                = 0;
+    a.totalVisibleHeap              = drv.localRAM / 4;
+    a.totalInvisibleHeap            = drv.localRAM - a.totalVisibleHeap;
+    a.totalDirectHeap               = 0;
+    a.totalCoherentHeap             = 0;
+    a.totalRemoteSharedHeap         = a.uncachedRemoteRAM;
+    a.totalCachedRemoteSharedHeap   = a.cachedRemoteRAM;
+    a.pciTopologyInformation        = 0;
+    std::snprintf(a.boardName, sizeof(a.boardName), "CAL Software Device %u", ordinal);
+    a.vectorBufferInstructionAddr64 = CAL_TRUE;
+    a.memRandomAccessTargetInstructions = CAL_TRUE;
+    a.asyncDispatchSupported        = CAL_TRUE;
+
+    CALuint size = attribs->struct_size ? std::min(attribs->struct_size, static_cast<CALuint>(sizeof(a))) : static_cast<CALuint>(sizeof(a));
+    std::memcpy(attribs, &a, size);
+    attribs->struct_size = size;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+deviceGetStatus(CALdevicestatus* status, CALdevice dev)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    Device* device = lookupDevice(dev);
+    if (!device || !status)
+    {
+        return setHandleError(dev, "Invalid device handle %u", dev);
+    }
+
+    CALdeviceattribs attribs;
+    attribs.struct_size = sizeof(attribs);
+    deviceGetAttribs(&attribs, device->ordinal);
+
+    CALuint usedLocal  = toMB(device->localBytes + MB - 1);
+    CALuint usedRemote = toMB(device->remoteBytes + MB - 1);
+    CALuint availLocal  = attribs.localRAM > usedLocal ? attribs.localRAM - usedLocal : 0;
+    CALuint availRemote = attribs.uncachedRemoteRAM > usedRemote ? attribs.uncachedRemoteRAM - usedRemote : 0;
+
+    // Local allocations fill the invisible heap first, then the visible one
+    CALuint usedInvisible = std::min(usedLocal, attribs.totalInvisibleHeap);
+    CALuint usedVisible   = usedLocal - usedInvisible;
+    CALuint availVisible  = attribs.totalVisibleHeap > usedVisible ? attribs.totalVisibleHeap - usedVisible : 0;
+
+    CALdevicestatus s;
+    std::memset(&s, 0, sizeof(s));
+    s.struct_size                        = sizeof(s);
+    s.availLocalRAM                      = availLocal;
+    s.availUncachedRemoteRAM             = availRemote;
+    s.availCachedRemoteRAM               = availRemote;
+    s.availVisibleHeap                   = availVisible;
+    s.availInvisibleHeap                 = attribs.totalInvisibleHeap - usedInvisible;
+    s.availRemoteSharedHeap              = availRemote;
+    s.availCachedRemoteSharedHeap        = availRemote;
+    s.largestBlockVisibleHeap            = s.availVisibleHeap;
+    s.largestBlockInvisibleHeap          = s.availInvisibleHeap;
+    s.largestBlockRemoteHeap             = availRemote;
+    s.largestBlockCachedRemoteHeap       = availRemote;
+    s.largestBlockRemoteSharedHeap       = availRemote;
+    s.largestBlockCachedRemoteSharedHeap = availRemote;
+
+    CALuint size = status->struct_size ? std::min(status->struct_size, static_cast<CALuint>(sizeof(s))) : static_cast<CALuint>(sizeof(s));
+    std::memcpy(status, &s, size);
+    status->struct_size = size;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+deviceOpen(CALdevice* dev, CALuint ordinal)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!dev)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "dev is NULL");
+    }
+    *dev = 0;
+
+    std::lock_guard<std::mutex> guard(drv.lock);
+    if (ordinal >= drv.deviceCount)
+    {
+        return setError(CAL_RESULT_ERROR, "Invalid device ordinal %u", ordinal);
+    }
+    if (drv.devices[ordinal].open)
+    {
+        return setError(CAL_RESULT_ERROR, "Device %u is already open", ordinal);
+    }
+    drv.devices[ordinal].open = true;
+    *dev = ordinal + 1;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+deviceClose(CALdevice dev)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+
+    CALresource heap = 0;
+    {
+        std::lock_guard<std::mutex> guard(drv.lock);
+        Device* device = lookupDevice(dev);
+        if (!device)
+        {
+            return setHandleError(dev, "Invalid device handle %u", dev);
+        }
+        heap = device->heap;
+        device->heap = 0;
+        device->open = false;
+    }
+    if (heap)
+    {
+        drv.resources.remove(heap);
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+deviceClockUp(CALdevice dev, CALuint flag)
+{
+    (void)flag;
+    if (!driver().initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    return lookupDevice(dev) ? CAL_RESULT_OK : setHandleError(dev, "Invalid device handle %u", dev);
+}
+
+CALresult
+deviceGetAttribsExt(CALdeviceattribsExt* attribsExt, CALdevice dev)
+{
+    if (!driver().initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!lookupDevice(dev) || !attribsExt)
+    {
+        return setHandleError(dev, "Invalid device handle %u", dev);
+    }
+    attribsExt->struct_size = sizeof(CALdeviceattribsExt);
+    attribsExt->isVMEnabled = CAL_FALSE;
+    return CAL_RESULT_OK;
+}
+
+/*----------------------------------------------------------------------------
+ * Resources
+ *----------------------------------------------------------------------------*/
+
+CALresult
+resAlloc(CALresource* res, CALdevice* devs, CALuint devCount, CALresallocType type, CALdimension dim,
+         CALuint width, CALuint height, CALformat format, CALuint flags, CALvoid* systemMemory, CALuint systemSize)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!res)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "res is NULL");
+    }
+    *res = 0;
+
+    if (!devs || devCount == 0)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "No device given for allocation");
+    }
+    Device* device = 0;
+    for (CALuint i = 0; i < devCount; ++i)
+    {
+        Device* d = lookupDevice(devs[i]);
+        if (!d)
+        {
+            return setHandleError(devs[i], "Invalid device handle %u", devs[i]);
+        }
+        device = device ? device : d;
+    }
+
+    CALuint elementSize = cal::formatTraits(format).elementSize;
+    if (elementSize == 0 || width == 0 || height == 0)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Invalid resource format or dimensions");
+    }
+    if (dim == CAL_DIM_1D || dim == CAL_DIM_BUFFER)
+    {
+        CALuint limit = (flags & CAL_RESALLOC_GLOBAL_BUFFER) ? MaxGlobalBuffer : MaxResource1DWidth;
+        if (width > limit)
+        {
+            return setError(CAL_RESULT_ERROR, "1D resource width %u exceeds %u", width, limit);
+        }
+    }
+    else if (width > MaxResource2DWidth || height > MaxResource2DHeight)
+    {
+        return setError(CAL_RESULT_ERROR, "2D resource %ux%u exceeds %ux%u", width, height, MaxResource2DWidth, MaxResource2DHeight);
+    }
+
+    std::shared_ptr<Resource> r = std::make_shared<Resource>();
+    r->dev         = devs[0];
+    r->type        = type;
+    r->dimension   = dim;
+    r->format      = format;
+    r->elementSize = elementSize;
+    r->width       = width;
+    r->height      = height;
+    r->pitch       = (dim == CAL_DIM_2D && !systemMemory) ? alignUp(width, PitchAlignment) : width;
+    r->flags       = flags;
+    r->byteSize    = static_cast<CALuint64>(r->pitch) * height * elementSize;
+
+    if (systemMemory)
+    {
+        if (systemSize < r->byteSize)
+        {
+            return setError(CAL_RESULT_INVALID_PARAMETER, "Supplied memory is %u bytes, resource needs %llu",
+                            systemSize, static_cast<unsigned long long>(r->byteSize));
+        }
+        r->base = static_cast<CALubyte*>(systemMemory);
+        r->type = CAL_RESALLOC_TYPE_SYSTEM;
+    }
+    else
+    {
+        CALuint64 budget = static_cast<CALuint64>(drv.localRAM) * MB;
+        if (type != CAL_RESALLOC_TYPE_LOCAL)
+        {
+            budget = static_cast<CALuint64>(envUint("CALSW_REMOTE_RAM_MB", 2048)) * MB;
+        }
+        if (!reserve(usage(*device, type), r->byteSize, budget))
+        {
+            return setError(CAL_RESULT_ERROR, "Out of %s memory allocating %llu bytes",
+                            type == CAL_RESALLOC_TYPE_LOCAL ? "local" : "remote",
+                            static_cast<unsigned long long>(r->byteSize));
+        }
+        r->base = allocAligned(r->byteSize);
+        if (!r->base)
+        {
+            usage(*device, type) -= r->byteSize;
+            return setError(CAL_RESULT_ERROR, "Host allocation of %llu bytes failed", static_cast<unsigned long long>(r->byteSize));
+        }
+        r->ownsMemory = true;
+    }
+
+    *res = drv.resources.add(r);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+resAllocDesc(CALdeviceDesc* devDesc, const CALresourceDesc* resDesc, CALresource* res)
+{
+    if (!devDesc || !resDesc)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Invalid resource descriptor");
+    }
+    if (resDesc->dimension == CAL_DIM_3D || resDesc->mipLevels > 1)
+    {
+        return setError(CAL_RESULT_NOT_SUPPORTED, "3D and mipmapped resources are not supported");
+    }
+    CALuint height = (resDesc->dimension == CAL_DIM_2D) ? resDesc->size.height : 1;
+    return resAlloc(res, devDesc->dev, devDesc->devCount, resDesc->type, resDesc->dimension,
+                    resDesc->size.width, height, resDesc->format, resDesc->flags,
+                    resDesc->type == CAL_RESALLOC_TYPE_SYSTEM ? resDesc->systemMemory : 0, resDesc->systemMemorySize);
+}
+
+CALresult
+resAllocView(CALresource* view, CALresource res, CALdevice dev, CALdomain3D size, CALdomain offset,
+             CALformat format, CALchannelorder order, CALdimension dim, CALuint flags)
+{
+    (void)order;
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!view)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "resView is NULL");
+    }
+    *view = 0;
+
+    std::shared_ptr<Resource> parent = drv.resources.get(res);
+    if (!parent)
+    {
+        return setHandleError(res, "Invalid resource handle %u", res);
+    }
+    if (!lookupDevice(dev))
+    {
+        return setHandleError(dev, "Invalid device handle %u", dev);
+    }
+
+    CALuint elementSize = cal::formatTraits(format).elementSize;
+    CALuint height = (dim == CAL_DIM_2D) ? std::max(size.height, 1u) : 1;
+    if (elementSize == 0 || size.width == 0)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Invalid view format or size");
+    }
+
+    CALuint64 parentPitchBytes = static_cast<CALuint64>(parent->pitch) * parent->elementSize;
+    CALuint64 start = static_cast<CALuint64>(offset.y) * parentPitchBytes + static_cast<CALuint64>(offset.x) * parent->elementSize;
+    CALuint   pitch = size.width;
+    if (dim == CAL_DIM_2D && parentPitchBytes % elementSize == 0)
+    {
+        pitch = static_cast<CALuint>(parentPitchBytes / elementSize);
+    }
+    CALuint64 bytes = (static_cast<CALuint64>(pitch) * (height - 1) + size.width) * elementSize;
+    if (start + bytes > parent->byteSize)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "View [%llu, +%llu) exceeds resource of %llu bytes",
+                        static_cast<unsigned long long>(start), static_cast<unsigned long long>(bytes),
+                        static_cast<unsigned long long>(parent->byteSize));
+    }
+    if ((flags & CAL_RESALLOCVIEW_LINEAR_UNALIGNED) != CAL_RESALLOCVIEW_LINEAR_UNALIGNED && (start % SurfaceAlignment) != 0)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "View offset %llu is not %u byte aligned",
+                        static_cast<unsigned long long>(start), SurfaceAlignment);
+    }
+
+    std::shared_ptr<Resource> r = std::make_shared<Resource>();
+    r->dev         = dev;
+    r->type        = parent->type;
+    r->dimension   = dim;
+    r->format      = format;
+    r->elementSize = elementSize;
+    r->width       = size.width;
+    r->height      = height;
+    r->pitch       = pitch;
+    r->flags       = flags;
+    r->byteSize    = bytes;
+    r->base        = parent->base + start;
+    r->parent      = parent;
+
+    *view = drv.resources.add(r);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+resGetHeap(CALresource* res, CALdeviceDesc* devDesc, CALheapType type, CALuint size)
+{
+    (void)size;     // ignored for the global heap
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!res || !devDesc || !devDesc->dev || devDesc->devCount == 0 || type != CAL_HEAP_GLOBAL)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "Invalid heap request");
+    }
+    *res = 0;
+
+    std::lock_guard<std::mutex> guard(drv.lock);
+    Device* device = lookupDevice(devDesc->dev[0]);
+    if (!device)
+    {
+        return setHandleError(devDesc->dev[0], "Invalid device handle %u", devDesc->dev[0]);
+    }
+    if (!device->heap)
+    {
+        CALuint width = static_cast<CALuint>(static_cast<CALuint64>(drv.heapSize) * MB / 4);
+        CALresult result = resAlloc(&device->heap, devDesc->dev, devDesc->devCount, CAL_RESALLOC_TYPE_LOCAL, CAL_DIM_BUFFER,
+                                    width, 1, CAL_FORMAT_UNSIGNED_INT32_1, CAL_RESALLOC_GLOBAL_BUFFER, 0, 0);
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        drv.resources.get(device->heap)->isHeap = true;
+    }
+    *res = device->heap;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+resFree(CALresource res)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    std::shared_ptr<Resource> r = drv.resources.get(res);
+    if (!r)
+    {
+        return setHandleError(res, "Invalid resource handle %u", res);
+    }
+    if (r->isHeap)
+    {
+        // The global heap lives as long as its device
+        return CAL_RESULT_OK;
+    }
+    drv.resources.remove(res);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+resMap(CALvoid** ptr, CALuint* pitch, CALresource res, CALuint flags)
+{
+    (void)flags;
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    if (!ptr || !pitch)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "pPtr or pitch is NULL");
+    }
+    *ptr   = 0;
+    *pitch = 0;
+
+    std::shared_ptr<Resource> r = drv.resources.get(res);
+    if (!r)
+    {
+        return setHandleError(res, "Invalid resource handle %u", res);
+    }
+    if (r->mapped.exchange(true))
+    {
+        return setError(CAL_RESULT_ERROR, "Resource %u is already mapped", res);
+    }
+    *ptr   = r->base;
+    *pitch = r->pitch;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+resUnmap(CALresource res)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    std::shared_ptr<Resource> r = drv.resources.get(res);
+    if (!r)
+    {
+        return setHandleError(res, "Invalid resource handle %u", res);
+    }
+    if (!r->mapped.exchange(false))
+    {
+        return setError(CAL_RESULT_ERROR, "Resource %u is not mapped", res);
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+resQueryInfo(CALresource res, CALresInfo* info)
+{
+    Driver& drv = driver();
+    if (!drv.initialized)
+    {
+        return setError(CAL_RESULT_NOT_INITIALIZED, "CAL has not been initialized");
+    }
+    std::shared_ptr<Resource> r = drv.resources.get(res);
+    if (!r || !info)
+    {
+        return setHandleError(res, "Invalid resource handle %u", res);
+    }
+
+    std::memset(info, 0, sizeof(*info));
+    info->address        = reinterpret_cast<CALuint64>(r->base);
+    info->offset         = r->parent ? static_cast<CALuint>(r->base - r->parent->base) : 0;
+    info->alignment_xxx  = SurfaceAlignment;
+    info->type           = r->dimension;
+    info->location       = (r->type == CAL_RESALLOC_TYPE_LOCAL) ? CAL_MEMORY_CARD :
+                           (r->type == CAL_RESALLOC_TYPE_REMOTE) ? ((r->flags & CAL_RESALLOC_CACHEABLE) ? CAL_MEMORY_REMOTE_CACHEABLE : CAL_MEMORY_AGP) :
+                           CAL_MEMORY_SYSTEM;
+    info->allocationType = CAL_MEMORY_ALLOCATION_MIRRORED;
+    info->tilingFormat   = CAL_MEMORY_TILING_LINEAR_ALIGNED;
+    info->displayable    = CAL_MEMORY_DISPLAYABLE_NO;
+    info->samples        = 1;
+    info->format         = r->format;
+    info->numberFormat   = CAL_MEMORY_FORMAT_NORM;
+    info->pitch          = r->pitch;
+    info->height         = r->height;
+    info->width          = r->width;
+    info->layers         = 1;
+    info->byteSize       = static_cast<CALuint>(r->byteSize);
+    info->bitsPerElement = r->elementSize * 8;
+    return CAL_RESULT_OK;
+}
+
+} // namespace calsw
@@ -0,0 +1,508 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "calsw_internal.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace calsw {
+
+namespace {
+
+CALuint64
+nowNs()
+{
+    return static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+std::shared_ptr<Counter>
+lookupCounter(CALcontext ctx, CALcounter counter, CALresult* result)
+{
+    if (!lookupContext(ctx, result))
+    {
+        return std::shared_ptr<Counter>();
+    }
+    std::shared_ptr<Counter> c = driver().counters.get(counter);
+    if (!c || c->ctx != ctx)
+    {
+        *result = setHandleError(counter, "Invalid counter handle %u", counter);
+        return std::shared_ptr<Counter>();
+    }
+    return c;
+}
+
+/*----------------------------------------------------------------------------
+ * Extension procs. Each one has the exact PFN signature of its extension.
+ *----------------------------------------------------------------------------*/
+
+CALresult CALAPIENTRY
+swCtxRunProgramGrid(CALevent* event, CALcontext ctx, CALprogramGrid* grid)
+{
+    return ctxRunProgramGrid(event, ctx, grid);
+}
+
+CALresult CALAPIENTRY
+swModuleGetFuncInfo(CALfuncInfo* info, CALcontext ctx, CALmodule module, CALfunc func)
+{
+    return moduleGetFuncInfo(info, ctx, module, func);
+}
+
+CALresult CALAPIENTRY
+swCtxRunProgramGridArray(CALevent* event, CALcontext ctx, CALprogramGridArray* gridArray)
+{
+    return ctxRunProgramGridArray(event, ctx, gridArray);
+}
+
+CALresult CALAPIENTRY
+swResCreate2D(CALresource* res, CALdevice dev, CALvoid* mem, CALuint width, CALuint height, CALformat format, CALuint size, CALuint flags)
+{
+    return resAlloc(res, &dev, 1, CAL_RESALLOC_TYPE_SYSTEM, CAL_DIM_2D, width, height, format, flags, mem, size);
+}
+
+CALresult CALAPIENTRY
+swResCreate1D(CALresource* res, CALdevice dev, CALvoid* mem, CALuint width, CALformat format, CALuint size, CALuint flags)
+{
+    return resAlloc(res, &dev, 1, CAL_RESALLOC_TYPE_SYSTEM, CAL_DIM_1D, width, 1, format, flags, mem, size);
+}
+
+CALresult CALAPIENTRY
+swCtxCreateCounter(CALcounter* counter, CALcontext ctx, CALcountertype type)
+{
+    CALresult result;
+    if (!lookupContext(ctx, &result))
+    {
+        return result;
+    }
+    if (!counter)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "counter is NULL");
+    }
+    *counter = 0;
+    if (type != CAL_COUNTER_IDLE)
+    {
+        return setError(CAL_RESULT_NOT_SUPPORTED, "Counter type %d is not supported", type);
+    }
+
+    std::shared_ptr<Counter> c = std::make_shared<Counter>();
+    c->ctx         = ctx;
+    c->type        = type;
+    c->active      = false;
+    c->startNs     = 0;
+    c->startBusyNs = 0;
+    c->value       = 0.0f;
+    *counter = driver().counters.add(c);
+    return CAL_RESULT_OK;
+}
+
+CALresult CALAPIENTRY
+swCtxDestroyCounter(CALcontext ctx, CALcounter counter)
+{
+    CALresult result;
+    if (!lookupCounter(ctx, counter, &result))
+    {
+        return result;
+    }
+    driver().counters.remove(counter);
+    return CAL_RESULT_OK;
+}
+
+CALresult CALAPIENTRY
+swCtxBeginCounter(CALcontext ctx, CALcounter counter)
+{
+    CALresult result;
+    std::shared_ptr<Counter> c = lookupCounter(ctx, counter, &result);
+    if (!c)
+    {
+        return result;
+    }
+    if (c->active)
+    {
+        return setError(CAL_RESULT_ALREADY, "Counter %u is already active", counter);
+    }
+    ctxBusyTime(ctx, &c->startBusyNs);
+    c->startNs = nowNs();
+    c->active  = true;
+    return CAL_RESULT_OK;
+}
+
+CALresult CALAPIENTRY
+swCtxEndCounter(CALcontext ctx, CALcounter counter)
+{
+    CALresult result;
+    std::shared_ptr<Counter> c = lookupCounter(ctx, counter, &result);
+    if (!c)
+    {
+        return result;
+    }
+    if (!c->active)
+    {
+        return setError(CAL_RESULT_ERROR, "Counter %u is not active", counter);
+    }
+
+    // Idle is the share of the interval the context worker did not execute
+    CALuint64 busy = 0;
+    ctxBusyTime(ctx, &busy);
+    CALuint64 elapsed = nowNs() - c->startNs;
+    c->value  = elapsed ? 1.0f - static_cast<CALfloat>(busy - c->startBusyNs) / static_cast<CALfloat>(elapsed) : 1.0f;
+    c->value  = (c->value < 0.0f) ? 0.0f : c->value;
+    c->active = false;
+    return CAL_RESULT_OK;
+}
+
+CALresult CALAPIENTRY
+swCtxGetCounter(CALfloat* value, CALcontext ctx, CALcounter counter)
+{
+    CALresult result;
+    std::shared_ptr<Counter> c = lookupCounter(ctx, counter, &result);
+    if (!c)
+    {
+        return result;
+    }
+    if (!value)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "result is NULL");
+    }
+    if (c->active)
+    {
+        return CAL_RESULT_PENDING;
+    }
+    *value = c->value;
+    return CAL_RESULT_OK;
+}
+
+CALresult CALAPIENTRY
+swResAllocView(CALresource* view, CALresource res, CALdevice dev, CALdomain3D size, CALdomain offset,
+               CALformat format, CALchannelorder order, CALdimension dim, CALuint flags)
+{
+    return resAllocView(view, res, dev, size, offset, format, order, dim, flags);
+}
+
+CALresult CALAPIENTRY
+swResQueryInfo(CALresource res, CALresInfo* info)
+{
+    return resQueryInfo(res, info);
+}
+
+CALresult CALAPIENTRY
+swResMemCopy(CALresource src, CALresource dst, CALuint flags)
+{
+    return resMemCopy(src, dst, flags);
+}
+
+CALresult CALAPIENTRY
+swResAlloc(CALdeviceDesc* devDesc, const CALresourceDesc* resDesc, CALresource* res)
+{
+    return resAllocDesc(devDesc, resDesc, res);
+}
+
+CALresult CALAPIENTRY
+swResGetHeap(CALresource* res, CALdeviceDesc* devDesc, CALheapType type, CALuint size)
+{
+    return resGetHeap(res, devDesc, type, size);
+}
+
+CALresult CALAPIENTRY
+swCtxWaitForEvents(CALcontext ctx, CALevent* events, CALuint n, CALuint flags)
+{
+    return ctxWaitForEvents(ctx, events, n, flags);
+}
+
+CALresult CALAPIENTRY
+swCtxFlushCache(CALcontext ctx, CALuint flags)
+{
+    return ctxFlushCache(ctx, flags);
+}
+
+CALresult CALAPIENTRY
+swDeviceClockUp(CALdevice dev, CALuint flag)
+{
+    return deviceClockUp(dev, flag);
+}
+
+CALresult CALAPIENTRY
+swMemCopyRaw(CALevent* event, CALcontext ctx, CALmem src, CALuint srcOffset, CALmem dst, CALuint dstOffset, CALuint size, CALuint flags)
+{
+    return memCopyRaw(event, ctx, src, srcOffset, dst, dstOffset, size, flags);
+}
+
+CALresult CALAPIENTRY
+swMemCopyPartial(CALevent* event, CALcontext ctx, CALmem src, CALuint* srcOffset, CALmem dst, CALuint* dstOffset, CALuint* size, CALuint flags)
+{
+    return memCopyPartial(event, ctx, src, srcOffset, dst, dstOffset, size, flags);
+}
+
+CALresult CALAPIENTRY
+swConfig(const CALchar* key, const CALchar* value)
+{
+    return config(key, value);
+}
+
+CALvoid CALAPIENTRY
+swClearConfig(void)
+{
+    clearConfig();
+}
+
+CALresult CALAPIENTRY
+swDeviceGetAttribsExt(CALdeviceattribsExt* attribsExt, CALdevice dev)
+{
+    return deviceGetAttribsExt(attribsExt, dev);
+}
+
+CALresult CALAPIENTRY
+swGetFuncInfoFromImage(CALimage image, CALfuncInfo* info)
+{
+    return getFuncInfoFromImage(image, info);
+}
+
+//
+// IL is kept as text, so the "binary" form is the NUL terminated source.
+//
+CALresult CALAPIENTRY
+swConvertTextToBinary(CALvoid** binary, CALuint* binarySize, CALlanguage language, const CALchar* source)
+{
+    if (!binary || !binarySize || !source || language != CAL_LANGUAGE_IL)
+    {
+        return setCompilerError(CAL_RESULT_INVALID_PARAMETER, "Invalid IL conversion parameters");
+    }
+    size_t size = std::strlen(source) + 1;
+    *binary = std::malloc(size);
+    if (!*binary)
+    {
+        return setCompilerError(CAL_RESULT_ERROR, "Out of memory");
+    }
+    std::memcpy(*binary, source, size);
+    *binarySize = static_cast<CALuint>(size);
+    return CAL_RESULT_OK;
+}
+
+CALresult CALAPIENTRY
+swConvertBinaryToText(const CALvoid* binary, CALuint binarySize, CALlanguage language, CALchar** source)
+{
+    if (!binary || !source || binarySize == 0 || language != CAL_LANGUAGE_IL)
+    {
+        return setCompilerError(CAL_RESULT_INVALID_PARAMETER, "Invalid IL conversion parameters");
+    }
+    CALchar* text = static_cast<CALchar*>(std::malloc(binarySize + 1));
+    if (!text)
+    {
+        return setCompilerError(CAL_RESULT_ERROR, "Out of memory");
+    }
+    std::memcpy(text, binary, binarySize);
+    text[binarySize] = 0;
+    *source = text;
+    return CAL_RESULT_OK;
+}
+
+CALresult CALAPIENTRY
+swFreeTextBinary(CALvoid* binary)
+{
+    std::free(binary);
+    return CAL_RESULT_OK;
+}
+
+struct ExtProc
+{
+    CALuint        extid;
+    const CALchar* name;
+    CALvoid*       proc;
+};
+
+const ExtProc s_extProcs[] = {
+    { CAL_EXT_COMPUTE_SHADER,                   "calCtxRunProgramGrid",         reinterpret_cast<CALvoid*>(swCtxRunProgramGrid) },
+    { CAL_EXT_COMPUTE_SHADER,                   "calModuleGetFuncInfo",         reinterpret_cast<CALvoid*>(swModuleGetFuncInfo) },
+    { CAL_EXT_COMPUTE_SHADER,                   "calCtxRunProgramGridArray",    reinterpret_cast<CALvoid*>(swCtxRunProgramGridArray) },
+    { CAL_EXT_RES_CREATE,                       "calResCreate2D",               reinterpret_cast<CALvoid*>(swResCreate2D) },
+    { CAL_EXT_RES_CREATE,                       "calResCreate1D",               reinterpret_cast<CALvoid*>(swResCreate1D) },
+    { CAL_EXT_COUNTERS,                         "calCtxCreateCounter",          reinterpret_cast<CALvoid*>(swCtxCreateCounter) },
+    { CAL_EXT_COUNTERS,                         "calCtxDestroyCounter",         reinterpret_cast<CALvoid*>(swCtxDestroyCounter) },
+    { CAL_EXT_COUNTERS,                         "calCtxBeginCounter",           reinterpret_cast<CALvoid*>(swCtxBeginCounter) },
+    { CAL_EXT_COUNTERS,                         "calCtxEndCounter",             reinterpret_cast<CALvoid*>(swCtxEndCounter) },
+    { CAL_EXT_COUNTERS,                         "calCtxGetCounter",             reinterpret_cast<CALvoid*>(swCtxGetCounter) },
+    { CAL_PRIVATE_EXT_RESOURCES,                "calResAllocView",              reinterpret_cast<CALvoid*>(swResAllocView) },
+    { CAL_PRIVATE_EXT_RESOURCES,                "calResQueryInfo",              reinterpret_cast<CALvoid*>(swResQueryInfo) },
+    { CAL_PRIVATE_EXT_RESOURCES,                "calResMemCopy",                reinterpret_cast<CALvoid*>(swResMemCopy) },
+    { CAL_PRIVATE_EXT_RES_ALLOC,                "calResAlloc",                  reinterpret_cast<CALvoid*>(swResAlloc) },
+    { CAL_PRIVATE_EXT_HEAP,                     "calResGetHeap",                reinterpret_cast<CALvoid*>(swResGetHeap) },
+    { CAL_PRIVATE_EXT_SYNC_OBJECT,              "calCtxWaitForEvents",          reinterpret_cast<CALvoid*>(swCtxWaitForEvents) },
+    { CAL_PRIVATE_EXT_FLUSH_CACHE,              "calCtxFlushCache",             reinterpret_cast<CALvoid*>(swCtxFlushCache) },
+    { CAL_PRIVATE_EXT_DEVICE_CLOCKUP,           "calDeviceClockUp",             reinterpret_cast<CALvoid*>(swDeviceClockUp) },
+    { CAL_PRIVATE_EXT_MEMCOPY_RAW,              "calMemCopyRaw",                reinterpret_cast<CALvoid*>(swMemCopyRaw) },
+    { CAL_PRIVATE_EXT_MEMCOPY_PARTIAL,          "calMemCopyPartial",            reinterpret_cast<CALvoid*>(swMemCopyPartial) },
+    { CAL_PRIVATE_EXT_RUNTIME_CONFIG,           "calConfig",                    reinterpret_cast<CALvoid*>(swConfig) },
+    { CAL_PRIVATE_EXT_RUNTIME_CONFIG,           "calClearConfig",               reinterpret_cast<CALvoid*>(swClearConfig) },
+    { CAL_PRIVATE_EXT_EXTENDED_DEVICEATTRIBS,   "calDeviceGetAttribsExt",       reinterpret_cast<CALvoid*>(swDeviceGetAttribsExt) },
+    { CAL_PRIVATE_EXT_COMPILER,                 "calGetFuncInfoFromImage",      reinterpret_cast<CALvoid*>(swGetFuncInfoFromImage) },
+    { CAL_PRIVATE_EXT_COMPILER,                 "calConvertTextToBinary",       reinterpret_cast<CALvoid*>(swConvertTextToBinary) },
+    { CAL_PRIVATE_EXT_COMPILER,                 "calConvertBinaryToText",       reinterpret_cast<CALvoid*>(swConvertBinaryToText) },
+    { CAL_PRIVATE_EXT_COMPILER,                 "calFreeTextBinary",            reinterpret_cast<CALvoid*>(swFreeTextBinary) },
+};
+
+// Extensions without procs of their own
+const CALuint s_procLessExts[] = {
+    CAL_PRIVATE_EXT_EXTENDED_RUNPROGRAMGRID,
+};
+
+const CALuint s_extProcCount = sizeof(s_extProcs) / sizeof(s_extProcs[0]);
+
+CALresult CALAPIENTRY
+swclConfig(const CALchar* key, const CALchar* value)
+{
+    return config(key, value);
+}
+
+CALvoid CALAPIENTRY
+swclClearConfig(void)
+{
+    clearConfig();
+}
+
+} // anonymous namespace
+
+/*----------------------------------------------------------------------------
+ * Extension queries
+ *----------------------------------------------------------------------------*/
+
+CALresult
+extSupported(CALextid extid)
+{
+    for (CALuint i = 0; i < s_extProcCount; ++i)
+    {
+        if (s_extProcs[i].extid == static_cast<CALuint>(extid))
+        {
+            return CAL_RESULT_OK;
+        }
+    }
+    for (CALuint i = 0; i < sizeof(s_procLessExts) / sizeof(s_procLessExts[0]); ++i)
+    {
+        if (s_procLessExts[i] == static_cast<CALuint>(extid))
+        {
+            return CAL_RESULT_OK;
+        }
+    }
+    return setError(CAL_RESULT_NOT_SUPPORTED, "Extension 0x%x is not supported", extid);
+}
+
+CALresult
+extGetVersion(CALuint* major, CALuint* minor, CALextid extid)
+{
+    if (!major || !minor)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "major or minor is NULL");
+    }
+    CALresult result = extSupported(extid);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    *major = 1;
+    *minor = 0;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+extGetProc(CALextproc* proc, CALextid extid, const CALchar* procname)
+{
+    if (!proc || !procname)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "proc or procname is NULL");
+    }
+    *proc = 0;
+    for (CALuint i = 0; i < s_extProcCount; ++i)
+    {
+        if (s_extProcs[i].extid == static_cast<CALuint>(extid) && std::strcmp(s_extProcs[i].name, procname) == 0)
+        {
+            *proc = s_extProcs[i].proc;
+            return CAL_RESULT_OK;
+        }
+    }
+    return setError(CAL_RESULT_NOT_SUPPORTED, "Extension 0x%x has no proc \"%s\"", extid, procname);
+}
+
+CALresult
+clExtSupported(CALCLextid extid)
+{
+    if (static_cast<CALuint>(extid) == CALCL_PRIVATE_EXT_COMPILER_CONFIG)
+    {
+        return CAL_RESULT_OK;
+    }
+    return setCompilerError(CAL_RESULT_NOT_SUPPORTED, "Compiler extension 0x%x is not supported", extid);
+}
+
+CALresult
+clExtGetProc(CALCLextproc* proc, CALCLextid extid, const CALchar* procname)
+{
+    if (!proc || !procname)
+    {
+        return setCompilerError(CAL_RESULT_INVALID_PARAMETER, "proc or procname is NULL");
+    }
+    *proc = 0;
+    if (static_cast<CALuint>(extid) == CALCL_PRIVATE_EXT_COMPILER_CONFIG)
+    {
+        if (std::strcmp(procname, "calclConfig") == 0)
+        {
+            *proc = reinterpret_cast<CALCLextproc>(swclConfig);
+        }
+        else if (std::strcmp(procname, "calclClearConfig") == 0)
+        {
+            *proc = reinterpret_cast<CALCLextproc>(swclClearConfig);
+        }
+    }
+    return *proc ? CAL_RESULT_OK : setCompilerError(CAL_RESULT_NOT_SUPPORTED, "Compiler extension 0x%x has no proc \"%s\"", extid, procname);
+}
+
+/*----------------------------------------------------------------------------
+ * Runtime configuration
+ *----------------------------------------------------------------------------*/
+
+CALresult
+config(const CALchar* key, const CALchar* value)
+{
+    if (!key || !value)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "key or value is NULL");
+    }
+    Driver& drv = driver();
+    std::lock_guard<std::mutex> guard(drv.configLock);
+    drv.config[key] = value;
+    if (std::strcmp(key, CAL_CONFIG_THREAD_SAFE_KEY) == 0)
+    {
+        drv.checkThread = (std::strcmp(value, CAL_CONFIG_THREAD_SAFE_OFF) == 0);
+    }
+    return CAL_RESULT_OK;
+}
+
+CALvoid
+clearConfig()
+{
+    Driver& drv = driver();
+    std::lock_guard<std::mutex> guard(drv.configLock);
+    drv.config.clear();
+    drv.checkThread = false;
+}
+
+} // namespace calsw
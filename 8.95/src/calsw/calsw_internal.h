@@ -0,0 +1,492 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#ifndef __CALSW_INTERNAL_H__
+#define __CALSW_INTERNAL_H__
+
+#include "calsw.h"
+#include "cal_private.h"
+#include "cal_private_ext.h"
+#include "calcl_private_ext.h"
+#include "cal_error.h"
+#include "cal_format.h"
+#include "cal_handle_table.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace calsw {
+
+const CALuint PitchAlignment   = 64;    // elements
+const CALuint SurfaceAlignment = 256;   // bytes
+
+//
+// Parsed program shared by CALobject, CALimage and loaded modules
+//
+struct Program
+{
+    std::string              il;            ///< IL source of every linked object
+    std::vector<std::string> entries;       ///< Entry point names, "main" first
+    std::vector<std::string> kernels;       ///< Native kernel bound to each entry, may be empty
+    std::vector<std::string> names;         ///< Bindable module variables
+    CALuint                  groupSize[3];  ///< dcl_num_thread_per_group
+    CALCLprogramType         type;
+
+    Program() : type(CAL_PROGRAM_TYPE_CS) { groupSize[0] = 64; groupSize[1] = 1; groupSize[2] = 1; }
+};
+
+struct Resource
+{
+    CALdevice                 dev;
+    CALresallocType           type;
+    CALdimension              dimension;
+    CALformat                 format;
+    CALuint                   elementSize;
+    CALuint                   width;
+    CALuint                   height;
+    CALuint                   depth;
+    CALuint                   pitch;        ///< elements
+    CALuint                   flags;
+    CALuint64                 byteSize;
+    CALubyte*                 base;
+    bool                      ownsMemory;
+    bool                      isHeap;
+    std::shared_ptr<Resource> parent;       ///< aliased resource for views
+    std::atomic<bool>         mapped;
+
+    Resource();
+    ~Resource();
+
+    /** Mapped in a way that keeps the device from using it; persistent resources stay usable. */
+    bool busyMapped() const { return mapped && !(flags & CAL_RESALLOC_PERSISTENT); }
+};
+
+struct Mem
+{
+    CALcontext                ctx;
+    std::shared_ptr<Resource> res;
+};
+
+struct Module
+{
+    CALcontext               ctx;
+    std::shared_ptr<Program> program;
+    std::vector<CALfunc>     funcs;
+    std::vector<CALname>     names;
+};
+
+struct Func
+{
+    CALcontext               ctx;
+    CALmodule                module;
+    CALuint                  entry;
+    std::shared_ptr<Program> program;
+};
+
+struct Name
+{
+    CALcontext               ctx;
+    CALmodule                module;
+    std::string              var;
+};
+
+struct Command
+{
+    CALevent              event;
+    std::function<void()> run;
+};
+
+struct Context
+{
+    CALdevice                               dev;
+    std::thread::id                         owner;
+
+    std::mutex                              lock;
+    std::condition_variable                 wake;       ///< worker: new work or exit
+    std::condition_variable                 idle;       ///< waiters: event retired
+    std::vector<Command>                    pending;    ///< issued but not flushed
+    std::deque<Command>                     queue;      ///< flushed, executing in order
+    std::thread                             worker;
+    bool                                    exit;
+
+    CALevent                                nextEvent;
+    CALevent                                flushedEvent;
+    std::atomic<CALevent>                   retiredEvent;
+    std::atomic<CALuint64>                  busyNs;
+
+    std::map<CALname, CALmem>               bindings;
+    std::vector<CALmem>                     mems;
+    std::vector<CALmodule>                  modules;
+
+    Context();
+};
+
+struct Counter
+{
+    CALcontext              ctx;
+    CALcountertype          type;
+    bool                    active;
+    CALuint64               startNs;        ///< steady clock at calCtxBeginCounter
+    CALuint64               startBusyNs;    ///< Context::busyNs at calCtxBeginCounter
+    CALfloat                value;
+};
+
+struct Device
+{
+    CALuint                 ordinal;
+    bool                    open;
+    std::atomic<CALuint64>  localBytes;
+    std::atomic<CALuint64>  remoteBytes;
+    CALresource             heap;
+
+    Device() : ordinal(0), open(false), localBytes(0), remoteBytes(0), heap(0) {}
+};
+
+//
+// Handle map from CAL handle to driver object. Lookups go through a lock-free
+// generational table, so a freed or reused handle reports a miss instead of
+// aliasing the new object. Zero is the invalid handle for every CAL handle
+// type. Freeing a handle while another thread still uses it is an
+// application error, as with any CAL handle.
+//
+// Each table slot has an entry, at the same index in slabs that live as long
+// as the map, holding the shared_ptr and a pin count. The live handle holds
+// one pin and every lookup holds one while it copies the shared_ptr. A
+// lookup pins only a count that is not 0 and then checks its handle again,
+// so it either sees the handle still live or lets go without touching the
+// shared_ptr. Whoever drops the last pin resets the shared_ptr; add() waits
+// for that before it reuses the entry of a recycled slot. Nothing takes a
+// lock.
+//
+template <typename T>
+class HandleMap
+{
+public:
+    HandleMap()
+    {
+        for (CALuint i = 0; i < SlabCount; ++i)
+        {
+            m_slabs[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~HandleMap()
+    {
+        clear();
+        for (CALuint i = 0; i < SlabCount; ++i)
+        {
+            delete[] m_slabs[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    HandleMap(const HandleMap&) = delete;
+    HandleMap& operator=(const HandleMap&) = delete;
+
+    CALuint add(const std::shared_ptr<T>& obj)
+    {
+        CALuint handle = m_table.add(true);
+        if (handle == 0)
+        {
+            return 0;
+        }
+        Entry* e = entry(Table::indexOf(handle), true);
+        if (!e)
+        {
+            m_table.remove(handle);
+            return 0;
+        }
+
+        // A lookup of the previous handle may still hold the last pin
+        while (!e->clean.load(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+        e->clean.store(false, std::memory_order_relaxed);
+        e->obj = obj;
+        e->pins.store(1, std::memory_order_release);
+        return handle;
+    }
+
+    std::shared_ptr<T> get(CALuint handle) const
+    {
+        bool live;
+        if (m_table.get(handle, live) != CAL_RESULT_OK)
+        {
+            return std::shared_ptr<T>();
+        }
+        Entry* e = entry(Table::indexOf(handle), false);
+        if (!e || !pin(e))
+        {
+            return std::shared_ptr<T>();
+        }
+
+        // The entry may have been released and reused before it was pinned
+        std::shared_ptr<T> obj;
+        if (m_table.get(handle, live) == CAL_RESULT_OK)
+        {
+            obj = e->obj;
+        }
+        unpin(e);
+        return obj;
+    }
+
+    std::shared_ptr<T> remove(CALuint handle)
+    {
+        std::shared_ptr<T> obj;
+        if (m_table.remove(handle) == CAL_RESULT_OK)
+        {
+            // The pin of the live handle keeps the entry until it is dropped
+            Entry* e = entry(Table::indexOf(handle), false);
+            obj = e->obj;
+            unpin(e);
+        }
+        return obj;
+    }
+
+    std::vector<CALuint> handles() const
+    {
+        return m_table.handles();
+    }
+
+    void clear()
+    {
+        std::vector<CALuint> live = m_table.handles();
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            remove(live[i]);
+        }
+    }
+
+private:
+    typedef cal::HandleTable<bool> Table;
+
+    static const CALuint SlabSize  = 1024;
+    static const CALuint SlabCount = Table::Capacity / SlabSize;
+
+    struct Entry
+    {
+        std::atomic<CALuint>    pins;       // live handle plus lookups, 0 while free
+        std::atomic<bool>       clean;      // obj reset after the last pin
+        std::shared_ptr<T>      obj;
+
+        Entry() : pins(0), clean(true) {}
+    };
+
+    Entry* entry(CALuint index, bool create) const
+    {
+        std::atomic<Entry*>& slab = m_slabs[index / SlabSize];
+        Entry* entries = slab.load(std::memory_order_acquire);
+        if (!entries && create)
+        {
+            Entry* fresh = new (std::nothrow) Entry[SlabSize];
+            if (!fresh)
+            {
+                return 0;
+            }
+            if (slab.compare_exchange_strong(entries, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                entries = fresh;
+            }
+            else
+            {
+                // Another thread installed the slab first
+                delete[] fresh;
+            }
+        }
+        return entries ? &entries[index % SlabSize] : 0;
+    }
+
+    static bool pin(Entry* e)
+    {
+        CALuint pins = e->pins.load(std::memory_order_relaxed);
+        do
+        {
+            if (pins == 0)
+            {
+                return false;
+            }
+        } while (!e->pins.compare_exchange_weak(pins, pins + 1, std::memory_order_acquire, std::memory_order_relaxed));
+        return true;
+    }
+
+    static void unpin(Entry* e)
+    {
+        if (e->pins.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            e->obj.reset();
+            e->clean.store(true, std::memory_order_release);
+        }
+    }
+
+    Table                       m_table;
+    mutable std::atomic<Entry*> m_slabs[SlabCount];
+};
+
+struct KernelEntry
+{
+    CALswKernel kernel;
+    CALvoid*    userData;
+};
+
+struct Driver
+{
+    std::atomic<bool>                   initialized;
+    std::mutex                          lock;
+    CALuint                             deviceCount;
+    CALuint                             localRAM;       ///< megabytes
+    CALuint                             heapSize;       ///< megabytes
+    std::vector<Device>                 devices;
+
+    HandleMap<Resource>                 resources;
+    HandleMap<Context>                  contexts;
+    HandleMap<Mem>                      mems;
+    HandleMap<Module>                   modules;
+    HandleMap<Func>                     funcs;
+    HandleMap<Name>                     names;
+    HandleMap<Counter>                  counters;
+
+    std::mutex                          kernelLock;
+    std::map<std::string, KernelEntry>  kernels;
+
+    std::mutex                          configLock;
+    std::map<std::string, std::string>  config;
+    std::atomic<bool>                   checkThread;
+};
+
+Driver& driver();
+
+//
+// Error reporting, mirrors calGetErrorString/calclGetErrorString. Errors are
+// recorded per thread (cal_error.h); the strings returned are the calling
+// thread's, or the process wide copy for threads that raised none.
+//
+CALresult setError(CALresult result, const char* fmt, ...);
+CALresult setCompilerError(CALresult result, const char* fmt, ...);
+
+// CAL_RESULT_BAD_HANDLE for handle. Lookups run in argument order and stop
+// at the first failure, so the record names the first invalid handle.
+CALresult setHandleError(CALuint handle, const char* fmt, ...);
+const CALchar* errorString();
+const CALchar* compilerErrorString();
+
+//
+// Core entry points, one per calddi_if export. Extension procs share them.
+//
+CALresult init();
+CALresult shutdown();
+CALresult deviceGetCount(CALuint* count);
+CALresult deviceGetInfo(CALdeviceinfo* info, CALuint ordinal);
+CALresult deviceGetAttribs(CALdeviceattribs* attribs, CALuint ordinal);
+CALresult deviceGetStatus(CALdevicestatus* status, CALdevice dev);
+CALresult deviceOpen(CALdevice* dev, CALuint ordinal);
+CALresult deviceClose(CALdevice dev);
+CALresult deviceClockUp(CALdevice dev, CALuint flag);
+CALresult deviceGetAttribsExt(CALdeviceattribsExt* attribsExt, CALdevice dev);
+
+CALresult resAlloc(CALresource* res, CALdevice* devs, CALuint devCount, CALresallocType type, CALdimension dim,
+                   CALuint width, CALuint height, CALformat format, CALuint flags, CALvoid* systemMemory, CALuint systemSize);
+CALresult resAllocDesc(CALdeviceDesc* devDesc, const CALresourceDesc* resDesc, CALresource* res);
+CALresult resAllocView(CALresource* view, CALresource res, CALdevice dev, CALdomain3D size, CALdomain offset,
+                       CALformat format, CALchannelorder order, CALdimension dim, CALuint flags);
+CALresult resGetHeap(CALresource* res, CALdeviceDesc* devDesc, CALheapType type, CALuint size);
+CALresult resFree(CALresource res);
+CALresult resMap(CALvoid** ptr, CALuint* pitch, CALresource res, CALuint flags);
+CALresult resUnmap(CALresource res);
+CALresult resQueryInfo(CALresource res, CALresInfo* info);
+CALresult resMemCopy(CALresource src, CALresource dst, CALuint flags);
+
+CALresult ctxCreate(CALcontext* ctx, CALdevice dev);
+CALresult ctxDestroy(CALcontext ctx);
+CALresult ctxGetMem(CALmem* mem, CALcontext ctx, CALresource res);
+CALresult ctxReleaseMem(CALcontext ctx, CALmem mem);
+CALresult ctxSetMem(CALcontext ctx, CALname name, CALmem mem);
+CALresult ctxRunProgram(CALevent* event, CALcontext ctx, CALfunc func, const CALdomain* domain);
+CALresult ctxRunProgramGrid(CALevent* event, CALcontext ctx, CALprogramGrid* grid);
+CALresult ctxRunProgramGridArray(CALevent* event, CALcontext ctx, CALprogramGridArray* gridArray);
+CALresult ctxIsEventDone(CALcontext ctx, CALevent event);
+CALresult ctxFlush(CALcontext ctx);
+CALresult ctxWaitForEvents(CALcontext ctx, CALevent* events, CALuint n, CALuint flags);
+CALresult ctxFlushCache(CALcontext ctx, CALuint flags);
+CALresult ctxBusyTime(CALcontext ctx, CALuint64* busyNs);
+CALresult memCopy(CALevent* event, CALcontext ctx, CALmem src, CALmem dst, CALuint flags);
+CALresult memCopyRaw(CALevent* event, CALcontext ctx, CALmem src, CALuint srcOffset, CALmem dst, CALuint dstOffset, CALuint size, CALuint flags);
+CALresult memCopyPartial(CALevent* event, CALcontext ctx, CALmem src, CALuint* srcOffset, CALmem dst, CALuint* dstOffset, CALuint* size, CALuint flags);
+
+CALresult compile(CALobject* obj, CALlanguage language, const CALchar* source, CALtarget target);
+CALresult assemble(CALobject* obj, CALlanguage language, CALCLprogramType type, const CALchar* source, CALtarget target);
+CALresult link(CALimage* image, CALobject* objs, CALuint count);
+CALresult freeObject(CALobject obj);
+CALresult freeImage(CALimage image);
+CALresult imageRead(CALimage* image, const CALvoid* buffer, CALuint size);
+CALresult imageGetSize(CALuint* size, CALimage image);
+CALresult imageWrite(CALvoid* buffer, CALuint size, CALimage image);
+void      disassembleImage(const CALimage image, CALLogFunction logfunc);
+void      disassembleObject(const CALobject* obj, CALLogFunction logfunc);
+CALresult getFuncInfoFromImage(CALimage image, CALfuncInfo* info);
+
+CALresult moduleLoad(CALmodule* module, CALcontext ctx, CALimage image);
+CALresult moduleUnload(CALcontext ctx, CALmodule module);
+CALresult moduleGetEntry(CALfunc* func, CALcontext ctx, CALmodule module, const CALchar* procName);
+CALresult moduleGetName(CALname* name, CALcontext ctx, CALmodule module, const CALchar* varName);
+CALresult moduleGetFuncInfo(CALfuncInfo* info, CALcontext ctx, CALmodule module, CALfunc func);
+
+CALresult extSupported(CALextid extid);
+CALresult extGetVersion(CALuint* major, CALuint* minor, CALextid extid);
+CALresult extGetProc(CALextproc* proc, CALextid extid, const CALchar* procname);
+CALresult clExtSupported(CALCLextid extid);
+CALresult clExtGetProc(CALCLextproc* proc, CALCLextid extid, const CALchar* procname);
+CALresult config(const CALchar* key, const CALchar* value);
+CALvoid   clearConfig();
+
+//
+// Helpers shared between translation units
+//
+std::shared_ptr<Context> lookupContext(CALcontext ctx, CALresult* result);
+void fillFuncInfo(const Program& program, CALfuncInfo* info);
+void releaseModule(Module& module);
+
+} // namespace calsw
+
+//
+// Opaque compiler containers from cal.h
+//
+struct CALobjectRec
+{
+    std::shared_ptr<calsw::Program> program;
+};
+
+struct CALimageRec
+{
+    std::shared_ptr<calsw::Program> program;
+};
+
+#endif // __CALSW_INTERNAL_H__
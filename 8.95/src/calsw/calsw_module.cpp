@@ -0,0 +1,682 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "calsw_internal.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace calsw {
+
+namespace {
+
+const CALchar  ImageMagic[8] = { 'C', 'A', 'L', 'S', 'W', 'I', 'M', 'G' };
+const CALuint  ImageVersion  = 1;
+
+void
+addName(Program& program, const std::string& name)
+{
+    if (std::find(program.names.begin(), program.names.end(), name) == program.names.end())
+    {
+        program.names.push_back(name);
+    }
+}
+
+//
+// Parse "<prefix>(N)" at pos and return N, or -1.
+//
+int
+parseId(const std::string& line, const char* prefix)
+{
+    size_t pos = line.find(prefix);
+    if (pos == std::string::npos)
+    {
+        return -1;
+    }
+    pos += std::strlen(prefix);
+    if (pos >= line.size() || line[pos] != '(')
+    {
+        return -1;
+    }
+    return std::atoi(line.c_str() + pos + 1);
+}
+
+std::string
+trim(const std::string& s)
+{
+    size_t begin = s.find_first_not_of(" \t\r");
+    size_t end   = s.find_last_not_of(" \t\r");
+    return (begin == std::string::npos) ? std::string() : s.substr(begin, end - begin + 1);
+}
+
+//
+// Extract what the runtime needs from IL text: program type, bindable
+// variables, thread group size and the native kernel annotation.
+//
+CALresult
+parseIL(Program& program, const CALchar* source)
+{
+    static const char* const uavPrefixes[] = {
+        "dcl_uav_id", "dcl_raw_uav_id", "dcl_typeless_uav_id", "dcl_struct_uav_id", "dcl_arena_uav_id"
+    };
+
+    bool haveHeader = false;
+    std::string kernel;
+    std::istringstream stream(source);
+    std::string raw;
+
+    while (std::getline(stream, raw))
+    {
+        std::string line = trim(raw);
+        if (line.empty())
+        {
+            continue;
+        }
+
+        if (line[0] == ';')
+        {
+            std::string annotation = trim(line.substr(1));
+            if (annotation.compare(0, 13, "@calsw kernel") == 0)
+            {
+                kernel = trim(annotation.substr(13));
+            }
+            continue;
+        }
+
+        if (!haveHeader)
+        {
+            if (line.compare(0, 3, "il_") != 0)
+            {
+                return setCompilerError(CAL_RESULT_ERROR, "IL must start with a program header, found \"%s\"", line.c_str());
+            }
+            program.type = (line.compare(0, 5, "il_ps") == 0) ? CAL_PROGRAM_TYPE_PS : CAL_PROGRAM_TYPE_CS;
+            haveHeader = true;
+            continue;
+        }
+
+        std::ostringstream name;
+        int id;
+        if ((id = parseId(line, "dcl_resource_id")) >= 0)
+        {
+            name << "i" << id;
+        }
+        else if (line.compare(0, 10, "dcl_output") == 0)
+        {
+            size_t pos = line.find(" o");
+            if (pos != std::string::npos)
+            {
+                name << "o" << std::atoi(line.c_str() + pos + 2);
+            }
+        }
+        else if (line.compare(0, 6, "dcl_cb") == 0)
+        {
+            size_t pos = line.find("cb", 6);
+            if (pos != std::string::npos)
+            {
+                name << "cb" << std::atoi(line.c_str() + pos + 2);
+            }
+        }
+        else if (line.compare(0, 24, "dcl_num_thread_per_group") == 0)
+        {
+            std::string dims = line.substr(24);
+            std::replace(dims.begin(), dims.end(), ',', ' ');
+            std::istringstream in(dims);
+            CALuint size[3] = { 1, 1, 1 };
+            in >> size[0] >> size[1] >> size[2];
+            for (int i = 0; i < 3; ++i)
+            {
+                program.groupSize[i] = std::max(size[i], 1u);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < sizeof(uavPrefixes) / sizeof(uavPrefixes[0]); ++i)
+            {
+                if ((id = parseId(line, uavPrefixes[i])) >= 0)
+                {
+                    name << "uav" << id;
+                    break;
+                }
+            }
+        }
+
+        if (!name.str().empty())
+        {
+            addName(program, name.str());
+        }
+        if (line.find("g[") != std::string::npos)
+        {
+            addName(program, "g[]");
+        }
+    }
+
+    if (!haveHeader)
+    {
+        return setCompilerError(CAL_RESULT_ERROR, "IL source is empty");
+    }
+
+    program.il = source;
+    program.entries.push_back("main");
+    program.kernels.push_back(kernel);
+    return CAL_RESULT_OK;
+}
+
+void
+putUint(std::string& out, CALuint value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void
+putString(std::string& out, const std::string& value)
+{
+    putUint(out, static_cast<CALuint>(value.size()));
+    out.append(value);
+}
+
+std::string
+serialize(const Program& program)
+{
+    std::string out(ImageMagic, sizeof(ImageMagic));
+    putUint(out, ImageVersion);
+    putUint(out, program.type);
+    for (int i = 0; i < 3; ++i)
+    {
+        putUint(out, program.groupSize[i]);
+    }
+    putUint(out, static_cast<CALuint>(program.entries.size()));
+    for (size_t i = 0; i < program.entries.size(); ++i)
+    {
+        putString(out, program.entries[i]);
+        putString(out, program.kernels[i]);
+    }
+    putUint(out, static_cast<CALuint>(program.names.size()));
+    for (size_t i = 0; i < program.names.size(); ++i)
+    {
+        putString(out, program.names[i]);
+    }
+    putString(out, program.il);
+    return out;
+}
+
+class Reader
+{
+public:
+    Reader(const CALubyte* data, CALuint size) : m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+
+    CALuint getUint()
+    {
+        CALuint value = 0;
+        if (!check(sizeof(value)))
+        {
+            return 0;
+        }
+        std::memcpy(&value, m_data + m_pos, sizeof(value));
+        m_pos += sizeof(value);
+        return value;
+    }
+
+    std::string getString()
+    {
+        CALuint length = getUint();
+        if (!check(length))
+        {
+            return std::string();
+        }
+        std::string value(reinterpret_cast<const char*>(m_data + m_pos), length);
+        m_pos += length;
+        return value;
+    }
+
+    bool ok() const { return m_ok; }
+
+private:
+    bool check(CALuint bytes)
+    {
+        m_ok = m_ok && (bytes <= m_size - m_pos);
+        return m_ok;
+    }
+
+    const CALubyte* m_data;
+    CALuint         m_size;
+    CALuint         m_pos;
+    bool            m_ok;
+};
+
+std::shared_ptr<Module>
+lookupModule(CALcontext ctx, CALmodule module)
+{
+    std::shared_ptr<Module> m = driver().modules.get(module);
+    return (m && m->ctx == ctx) ? m : std::shared_ptr<Module>();
+}
+
+} // anonymous namespace
+
+/*----------------------------------------------------------------------------
+ * Compiler
+ *----------------------------------------------------------------------------*/
+
+CALresult
+compile(CALobject* obj, CALlanguage language, const CALchar* source, CALtarget target)
+{
+    (void)target;
+    if (!obj || !source)
+    {
+        return setCompilerError(CAL_RESULT_INVALID_PARAMETER, "obj or source is NULL");
+    }
+    *obj = 0;
+    if (language != CAL_LANGUAGE_IL)
+    {
+        return setCompilerError(CAL_RESULT_NOT_SUPPORTED, "Unsupported language %d", language);
+    }
+
+    std::shared_ptr<Program> program = std::make_shared<Program>();
+    CALresult result = parseIL(*program, source);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    *obj = new CALobjectRec;
+    (*obj)->program = program;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+assemble(CALobject* obj, CALlanguage language, CALCLprogramType type, const CALchar* source, CALtarget target)
+{
+    CALresult result = compile(obj, language, source, target);
+    if (result == CAL_RESULT_OK && (*obj)->program->type != type)
+    {
+        freeObject(*obj);
+        *obj = 0;
+        return setCompilerError(CAL_RESULT_ERROR, "IL program type does not match the requested type");
+    }
+    return result;
+}
+
+CALresult
+link(CALimage* image, CALobject* objs, CALuint count)
+{
+    if (!image || !objs || count == 0)
+    {
+        return setCompilerError(CAL_RESULT_INVALID_PARAMETER, "Nothing to link");
+    }
+    *image = 0;
+
+    for (CALuint i = 0; i < count; ++i)
+    {
+        if (!objs[i] || !objs[i]->program)
+        {
+            return setCompilerError(CAL_RESULT_BAD_HANDLE, "Object %u is NULL", i);
+        }
+    }
+
+    // The first object provides "main", later objects contribute names only
+    std::shared_ptr<Program> program = std::make_shared<Program>(*objs[0]->program);
+    for (CALuint i = 1; i < count; ++i)
+    {
+        const Program& other = *objs[i]->program;
+        program->il += other.il;
+        for (size_t n = 0; n < other.names.size(); ++n)
+        {
+            addName(*program, other.names[n]);
+        }
+    }
+
+    *image = new CALimageRec;
+    (*image)->program = program;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+freeObject(CALobject obj)
+{
+    if (!obj)
+    {
+        return setCompilerError(CAL_RESULT_BAD_HANDLE, "obj is NULL");
+    }
+    delete obj;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+freeImage(CALimage image)
+{
+    if (!image)
+    {
+        return setCompilerError(CAL_RESULT_BAD_HANDLE, "image is NULL");
+    }
+    delete image;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+imageRead(CALimage* image, const CALvoid* buffer, CALuint size)
+{
+    if (!image || !buffer)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "image or buffer is NULL");
+    }
+    *image = 0;
+    if (size < sizeof(ImageMagic) || std::memcmp(buffer, ImageMagic, sizeof(ImageMagic)) != 0)
+    {
+        return setError(CAL_RESULT_ERROR, "Not a software driver image");
+    }
+
+    Reader in(static_cast<const CALubyte*>(buffer) + sizeof(ImageMagic), size - sizeof(ImageMagic));
+    std::shared_ptr<Program> program = std::make_shared<Program>();
+    if (in.getUint() != ImageVersion)
+    {
+        return setError(CAL_RESULT_ERROR, "Unsupported image version");
+    }
+    program->type = static_cast<CALCLprogramType>(in.getUint());
+    for (int i = 0; i < 3; ++i)
+    {
+        program->groupSize[i] = in.getUint();
+    }
+    CALuint entries = in.getUint();
+    for (CALuint i = 0; i < entries && in.ok(); ++i)
+    {
+        program->entries.push_back(in.getString());
+        program->kernels.push_back(in.getString());
+    }
+    CALuint names = in.getUint();
+    for (CALuint i = 0; i < names && in.ok(); ++i)
+    {
+        program->names.push_back(in.getString());
+    }
+    program->il = in.getString();
+    if (!in.ok())
+    {
+        return setError(CAL_RESULT_ERROR, "Image is truncated");
+    }
+
+    *image = new CALimageRec;
+    (*image)->program = program;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+imageGetSize(CALuint* size, CALimage image)
+{
+    if (!size || !image)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "size or image is NULL");
+    }
+    *size = static_cast<CALuint>(serialize(*image->program).size());
+    return CAL_RESULT_OK;
+}
+
+CALresult
+imageWrite(CALvoid* buffer, CALuint size, CALimage image)
+{
+    if (!buffer || !image)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "buffer or image is NULL");
+    }
+    std::string data = serialize(*image->program);
+    if (size < data.size())
+    {
+        return setError(CAL_RESULT_ERROR, "Buffer of %u bytes is too small for image of %u bytes",
+                        size, static_cast<CALuint>(data.size()));
+    }
+    std::memcpy(buffer, data.data(), data.size());
+    return CAL_RESULT_OK;
+}
+
+static void
+logProgram(const Program& program, CALLogFunction logfunc)
+{
+    if (!logfunc)
+    {
+        return;
+    }
+    std::istringstream stream(program.il);
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        line += "\n";
+        logfunc(line.c_str());
+    }
+}
+
+void
+disassembleImage(const CALimage image, CALLogFunction logfunc)
+{
+    if (image)
+    {
+        logProgram(*image->program, logfunc);
+    }
+}
+
+void
+disassembleObject(const CALobject* obj, CALLogFunction logfunc)
+{
+    if (obj && *obj)
+    {
+        logProgram(*(*obj)->program, logfunc);
+    }
+}
+
+void
+fillFuncInfo(const Program& program, CALfuncInfo* info)
+{
+    std::memset(info, 0, sizeof(*info));
+    info->numThreadPerGroupX  = program.groupSize[0];
+    info->numThreadPerGroupY  = program.groupSize[1];
+    info->numThreadPerGroupZ  = program.groupSize[2];
+    info->numThreadPerGroup   = program.groupSize[0] * program.groupSize[1] * program.groupSize[2];
+    info->numWavefrontPerSIMD = 1;
+    info->wavefrontSize       = 64;
+    info->LDSSizeAvailable    = 32768;
+}
+
+CALresult
+getFuncInfoFromImage(CALimage image, CALfuncInfo* info)
+{
+    if (!image || !info)
+    {
+        return setCompilerError(CAL_RESULT_INVALID_PARAMETER, "image or info is NULL");
+    }
+    fillFuncInfo(*image->program, info);
+    return CAL_RESULT_OK;
+}
+
+/*----------------------------------------------------------------------------
+ * Modules
+ *----------------------------------------------------------------------------*/
+
+CALresult
+moduleLoad(CALmodule* module, CALcontext ctx, CALimage image)
+{
+    if (!module || !image)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "module or image is NULL");
+    }
+    *module = 0;
+
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+
+    Driver& drv = driver();
+    std::shared_ptr<Module> m = std::make_shared<Module>();
+    m->ctx     = ctx;
+    m->program = image->program;
+    *module    = drv.modules.add(m);
+
+    for (CALuint i = 0; i < m->program->entries.size(); ++i)
+    {
+        std::shared_ptr<Func> f = std::make_shared<Func>();
+        f->ctx     = ctx;
+        f->module  = *module;
+        f->entry   = i;
+        f->program = m->program;
+        m->funcs.push_back(drv.funcs.add(f));
+    }
+    for (size_t i = 0; i < m->program->names.size(); ++i)
+    {
+        std::shared_ptr<Name> n = std::make_shared<Name>();
+        n->ctx    = ctx;
+        n->module = *module;
+        n->var    = m->program->names[i];
+        m->names.push_back(drv.names.add(n));
+    }
+
+    std::lock_guard<std::mutex> guard(context->lock);
+    context->modules.push_back(*module);
+    return CAL_RESULT_OK;
+}
+
+void
+releaseModule(Module& module)
+{
+    Driver& drv = driver();
+    for (size_t i = 0; i < module.funcs.size(); ++i)
+    {
+        drv.funcs.remove(module.funcs[i]);
+    }
+    for (size_t i = 0; i < module.names.size(); ++i)
+    {
+        drv.names.remove(module.names[i]);
+    }
+}
+
+CALresult
+moduleUnload(CALcontext ctx, CALmodule module)
+{
+    CALresult result;
+    std::shared_ptr<Context> context = lookupContext(ctx, &result);
+    if (!context)
+    {
+        return result;
+    }
+    std::shared_ptr<Module> m = lookupModule(ctx, module);
+    if (!m)
+    {
+        return setHandleError(module, "Invalid module handle %u", module);
+    }
+    driver().modules.remove(module);
+    releaseModule(*m);
+
+    std::lock_guard<std::mutex> guard(context->lock);
+    context->modules.erase(std::remove(context->modules.begin(), context->modules.end(), module), context->modules.end());
+    for (size_t i = 0; i < m->names.size(); ++i)
+    {
+        context->bindings.erase(m->names[i]);
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+moduleGetEntry(CALfunc* func, CALcontext ctx, CALmodule module, const CALchar* procName)
+{
+    if (!func || !procName)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "func or procName is NULL");
+    }
+    *func = 0;
+
+    CALresult result;
+    if (!lookupContext(ctx, &result))
+    {
+        return result;
+    }
+    std::shared_ptr<Module> m = lookupModule(ctx, module);
+    if (!m)
+    {
+        return setHandleError(module, "Invalid module handle %u", module);
+    }
+
+    for (size_t i = 0; i < m->program->entries.size(); ++i)
+    {
+        if (m->program->entries[i] == procName)
+        {
+            *func = m->funcs[i];
+            return CAL_RESULT_OK;
+        }
+    }
+    return setError(CAL_RESULT_ERROR, "Entry point \"%s\" not found", procName);
+}
+
+CALresult
+moduleGetName(CALname* name, CALcontext ctx, CALmodule module, const CALchar* varName)
+{
+    if (!name || !varName)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "name or varName is NULL");
+    }
+    *name = 0;
+
+    CALresult result;
+    if (!lookupContext(ctx, &result))
+    {
+        return result;
+    }
+    std::shared_ptr<Module> m = lookupModule(ctx, module);
+    if (!m)
+    {
+        return setHandleError(module, "Invalid module handle %u", module);
+    }
+
+    for (size_t i = 0; i < m->program->names.size(); ++i)
+    {
+        if (m->program->names[i] == varName)
+        {
+            *name = m->names[i];
+            return CAL_RESULT_OK;
+        }
+    }
+    return setError(CAL_RESULT_BAD_NAME_TYPE, "Variable \"%s\" is not declared by the module", varName);
+}
+
+CALresult
+moduleGetFuncInfo(CALfuncInfo* info, CALcontext ctx, CALmodule module, CALfunc func)
+{
+    if (!info)
+    {
+        return setError(CAL_RESULT_INVALID_PARAMETER, "info is NULL");
+    }
+
+    CALresult result;
+    if (!lookupContext(ctx, &result))
+    {
+        return result;
+    }
+    std::shared_ptr<Func> f = driver().funcs.get(func);
+    if (!f || f->ctx != ctx || f->module != module)
+    {
+        return setHandleError(func, "Invalid function handle %u", func);
+    }
+    fillFuncInfo(*f->program, info);
+    return CAL_RESULT_OK;
+}
+
+} // namespace calsw
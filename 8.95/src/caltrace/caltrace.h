@@ -0,0 +1,164 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#ifndef __CALTRACE_H__
+#define __CALTRACE_H__
+
+#include "cal_trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CALTRACE_HAVE_TSC 1
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace caltrace {
+
+inline CALuint64
+tsc()
+{
+#ifdef CALTRACE_HAVE_TSC
+    return __rdtsc();
+#else
+    return static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Life cycle of a ring: owned by a thread, then drained after the thread
+// exited, then free for the next thread that starts tracing
+enum RingState
+{
+    RingLive = 0,
+    RingRetired,
+    RingFree
+};
+
+//
+// Single producer (the owning thread), single consumer (the writer thread)
+// ring of trace records. The producer never blocks: a full ring drops the
+// record and counts it.
+//
+struct Ring
+{
+    static const CALuint Capacity = 16384;  // records, power of two
+
+    std::atomic<CALuint64>  head;           // next slot the producer writes
+    CALubyte                pad0[56];
+    std::atomic<CALuint64>  tail;           // next slot the consumer reads
+    CALuint64               reportedDrops;  // consumer side
+    CALubyte                pad1[48];
+    std::atomic<CALuint64>  dropped;        // producer side
+    std::atomic<CALuint>    thread;
+    std::atomic<CALuint>    state;          // RingState
+    Ring*                   next;           // intrusive list of all rings
+    CALtraceRecord          records[Capacity];
+};
+
+// Take a free ring or allocate and register one for the calling thread;
+// NULL on failure or while the thread exits
+Ring* createRing();
+
+// Ring of the calling thread, defined next to the entry points so access
+// compiles to a plain TLS load
+extern thread_local Ring* t_ring;
+
+// calErrorSequence() before the call being traced, see CALTRACE_FORWARD
+extern thread_local CALuint64 t_errorSince;
+
+// Put a failure the runtime reported on the thread's error record
+// (cal_error.h) unless a lower layer recorded it already
+void recordError(CALapiId api, CALresult result);
+
+inline void
+record(CALapiId api, CALuint64 begin, CALresult result,
+       CALuint64 a0 = 0, CALuint64 a1 = 0, CALuint64 a2 = 0, CALuint64 a3 = 0, CALuint64 a4 = 0)
+{
+    CALuint64 end = tsc();
+    if (result != CAL_RESULT_OK && result != CAL_RESULT_PENDING)
+    {
+        recordError(api, result);
+    }
+    Ring* ring = t_ring;
+    if (!ring)
+    {
+        ring = createRing();
+        if (!ring)
+        {
+            return;
+        }
+        t_ring = ring;
+    }
+
+    CALuint64 head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= Ring::Capacity)
+    {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    CALtraceRecord& r = ring->records[head & (Ring::Capacity - 1)];
+    r.begin   = begin;
+    r.end     = end;
+    r.thread  = ring->thread.load(std::memory_order_relaxed);
+    r.api     = static_cast<CALushort>(api);
+    r.result  = static_cast<CALushort>(result);
+    r.args[0] = a0;
+    r.args[1] = a1;
+    r.args[2] = a2;
+    r.args[3] = a3;
+    r.args[4] = a4;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+template <typename T>
+inline CALuint64
+out(const T* value, CALresult result)
+{
+    return (value && result == CAL_RESULT_OK) ? static_cast<CALuint64>(*value) : 0;
+}
+
+template <typename T>
+inline CALuint64
+ptr(T* value)
+{
+    return static_cast<CALuint64>(reinterpret_cast<uintptr_t>(value));
+}
+
+inline CALuint64
+pack(CALuint lo, CALuint hi)
+{
+    return static_cast<CALuint64>(lo) | (static_cast<CALuint64>(hi) << 32);
+}
+
+} // namespace caltrace
+
+#endif // __CALTRACE_H__
@@ -0,0 +1,353 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "caltrace_capture.h"
+#include "cal_format.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace caltrace {
+
+Capture* g_capture = 0;
+
+namespace {
+
+// Unchanged stretch that ends a write run; shorter gaps are sent along
+const CALuint RunGap = 32;
+
+CALuint
+currentThreadId()
+{
+#ifdef _WIN32
+    return static_cast<CALuint>(GetCurrentThreadId());
+#else
+    return static_cast<CALuint>(syscall(SYS_gettid));
+#endif
+}
+
+CALuint64
+steadyNs()
+{
+    return static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// First differing byte at or after begin, end when none
+CALuint
+skipEqual(const CALubyte* a, const CALubyte* b, CALuint begin, CALuint end)
+{
+    CALuint i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        CALuint64 x, y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        if (x != y)
+        {
+            break;
+        }
+    }
+    while (i < end && a[i] == b[i])
+    {
+        ++i;
+    }
+    return i;
+}
+
+void
+append(std::vector<CALubyte>& out, const CALvoid* data, size_t size)
+{
+    const CALubyte* bytes = static_cast<const CALubyte*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+} // anonymous namespace
+
+Capture::Capture()
+    : m_file(0), m_startNs(0)
+{
+}
+
+Capture::~Capture()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (m_file)
+    {
+        std::fclose(m_file);
+        m_file = 0;
+    }
+}
+
+bool
+Capture::open()
+{
+    const char* path = std::getenv("CALTRACE_CAPTURE");
+    if (!path || !*path)
+    {
+        return false;
+    }
+
+    m_file = std::fopen(path, "wb");
+    if (!m_file)
+    {
+        std::fprintf(stderr, "caltrace: cannot open %s, capture disabled\n", path);
+        return false;
+    }
+
+    CALreplayHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CAL_REPLAY_MAGIC, sizeof(header.magic));
+    header.version     = CAL_REPLAY_VERSION;
+#ifdef _WIN32
+    header.pid         = static_cast<CALuint>(GetCurrentProcessId());
+#else
+    header.pid         = static_cast<CALuint>(getpid());
+#endif
+    header.startTimeNs = static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    std::fwrite(&header, sizeof(header), 1, m_file);
+
+    m_startNs = steadyNs();
+    return true;
+}
+
+void
+Capture::writeLocked(CALapiId api, std::initializer_list<CALuint64> args, const CALvoid* payload, CALuint payloadSize)
+{
+    if (!m_file)
+    {
+        return;
+    }
+
+    CALuint body = static_cast<CALuint>(sizeof(CALreplayPacket) + args.size() * sizeof(CALuint64)) + payloadSize;
+
+    CALreplayPacket packet;
+    packet.size        = (body + 7) & ~7u;
+    packet.api         = static_cast<CALushort>(api);
+    packet.argCount    = static_cast<CALushort>(args.size());
+    packet.time        = steadyNs() - m_startNs;
+    packet.thread      = currentThreadId();
+    packet.payloadSize = payloadSize;
+
+    static const CALubyte zeros[8] = { 0 };
+    std::fwrite(&packet, sizeof(packet), 1, m_file);
+    std::fwrite(args.begin(), sizeof(CALuint64), args.size(), m_file);
+    if (payloadSize)
+    {
+        std::fwrite(payload, 1, payloadSize, m_file);
+    }
+    std::fwrite(zeros, 1, packet.size - body, m_file);
+}
+
+void
+Capture::call(CALapiId api, std::initializer_list<CALuint64> args, const CALvoid* payload, CALuint payloadSize)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    writeLocked(api, args, payload, payloadSize);
+}
+
+void
+Capture::resource(CALresource res, CALuint width, CALuint height, CALformat format)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    Resource& r   = m_resources[res];
+    r.width       = width;
+    r.height      = (height != 0) ? height : 1;
+    r.elementSize = cal::formatElementSize(format);
+    r.mapped      = 0;
+    r.persistent  = false;
+    r.pitchBytes  = 0;
+    r.snapshot.clear();
+}
+
+void
+Capture::freeResource(CALresource res)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_resources.erase(res);
+}
+
+void
+Capture::map(CALresource res, CALvoid* ptr, CALuint pitch)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<CALresource, Resource>::iterator it = m_resources.find(res);
+    if (it == m_resources.end() || !ptr || it->second.persistent)
+    {
+        return;
+    }
+
+    Resource& r  = it->second;
+    r.mapped     = static_cast<CALubyte*>(ptr);
+    r.pitchBytes = pitch * r.elementSize;
+    snapshotLocked(r);
+}
+
+void
+Capture::host(CALresource res, CALvoid* ptr, CALuint pitch)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<CALresource, Resource>::iterator it = m_resources.find(res);
+    if (it == m_resources.end() || !ptr)
+    {
+        return;
+    }
+
+    // The replay starts from zeroed host memory, so the first sync sends
+    // everything the process put there
+    Resource& r   = it->second;
+    r.mapped      = static_cast<CALubyte*>(ptr);
+    r.persistent  = true;
+    r.pitchBytes  = pitch * r.elementSize;
+    r.snapshot.assign(static_cast<size_t>(r.width) * r.elementSize * r.height, 0);
+}
+
+void
+Capture::snapshotLocked(Resource& r)
+{
+    CALuint rowBytes = r.width * r.elementSize;
+    r.snapshot.resize(static_cast<size_t>(rowBytes) * r.height);
+    for (CALuint row = 0; row < r.height; ++row)
+    {
+        std::memcpy(&r.snapshot[static_cast<size_t>(row) * rowBytes], r.mapped + static_cast<size_t>(row) * r.pitchBytes, rowBytes);
+    }
+}
+
+//
+// Diff the mapped memory against its snapshot and collect the changed
+// bytes as row-local runs.
+//
+void
+Capture::diffLocked(const Resource& r, std::vector<CALubyte>& writes) const
+{
+    CALuint rowBytes = r.width * r.elementSize;
+    writes.clear();
+    for (CALuint row = 0; row < r.height; ++row)
+    {
+        const CALubyte* now = r.mapped + static_cast<size_t>(row) * r.pitchBytes;
+        const CALubyte* old = &r.snapshot[static_cast<size_t>(row) * rowBytes];
+
+        CALuint i = skipEqual(now, old, 0, rowBytes);
+        while (i < rowBytes)
+        {
+            // Extend the run until RunGap unchanged bytes in a row
+            CALuint last = i;
+            CALuint j    = i + 1;
+            while (j < rowBytes && j - last <= RunGap)
+            {
+                if (now[j] != old[j])
+                {
+                    last = j;
+                }
+                ++j;
+            }
+
+            CALreplayWrite write;
+            write.row    = row;
+            write.offset = i;
+            write.size   = last + 1 - i;
+            append(writes, &write, sizeof(write));
+            append(writes, now + i, write.size);
+            writes.resize((writes.size() + 3) & ~static_cast<size_t>(3), 0);
+
+            i = skipEqual(now, old, last + 1, rowBytes);
+        }
+    }
+}
+
+void
+Capture::writesLocked(CALresource res, const Resource& r, const std::vector<CALubyte>& writes)
+{
+    writeLocked(CAL_API_RES_UNMAP, { res, r.elementSize, r.pitchBytes, r.width * r.elementSize, r.height },
+                writes.empty() ? 0 : &writes[0], static_cast<CALuint>(writes.size()));
+}
+
+//
+// Host backed resources report nothing here: the device sees their memory
+// without an unmap, so sync() sends their changes instead.
+//
+bool
+Capture::diff(CALresource res, std::vector<CALubyte>& writes)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<CALresource, Resource>::iterator it = m_resources.find(res);
+    if (it == m_resources.end() || !it->second.mapped || it->second.persistent)
+    {
+        return false;
+    }
+    diffLocked(it->second, writes);
+    return true;
+}
+
+void
+Capture::unmap(CALresource res, const std::vector<CALubyte>& writes)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<CALresource, Resource>::iterator it = m_resources.find(res);
+    if (it == m_resources.end() || !it->second.mapped || it->second.persistent)
+    {
+        return;
+    }
+
+    Resource& r = it->second;
+    writesLocked(res, r, writes);
+    r.mapped = 0;
+    r.snapshot.clear();
+}
+
+//
+// Every mapped resource is diffed because a CALmem does not tell which
+// resource a copy or run reads; the cost is one compare of mapped memory
+// per captured copy or run.
+//
+void
+Capture::sync()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    for (std::map<CALresource, Resource>::iterator it = m_resources.begin(); it != m_resources.end(); ++it)
+    {
+        Resource& r = it->second;
+        if (!r.mapped)
+        {
+            continue;
+        }
+        diffLocked(r, m_scratch);
+        if (!m_scratch.empty())
+        {
+            writesLocked(it->first, r, m_scratch);
+            snapshotLocked(r);
+        }
+    }
+}
+
+} // namespace caltrace
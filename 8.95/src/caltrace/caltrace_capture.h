@@ -0,0 +1,102 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#ifndef __CALTRACE_CAPTURE_H__
+#define __CALTRACE_CAPTURE_H__
+
+#include "cal_replay.h"
+
+#include <cstdio>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace caltrace {
+
+//
+// Serializes the command stream of the process into the capture file named
+// by CALTRACE_CAPTURE (see cal_replay.h). Unlike the call trace this is
+// synchronous: packets are written in one global order under a lock.
+//
+class Capture
+{
+public:
+    Capture();
+    ~Capture();
+
+    // Open the capture file, false when capturing is not requested
+    bool open();
+
+    void call(CALapiId api, std::initializer_list<CALuint64> args, const CALvoid* payload = 0, CALuint payloadSize = 0);
+
+    // Resource geometry, needed to snapshot mapped memory
+    void resource(CALresource res, CALuint width, CALuint height, CALformat format);
+    void freeResource(CALresource res);
+
+    // Snapshot at map; diff() collects the changed runs of a mapped
+    // resource before its unmap, unmap() emits them once the unmap succeeded
+    void map(CALresource res, CALvoid* ptr, CALuint pitch);
+    bool diff(CALresource res, std::vector<CALubyte>& writes);
+    void unmap(CALresource res, const std::vector<CALubyte>& writes);
+
+    // Host memory backing a calResCreate or system memory calResAlloc
+    // resource; it stays visible to the device for the resource's lifetime
+    void host(CALresource res, CALvoid* ptr, CALuint pitch);
+
+    // Emit the bytes changed since the last snapshot of every mapped or
+    // host backed resource, so a copy or run that follows reads them on
+    // replay too (persistent maps such as a StagingRing never unmap)
+    void sync();
+
+private:
+    struct Resource
+    {
+        CALuint               width;
+        CALuint               height;
+        CALuint               elementSize;
+        CALubyte*             mapped;       // NULL when not mapped
+        bool                  persistent;   // host memory, mapped for good
+        CALuint               pitchBytes;
+        std::vector<CALubyte> snapshot;     // contents when mapped
+    };
+
+    void snapshotLocked(Resource& r);
+    void diffLocked(const Resource& r, std::vector<CALubyte>& writes) const;
+    void writesLocked(CALresource res, const Resource& r, const std::vector<CALubyte>& writes);
+    void writeLocked(CALapiId api, std::initializer_list<CALuint64> args, const CALvoid* payload, CALuint payloadSize);
+
+    std::mutex                      m_lock;
+    std::FILE*                      m_file;
+    CALuint64                       m_startNs;
+    std::map<CALresource, Resource> m_resources;
+    std::vector<CALubyte>           m_scratch;      // sync() runs
+};
+
+// Non-NULL while capturing
+extern Capture* g_capture;
+
+} // namespace caltrace
+
+#endif // __CALTRACE_CAPTURE_H__
@@ -0,0 +1,1178 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+//
+// Tracing interposer for the CAL runtime and compiler libraries.
+//
+// Built as libcaltrace.so and loaded with LD_PRELOAD it exports every
+// symbol of libaticalrt.so and libaticalcl.so, records each call into the
+// per-thread ring of caltrace.h and forwards it to:
+//
+//   - the next definition in the lookup order (the real libraries), or
+//   - CALTRACE_RUNTIME / CALTRACE_COMPILER, paths of the real libraries when
+//     the interposer is installed under their names, or
+//   - CALTRACE_DDI, the path of a driver exporting calddi_if (for example
+//     the software driver), which is then called directly.
+//
+// Extension procs returned by calExtGetProc that have a CALapiId are
+// wrapped as well.
+//
+// With CALTRACE_CAPTURE set the command stream is also written to a
+// replay file, see caltrace_capture.h.
+//
+
+#include "caltrace.h"
+#include "caltrace_capture.h"
+#include "cal_error.h"
+#include "cal_private_ext.h"
+#include "calddi.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <dlfcn.h>
+
+namespace caltrace {
+
+thread_local Ring* t_ring = 0;
+thread_local CALuint64 t_errorSince = 0;
+
+} // namespace caltrace
+
+using namespace caltrace;
+
+namespace {
+
+struct RealEntries
+{
+    decltype(&::calInit)                    init;
+    decltype(&::calGetVersion)              getVersion;
+    decltype(&::calShutdown)                shutdown;
+    decltype(&::calDeviceGetCount)          deviceGetCount;
+    decltype(&::calDeviceGetInfo)           deviceGetInfo;
+    decltype(&::calDeviceGetAttribs)        deviceGetAttribs;
+    decltype(&::calDeviceGetStatus)         deviceGetStatus;
+    decltype(&::calDeviceOpen)              deviceOpen;
+    decltype(&::calDeviceClose)             deviceClose;
+    decltype(&::calResAllocLocal2D)         resAllocLocal2D;
+    decltype(&::calResAllocRemote2D)        resAllocRemote2D;
+    decltype(&::calResAllocLocal1D)         resAllocLocal1D;
+    decltype(&::calResAllocRemote1D)        resAllocRemote1D;
+    decltype(&::calResFree)                 resFree;
+    decltype(&::calResMap)                  resMap;
+    decltype(&::calResUnmap)                resUnmap;
+    decltype(&::calCtxCreate)               ctxCreate;
+    decltype(&::calCtxDestroy)              ctxDestroy;
+    decltype(&::calCtxGetMem)               ctxGetMem;
+    decltype(&::calCtxReleaseMem)           ctxReleaseMem;
+    decltype(&::calCtxSetMem)               ctxSetMem;
+    decltype(&::calCtxRunProgram)           ctxRunProgram;
+    decltype(&::calCtxIsEventDone)          ctxIsEventDone;
+    decltype(&::calCtxFlush)                ctxFlush;
+    decltype(&::calMemCopy)                 memCopy;
+    decltype(&::calImageRead)               imageRead;
+    decltype(&::calImageFree)               imageFree;
+    decltype(&::calModuleLoad)              moduleLoad;
+    decltype(&::calModuleUnload)            moduleUnload;
+    decltype(&::calModuleGetEntry)          moduleGetEntry;
+    decltype(&::calModuleGetName)           moduleGetName;
+    decltype(&::calGetErrorString)          getErrorString;
+    decltype(&::calCtxRunProgramGrid)       ctxRunProgramGrid;
+    decltype(&::calModuleGetFuncInfo)       moduleGetFuncInfo;
+    decltype(&::calCtxRunProgramGridArray)  ctxRunProgramGridArray;
+    decltype(&::calExtSupported)            extSupported;
+    decltype(&::calExtGetVersion)           extGetVersion;
+    decltype(&::calExtGetProc)              extGetProc;
+
+    decltype(&::calclGetVersion)            clGetVersion;
+    decltype(&::calclCompile)               clCompile;
+    decltype(&::calclLink)                  clLink;
+    decltype(&::calclFreeObject)            clFreeObject;
+    decltype(&::calclFreeImage)             clFreeImage;
+    decltype(&::calclDisassembleImage)      clDisassembleImage;
+    decltype(&::calclAssembleObject)        clAssembleObject;
+    decltype(&::calclDisassembleObject)     clDisassembleObject;
+    decltype(&::calclImageGetSize)          clImageGetSize;
+    decltype(&::calclImageWrite)            clImageWrite;
+    decltype(&::calclGetErrorString)        clGetErrorString;
+    decltype(&::calclExtSupported)          clExtSupported;
+    decltype(&::calclExtGetProc)            clExtGetProc;
+};
+
+//
+// Extension procs as handed out by the driver. Written by calExtGetProc,
+// possibly from several threads, always with the same value.
+//
+struct ExtEntries
+{
+    std::atomic<PFNCALRESCREATE2D>          resCreate2D;
+    std::atomic<PFNCALRESCREATE1D>          resCreate1D;
+    std::atomic<PFNCALRESALLOCVIEW>         resAllocView;
+    std::atomic<PFNCALRESALLOC>             resAlloc;
+    std::atomic<PFNCALRESGETHEAP>           resGetHeap;
+    std::atomic<PFNCALCTXWAITFOREVENTS>     ctxWaitForEvents;
+    std::atomic<PFNCALCTXFLUSHCACHE>        ctxFlushCache;
+    std::atomic<PFNCALMEMCOPYRAW>           memCopyRaw;
+    std::atomic<PFNCALMEMCOPYPARTIAL>       memCopyPartial;
+};
+
+RealEntries      s_real;
+ExtEntries       s_ext;
+calddi_if        s_ddiTable;
+const calddi_if* s_ddi = 0;
+
+void*
+openFallback(const char* env, const char* defaultName)
+{
+    const char* path = std::getenv(env);
+    return dlopen((path && *path) ? path : defaultName, RTLD_NOW | RTLD_LOCAL);
+}
+
+void*
+resolve(const char* name, void* self, void*& fallback, const char* env, const char* defaultName)
+{
+    void* sym = dlsym(RTLD_NEXT, name);
+    if (!sym || sym == self)
+    {
+        if (!fallback)
+        {
+            fallback = openFallback(env, defaultName);
+        }
+        sym = fallback ? dlsym(fallback, name) : 0;
+    }
+    return (sym == self) ? 0 : sym;
+}
+
+bool
+loadDdi()
+{
+    const char* path = std::getenv("CALTRACE_DDI");
+    if (!path || !*path)
+    {
+        return false;
+    }
+
+    void* lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    typedef int (*PFNDDIINIT)(unsigned int);
+    typedef void* (*PFNDDIGETEXPORT)(unsigned int);
+    PFNDDIINIT      ddiInit      = lib ? reinterpret_cast<PFNDDIINIT>(dlsym(lib, "calddiInit")) : 0;
+    PFNDDIGETEXPORT ddiGetExport = lib ? reinterpret_cast<PFNDDIGETEXPORT>(dlsym(lib, "calddiGetExport")) : 0;
+    if (!ddiInit || !ddiGetExport || !ddiInit(CALDDI_VERSION))
+    {
+        std::fprintf(stderr, "caltrace: %s is not a CAL driver, using the runtime\n", path);
+        return false;
+    }
+
+    void** slots = reinterpret_cast<void**>(&s_ddiTable);
+    for (unsigned int i = 0; i < sizeof(calddi_if) / sizeof(void*); ++i)
+    {
+        slots[i] = ddiGetExport(i);
+    }
+    s_ddi = &s_ddiTable;
+    return true;
+}
+
+#define CALTRACE_RESOLVE_RT(member, name) \
+    s_real.member = reinterpret_cast<decltype(s_real.member)>(resolve(#name, reinterpret_cast<void*>(&::name), runtime, "CALTRACE_RUNTIME", "libaticalrt.so"))
+#define CALTRACE_RESOLVE_CL(member, name) \
+    s_real.member = reinterpret_cast<decltype(s_real.member)>(resolve(#name, reinterpret_cast<void*>(&::name), compiler, "CALTRACE_COMPILER", "libaticalcl.so"))
+
+__attribute__((constructor)) void
+initInterposer()
+{
+    static Capture capture;
+    if (capture.open())
+    {
+        g_capture = &capture;
+    }
+
+    if (loadDdi())
+    {
+        return;
+    }
+
+    void* runtime  = 0;
+    void* compiler = 0;
+    CALTRACE_RESOLVE_RT(init,                   calInit);
+    CALTRACE_RESOLVE_RT(getVersion,             calGetVersion);
+    CALTRACE_RESOLVE_RT(shutdown,               calShutdown);
+    CALTRACE_RESOLVE_RT(deviceGetCount,         calDeviceGetCount);
+    CALTRACE_RESOLVE_RT(deviceGetInfo,          calDeviceGetInfo);
+    CALTRACE_RESOLVE_RT(deviceGetAttribs,       calDeviceGetAttribs);
+    CALTRACE_RESOLVE_RT(deviceGetStatus,        calDeviceGetStatus);
+    CALTRACE_RESOLVE_RT(deviceOpen,             calDeviceOpen);
+    CALTRACE_RESOLVE_RT(deviceClose,            calDeviceClose);
+    CALTRACE_RESOLVE_RT(resAllocLocal2D,        calResAllocLocal2D);
+    CALTRACE_RESOLVE_RT(resAllocRemote2D,       calResAllocRemote2D);
+    CALTRACE_RESOLVE_RT(resAllocLocal1D,        calResAllocLocal1D);
+    CALTRACE_RESOLVE_RT(resAllocRemote1D,       calResAllocRemote1D);
+    CALTRACE_RESOLVE_RT(resFree,                calResFree);
+    CALTRACE_RESOLVE_RT(resMap,                 calResMap);
+    CALTRACE_RESOLVE_RT(resUnmap,               calResUnmap);
+    CALTRACE_RESOLVE_RT(ctxCreate,              calCtxCreate);
+    CALTRACE_RESOLVE_RT(ctxDestroy,             calCtxDestroy);
+    CALTRACE_RESOLVE_RT(ctxGetMem,              calCtxGetMem);
+    CALTRACE_RESOLVE_RT(ctxReleaseMem,          calCtxReleaseMem);
+    CALTRACE_RESOLVE_RT(ctxSetMem,              calCtxSetMem);
+    CALTRACE_RESOLVE_RT(ctxRunProgram,          calCtxRunProgram);
+    CALTRACE_RESOLVE_RT(ctxIsEventDone,         calCtxIsEventDone);
+    CALTRACE_RESOLVE_RT(ctxFlush,               calCtxFlush);
+    CALTRACE_RESOLVE_RT(memCopy,                calMemCopy);
+    CALTRACE_RESOLVE_RT(imageRead,              calImageRead);
+    CALTRACE_RESOLVE_RT(imageFree,              calImageFree);
+    CALTRACE_RESOLVE_RT(moduleLoad,             calModuleLoad);
+    CALTRACE_RESOLVE_RT(moduleUnload,           calModuleUnload);
+    CALTRACE_RESOLVE_RT(moduleGetEntry,         calModuleGetEntry);
+    CALTRACE_RESOLVE_RT(moduleGetName,          calModuleGetName);
+    CALTRACE_RESOLVE_RT(getErrorString,         calGetErrorString);
+    CALTRACE_RESOLVE_RT(ctxRunProgramGrid,      calCtxRunProgramGrid);
+    CALTRACE_RESOLVE_RT(moduleGetFuncInfo,      calModuleGetFuncInfo);
+    CALTRACE_RESOLVE_RT(ctxRunProgramGridArray, calCtxRunProgramGridArray);
+    CALTRACE_RESOLVE_RT(extSupported,           calExtSupported);
+    CALTRACE_RESOLVE_RT(extGetVersion,          calExtGetVersion);
+    CALTRACE_RESOLVE_RT(extGetProc,             calExtGetProc);
+    CALTRACE_RESOLVE_CL(clGetVersion,           calclGetVersion);
+    CALTRACE_RESOLVE_CL(clCompile,              calclCompile);
+    CALTRACE_RESOLVE_CL(clLink,                 calclLink);
+    CALTRACE_RESOLVE_CL(clFreeObject,           calclFreeObject);
+    CALTRACE_RESOLVE_CL(clFreeImage,            calclFreeImage);
+    CALTRACE_RESOLVE_CL(clDisassembleImage,     calclDisassembleImage);
+    CALTRACE_RESOLVE_CL(clAssembleObject,       calclAssembleObject);
+    CALTRACE_RESOLVE_CL(clDisassembleObject,    calclDisassembleObject);
+    CALTRACE_RESOLVE_CL(clImageGetSize,         calclImageGetSize);
+    CALTRACE_RESOLVE_CL(clImageWrite,           calclImageWrite);
+    CALTRACE_RESOLVE_CL(clGetErrorString,       calclGetErrorString);
+    CALTRACE_RESOLVE_CL(clExtSupported,         calclExtSupported);
+    CALTRACE_RESOLVE_CL(clExtGetProc,           calclExtGetProc);
+}
+
+#undef CALTRACE_RESOLVE_RT
+#undef CALTRACE_RESOLVE_CL
+
+} // anonymous namespace
+
+namespace caltrace {
+
+void
+recordError(CALapiId api, CALresult result)
+{
+    const CALchar* message = 0;
+    if (api >= CAL_API_CL_GET_VERSION && api <= CAL_API_CL_EXT_GET_PROC)
+    {
+        message = s_ddi ? s_ddi->ddiifclGetErrorString() : (s_real.clGetErrorString ? s_real.clGetErrorString() : 0);
+    }
+    else
+    {
+        message = s_ddi ? s_ddi->ddiifGetErrorString() : (s_real.getErrorString ? s_real.getErrorString() : 0);
+    }
+    calErrorAnnotate(t_errorSince, result, api, 0, message);
+}
+
+} // namespace caltrace
+
+//
+// Forward a call to the driver table or the real library. A missing real
+// entry point reports CAL_RESULT_NOT_SUPPORTED. The error sequence is
+// sampled first so recordError can tell whether the callee recorded its
+// own failure.
+//
+#define CALTRACE_FORWARD(member, ddiMember, args)                               \
+    (t_errorSince = calErrorSequence(),                                         \
+     s_ddi ? static_cast<CALresult>(s_ddi->ddiMember args)                      \
+           : (s_real.member ? s_real.member args : CAL_RESULT_NOT_SUPPORTED))
+
+#define CALTRACE_FORWARD_EXT(member, args)                                      \
+    (t_errorSince = calErrorSequence(),                                         \
+     s_ext.member.load(std::memory_order_relaxed) ? s_ext.member.load(std::memory_order_relaxed) args : CAL_RESULT_NOT_SUPPORTED)
+
+/*----------------------------------------------------------------------------
+ * Extension proc wrappers
+ *----------------------------------------------------------------------------*/
+
+namespace {
+
+CALresult CALAPIENTRY
+traceResCreate2D(CALresource* res, CALdevice dev, CALvoid* mem, CALuint width, CALuint height, CALformat format, CALuint size, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(resCreate2D, (res, dev, mem, width, height, format, size, flags));
+    record(CAL_API_RES_CREATE_2D, begin, result, out(res, result), dev, ptr(mem), pack(width, height), pack(format, size));
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*res, width, height, format);
+        g_capture->host(*res, mem, width);
+        g_capture->call(CAL_API_RES_CREATE_2D, { *res, dev, width, height, static_cast<CALuint64>(format), size, flags });
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceResCreate1D(CALresource* res, CALdevice dev, CALvoid* mem, CALuint width, CALformat format, CALuint size, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(resCreate1D, (res, dev, mem, width, format, size, flags));
+    record(CAL_API_RES_CREATE_1D, begin, result, out(res, result), dev, ptr(mem), width, pack(format, size));
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*res, width, 1, format);
+        g_capture->host(*res, mem, width);
+        g_capture->call(CAL_API_RES_CREATE_1D, { *res, dev, width, static_cast<CALuint64>(format), size, flags });
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceResAllocView(CALresource* view, CALresource res, CALdevice dev, CALdomain3D size, CALdomain offset,
+                  CALformat format, CALchannelorder order, CALdimension dim, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(resAllocView, (view, res, dev, size, offset, format, order, dim, flags));
+    record(CAL_API_RES_ALLOC_VIEW, begin, result, out(view, result), res, dev, pack(size.width, size.height), pack(offset.x, offset.y));
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*view, size.width, size.height, format);
+        g_capture->call(CAL_API_RES_ALLOC_VIEW, { *view, res, dev, size.width, size.height, size.depth,
+                                                  offset.x, offset.y, offset.width, offset.height,
+                                                  static_cast<CALuint64>(format), static_cast<CALuint64>(order),
+                                                  static_cast<CALuint64>(dim), flags });
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceResAlloc(CALdeviceDesc* devDesc, const CALresourceDesc* resDesc, CALresource* res)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(resAlloc, (devDesc, resDesc, res));
+    record(CAL_API_RES_ALLOC, begin, result, ptr(devDesc), ptr(resDesc), out(res, result),
+           resDesc ? pack(resDesc->size.width, resDesc->size.height) : 0, resDesc ? pack(resDesc->format, resDesc->type) : 0);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*res, resDesc->size.width, resDesc->size.height, resDesc->format);
+        if (resDesc->systemMemory)
+        {
+            g_capture->host(*res, resDesc->systemMemory, resDesc->size.width);
+        }
+        g_capture->call(CAL_API_RES_ALLOC, { *res, devDesc->devCount, static_cast<CALuint64>(resDesc->type),
+                                             resDesc->size.width, resDesc->size.height, resDesc->size.depth,
+                                             static_cast<CALuint64>(resDesc->format), static_cast<CALuint64>(resDesc->channelOrder),
+                                             static_cast<CALuint64>(resDesc->dimension), resDesc->mipLevels, resDesc->flags,
+                                             resDesc->systemMemory ? resDesc->systemMemorySize : 0 },
+                        devDesc->dev, devDesc->devCount * sizeof(CALdevice));
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceResGetHeap(CALresource* res, CALdeviceDesc* devDesc, CALheapType type, CALuint size)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(resGetHeap, (res, devDesc, type, size));
+    record(CAL_API_RES_GET_HEAP, begin, result, out(res, result), ptr(devDesc), type, size);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_RES_GET_HEAP, { *res, devDesc->devCount, static_cast<CALuint64>(type), size },
+                        devDesc->dev, devDesc->devCount * sizeof(CALdevice));
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceCtxWaitForEvents(CALcontext ctx, CALevent* events, CALuint n, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(ctxWaitForEvents, (ctx, events, n, flags));
+    CALevent newest = 0;
+    for (CALuint i = 0; events && i < n; ++i)
+    {
+        newest = (events[i] > newest) ? events[i] : newest;
+    }
+    record(CAL_API_CTX_WAIT_FOR_EVENTS, begin, result, ctx, n, flags, newest);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_WAIT_FOR_EVENTS, { ctx, n, flags }, events, n * sizeof(CALevent));
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceCtxFlushCache(CALcontext ctx, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(ctxFlushCache, (ctx, flags));
+    record(CAL_API_CTX_FLUSH_CACHE, begin, result, ctx, flags);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_FLUSH_CACHE, { ctx, flags });
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceMemCopyRaw(CALevent* event, CALcontext ctx, CALmem src, CALuint srcOffset, CALmem dst, CALuint dstOffset, CALuint size, CALuint flags)
+{
+    if (g_capture)
+    {
+        g_capture->sync();
+    }
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(memCopyRaw, (event, ctx, src, srcOffset, dst, dstOffset, size, flags));
+    record(CAL_API_MEM_COPY_RAW, begin, result, out(event, result), ctx, src, dst, size);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_MEM_COPY_RAW, { *event, ctx, src, srcOffset, dst, dstOffset, size, flags });
+    }
+    return result;
+}
+
+CALresult CALAPIENTRY
+traceMemCopyPartial(CALevent* event, CALcontext ctx, CALmem src, CALuint* srcOffset, CALmem dst, CALuint* dstOffset, CALuint* size, CALuint flags)
+{
+    if (g_capture)
+    {
+        g_capture->sync();
+    }
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD_EXT(memCopyPartial, (event, ctx, src, srcOffset, dst, dstOffset, size, flags));
+    record(CAL_API_MEM_COPY_PARTIAL, begin, result, out(event, result), ctx, src, dst, size ? pack(size[0], size[1]) : 0);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        CALuint region[9];
+        std::memcpy(region, srcOffset, 3 * sizeof(CALuint));
+        std::memcpy(region + 3, dstOffset, 3 * sizeof(CALuint));
+        std::memcpy(region + 6, size, 3 * sizeof(CALuint));
+        g_capture->call(CAL_API_MEM_COPY_PARTIAL, { *event, ctx, src, dst, flags }, region, sizeof(region));
+    }
+    return result;
+}
+
+//
+// Capture the module image through the compiler so a replay can load it.
+//
+void
+captureModuleLoad(CALmodule module, CALcontext ctx, CALimage image)
+{
+    CALuint size = 0;
+    CALresult result = CALTRACE_FORWARD(clImageGetSize, ddiifImageGetSize, (&size, image));
+    std::vector<CALubyte> bytes(size);
+    if (result == CAL_RESULT_OK && size != 0)
+    {
+        result = CALTRACE_FORWARD(clImageWrite, ddiifImageWrite, (&bytes[0], size, image));
+    }
+    if (result != CAL_RESULT_OK)
+    {
+        std::fprintf(stderr, "caltrace: cannot serialize the image of module %u, capture is incomplete\n", module);
+        size = 0;
+    }
+    g_capture->call(CAL_API_MODULE_LOAD, { module, ctx }, size ? &bytes[0] : 0, size);
+}
+
+//
+// Swap a driver proc for its tracing wrapper, remembering the original.
+//
+template <typename PFN>
+CALextproc
+wrapProc(std::atomic<PFN>& slot, CALextproc proc, PFN wrapper)
+{
+    slot.store(reinterpret_cast<PFN>(proc), std::memory_order_relaxed);
+    return reinterpret_cast<CALextproc>(wrapper);
+}
+
+CALextproc
+wrapExtProc(const CALchar* name, CALextproc proc)
+{
+    switch (calApiIdFromName(name))
+    {
+    case CAL_API_RES_CREATE_2D:         return wrapProc(s_ext.resCreate2D, proc, traceResCreate2D);
+    case CAL_API_RES_CREATE_1D:         return wrapProc(s_ext.resCreate1D, proc, traceResCreate1D);
+    case CAL_API_RES_ALLOC_VIEW:        return wrapProc(s_ext.resAllocView, proc, traceResAllocView);
+    case CAL_API_RES_ALLOC:             return wrapProc(s_ext.resAlloc, proc, traceResAlloc);
+    case CAL_API_RES_GET_HEAP:          return wrapProc(s_ext.resGetHeap, proc, traceResGetHeap);
+    case CAL_API_CTX_WAIT_FOR_EVENTS:   return wrapProc(s_ext.ctxWaitForEvents, proc, traceCtxWaitForEvents);
+    case CAL_API_CTX_FLUSH_CACHE:       return wrapProc(s_ext.ctxFlushCache, proc, traceCtxFlushCache);
+    case CAL_API_MEM_COPY_RAW:          return wrapProc(s_ext.memCopyRaw, proc, traceMemCopyRaw);
+    case CAL_API_MEM_COPY_PARTIAL:      return wrapProc(s_ext.memCopyPartial, proc, traceMemCopyPartial);
+    case CAL_API_CTX_RUN_PROGRAM_GRID:  return reinterpret_cast<CALextproc>(&::calCtxRunProgramGrid);
+    case CAL_API_MODULE_GET_FUNC_INFO:  return reinterpret_cast<CALextproc>(&::calModuleGetFuncInfo);
+    case CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY: return reinterpret_cast<CALextproc>(&::calCtxRunProgramGridArray);
+    default:                            return proc;
+    }
+}
+
+//
+// An extended grid is captured whole, followed by the handles of its
+// memUsage list so the replay can rebuild the list with its own handles
+//
+void
+captureGrid(CALevent event, CALcontext ctx, const CALprogramGrid* grid)
+{
+    if (!(grid->flags & CAL_RUNPROGRAMGRID_EXTENDED_STRUCTURE))
+    {
+        g_capture->call(CAL_API_CTX_RUN_PROGRAM_GRID, { event, ctx }, grid, sizeof(CALprogramGrid));
+        return;
+    }
+
+    const CALprogramGridExtended* extended = reinterpret_cast<const CALprogramGridExtended*>(grid);
+    std::vector<CALubyte> payload(sizeof(CALprogramGridExtended));
+    std::memcpy(&payload[0], extended, sizeof(CALprogramGridExtended));
+    if ((extended->extendedFlags & CAL_RUNPROGRAMGRID_EXTENDED_MEMORY_USAGE) && extended->memUsage)
+    {
+        const CALmemusage& usage = *extended->memUsage;
+        payload.resize(payload.size() + usage.memCount * sizeof(CALmem));
+        if (usage.memCount)
+        {
+            std::memcpy(&payload[sizeof(CALprogramGridExtended)], usage.mem, usage.memCount * sizeof(CALmem));
+        }
+    }
+    g_capture->call(CAL_API_CTX_RUN_PROGRAM_GRID, { event, ctx }, &payload[0], static_cast<CALuint>(payload.size()));
+}
+
+} // anonymous namespace
+
+/*----------------------------------------------------------------------------
+ * aticalrt exports
+ *----------------------------------------------------------------------------*/
+
+extern "C" {
+
+CALAPI CALresult CALAPIENTRY
+calInit(void)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(init, ddiifInit, ());
+    record(CAL_API_INIT, begin, result);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calGetVersion(CALuint* major, CALuint* minor, CALuint* imp)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(getVersion, ddiifGetVersion, (major, minor, imp));
+    record(CAL_API_GET_VERSION, begin, result, out(major, result), out(minor, result), out(imp, result));
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calShutdown(void)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(shutdown, ddiifShutdown, ());
+    record(CAL_API_SHUTDOWN, begin, result);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calDeviceGetCount(CALuint* count)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(deviceGetCount, ddiifDeviceGetCount, (count));
+    record(CAL_API_DEVICE_GET_COUNT, begin, result, out(count, result));
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calDeviceGetInfo(CALdeviceinfo* info, CALuint ordinal)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(deviceGetInfo, ddiifDeviceGetInfo, (info, ordinal));
+    record(CAL_API_DEVICE_GET_INFO, begin, result, ptr(info), ordinal);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calDeviceGetAttribs(CALdeviceattribs* attribs, CALuint ordinal)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(deviceGetAttribs, ddiifDeviceGetAttribs, (attribs, ordinal));
+    record(CAL_API_DEVICE_GET_ATTRIBS, begin, result, ptr(attribs), ordinal);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calDeviceGetStatus(CALdevicestatus* status, CALdevice device)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(deviceGetStatus, ddiifDeviceGetStatus, (status, device));
+    record(CAL_API_DEVICE_GET_STATUS, begin, result, ptr(status), device);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calDeviceOpen(CALdevice* dev, CALuint ordinal)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(deviceOpen, ddiifDeviceOpen, (dev, ordinal));
+    record(CAL_API_DEVICE_OPEN, begin, result, out(dev, result), ordinal);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_DEVICE_OPEN, { *dev, ordinal });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calDeviceClose(CALdevice dev)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(deviceClose, ddiifDeviceClose, (dev));
+    record(CAL_API_DEVICE_CLOSE, begin, result, dev);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_DEVICE_CLOSE, { dev });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calResAllocLocal2D(CALresource* res, CALdevice dev, CALuint width, CALuint height, CALformat format, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(resAllocLocal2D, ddiifResAllocLocal2D, (res, dev, width, height, format, flags));
+    record(CAL_API_RES_ALLOC_LOCAL_2D, begin, result, out(res, result), dev, pack(width, height), format, flags);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*res, width, height, format);
+        g_capture->call(CAL_API_RES_ALLOC_LOCAL_2D, { *res, dev, width, height, static_cast<CALuint64>(format), flags });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calResAllocRemote2D(CALresource* res, CALdevice* dev, CALuint deviceCount, CALuint width, CALuint height, CALformat format, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(resAllocRemote2D, ddiifResAllocRemote2D, (res, dev, deviceCount, width, height, format, flags));
+    record(CAL_API_RES_ALLOC_REMOTE_2D, begin, result, out(res, result), pack(dev ? *dev : 0, deviceCount), pack(width, height), format, flags);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*res, width, height, format);
+        g_capture->call(CAL_API_RES_ALLOC_REMOTE_2D, { *res, deviceCount, width, height, static_cast<CALuint64>(format), flags },
+                        dev, deviceCount * sizeof(CALdevice));
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calResAllocLocal1D(CALresource* res, CALdevice dev, CALuint width, CALformat format, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(resAllocLocal1D, ddiifResAllocLocal1D, (res, dev, width, format, flags));
+    record(CAL_API_RES_ALLOC_LOCAL_1D, begin, result, out(res, result), dev, width, format, flags);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*res, width, 1, format);
+        g_capture->call(CAL_API_RES_ALLOC_LOCAL_1D, { *res, dev, width, static_cast<CALuint64>(format), flags });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calResAllocRemote1D(CALresource* res, CALdevice* dev, CALuint deviceCount, CALuint width, CALformat format, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(resAllocRemote1D, ddiifResAllocRemote1D, (res, dev, deviceCount, width, format, flags));
+    record(CAL_API_RES_ALLOC_REMOTE_1D, begin, result, out(res, result), pack(dev ? *dev : 0, deviceCount), width, format, flags);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->resource(*res, width, 1, format);
+        g_capture->call(CAL_API_RES_ALLOC_REMOTE_1D, { *res, deviceCount, width, static_cast<CALuint64>(format), flags },
+                        dev, deviceCount * sizeof(CALdevice));
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calResFree(CALresource res)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(resFree, ddiifResFree, (res));
+    record(CAL_API_RES_FREE, begin, result, res);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->freeResource(res);
+        g_capture->call(CAL_API_RES_FREE, { res });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calResMap(CALvoid** pPtr, CALuint* pitch, CALresource res, CALuint flags)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(resMap, ddiifResMap, (pPtr, pitch, res, flags));
+    record(CAL_API_RES_MAP, begin, result, (pPtr && result == CAL_RESULT_OK) ? ptr(*pPtr) : 0, out(pitch, result), res, flags);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->map(res, *pPtr, *pitch);
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calResUnmap(CALresource res)
+{
+    CALuint64 begin = tsc();
+
+    // Diff while the memory is still mapped; only a successful unmap is
+    // written, a failed one leaves the mapping and its snapshot in place
+    std::vector<CALubyte> writes;
+    bool diffed = g_capture && g_capture->diff(res, writes);
+    CALresult result = CALTRACE_FORWARD(resUnmap, ddiifResUnmap, (res));
+    record(CAL_API_RES_UNMAP, begin, result, res);
+    if (diffed && result == CAL_RESULT_OK)
+    {
+        g_capture->unmap(res, writes);
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxCreate(CALcontext* ctx, CALdevice dev)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxCreate, ddiifCtxCreate, (ctx, dev));
+    record(CAL_API_CTX_CREATE, begin, result, out(ctx, result), dev);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_CREATE, { *ctx, dev });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxDestroy(CALcontext ctx)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxDestroy, ddiifCtxDestory, (ctx));
+    record(CAL_API_CTX_DESTROY, begin, result, ctx);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_DESTROY, { ctx });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxGetMem(CALmem* mem, CALcontext ctx, CALresource res)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxGetMem, ddiifCtxGetMem, (mem, ctx, res));
+    record(CAL_API_CTX_GET_MEM, begin, result, out(mem, result), ctx, res);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_GET_MEM, { *mem, ctx, res });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxReleaseMem(CALcontext ctx, CALmem mem)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxReleaseMem, ddiifCtxReleaseMem, (ctx, mem));
+    record(CAL_API_CTX_RELEASE_MEM, begin, result, ctx, mem);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_RELEASE_MEM, { ctx, mem });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxSetMem(CALcontext ctx, CALname name, CALmem mem)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxSetMem, ddiifCtxSetMem, (ctx, name, mem));
+    record(CAL_API_CTX_SET_MEM, begin, result, ctx, name, mem);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_SET_MEM, { ctx, name, mem });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxRunProgram(CALevent* event, CALcontext ctx, CALfunc func, const CALdomain* domain)
+{
+    if (g_capture)
+    {
+        g_capture->sync();
+    }
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxRunProgram, ddiifCtxRunProgram, (event, ctx, func, domain));
+    record(CAL_API_CTX_RUN_PROGRAM, begin, result, out(event, result), ctx, func,
+           domain ? pack(domain->width, domain->height) : 0, domain ? pack(domain->x, domain->y) : 0);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_RUN_PROGRAM, { *event, ctx, func, domain->x, domain->y, domain->width, domain->height });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxIsEventDone(CALcontext ctx, CALevent event)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxIsEventDone, ddiifCtxIsEventDone, (ctx, event));
+    record(CAL_API_CTX_IS_EVENT_DONE, begin, result, ctx, event);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_IS_EVENT_DONE, { ctx, event });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxFlush(CALcontext ctx)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxFlush, ddiifCtxFlush, (ctx));
+    record(CAL_API_CTX_FLUSH, begin, result, ctx);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_FLUSH, { ctx });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calMemCopy(CALevent* event, CALcontext ctx, CALmem srcMem, CALmem dstMem, CALuint flags)
+{
+    if (g_capture)
+    {
+        g_capture->sync();
+    }
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(memCopy, ddiifMemCopy, (event, ctx, srcMem, dstMem, flags));
+    record(CAL_API_MEM_COPY, begin, result, out(event, result), ctx, srcMem, dstMem, flags);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_MEM_COPY, { *event, ctx, srcMem, dstMem, flags });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calImageRead(CALimage* image, const CALvoid* buffer, CALuint size)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(imageRead, ddiifImageRead, (image, buffer, size));
+    record(CAL_API_IMAGE_READ, begin, result, (image && result == CAL_RESULT_OK) ? ptr(*image) : 0, ptr(buffer), size);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calImageFree(CALimage image)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(imageFree, ddiifImageFree, (image));
+    record(CAL_API_IMAGE_FREE, begin, result, ptr(image));
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calModuleLoad(CALmodule* module, CALcontext ctx, CALimage image)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(moduleLoad, ddiifModuleLoad, (module, ctx, image));
+    record(CAL_API_MODULE_LOAD, begin, result, out(module, result), ctx, ptr(image));
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        captureModuleLoad(*module, ctx, image);
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calModuleUnload(CALcontext ctx, CALmodule module)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(moduleUnload, ddiifModuleUnload, (ctx, module));
+    record(CAL_API_MODULE_UNLOAD, begin, result, ctx, module);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_MODULE_UNLOAD, { ctx, module });
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calModuleGetEntry(CALfunc* func, CALcontext ctx, CALmodule module, const CALchar* procName)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(moduleGetEntry, ddiifModuleGetEntry, (func, ctx, module, procName));
+    record(CAL_API_MODULE_GET_ENTRY, begin, result, out(func, result), ctx, module, ptr(procName));
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_MODULE_GET_ENTRY, { *func, ctx, module }, procName, static_cast<CALuint>(std::strlen(procName) + 1));
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calModuleGetName(CALname* name, CALcontext ctx, CALmodule module, const CALchar* varName)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(moduleGetName, ddiifModuleGetName, (name, ctx, module, varName));
+    record(CAL_API_MODULE_GET_NAME, begin, result, out(name, result), ctx, module, ptr(varName));
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_MODULE_GET_NAME, { *name, ctx, module }, varName, static_cast<CALuint>(std::strlen(varName) + 1));
+    }
+    return result;
+}
+
+CALAPI const CALchar* CALAPIENTRY
+calGetErrorString(void)
+{
+    CALuint64 begin = tsc();
+    const CALchar* message = s_ddi ? s_ddi->ddiifGetErrorString() : (s_real.getErrorString ? s_real.getErrorString() : "");
+    record(CAL_API_GET_ERROR_STRING, begin, CAL_RESULT_OK, ptr(message));
+    return message;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxRunProgramGrid(CALevent* event, CALcontext ctx, CALprogramGrid* pProgramGrid)
+{
+    if (g_capture)
+    {
+        g_capture->sync();
+    }
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxRunProgramGrid, ddiifCtxRunProgramGrid, (event, ctx, pProgramGrid));
+    CALuint64 groups  = 0;
+    CALuint64 threads = 0;
+    if (pProgramGrid)
+    {
+        groups  = static_cast<CALuint64>(pProgramGrid->gridSize.width) * pProgramGrid->gridSize.height * pProgramGrid->gridSize.depth;
+        threads = static_cast<CALuint64>(pProgramGrid->gridBlock.width) * pProgramGrid->gridBlock.height * pProgramGrid->gridBlock.depth;
+    }
+    record(CAL_API_CTX_RUN_PROGRAM_GRID, begin, result, out(event, result), ctx, pProgramGrid ? pProgramGrid->func : 0, groups, threads);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        captureGrid(*event, ctx, pProgramGrid);
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calModuleGetFuncInfo(CALfuncInfo* pInfo, CALcontext ctx, CALmodule module, CALfunc func)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(moduleGetFuncInfo, ddiifModuleGetFuncInfo, (pInfo, ctx, module, func));
+    record(CAL_API_MODULE_GET_FUNC_INFO, begin, result, ptr(pInfo), ctx, module, func);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calCtxRunProgramGridArray(CALevent* event, CALcontext ctx, CALprogramGridArray* pGridArray)
+{
+    if (g_capture)
+    {
+        g_capture->sync();
+    }
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(ctxRunProgramGridArray, ddiifCtxRunProgramGridArray, (event, ctx, pGridArray));
+    bool haveGrid = pGridArray && pGridArray->gridArray && pGridArray->num;
+    record(CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY, begin, result, out(event, result), ctx, pGridArray ? pGridArray->num : 0,
+           haveGrid ? pGridArray->gridArray[0].func : 0, pGridArray ? pGridArray->flags : 0);
+    if (g_capture && result == CAL_RESULT_OK)
+    {
+        g_capture->call(CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY, { *event, ctx, pGridArray->num, pGridArray->flags },
+                        pGridArray->gridArray, pGridArray->num * sizeof(CALprogramGrid));
+    }
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calExtSupported(CALextid extid)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(extSupported, ddiifExtSupported, (extid));
+    record(CAL_API_EXT_SUPPORTED, begin, result, extid);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calExtGetVersion(CALuint* major, CALuint* minor, CALextid extid)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(extGetVersion, ddiifExtGetVersion, (major, minor, extid));
+    record(CAL_API_EXT_GET_VERSION, begin, result, out(major, result), out(minor, result), extid);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calExtGetProc(CALextproc* proc, CALextid extid, const CALchar* procname)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(extGetProc, ddiifExtGetProc, (proc, extid, procname));
+    if (result == CAL_RESULT_OK && proc && *proc)
+    {
+        *proc = wrapExtProc(procname, *proc);
+    }
+    record(CAL_API_EXT_GET_PROC, begin, result, (proc && result == CAL_RESULT_OK) ? ptr(*proc) : 0, extid, ptr(procname),
+           calApiIdFromName(procname));
+    return result;
+}
+
+/*----------------------------------------------------------------------------
+ * aticalcl exports
+ *----------------------------------------------------------------------------*/
+
+CALAPI CALresult CALAPIENTRY
+calclGetVersion(CALuint* major, CALuint* minor, CALuint* imp)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clGetVersion, ddiifGetVersion, (major, minor, imp));
+    record(CAL_API_CL_GET_VERSION, begin, result, out(major, result), out(minor, result), out(imp, result));
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calclCompile(CALobject* obj, CALlanguage language, const CALchar* source, CALtarget target)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clCompile, ddiifCompile, (obj, language, source, target));
+    record(CAL_API_CL_COMPILE, begin, result, (obj && result == CAL_RESULT_OK) ? ptr(*obj) : 0, language,
+           source ? std::strlen(source) : 0, target);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calclLink(CALimage* image, CALobject* obj, CALuint objCount)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clLink, ddiifLink, (image, obj, objCount));
+    record(CAL_API_CL_LINK, begin, result, (image && result == CAL_RESULT_OK) ? ptr(*image) : 0, ptr(obj), objCount);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calclFreeObject(CALobject obj)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clFreeObject, ddiifFreeObject, (obj));
+    record(CAL_API_CL_FREE_OBJECT, begin, result, ptr(obj));
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calclFreeImage(CALimage image)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clFreeImage, ddiifFreeImage, (image));
+    record(CAL_API_CL_FREE_IMAGE, begin, result, ptr(image));
+    return result;
+}
+
+CALAPI void CALAPIENTRY
+calclDisassembleImage(const CALimage image, CALLogFunction logfunc)
+{
+    CALuint64 begin = tsc();
+    if (s_ddi)
+    {
+        s_ddi->ddiifDisassembleImage(image, logfunc);
+    }
+    else if (s_real.clDisassembleImage)
+    {
+        s_real.clDisassembleImage(image, logfunc);
+    }
+    record(CAL_API_CL_DISASSEMBLE_IMAGE, begin, CAL_RESULT_OK, ptr(image));
+}
+
+CALAPI CALresult CALAPIENTRY
+calclAssembleObject(CALobject* obj, CALCLprogramType type, const CALchar* source, CALtarget target)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clAssembleObject, ddiifAssembleObject, (obj, type, source, target));
+    record(CAL_API_CL_ASSEMBLE_OBJECT, begin, result, (obj && result == CAL_RESULT_OK) ? ptr(*obj) : 0, type,
+           source ? std::strlen(source) : 0, target);
+    return result;
+}
+
+CALAPI void CALAPIENTRY
+calclDisassembleObject(const CALobject* obj, CALLogFunction logfunc)
+{
+    CALuint64 begin = tsc();
+    if (s_ddi)
+    {
+        s_ddi->ddiifDisassembleObject(obj, logfunc);
+    }
+    else if (s_real.clDisassembleObject)
+    {
+        s_real.clDisassembleObject(obj, logfunc);
+    }
+    record(CAL_API_CL_DISASSEMBLE_OBJECT, begin, CAL_RESULT_OK, obj ? ptr(*obj) : 0);
+}
+
+CALAPI CALresult CALAPIENTRY
+calclImageGetSize(CALuint* size, CALimage image)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clImageGetSize, ddiifImageGetSize, (size, image));
+    record(CAL_API_CL_IMAGE_GET_SIZE, begin, result, out(size, result), ptr(image));
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calclImageWrite(CALvoid* buffer, CALuint size, CALimage image)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clImageWrite, ddiifImageWrite, (buffer, size, image));
+    record(CAL_API_CL_IMAGE_WRITE, begin, result, ptr(buffer), size, ptr(image));
+    return result;
+}
+
+CALAPI const CALchar* CALAPIENTRY
+calclGetErrorString(void)
+{
+    CALuint64 begin = tsc();
+    const CALchar* message = s_ddi ? s_ddi->ddiifclGetErrorString() : (s_real.clGetErrorString ? s_real.clGetErrorString() : "");
+    record(CAL_API_CL_GET_ERROR_STRING, begin, CAL_RESULT_OK, ptr(message));
+    return message;
+}
+
+CALAPI CALresult CALAPIENTRY
+calclExtSupported(CALCLextid extid)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clExtSupported, ddiifclExtSupported, (extid));
+    record(CAL_API_CL_EXT_SUPPORTED, begin, result, extid);
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calclExtGetProc(CALCLextproc* proc, CALCLextid extid, const CALchar* procname)
+{
+    CALuint64 begin = tsc();
+    CALresult result = CALTRACE_FORWARD(clExtGetProc, ddiifclExtGetProc, (proc, extid, procname));
+    record(CAL_API_CL_EXT_GET_PROC, begin, result, (proc && result == CAL_RESULT_OK) ? ptr(*proc) : 0, extid, ptr(procname));
+    return result;
+}
+
+} // extern "C"
@@ -0,0 +1,530 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+//
+// caltrace_timeline <trace.bin> [out.json]
+//
+// Converts a trace written by libcaltrace.so into Chrome trace event JSON,
+// loadable in Perfetto or chrome://tracing.
+//
+// Every traced call becomes a slice on its host thread. Every CALevent
+// returned by a submission (calCtxRunProgram*, calMemCopy*) becomes a slice
+// on the track of its CALcontext, spanning submission to the first
+// calCtxIsEventDone/calCtxWaitForEvents that reported it complete:
+//
+//     queued      submit until the first calCtxFlush of the context
+//     in flight   that flush until completion was observed
+//
+// with an instant at the first poll. A flow arrow links the submitting
+// call, the flush, the first poll and the completion. Events still pending
+// at the end of the trace are closed at the last timestamp.
+//
+
+#include "cal_trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const CALuint64 NotSeen = ~0ull;
+
+// Context tracks are emitted as processes of their own, above any real pid
+const CALuint64 ContextPidBase = 1000000000ull;
+
+struct EventLife
+{
+    CALuint    ctx;
+    CALuint    event;
+    CALapiId   api;
+    CALuint    thread;          // submitting thread
+    CALuint64  submitBegin;
+    CALuint64  submit;          // submission returned
+    CALuint64  flush;           // first flush of ctx that returned after submit
+    CALuint    flushThread;
+    CALuint64  flushBegin;
+    CALuint64  firstPoll;
+    CALuint    pollThread;
+    CALuint    polls;
+    CALuint64  complete;        // completion observed
+    CALuint    lane;
+};
+
+bool
+isSubmission(CALapiId api)
+{
+    switch (api)
+    {
+    case CAL_API_CTX_RUN_PROGRAM:
+    case CAL_API_CTX_RUN_PROGRAM_GRID:
+    case CAL_API_CTX_RUN_PROGRAM_GRID_ARRAY:
+    case CAL_API_MEM_COPY:
+    case CAL_API_MEM_COPY_RAW:
+    case CAL_API_MEM_COPY_PARTIAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+class Timeline
+{
+public:
+    Timeline() : m_origin(0), m_last(0), m_out(0) {}
+
+    bool load(const char* path);
+    void correlate();
+    void write(std::FILE* out);
+    void summary(std::FILE* out) const;
+
+private:
+    typedef std::pair<CALuint, CALuint> Key;    // ctx, event
+
+    double us(CALuint64 t) const
+    {
+        return (t > m_origin) ? static_cast<double>(t - m_origin) * 1e6 / static_cast<double>(m_header.tscHz) : 0.0;
+    }
+
+    void completeEvent(size_t index, CALuint64 when);
+    void assignLanes();
+    void writeMetadata();
+    void writeCalls();
+    void writeEvents();
+    void writeFlow(const char* phase, CALuint64 pid, CALuint tid, double ts, size_t id);
+
+    void beginEntry() { std::fprintf(m_out, m_first ? "\n" : ",\n"); m_first = false; }
+
+    CALtraceHeader                      m_header;
+    std::vector<CALtraceRecord>         m_records;
+    std::vector<EventLife>              m_events;
+    std::map<Key, size_t>               m_pending;      // events not yet seen complete
+    std::map<CALuint, std::vector<size_t> > m_unflushed; // per ctx
+    std::map<CALuint, CALuint>          m_lanes;        // lanes used per ctx
+    CALuint64                           m_origin;
+    CALuint64                           m_last;
+    std::FILE*                          m_out;
+    bool                                m_first;
+};
+
+bool
+Timeline::load(const char* path)
+{
+    std::FILE* in = std::fopen(path, "rb");
+    if (!in)
+    {
+        std::fprintf(stderr, "caltrace_timeline: cannot open %s\n", path);
+        return false;
+    }
+
+    bool valid = std::fread(&m_header, sizeof(m_header), 1, in) == 1 &&
+                 std::memcmp(m_header.magic, CAL_TRACE_MAGIC, sizeof(m_header.magic)) == 0 &&
+                 m_header.version == CAL_TRACE_VERSION &&
+                 m_header.recordSize == sizeof(CALtraceRecord) &&
+                 m_header.tscHz != 0;
+    if (!valid)
+    {
+        std::fprintf(stderr, "caltrace_timeline: %s is not a version %u trace\n", path, CAL_TRACE_VERSION);
+        std::fclose(in);
+        return false;
+    }
+
+    CALtraceRecord record;
+    while (std::fread(&record, sizeof(record), 1, in) == 1)
+    {
+        m_records.push_back(record);
+    }
+    std::fclose(in);
+
+    // Threads are interleaved in drain order
+    std::stable_sort(m_records.begin(), m_records.end(),
+                     [](const CALtraceRecord& a, const CALtraceRecord& b) { return a.begin < b.begin; });
+
+    m_origin = m_header.startTsc;
+    m_last   = m_header.startTsc;
+    for (const CALtraceRecord& r : m_records)
+    {
+        m_origin = std::min(m_origin, r.begin);
+        m_last   = std::max(m_last, r.end);
+    }
+    return true;
+}
+
+void
+Timeline::completeEvent(size_t index, CALuint64 when)
+{
+    EventLife& life = m_events[index];
+    life.complete = when;
+    m_pending.erase(Key(life.ctx, life.event));
+}
+
+//
+// Replays the host calls in time order and tracks every event through
+// submit, flush, polling and completion.
+//
+void
+Timeline::correlate()
+{
+    for (const CALtraceRecord& r : m_records)
+    {
+        CALapiId api = static_cast<CALapiId>(r.api);
+        CALuint  ctx = static_cast<CALuint>(r.args[1]);
+
+        if (isSubmission(api))
+        {
+            CALuint event = static_cast<CALuint>(r.args[0]);
+            if (r.result != CAL_RESULT_OK || event == 0)
+            {
+                continue;
+            }
+
+            // A reused event number starts a new lifetime
+            std::map<Key, size_t>::iterator old = m_pending.find(Key(ctx, event));
+            if (old != m_pending.end())
+            {
+                m_pending.erase(old);
+            }
+
+            EventLife life;
+            life.ctx         = ctx;
+            life.event       = event;
+            life.api         = api;
+            life.thread      = r.thread;
+            life.submitBegin = r.begin;
+            life.submit      = r.end;
+            life.flush       = NotSeen;
+            life.flushThread = 0;
+            life.flushBegin  = NotSeen;
+            life.firstPoll   = NotSeen;
+            life.pollThread  = 0;
+            life.polls       = 0;
+            life.complete    = NotSeen;
+            life.lane        = 0;
+            m_pending[Key(ctx, event)] = m_events.size();
+            m_unflushed[ctx].push_back(m_events.size());
+            m_events.push_back(life);
+            continue;
+        }
+
+        switch (api)
+        {
+        case CAL_API_CTX_FLUSH:
+        {
+            ctx = static_cast<CALuint>(r.args[0]);
+            if (r.result != CAL_RESULT_OK)
+            {
+                break;
+            }
+            std::vector<size_t>& unflushed = m_unflushed[ctx];
+            for (size_t index : unflushed)
+            {
+                m_events[index].flush       = r.end;
+                m_events[index].flushBegin  = r.begin;
+                m_events[index].flushThread = r.thread;
+            }
+            unflushed.clear();
+            break;
+        }
+        case CAL_API_CTX_IS_EVENT_DONE:
+        {
+            ctx = static_cast<CALuint>(r.args[0]);
+            std::map<Key, size_t>::iterator it = m_pending.find(Key(ctx, static_cast<CALuint>(r.args[1])));
+            if (it == m_pending.end())
+            {
+                break;
+            }
+            EventLife& life = m_events[it->second];
+            if (life.polls++ == 0)
+            {
+                life.firstPoll  = r.begin;
+                life.pollThread = r.thread;
+            }
+            if (r.result == CAL_RESULT_OK)
+            {
+                completeEvent(it->second, r.end);
+            }
+            break;
+        }
+        case CAL_API_CTX_WAIT_FOR_EVENTS:
+        {
+            // Only the newest event of the list is recorded: a successful
+            // wait completes everything on ctx up to it.
+            ctx = static_cast<CALuint>(r.args[0]);
+            CALuint newest = static_cast<CALuint>(r.args[3]);
+            std::vector<size_t> done;
+            for (std::map<Key, size_t>::iterator it = m_pending.lower_bound(Key(ctx, 0));
+                 it != m_pending.end() && it->first.first == ctx && it->first.second <= newest; ++it)
+            {
+                EventLife& life = m_events[it->second];
+                if (life.polls++ == 0)
+                {
+                    life.firstPoll  = r.begin;
+                    life.pollThread = r.thread;
+                }
+                done.push_back(it->second);
+            }
+            if (r.result == CAL_RESULT_OK)
+            {
+                for (size_t index : done)
+                {
+                    completeEvent(index, r.end);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    assignLanes();
+}
+
+//
+// Events of one context may overlap; give each a lane so slices on a lane
+// never overlap.
+//
+void
+Timeline::assignLanes()
+{
+    std::map<CALuint, std::vector<CALuint64> > laneEnd;
+    for (EventLife& life : m_events)
+    {
+        std::vector<CALuint64>& ends = laneEnd[life.ctx];
+        CALuint64 end = (life.complete != NotSeen) ? life.complete : m_last;
+        size_t lane = 0;
+        while (lane < ends.size() && ends[lane] > life.submit)
+        {
+            ++lane;
+        }
+        if (lane == ends.size())
+        {
+            ends.push_back(end);
+        }
+        else
+        {
+            ends[lane] = end;
+        }
+        life.lane = static_cast<CALuint>(lane);
+    }
+
+    for (const auto& ctx : laneEnd)
+    {
+        m_lanes[ctx.first] = static_cast<CALuint>(ctx.second.size());
+    }
+}
+
+void
+Timeline::writeMetadata()
+{
+    beginEntry();
+    std::fprintf(m_out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,\"args\":{\"name\":\"host %u\"}}",
+                 m_header.pid, m_header.pid);
+    beginEntry();
+    std::fprintf(m_out, "{\"ph\":\"M\",\"name\":\"process_sort_index\",\"pid\":%u,\"args\":{\"sort_index\":0}}", m_header.pid);
+
+    for (const auto& ctx : m_lanes)
+    {
+        CALuint64 pid = ContextPidBase + ctx.first;
+        beginEntry();
+        std::fprintf(m_out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%llu,\"args\":{\"name\":\"CALcontext %u\"}}",
+                     pid, ctx.first);
+        beginEntry();
+        std::fprintf(m_out, "{\"ph\":\"M\",\"name\":\"process_sort_index\",\"pid\":%llu,\"args\":{\"sort_index\":%u}}",
+                     pid, ctx.first);
+        for (CALuint lane = 0; lane < ctx.second; ++lane)
+        {
+            beginEntry();
+            std::fprintf(m_out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%llu,\"tid\":%u,\"args\":{\"name\":\"events %u\"}}",
+                         pid, lane, lane);
+        }
+    }
+}
+
+void
+Timeline::writeCalls()
+{
+    for (const CALtraceRecord& r : m_records)
+    {
+        beginEntry();
+        if (r.api == CAL_API_NONE)
+        {
+            std::fprintf(m_out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"dropped %llu records\",\"cat\":\"caltrace\","
+                                "\"pid\":%u,\"tid\":%u,\"ts\":%.3f}",
+                         static_cast<unsigned long long>(r.args[0]), m_header.pid, r.thread, us(r.begin));
+            continue;
+        }
+
+        std::fprintf(m_out, "{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"cal\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"args\":{\"result\":%u,\"a0\":\"0x%llx\",\"a1\":\"0x%llx\",\"a2\":\"0x%llx\",\"a3\":\"0x%llx\",\"a4\":\"0x%llx\"}}",
+                     calApiName(static_cast<CALapiId>(r.api)), m_header.pid, r.thread, us(r.begin), us(r.end) - us(r.begin),
+                     r.result,
+                     static_cast<unsigned long long>(r.args[0]), static_cast<unsigned long long>(r.args[1]),
+                     static_cast<unsigned long long>(r.args[2]), static_cast<unsigned long long>(r.args[3]),
+                     static_cast<unsigned long long>(r.args[4]));
+    }
+}
+
+void
+Timeline::writeFlow(const char* phase, CALuint64 pid, CALuint tid, double ts, size_t id)
+{
+    beginEntry();
+    std::fprintf(m_out, "{\"ph\":\"%s\",\"name\":\"event\",\"cat\":\"event\",\"id\":%llu,\"pid\":%llu,\"tid\":%u,\"ts\":%.3f,\"bp\":\"e\"}",
+                 phase, static_cast<unsigned long long>(id), static_cast<unsigned long long>(pid), tid, ts);
+}
+
+void
+Timeline::writeEvents()
+{
+    for (size_t id = 0; id < m_events.size(); ++id)
+    {
+        const EventLife& life = m_events[id];
+        CALuint64 pid       = ContextPidBase + life.ctx;
+        bool      completed = life.complete != NotSeen;
+        CALuint64 end       = completed ? life.complete : m_last;
+        double    submit    = us(life.submit);
+        double    finish    = std::max(us(end), submit);
+
+        beginEntry();
+        std::fprintf(m_out, "{\"ph\":\"X\",\"name\":\"%s #%u\",\"cat\":\"event\",\"pid\":%llu,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"args\":{\"event\":%u,\"completed\":%s,\"polls\":%u,\"flush_wait_us\":%.3f,\"first_poll_us\":%.3f}}",
+                     calApiName(life.api), life.event, static_cast<unsigned long long>(pid), life.lane, submit, finish - submit,
+                     life.event, completed ? "true" : "false", life.polls,
+                     (life.flush != NotSeen) ? us(life.flush) - submit : -1.0,
+                     (life.firstPoll != NotSeen) ? us(life.firstPoll) - submit : -1.0);
+
+        // Phases nest inside the event slice
+        double flushed = (life.flush != NotSeen) ? std::min(std::max(us(life.flush), submit), finish) : finish;
+        beginEntry();
+        std::fprintf(m_out, "{\"ph\":\"X\",\"name\":\"queued\",\"cat\":\"event\",\"pid\":%llu,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                     static_cast<unsigned long long>(pid), life.lane, submit, flushed - submit);
+        if (life.flush != NotSeen)
+        {
+            beginEntry();
+            std::fprintf(m_out, "{\"ph\":\"X\",\"name\":\"in flight\",\"cat\":\"event\",\"pid\":%llu,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         static_cast<unsigned long long>(pid), life.lane, flushed, finish - flushed);
+        }
+        if (life.firstPoll != NotSeen)
+        {
+            beginEntry();
+            std::fprintf(m_out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"first poll\",\"cat\":\"event\",\"pid\":%llu,\"tid\":%u,\"ts\":%.3f}",
+                         static_cast<unsigned long long>(pid), life.lane, std::min(std::max(us(life.firstPoll), submit), finish));
+        }
+
+        // Submit -> flush -> first poll -> completion, steps in time order
+        struct Step { CALuint64 when; CALuint thread; };
+        Step steps[2];
+        size_t count = 0;
+        if (life.flush != NotSeen)
+        {
+            steps[count].when   = life.flushBegin;
+            steps[count].thread = life.flushThread;
+            ++count;
+        }
+        if (life.firstPoll != NotSeen)
+        {
+            steps[count].when   = life.firstPoll;
+            steps[count].thread = life.pollThread;
+            ++count;
+        }
+        if (count == 2 && steps[1].when < steps[0].when)
+        {
+            std::swap(steps[0], steps[1]);
+        }
+
+        writeFlow("s", m_header.pid, life.thread, us(life.submitBegin), id);
+        for (size_t i = 0; i < count; ++i)
+        {
+            writeFlow("t", m_header.pid, steps[i].thread, us(steps[i].when), id);
+        }
+        if (completed)
+        {
+            writeFlow("f", pid, life.lane, finish, id);
+        }
+    }
+}
+
+void
+Timeline::write(std::FILE* out)
+{
+    m_out   = out;
+    m_first = true;
+    std::fprintf(m_out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    writeMetadata();
+    writeCalls();
+    writeEvents();
+    std::fprintf(m_out, "\n]}\n");
+}
+
+void
+Timeline::summary(std::FILE* out) const
+{
+    size_t completed = 0;
+    size_t unflushed = 0;
+    size_t neverPolled = 0;
+    for (const EventLife& life : m_events)
+    {
+        completed   += (life.complete != NotSeen) ? 1 : 0;
+        unflushed   += (life.flush == NotSeen) ? 1 : 0;
+        neverPolled += (life.polls == 0) ? 1 : 0;
+    }
+    std::fprintf(out, "%zu calls, %zu contexts, %zu events: %zu completed, %zu never flushed, %zu never polled\n",
+                 m_records.size(), m_lanes.size(), m_events.size(), completed, unflushed, neverPolled);
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::fprintf(stderr, "usage: %s <trace.bin> [out.json]\n", argv[0]);
+        return 2;
+    }
+
+    Timeline timeline;
+    if (!timeline.load(argv[1]))
+    {
+        return 1;
+    }
+    timeline.correlate();
+
+    std::FILE* out = (argc == 3) ? std::fopen(argv[2], "w") : stdout;
+    if (!out)
+    {
+        std::fprintf(stderr, "caltrace_timeline: cannot create %s\n", argv[2]);
+        return 1;
+    }
+    timeline.write(out);
+    if (out != stdout)
+    {
+        std::fclose(out);
+    }
+    timeline.summary(stderr);
+    return 0;
+}
@@ -0,0 +1,296 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "caltrace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace caltrace {
+
+namespace {
+
+CALuint
+currentThreadId()
+{
+#ifdef _WIN32
+    return static_cast<CALuint>(GetCurrentThreadId());
+#else
+    return static_cast<CALuint>(syscall(SYS_gettid));
+#endif
+}
+
+CALuint
+currentProcessId()
+{
+#ifdef _WIN32
+    return static_cast<CALuint>(GetCurrentProcessId());
+#else
+    return static_cast<CALuint>(getpid());
+#endif
+}
+
+CALuint64
+steadyNs()
+{
+    return static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//
+// Drains every registered ring into the trace file from one background
+// thread. Started by the first ring, stopped by static destruction.
+//
+class Writer
+{
+public:
+    Writer() : m_rings(0), m_file(0), m_exit(false), m_started(false) {}
+    ~Writer() { stop(); }
+
+    void addRing(Ring* ring)
+    {
+        Ring* head = m_rings.load(std::memory_order_relaxed);
+        do
+        {
+            ring->next = head;
+        } while (!m_rings.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+
+        std::call_once(m_startOnce, [this] { start(); });
+    }
+
+    // A drained ring of an exited thread, claimed for the caller; NULL if none
+    Ring* reuseRing()
+    {
+        for (Ring* ring = m_rings.load(std::memory_order_acquire); ring; ring = ring->next)
+        {
+            CALuint state = RingFree;
+            if (ring->state.compare_exchange_strong(state, RingLive, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return ring;
+            }
+        }
+        return 0;
+    }
+
+private:
+    void start()
+    {
+        const char* path = std::getenv("CALTRACE_FILE");
+        char defaultPath[64];
+        if (!path || !*path)
+        {
+            std::snprintf(defaultPath, sizeof(defaultPath), "caltrace-%u.bin", currentProcessId());
+            path = defaultPath;
+        }
+        m_file = std::fopen(path, "wb");
+        if (!m_file)
+        {
+            std::fprintf(stderr, "caltrace: cannot open %s, tracing disabled\n", path);
+            return;
+        }
+
+        const char* flush = std::getenv("CALTRACE_FLUSH_MS");
+        m_flushMs = (flush && *flush) ? std::strtoul(flush, 0, 10) : 5;
+        m_started = true;
+        m_thread = std::thread(&Writer::main, this);
+    }
+
+    void stop()
+    {
+        if (!m_started)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_exit = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+        std::fclose(m_file);
+        m_started = false;
+    }
+
+    void writeHeader()
+    {
+        CALtraceHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, CAL_TRACE_MAGIC, sizeof(header.magic));
+        header.version    = CAL_TRACE_VERSION;
+        header.recordSize = sizeof(CALtraceRecord);
+        header.pid        = currentProcessId();
+
+        // Calibrate the timestamp counter against the steady clock
+        CALuint64 ns0  = steadyNs();
+        CALuint64 tsc0 = tsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CALuint64 ns1  = steadyNs();
+        CALuint64 tsc1 = tsc();
+        header.tscHz = (ns1 > ns0) ? (tsc1 - tsc0) * 1000000000ull / (ns1 - ns0) : 1000000000ull;
+
+        header.startTsc    = tsc1;
+        header.startTimeNs = static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        std::fwrite(&header, sizeof(header), 1, m_file);
+    }
+
+    void drain()
+    {
+        for (Ring* ring = m_rings.load(std::memory_order_acquire); ring; ring = ring->next)
+        {
+            CALuint64 head = ring->head.load(std::memory_order_acquire);
+            CALuint64 tail = ring->tail.load(std::memory_order_relaxed);
+            while (tail != head)
+            {
+                // Write contiguous runs straight out of the ring
+                CALuint64 index = tail & (Ring::Capacity - 1);
+                CALuint64 count = std::min<CALuint64>(head - tail, Ring::Capacity - index);
+                std::fwrite(&ring->records[index], sizeof(CALtraceRecord), static_cast<size_t>(count), m_file);
+                tail += count;
+            }
+            ring->tail.store(tail, std::memory_order_release);
+
+            // The owner exited before head was read, so the ring is empty for good
+            if (ring->state.load(std::memory_order_acquire) == RingRetired &&
+                ring->head.load(std::memory_order_relaxed) == tail)
+            {
+                ring->state.store(RingFree, std::memory_order_release);
+            }
+
+            CALuint64 dropped = ring->dropped.load(std::memory_order_relaxed);
+            if (dropped != ring->reportedDrops)
+            {
+                CALtraceRecord marker;
+                std::memset(&marker, 0, sizeof(marker));
+                marker.begin   = marker.end = tsc();
+                marker.thread  = ring->thread.load(std::memory_order_relaxed);
+                marker.api     = CAL_API_NONE;
+                marker.args[0] = dropped - ring->reportedDrops;
+                std::fwrite(&marker, sizeof(marker), 1, m_file);
+                ring->reportedDrops = dropped;
+            }
+        }
+    }
+
+    void main()
+    {
+        writeHeader();
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (!m_exit)
+        {
+            m_wake.wait_for(lock, std::chrono::milliseconds(m_flushMs));
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+        lock.unlock();
+        drain();
+        std::fflush(m_file);
+    }
+
+    std::atomic<Ring*>      m_rings;
+    std::FILE*              m_file;
+    unsigned long           m_flushMs;
+    std::once_flag          m_startOnce;
+    std::mutex              m_lock;
+    std::condition_variable m_wake;
+    std::thread             m_thread;
+    bool                    m_exit;
+    bool                    m_started;
+};
+
+Writer s_writer;
+
+// Set once the calling thread released its ring; later calls go untraced
+thread_local bool t_exiting = false;
+
+//
+// Hands the ring of an exiting thread back to the writer, which frees it
+// for reuse once drained. Constructed on the first ring a thread takes.
+//
+struct RingRelease
+{
+    ~RingRelease()
+    {
+        t_exiting = true;
+        if (t_ring)
+        {
+            t_ring->state.store(RingRetired, std::memory_order_release);
+            t_ring = 0;
+        }
+    }
+};
+
+} // anonymous namespace
+
+Ring*
+createRing()
+{
+    if (t_exiting)
+    {
+        return 0;
+    }
+    thread_local RingRelease release;
+    (void)release;
+
+    // Rings are never freed, only reused: the memory is bounded by the
+    // number of threads tracing at the same time
+    Ring* ring = s_writer.reuseRing();
+    if (ring)
+    {
+        ring->thread.store(currentThreadId(), std::memory_order_relaxed);
+        return ring;
+    }
+
+    ring = new (std::nothrow) Ring;
+    if (!ring)
+    {
+        return 0;
+    }
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->dropped.store(0, std::memory_order_relaxed);
+    ring->reportedDrops = 0;
+    ring->thread.store(currentThreadId(), std::memory_order_relaxed);
+    ring->state.store(RingLive, std::memory_order_relaxed);
+    ring->next          = 0;
+    s_writer.addRing(ring);
+    return ring;
+}
+
+} // namespace caltrace
@@ -0,0 +1,122 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_api_id.h"
+
+#include <cstring>
+
+namespace {
+
+// Indexed by CALapiId
+const CALchar* const s_apiNames[CAL_API_COUNT] = {
+    "none",
+    "calInit",
+    "calGetVersion",
+    "calShutdown",
+    "calDeviceGetCount",
+    "calDeviceGetInfo",
+    "calDeviceGetAttribs",
+    "calDeviceGetStatus",
+    "calDeviceOpen",
+    "calDeviceClose",
+    "calResAllocLocal2D",
+    "calResAllocRemote2D",
+    "calResAllocLocal1D",
+    "calResAllocRemote1D",
+    "calResFree",
+    "calResMap",
+    "calResUnmap",
+    "calCtxCreate",
+    "calCtxDestroy",
+    "calCtxGetMem",
+    "calCtxReleaseMem",
+    "calCtxSetMem",
+    "calCtxRunProgram",
+    "calCtxIsEventDone",
+    "calCtxFlush",
+    "calMemCopy",
+    "calImageRead",
+    "calImageFree",
+    "calModuleLoad",
+    "calModuleUnload",
+    "calModuleGetEntry",
+    "calModuleGetName",
+    "calGetErrorString",
+    "calCtxRunProgramGrid",
+    "calModuleGetFuncInfo",
+    "calCtxRunProgramGridArray",
+    "calExtSupported",
+    "calExtGetVersion",
+    "calExtGetProc",
+    "calclGetVersion",
+    "calclCompile",
+    "calclLink",
+    "calclFreeObject",
+    "calclFreeImage",
+    "calclDisassembleImage",
+    "calclAssembleObject",
+    "calclDisassembleObject",
+    "calclImageGetSize",
+    "calclImageWrite",
+    "calclGetErrorString",
+    "calclExtSupported",
+    "calclExtGetProc",
+    "calResCreate2D",
+    "calResCreate1D",
+    "calResAllocView",
+    "calResAlloc",
+    "calResGetHeap",
+    "calCtxWaitForEvents",
+    "calCtxFlushCache",
+    "calMemCopyRaw",
+    "calMemCopyPartial",
+};
+
+} // anonymous namespace
+
+extern "C" {
+
+CALAPI const CALchar* CALAPIENTRY
+calApiName(CALapiId id)
+{
+    return (id > CAL_API_NONE && id < CAL_API_COUNT) ? s_apiNames[id] : "unknown";
+}
+
+CALAPI CALapiId CALAPIENTRY
+calApiIdFromName(const CALchar* name)
+{
+    if (name)
+    {
+        for (int id = CAL_API_NONE + 1; id < CAL_API_COUNT; ++id)
+        {
+            if (std::strcmp(s_apiNames[id], name) == 0)
+            {
+                return static_cast<CALapiId>(id);
+            }
+        }
+    }
+    return CAL_API_NONE;
+}
+
+} // extern "C"
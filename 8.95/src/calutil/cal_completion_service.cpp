@@ -0,0 +1,293 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_completion_service.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace cal {
+
+namespace {
+
+// Sweeps that found nothing done before the poller sleeps between sweeps
+const CALuint PollSpins = 16;
+const CALuint DefaultPollIntervalUs = 50;
+
+struct Registration
+{
+    CALcontext      ctx;
+    CALevent        event;
+    EventCallback   callback;
+    CALresult       result;
+};
+
+} // anonymous namespace
+
+//
+// Poller thread of one device. Registrations arrive in m_incoming under the
+// lock; the thread moves them to m_pending, which only it touches, so the
+// calCtxIsEventDone sweep and the callbacks run without holding the lock.
+//
+struct DevicePoller
+{
+    CompletionService&                          service;
+    std::mutex                                  lock;
+    std::condition_variable                     wake;       // poller: registrations or exit
+    std::condition_variable                     drained;    // detach: callbacks of a context ran
+    std::vector<Registration>                   incoming;
+    std::unordered_map<CALcontext, CALuint>     outstanding;
+    bool                                        exit;
+    std::thread                                 thread;
+
+    std::vector<Registration>                   pending;    // poller thread only
+    std::vector<Registration>                   done;       // poller thread only
+
+    explicit DevicePoller(CompletionService& owner) : service(owner), exit(false) {}
+
+    void run();
+    void sweep();
+};
+
+void
+DevicePoller::run()
+{
+    CALuint idleSweeps = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (pending.empty())
+            {
+                wake.wait(guard, [this] { return exit || !incoming.empty(); });
+            }
+            else if (idleSweeps >= PollSpins)
+            {
+                std::chrono::microseconds interval(service.m_pollIntervalUs.load(std::memory_order_relaxed));
+                wake.wait_for(guard, interval, [this] { return !incoming.empty(); });
+            }
+            if (exit && pending.empty() && incoming.empty())
+            {
+                return;
+            }
+            for (size_t i = 0; i < incoming.size(); ++i)
+            {
+                pending.push_back(std::move(incoming[i]));
+            }
+            incoming.clear();
+        }
+
+        sweep();
+        if (done.empty())
+        {
+            if (++idleSweeps < PollSpins)
+            {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        idleSweeps = 0;
+
+        for (size_t i = 0; i < done.size(); ++i)
+        {
+            done[i].callback(done[i].event, done[i].result);
+        }
+        service.m_dispatched.fetch_add(done.size(), std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = 0; i < done.size(); ++i)
+            {
+                std::unordered_map<CALcontext, CALuint>::iterator it = outstanding.find(done[i].ctx);
+                if (it != outstanding.end() && --it->second == 0)
+                {
+                    outstanding.erase(it);
+                }
+            }
+        }
+        done.clear();
+        drained.notify_all();
+    }
+}
+
+//
+// Poll every pending event once, moving finished ones to done in
+// registration order
+//
+void
+DevicePoller::sweep()
+{
+    service.m_sweeps.fetch_add(1, std::memory_order_relaxed);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        Registration& r = pending[i];
+        CALresult result = calCtxIsEventDone(r.ctx, r.event);
+        if (result == CAL_RESULT_PENDING)
+        {
+            if (kept != i)
+            {
+                pending[kept] = std::move(r);
+            }
+            ++kept;
+            continue;
+        }
+        r.result = result;
+        done.push_back(std::move(r));
+    }
+    pending.resize(kept);
+}
+
+CompletionService::CompletionService()
+    : m_shutdown(false),
+      m_pollIntervalUs(DefaultPollIntervalUs),
+      m_sweeps(0),
+      m_dispatched(0)
+{
+}
+
+CompletionService::~CompletionService()
+{
+    shutdown();
+}
+
+CALresult
+CompletionService::attach(CALcontext ctx, CALdevice dev)
+{
+    if (ctx == 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (m_shutdown)
+    {
+        return CAL_RESULT_ERROR;
+    }
+
+    std::unique_ptr<DevicePoller>& poller = m_devices[dev];
+    if (!poller)
+    {
+        poller.reset(new DevicePoller(*this));
+        DevicePoller* p = poller.get();
+        p->thread = std::thread([p] { p->run(); });
+    }
+
+    std::unordered_map<CALcontext, DevicePoller*>::iterator it = m_contexts.find(ctx);
+    if (it != m_contexts.end() && it->second != poller.get())
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    m_contexts[ctx] = poller.get();
+    return CAL_RESULT_OK;
+}
+
+CALresult
+CompletionService::detach(CALcontext ctx)
+{
+    DevicePoller* poller;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::unordered_map<CALcontext, DevicePoller*>::iterator it = m_contexts.find(ctx);
+        if (it == m_contexts.end())
+        {
+            return CAL_RESULT_BAD_HANDLE;
+        }
+        poller = it->second;
+    }
+
+    // The context stays attached while draining so callbacks can chain
+    // further registrations; pollers live until shutdown()
+    {
+        std::unique_lock<std::mutex> guard(poller->lock);
+        poller->drained.wait(guard, [poller, ctx] { return poller->outstanding.find(ctx) == poller->outstanding.end(); });
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_contexts.erase(ctx);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+CompletionService::notify(CALcontext ctx, CALevent event, const EventCallback& callback)
+{
+    if (event == 0 || !callback)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    DevicePoller* poller;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::unordered_map<CALcontext, DevicePoller*>::iterator it = m_contexts.find(ctx);
+        if (it == m_contexts.end())
+        {
+            return CAL_RESULT_BAD_HANDLE;
+        }
+        poller = it->second;
+    }
+
+    Registration r = { ctx, event, callback, CAL_RESULT_PENDING };
+    {
+        std::lock_guard<std::mutex> guard(poller->lock);
+        poller->incoming.push_back(std::move(r));
+        ++poller->outstanding[ctx];
+    }
+    poller->wake.notify_one();
+    return CAL_RESULT_OK;
+}
+
+void
+CompletionService::setPollInterval(CALuint microseconds)
+{
+    m_pollIntervalUs.store(microseconds, std::memory_order_relaxed);
+}
+
+void
+CompletionService::shutdown()
+{
+    std::unordered_map<CALdevice, std::unique_ptr<DevicePoller> > devices;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_shutdown = true;
+        m_contexts.clear();
+        devices.swap(m_devices);
+    }
+
+    for (std::unordered_map<CALdevice, std::unique_ptr<DevicePoller> >::iterator it = devices.begin(); it != devices.end(); ++it)
+    {
+        DevicePoller& poller = *it->second;
+        {
+            std::lock_guard<std::mutex> guard(poller.lock);
+            poller.exit = true;
+        }
+        poller.wake.notify_one();
+        poller.thread.join();
+    }
+}
+
+} // namespace cal
@@ -0,0 +1,491 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_context_executor.h"
+
+#include <chrono>
+
+namespace cal {
+
+struct ExecutorCompletion
+{
+    std::atomic<bool>       finished;
+    std::atomic<CALint>     result;
+    std::atomic<CALevent>   event;
+    ContextExecutor*        owner;
+};
+
+struct ExecutorWork
+{
+    enum Type
+    {
+        SetMem,
+        RunProgramGrid,
+        MemCopy,
+        Flush,
+        Invoke
+    };
+
+    std::atomic<ExecutorWork*>              next;
+    Type                                    type;
+    CALname                                 name;
+    CALmem                                  mem;
+    CALmem                                  dstMem;
+    CALuint                                 flags;
+    CALprogramGrid                          grid;
+    std::function<CALresult(CALcontext)>    fn;
+    std::shared_ptr<ExecutorCompletion>     state;
+};
+
+namespace {
+
+// Yields while events are in flight before the executor sleeps between polls
+const CALuint PollSpins = 64;
+const std::chrono::microseconds PollSleep(200);
+
+ExecutorWork*
+newWork(ExecutorWork::Type type)
+{
+    ExecutorWork* work = new ExecutorWork;
+    work->next.store(0, std::memory_order_relaxed);
+    work->type   = type;
+    work->name   = 0;
+    work->mem    = 0;
+    work->dstMem = 0;
+    work->flags  = 0;
+    return work;
+}
+
+} // anonymous namespace
+
+/*----------------------------------------------------------------------------
+ * Completion
+ *----------------------------------------------------------------------------*/
+
+bool
+Completion::done() const
+{
+    return m_state && m_state->finished.load(std::memory_order_acquire);
+}
+
+CALresult
+Completion::result() const
+{
+    return done() ? static_cast<CALresult>(m_state->result.load(std::memory_order_relaxed)) : CAL_RESULT_PENDING;
+}
+
+CALevent
+Completion::event() const
+{
+    return m_state ? m_state->event.load(std::memory_order_relaxed) : 0;
+}
+
+CALresult
+Completion::wait() const
+{
+    if (!m_state)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    if (!done())
+    {
+        m_state->owner->waitFor(*m_state);
+    }
+    return result();
+}
+
+/*----------------------------------------------------------------------------
+ * ContextExecutor
+ *----------------------------------------------------------------------------*/
+
+ContextExecutor::ContextExecutor()
+    : m_tail(0), m_stub(newWork(ExecutorWork::Flush)), m_sleeping(false), m_waiters(0), m_producers(0), m_accepting(false),
+      m_exit(false), m_ctx(0), m_openResult(CAL_RESULT_OK), m_batches(0), m_executed(0), m_flushes(0)
+{
+    m_head.store(m_stub, std::memory_order_relaxed);
+    m_tail = m_stub;
+}
+
+ContextExecutor::~ContextExecutor()
+{
+    close();
+    delete m_stub;
+}
+
+CALresult
+ContextExecutor::open(CALdevice dev)
+{
+    if (m_thread.joinable())
+    {
+        return CAL_RESULT_ALREADY;
+    }
+
+    m_exit       = false;
+    m_ctx        = 0;
+    m_openResult = CAL_RESULT_PENDING;
+    m_thread     = std::thread(&ContextExecutor::threadMain, this, dev);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_done.wait(lock, [this] { return m_openResult != CAL_RESULT_PENDING; });
+    CALresult result = m_openResult;
+    lock.unlock();
+
+    if (result != CAL_RESULT_OK)
+    {
+        m_thread.join();
+        return result;
+    }
+    m_accepting.store(true, std::memory_order_release);
+    return CAL_RESULT_OK;
+}
+
+void
+ContextExecutor::close()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    // Producers that saw m_accepting set link their work before leaving,
+    // so once none is in flight everything accepted is in the queue and the
+    // executor thread runs it before it exits
+    m_accepting.store(false, std::memory_order_seq_cst);
+    while (m_producers.load(std::memory_order_seq_cst) != 0)
+    {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_exit = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+
+    // pop() also reports an empty queue while a link is pending, so loop
+    // until the queue really is empty
+    while (!queueEmpty())
+    {
+        while (ExecutorWork* work = pop())
+        {
+            retire(*work->state, CAL_RESULT_ERROR);
+            delete work;
+        }
+    }
+}
+
+Completion
+ContextExecutor::enqueue(ExecutorWork* work)
+{
+    work->state = std::make_shared<ExecutorCompletion>();
+    work->state->finished.store(false, std::memory_order_relaxed);
+    work->state->result.store(CAL_RESULT_PENDING, std::memory_order_relaxed);
+    work->state->event.store(0, std::memory_order_relaxed);
+    work->state->owner = this;
+    Completion completion(work->state);
+
+    // Counted before m_accepting is read so close() can wait for the push
+    m_producers.fetch_add(1, std::memory_order_seq_cst);
+    if (!m_accepting.load(std::memory_order_seq_cst))
+    {
+        m_producers.fetch_sub(1, std::memory_order_seq_cst);
+        retire(*work->state, CAL_RESULT_ERROR);
+        delete work;
+        return completion;
+    }
+
+    work->next.store(0, std::memory_order_relaxed);
+    ExecutorWork* prev = m_head.exchange(work, std::memory_order_seq_cst);
+    prev->next.store(work, std::memory_order_release);
+    m_producers.fetch_sub(1, std::memory_order_seq_cst);
+
+    if (m_sleeping.load(std::memory_order_seq_cst))
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_wake.notify_one();
+    }
+    return completion;
+}
+
+//
+// Consumer side of the queue; returns NULL when empty or when a producer is
+// between swapping the head and linking its node.
+//
+ExecutorWork*
+ContextExecutor::pop()
+{
+    ExecutorWork* tail = m_tail;
+    ExecutorWork* next = tail->next.load(std::memory_order_acquire);
+    if (tail == m_stub)
+    {
+        if (!next)
+        {
+            return 0;
+        }
+        m_tail = next;
+        tail   = next;
+        next   = next->next.load(std::memory_order_acquire);
+    }
+    if (next)
+    {
+        m_tail = next;
+        return tail;
+    }
+    if (tail != m_head.load(std::memory_order_acquire))
+    {
+        return 0;
+    }
+
+    // tail is the last node: put the stub behind it so it can be detached
+    m_stub->next.store(0, std::memory_order_relaxed);
+    ExecutorWork* prev = m_head.exchange(m_stub, std::memory_order_acq_rel);
+    prev->next.store(m_stub, std::memory_order_release);
+
+    next = tail->next.load(std::memory_order_acquire);
+    if (next)
+    {
+        m_tail = next;
+        return tail;
+    }
+    return 0;
+}
+
+bool
+ContextExecutor::queueEmpty() const
+{
+    return m_tail == m_stub && m_head.load(std::memory_order_seq_cst) == m_stub;
+}
+
+Completion
+ContextExecutor::setMem(CALname name, CALmem mem)
+{
+    ExecutorWork* work = newWork(ExecutorWork::SetMem);
+    work->name = name;
+    work->mem  = mem;
+    return enqueue(work);
+}
+
+Completion
+ContextExecutor::runProgramGrid(const CALprogramGrid& grid)
+{
+    ExecutorWork* work = newWork(ExecutorWork::RunProgramGrid);
+    work->grid = grid;
+    return enqueue(work);
+}
+
+Completion
+ContextExecutor::memCopy(CALmem srcMem, CALmem dstMem, CALuint flags)
+{
+    ExecutorWork* work = newWork(ExecutorWork::MemCopy);
+    work->mem    = srcMem;
+    work->dstMem = dstMem;
+    work->flags  = flags;
+    return enqueue(work);
+}
+
+Completion
+ContextExecutor::flush()
+{
+    return enqueue(newWork(ExecutorWork::Flush));
+}
+
+Completion
+ContextExecutor::invoke(const std::function<CALresult(CALcontext)>& fn)
+{
+    ExecutorWork* work = newWork(ExecutorWork::Invoke);
+    work->fn = fn;
+    return enqueue(work);
+}
+
+void
+ContextExecutor::retire(ExecutorCompletion& state, CALresult result)
+{
+    state.result.store(result, std::memory_order_relaxed);
+    state.finished.store(true, std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_seq_cst) != 0)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_done.notify_all();
+    }
+}
+
+void
+ContextExecutor::waitFor(const ExecutorCompletion& state)
+{
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_done.wait(lock, [&state] { return state.finished.load(std::memory_order_acquire); });
+    }
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void
+ContextExecutor::execute(ExecutorWork& work, bool& submitted, std::vector<ExecutorWork*>& flushes)
+{
+    CALresult result = CAL_RESULT_OK;
+    CALevent  event  = 0;
+    switch (work.type)
+    {
+    case ExecutorWork::SetMem:
+        result = calCtxSetMem(m_ctx, work.name, work.mem);
+        break;
+    case ExecutorWork::RunProgramGrid:
+        result = calCtxRunProgramGrid(&event, m_ctx, &work.grid);
+        break;
+    case ExecutorWork::MemCopy:
+        result = calMemCopy(&event, m_ctx, work.mem, work.dstMem, work.flags);
+        break;
+    case ExecutorWork::Flush:
+        // Merged into the flush at the end of the batch
+        flushes.push_back(&work);
+        return;
+    case ExecutorWork::Invoke:
+        result = work.fn(m_ctx);
+        break;
+    }
+
+    if (result == CAL_RESULT_OK && event != 0)
+    {
+        work.state->event.store(event, std::memory_order_relaxed);
+        m_inFlight.push_back(&work);
+        submitted = true;
+        return;
+    }
+    retire(*work.state, result);
+    delete &work;
+}
+
+//
+// Execute everything queued right now as one batch.
+//
+bool
+ContextExecutor::runBatch()
+{
+    bool submitted = false;
+    std::vector<ExecutorWork*> flushes;
+    CALuint64 count = 0;
+
+    while (ExecutorWork* work = pop())
+    {
+        execute(*work, submitted, flushes);
+        ++count;
+    }
+
+    if (submitted || !flushes.empty())
+    {
+        CALresult result = calCtxFlush(m_ctx);
+        m_flushes.fetch_add(1, std::memory_order_relaxed);
+        for (ExecutorWork* work : flushes)
+        {
+            retire(*work->state, result);
+            delete work;
+        }
+    }
+
+    if (count != 0)
+    {
+        m_executed.fetch_add(count, std::memory_order_relaxed);
+        m_batches.fetch_add(1, std::memory_order_relaxed);
+    }
+    return count != 0;
+}
+
+void
+ContextExecutor::pollEvents()
+{
+    for (size_t i = 0; i < m_inFlight.size();)
+    {
+        ExecutorWork* work = m_inFlight[i];
+        CALresult result = calCtxIsEventDone(m_ctx, work->state->event.load(std::memory_order_relaxed));
+        if (result == CAL_RESULT_PENDING)
+        {
+            ++i;
+            continue;
+        }
+        retire(*work->state, result);
+        delete work;
+        m_inFlight[i] = m_inFlight.back();
+        m_inFlight.pop_back();
+    }
+}
+
+void
+ContextExecutor::threadMain(CALdevice dev)
+{
+    CALcontext ctx = 0;
+    CALresult result = calCtxCreate(&ctx, dev);
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_ctx        = ctx;
+        m_openResult = result;
+    }
+    m_done.notify_all();
+    if (result != CAL_RESULT_OK)
+    {
+        return;
+    }
+
+    CALuint idleSpins = 0;
+    for (;;)
+    {
+        bool worked = runBatch();
+        pollEvents();
+        if (worked)
+        {
+            idleSpins = 0;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (m_exit && queueEmpty() && m_inFlight.empty())
+        {
+            break;
+        }
+        if (!m_inFlight.empty() && idleSpins < PollSpins)
+        {
+            lock.unlock();
+            ++idleSpins;
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Sleep until work arrives, or until the next poll when events are pending
+        m_sleeping.store(true, std::memory_order_seq_cst);
+        if (m_inFlight.empty())
+        {
+            m_wake.wait(lock, [this] { return m_exit || !queueEmpty(); });
+        }
+        else
+        {
+            m_wake.wait_for(lock, PollSleep, [this] { return !queueEmpty(); });
+        }
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    calCtxDestroy(m_ctx);
+    m_ctx = 0;
+}
+
+} // namespace cal
@@ -0,0 +1,337 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_copy.h"
+#include "cal_format.h"
+#include "cal_thread_pool.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CAL_COPY_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CAL_COPY_TARGET(isa)
+#else
+#define CAL_COPY_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace cal {
+
+namespace {
+
+// Rows shorter than this are left to memcpy, which wins on short copies
+const size_t    SimdMinBytes     = 256;
+
+// The kernels below only do streaming stores: for cached stores the C
+// library memcpy is already vectorized and was measured as fast or faster
+// (calbench_copy).
+
+// Parallel copies split into pieces of at least this many bytes
+const size_t    ParallelMinPiece = 256 * 1024;
+
+typedef void (*RowCopy)(CALubyte* dst, const CALubyte* src, size_t bytes);
+
+void
+rowScalar(CALubyte* dst, const CALubyte* src, size_t bytes)
+{
+    std::memcpy(dst, src, bytes);
+}
+
+#ifdef CAL_COPY_X86
+
+CAL_COPY_TARGET("sse2")
+void
+rowSse2(CALubyte* dst, const CALubyte* src, size_t bytes)
+{
+    if (bytes < SimdMinBytes)
+    {
+        std::memcpy(dst, src, bytes);
+        return;
+    }
+
+    // Align the destination so every store is a full aligned vector
+    size_t head = (16 - (reinterpret_cast<size_t>(dst) & 15)) & 15;
+    std::memcpy(dst, src, head);
+    dst += head, src += head, bytes -= head;
+
+    for (; bytes >= 64; dst += 64, src += 64, bytes -= 64)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+    }
+    std::memcpy(dst, src, bytes);
+}
+
+CAL_COPY_TARGET("avx2")
+void
+rowAvx2(CALubyte* dst, const CALubyte* src, size_t bytes)
+{
+    if (bytes < SimdMinBytes)
+    {
+        std::memcpy(dst, src, bytes);
+        return;
+    }
+
+    size_t head = (32 - (reinterpret_cast<size_t>(dst) & 31)) & 31;
+    std::memcpy(dst, src, head);
+    dst += head, src += head, bytes -= head;
+
+    for (; bytes >= 128; dst += 128, src += 128, bytes -= 128)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 96), d);
+    }
+    std::memcpy(dst, src, bytes);
+}
+
+CAL_COPY_TARGET("avx512f")
+void
+rowAvx512(CALubyte* dst, const CALubyte* src, size_t bytes)
+{
+    if (bytes < SimdMinBytes)
+    {
+        std::memcpy(dst, src, bytes);
+        return;
+    }
+
+    size_t head = (64 - (reinterpret_cast<size_t>(dst) & 63)) & 63;
+    std::memcpy(dst, src, head);
+    dst += head, src += head, bytes -= head;
+
+    for (; bytes >= 256; dst += 256, src += 256, bytes -= 256)
+    {
+        __m512i a = _mm512_loadu_si512(src);
+        __m512i b = _mm512_loadu_si512(src + 64);
+        __m512i c = _mm512_loadu_si512(src + 128);
+        __m512i d = _mm512_loadu_si512(src + 192);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), a);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 64), b);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 128), c);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 192), d);
+    }
+    std::memcpy(dst, src, bytes);
+}
+
+CopyIsa
+detectIsa()
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    int maxLeaf = regs[0];
+    __cpuid(regs, 1);
+    bool sse2    = (regs[3] & (1 << 26)) != 0;
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(regs, 7, 0);
+        avx2   = (regs[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        avx512 = (regs[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse2   = __builtin_cpu_supports("sse2");
+    bool avx2   = __builtin_cpu_supports("avx2");
+    bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+    return avx512 ? CopyIsaAvx512 : avx2 ? CopyIsaAvx2 : sse2 ? CopyIsaSse2 : CopyIsaScalar;
+}
+
+#else
+
+CopyIsa
+detectIsa()
+{
+    return CopyIsaScalar;
+}
+
+#endif // CAL_COPY_X86
+
+CopyIsa
+supportedIsa()
+{
+    static const CopyIsa isa = detectIsa();
+    return isa;
+}
+
+std::atomic<int> g_isa(-1);     // -1 until first use
+
+RowCopy
+rowCopy(CopyIsa isa)
+{
+    switch (isa)
+    {
+#ifdef CAL_COPY_X86
+    case CopyIsaAvx512: return rowAvx512;
+    case CopyIsaAvx2:   return rowAvx2;
+    case CopyIsaSse2:   return rowSse2;
+#endif
+    default:            return rowScalar;
+    }
+}
+
+void
+copyRows(RowCopy copy, CALubyte* dst, size_t dstPitch, const CALubyte* src, size_t srcPitch,
+         size_t rowBytes, CALuint rows, bool streaming)
+{
+    for (CALuint row = 0; row < rows; ++row)
+    {
+        copy(dst + row * dstPitch, src + row * srcPitch, rowBytes);
+    }
+#ifdef CAL_COPY_X86
+    if (streaming)
+    {
+        // Streaming stores are weakly ordered; publish them before returning
+        _mm_sfence();
+    }
+#endif
+}
+
+} // anonymous namespace
+
+CopyIsa
+copyIsaSupported()
+{
+    return supportedIsa();
+}
+
+CopyIsa
+copyIsa()
+{
+    int isa = g_isa.load(std::memory_order_relaxed);
+    return (isa < 0) ? supportedIsa() : static_cast<CopyIsa>(isa);
+}
+
+void
+setCopyIsa(CopyIsa isa)
+{
+    g_isa.store((isa > supportedIsa()) ? supportedIsa() : isa, std::memory_order_relaxed);
+}
+
+void
+copyPitched(CALvoid* dst, size_t dstPitchBytes, const CALvoid* src, size_t srcPitchBytes,
+            size_t rowBytes, CALuint rows, CALuint flags)
+{
+    CALubyte*       d = static_cast<CALubyte*>(dst);
+    const CALubyte* s = static_cast<const CALubyte*>(src);
+    bool streaming    = (flags & CopyStreaming) != 0;
+    RowCopy copy      = streaming ? rowCopy(copyIsa()) : rowScalar;
+    if (rows == 0 || rowBytes == 0)
+    {
+        return;
+    }
+
+    // Packed on both sides: one block
+    if (rows > 1 && dstPitchBytes == rowBytes && srcPitchBytes == rowBytes)
+    {
+        rowBytes *= rows;
+        rows      = 1;
+    }
+
+    size_t total  = rowBytes * rows;
+    CALuint pieces = 1;
+    if ((flags & CopyParallel) && total >= 2 * ParallelMinPiece)
+    {
+        size_t byBytes  = total / ParallelMinPiece;
+        size_t byThread = (static_cast<size_t>(ThreadPool::shared().threadCount()) + 1) * 4;
+        pieces = static_cast<CALuint>(byBytes < byThread ? byBytes : byThread);
+    }
+    if (pieces <= 1)
+    {
+        copyRows(copy, d, dstPitchBytes, s, srcPitchBytes, rowBytes, rows, streaming);
+        return;
+    }
+
+    if (rows == 1)
+    {
+        // One long block: split it at 64 byte boundaries of the destination
+        size_t step = ((rowBytes / pieces) + 63) & ~static_cast<size_t>(63);
+        ThreadPool::shared().parallelFor(pieces, [=](CALuint i) {
+            size_t begin = step * i;
+            size_t end   = (i + 1 == pieces) ? rowBytes : begin + step;
+            if (begin < end)
+            {
+                copyRows(copy, d + begin, 0, s + begin, 0, end - begin, 1, streaming);
+            }
+        });
+        return;
+    }
+
+    pieces = (pieces > rows) ? rows : pieces;
+    ThreadPool::shared().parallelFor(pieces, [=](CALuint i) {
+        CALuint begin = static_cast<CALuint>(static_cast<CALuint64>(rows) * i / pieces);
+        CALuint end   = static_cast<CALuint>(static_cast<CALuint64>(rows) * (i + 1) / pieces);
+        copyRows(copy, d + begin * dstPitchBytes, dstPitchBytes, s + begin * srcPitchBytes, srcPitchBytes,
+                 rowBytes, end - begin, streaming);
+    });
+}
+
+CALresult
+copyToSurface(CALvoid* surface, CALuint pitch, const CALvoid* host, CALuint width, CALuint height,
+              CALformat format, CALuint flags)
+{
+    if (!surface || !host || pitch < width)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    size_t elementSize = formatElementSize(format);
+    copyPitched(surface, pitch * elementSize, host, width * elementSize, width * elementSize,
+                height ? height : 1, flags);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+copyFromSurface(CALvoid* host, const CALvoid* surface, CALuint pitch, CALuint width, CALuint height,
+                CALformat format, CALuint flags)
+{
+    if (!surface || !host || pitch < width)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    size_t elementSize = formatElementSize(format);
+    copyPitched(host, width * elementSize, surface, pitch * elementSize, width * elementSize,
+                height ? height : 1, flags);
+    return CAL_RESULT_OK;
+}
+
+} // namespace cal
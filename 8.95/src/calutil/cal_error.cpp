@@ -0,0 +1,350 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_error.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+CALuint
+currentThreadId()
+{
+#ifdef _WIN32
+    return static_cast<CALuint>(GetCurrentThreadId());
+#else
+    return static_cast<CALuint>(syscall(SYS_gettid));
+#endif
+}
+
+CALuint64
+steadyNs()
+{
+    return static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+bool
+ringDefault()
+{
+    static const bool s_enabled = (getenv("CAL_ERROR_RING") != 0) && (atoi(getenv("CAL_ERROR_RING")) != 0);
+    return s_enabled;
+}
+
+//
+// Last CAL_ERROR_RING_SIZE records of one thread. Only the owning thread
+// writes; rings are linked into a process wide list for calErrorDumpRings.
+//
+struct ErrorRing
+{
+    CALerrorRecord          records[CAL_ERROR_RING_SIZE];
+    std::atomic<CALuint64>  count;      // records ever written
+    ErrorRing*              prev;
+    ErrorRing*              next;
+};
+
+std::mutex  s_ringLock;
+ErrorRing*  s_rings = 0;
+
+void
+linkRing(ErrorRing* ring)
+{
+    std::lock_guard<std::mutex> guard(s_ringLock);
+    ring->prev = 0;
+    ring->next = s_rings;
+    if (s_rings)
+    {
+        s_rings->prev = ring;
+    }
+    s_rings = ring;
+}
+
+void
+unlinkRing(ErrorRing* ring)
+{
+    std::lock_guard<std::mutex> guard(s_ringLock);
+    if (ring->prev)
+    {
+        ring->prev->next = ring->next;
+    }
+    else
+    {
+        s_rings = ring->next;
+    }
+    if (ring->next)
+    {
+        ring->next->prev = ring->prev;
+    }
+}
+
+struct ThreadErrors
+{
+    CALerrorRecord  last;
+    CALuint         thread;
+    CALuint64       sequence;
+    ErrorRing*      ring;
+    bool            ringChecked;    // CAL_ERROR_RING applied to this thread
+
+    ThreadErrors() : thread(0), sequence(0), ring(0), ringChecked(false)
+    {
+        memset(&last, 0, sizeof(last));
+        last.result = CAL_RESULT_OK;
+        last.api    = CAL_API_NONE;
+    }
+
+    ~ThreadErrors()
+    {
+        disableRing();
+    }
+
+    bool enableRing()
+    {
+        ringChecked = true;
+        if (!ring)
+        {
+            ring = new (std::nothrow) ErrorRing;
+            if (!ring)
+            {
+                return false;
+            }
+            memset(ring->records, 0, sizeof(ring->records));
+            ring->count.store(0, std::memory_order_relaxed);
+            linkRing(ring);
+        }
+        return true;
+    }
+
+    void disableRing()
+    {
+        ringChecked = true;
+        if (ring)
+        {
+            unlinkRing(ring);
+            delete ring;
+            ring = 0;
+        }
+    }
+
+    // Copy the finished last record into the ring
+    void push()
+    {
+        if (!ringChecked && ringDefault())
+        {
+            enableRing();
+        }
+        if (ring)
+        {
+            CALuint64 n = ring->count.load(std::memory_order_relaxed);
+            ring->records[n % CAL_ERROR_RING_SIZE] = last;
+            ring->count.store(n + 1, std::memory_order_release);
+        }
+    }
+
+    // Refresh the ring copy after last was amended in place
+    void update()
+    {
+        if (ring)
+        {
+            CALuint64 n = ring->count.load(std::memory_order_relaxed);
+            if (n != 0)
+            {
+                ring->records[(n - 1) % CAL_ERROR_RING_SIZE] = last;
+            }
+        }
+    }
+
+    void begin(CALresult result, CALapiId api, CALuint handle)
+    {
+        if (thread == 0)
+        {
+            thread = currentThreadId();
+        }
+        last.result     = result;
+        last.api        = api;
+        last.handle     = handle;
+        last.thread     = thread;
+        last.sequence   = ++sequence;
+        last.timeNs     = steadyNs();
+        last.message[0] = 0;
+    }
+};
+
+thread_local ThreadErrors t_errors;
+
+void
+logRecord(CALLogFunction log, const CALerrorRecord& record)
+{
+    char line[CAL_ERROR_MESSAGE_SIZE + 128];
+    snprintf(line, sizeof(line), "thread %u #%llu %s: result %d handle %u: %s\n",
+             record.thread, static_cast<unsigned long long>(record.sequence), calApiName(record.api),
+             static_cast<int>(record.result), record.handle, record.message);
+    log(line);
+}
+
+} // anonymous namespace
+
+extern "C" {
+
+CALAPI CALresult CALAPIENTRY
+calErrorSetV(CALresult result, CALapiId api, CALuint handle, const CALchar* fmt, va_list args)
+{
+    ThreadErrors& errors = t_errors;
+    errors.begin(result, api, handle);
+    if (fmt)
+    {
+        vsnprintf(errors.last.message, sizeof(errors.last.message), fmt, args);
+    }
+    errors.push();
+    return result;
+}
+
+CALAPI CALresult CALAPIENTRY
+calErrorSet(CALresult result, CALapiId api, CALuint handle, const CALchar* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    calErrorSetV(result, api, handle, fmt, args);
+    va_end(args);
+    return result;
+}
+
+CALAPI CALuint64 CALAPIENTRY
+calErrorSequence(void)
+{
+    return t_errors.sequence;
+}
+
+CALAPI CALresult CALAPIENTRY
+calErrorAnnotate(CALuint64 since, CALresult result, CALapiId api, CALuint handle, const CALchar* message)
+{
+    if (result == CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    ThreadErrors& errors = t_errors;
+    if (errors.last.sequence <= since || errors.last.result != result)
+    {
+        // Nothing recorded by an inner layer for this failure
+        errors.begin(result, api, handle);
+        if (message)
+        {
+            snprintf(errors.last.message, sizeof(errors.last.message), "%s", message);
+        }
+        errors.push();
+        return result;
+    }
+
+    if (errors.last.api == CAL_API_NONE)
+    {
+        errors.last.api = api;
+    }
+    if (errors.last.handle == 0)
+    {
+        errors.last.handle = handle;
+    }
+    errors.update();
+    return result;
+}
+
+CALAPI const CALerrorRecord* CALAPIENTRY
+calErrorGetLast(void)
+{
+    return &t_errors.last;
+}
+
+CALAPI void CALAPIENTRY
+calErrorClear(void)
+{
+    ThreadErrors& errors = t_errors;
+    errors.last.result     = CAL_RESULT_OK;
+    errors.last.api        = CAL_API_NONE;
+    errors.last.handle     = 0;
+    errors.last.message[0] = 0;
+}
+
+CALAPI CALresult CALAPIENTRY
+calErrorEnableRing(CALboolean enable)
+{
+    if (!enable)
+    {
+        t_errors.disableRing();
+        return CAL_RESULT_OK;
+    }
+    return t_errors.enableRing() ? CAL_RESULT_OK : CAL_RESULT_ERROR;
+}
+
+CALAPI CALuint CALAPIENTRY
+calErrorGetRing(CALerrorRecord* records, CALuint count)
+{
+    const ErrorRing* ring = t_errors.ring;
+    if (!ring || !records)
+    {
+        return 0;
+    }
+
+    CALuint64 total = ring->count.load(std::memory_order_relaxed);
+    CALuint copied = 0;
+    while (copied < count && copied < total && copied < CAL_ERROR_RING_SIZE)
+    {
+        records[copied] = ring->records[(total - 1 - copied) % CAL_ERROR_RING_SIZE];
+        ++copied;
+    }
+    return copied;
+}
+
+CALAPI void CALAPIENTRY
+calErrorDumpRings(CALLogFunction log)
+{
+    if (!log)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(s_ringLock);
+    for (const ErrorRing* ring = s_rings; ring; ring = ring->next)
+    {
+        CALuint64 total = ring->count.load(std::memory_order_acquire);
+        CALuint64 first = (total > CAL_ERROR_RING_SIZE) ? total - CAL_ERROR_RING_SIZE : 0;
+        for (CALuint64 i = first; i < total; ++i)
+        {
+            logRecord(log, ring->records[i % CAL_ERROR_RING_SIZE]);
+        }
+    }
+}
+
+} // extern "C"
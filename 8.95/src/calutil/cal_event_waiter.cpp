@@ -0,0 +1,361 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_event_waiter.h"
+#include "cal_ext_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define CAL_CPU_RELAX() _mm_pause()
+#else
+#define CAL_CPU_RELAX() std::this_thread::yield()
+#endif
+
+namespace cal {
+
+namespace {
+
+const CALuint64 DefaultSpinLimitNs = 200000;
+const CALuint64 UntrackedSpinNs    = 20000;     // spin for events without an estimate
+const CALuint   PausesPerPoll      = 16;
+const size_t    MaxTracked         = 1024;      // events submitted but never waited for are dropped
+
+// Fallback without calCtxWaitForEvents
+const std::chrono::microseconds MinPollSleep(20);
+const std::chrono::microseconds MaxPollSleep(1000);
+
+CALuint64
+steadyNs()
+{
+    return static_cast<CALuint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // anonymous namespace
+
+EventWaiter::EventWaiter(CALcontext ctx)
+    : m_ctx(ctx),
+      m_spinLimitNs((std::thread::hardware_concurrency() > 1) ? DefaultSpinLimitNs : 0),
+      m_spinHits(0),
+      m_blocks(0),
+      m_spinNs(0)
+{
+}
+
+void
+EventWaiter::submitted(CALevent event, CALfunc func)
+{
+    if (m_tracked.size() >= MaxTracked)
+    {
+        m_tracked.erase(m_tracked.begin(), m_tracked.begin() + MaxTracked / 2);
+    }
+    Tracked tracked = { event, func, steadyNs(), 0 };
+    m_tracked.push_back(tracked);
+}
+
+CALuint64
+EventWaiter::estimate(CALfunc func) const
+{
+    std::unordered_map<CALfunc, Estimate>::const_iterator it = m_estimates.find(func);
+    return (it == m_estimates.end()) ? 0 : it->second.meanNs;
+}
+
+CALresult
+EventWaiter::wait(CALevent event)
+{
+    CALresult result = poll(event, false);
+    if (result != CAL_RESULT_PENDING)
+    {
+        return result;
+    }
+
+    CALuint64 now = steadyNs();
+    CALuint64 until = deadline(event, now);
+    CALuint index;
+    if (until - now <= m_spinLimitNs && spinUntil(&event, 1, until, &index, &result))
+    {
+        return result;
+    }
+    return block(event);
+}
+
+CALresult
+EventWaiter::waitAll(const CALevent* events, CALuint n)
+{
+    if (n != 0 && !events)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    for (CALuint i = 0; i < n; ++i)
+    {
+        CALresult result = wait(events[i]);
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+EventWaiter::waitAny(const CALevent* events, CALuint n, CALuint* index)
+{
+    if (n == 0 || !events || !index)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    // Spin until the earliest expected completion
+    CALuint64 now = steadyNs();
+    CALuint64 until = ~static_cast<CALuint64>(0);
+    for (CALuint i = 0; i < n; ++i)
+    {
+        CALresult result = poll(events[i], false);
+        if (result != CAL_RESULT_PENDING)
+        {
+            *index = i;
+            return result;
+        }
+        until = std::min(until, deadline(events[i], now));
+    }
+
+    CALresult result;
+    if (until - now <= m_spinLimitNs && spinUntil(events, n, until, index, &result))
+    {
+        return result;
+    }
+    return blockAny(events, n, index);
+}
+
+//
+// calCtxIsEventDone, retiring the event when it is done. Only spinUntil()
+// polls timed: it saw the event pending a moment ago, so the time it sees
+// it done is the completion time. Untimed polls note when the event was
+// last pending instead.
+//
+CALresult
+EventWaiter::poll(CALevent event, bool timed)
+{
+    CALresult result = calCtxIsEventDone(m_ctx, event);
+    if (result == CAL_RESULT_OK)
+    {
+        retire(event, steadyNs(), timed);
+    }
+    else if (result == CAL_RESULT_PENDING && !timed)
+    {
+        pending(event, steadyNs());
+    }
+    return result;
+}
+
+void
+EventWaiter::pending(CALevent event, CALuint64 now)
+{
+    for (size_t i = 0; i < m_tracked.size(); ++i)
+    {
+        if (m_tracked[i].event == event)
+        {
+            m_tracked[i].pendingNs = now;
+            return;
+        }
+    }
+}
+
+//
+// Time by which event is expected to be done: its submission plus the mean
+// and twice the deviation of its func
+//
+CALuint64
+EventWaiter::deadline(CALevent event, CALuint64 now) const
+{
+    for (size_t i = 0; i < m_tracked.size(); ++i)
+    {
+        if (m_tracked[i].event != event)
+        {
+            continue;
+        }
+        std::unordered_map<CALfunc, Estimate>::const_iterator it = m_estimates.find(m_tracked[i].func);
+        if (it == m_estimates.end())
+        {
+            break;
+        }
+        CALuint64 expected = m_tracked[i].submitNs + it->second.meanNs + 2 * it->second.devNs;
+        return (expected > now) ? expected : now;
+    }
+    return now + UntrackedSpinNs;
+}
+
+//
+// Poll until one of the events is done or until has passed. Returns false
+// when the time ran out.
+//
+bool
+EventWaiter::spinUntil(const CALevent* events, CALuint n, CALuint64 until, CALuint* index, CALresult* result)
+{
+    CALuint64 start = steadyNs();
+    CALuint64 now = start;
+    do
+    {
+        for (CALuint i = 0; i < n; ++i)
+        {
+            CALresult polled = poll(events[i], true);
+            if (polled != CAL_RESULT_PENDING)
+            {
+                m_spinNs += steadyNs() - start;
+                if (polled == CAL_RESULT_OK)
+                {
+                    ++m_spinHits;
+                }
+                *index  = i;
+                *result = polled;
+                return true;
+            }
+        }
+        for (CALuint i = 0; i < PausesPerPoll; ++i)
+        {
+            CAL_CPU_RELAX();
+        }
+        now = steadyNs();
+    } while (now < until);
+
+    for (CALuint i = 0; i < n; ++i)
+    {
+        pending(events[i], now);
+    }
+    m_spinNs += now - start;
+    return false;
+}
+
+CALresult
+EventWaiter::block(CALevent event)
+{
+    ++m_blocks;
+
+    PFNCALCTXWAITFOREVENTS waitForEvents = calExtTableGet()->ctxWaitForEvents;
+    if (waitForEvents)
+    {
+        CALresult result = waitForEvents(m_ctx, &event, 1, CAL_WAIT_LOW_CPU_UTILIZATION);
+        if (result == CAL_RESULT_OK)
+        {
+            retire(event, steadyNs(), false);
+        }
+        return result;
+    }
+
+    std::chrono::microseconds sleep = MinPollSleep;
+    for (;;)
+    {
+        CALresult result = poll(event, false);
+        if (result != CAL_RESULT_PENDING)
+        {
+            return result;
+        }
+        std::this_thread::sleep_for(sleep);
+        sleep = std::min(sleep * 2, MaxPollSleep);
+    }
+}
+
+//
+// calCtxWaitForEvents only waits for all of its events, so waiting for any
+// of several keeps polling every one of them with growing sleeps
+//
+CALresult
+EventWaiter::blockAny(const CALevent* events, CALuint n, CALuint* index)
+{
+    ++m_blocks;
+
+    std::chrono::microseconds sleep = MinPollSleep;
+    for (;;)
+    {
+        for (CALuint i = 0; i < n; ++i)
+        {
+            CALresult result = poll(events[i], false);
+            if (result != CAL_RESULT_PENDING)
+            {
+                *index = i;
+                return result;
+            }
+        }
+        std::this_thread::sleep_for(sleep);
+        sleep = std::min(sleep * 2, MaxPollSleep);
+    }
+}
+
+//
+// Forget a completed event and fold its completion time into the estimate
+// of its func: an exponentially weighted mean (1/8) and mean deviation (1/4).
+//
+// An event seen done by a timed poll completed at now. Otherwise it
+// completed anywhere between the last poll that saw it pending and now,
+// which for a late wait or a slow wake-up is far past the completion; the
+// sample is capped at that last pending poll. It then never exceeds the
+// real completion time, and an estimate that came out too short grows
+// back with every spin that runs out. An event never seen pending gives
+// no sample.
+//
+void
+EventWaiter::retire(CALevent event, CALuint64 now, bool timed)
+{
+    for (size_t i = 0; i < m_tracked.size(); ++i)
+    {
+        if (m_tracked[i].event != event)
+        {
+            continue;
+        }
+
+        CALuint64 until = timed ? now : m_tracked[i].pendingNs;
+        if (until == 0)
+        {
+            m_tracked[i] = m_tracked.back();
+            m_tracked.pop_back();
+            return;
+        }
+
+        CALuint64 sample = (until > m_tracked[i].submitNs) ? until - m_tracked[i].submitNs : 0;
+        Estimate& e = m_estimates[m_tracked[i].func];
+        if (e.samples == 0)
+        {
+            e.meanNs = sample;
+            e.devNs  = sample / 2;
+        }
+        else
+        {
+            CALint64 error = static_cast<CALint64>(sample) - static_cast<CALint64>(e.meanNs);
+            CALint64 absError = (error < 0) ? -error : error;
+            e.meanNs = static_cast<CALuint64>(static_cast<CALint64>(e.meanNs) + error / 8);
+            e.devNs  = static_cast<CALuint64>(static_cast<CALint64>(e.devNs) + (absError - static_cast<CALint64>(e.devNs)) / 4);
+        }
+        ++e.samples;
+
+        m_tracked[i] = m_tracked.back();
+        m_tracked.pop_back();
+        return;
+    }
+}
+
+} // namespace cal
@@ -0,0 +1,253 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_ext_table.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+namespace {
+
+struct ExtDesc
+{
+    CALextCap cap;
+    CALuint   extid;
+    bool      compiler;     // resolved through the calcl entry points
+};
+
+struct ProcDesc
+{
+    CALextCap      cap;
+    const CALchar* name;
+    size_t         offset;  // of the pointer inside CALextTable
+};
+
+const ExtDesc s_exts[] = {
+    { CAL_EXTCAP_COUNTERS,                                  CAL_EXT_COUNTERS,                                   false },
+    { CAL_EXTCAP_DOMAIN_PARAMS,                             CAL_EXT_DOMAIN_PARAMS,                              false },
+    { CAL_EXTCAP_RES_CREATE,                                CAL_EXT_RES_CREATE,                                 false },
+    { CAL_EXTCAP_COMPUTE_SHADER,                            CAL_EXT_COMPUTE_SHADER,                             false },
+    { CAL_EXTCAP_SAMPLER_PARAM,                             CAL_EXT_SAMPLER_PARAM,                              false },
+    { CAL_EXTCAP_PRIVATE_PM4CAP,                            CAL_PRIVATE_EXT_PM4CAP,                             false },
+    { CAL_EXTCAP_PRIVATE_SAMPLER_PARAM,                     CAL_PRIVATE_EXT_SAMPLER_PARAM,                      false },
+    { CAL_EXTCAP_PRIVATE_DOMAIN_PARAMS,                     CAL_PRIVATE_EXT_DOMAIN_PARAMS,                      false },
+    { CAL_EXTCAP_PRIVATE_INTERNAL_COUNTERS,                 CAL_PRIVATE_EXT_INTERNAL_COUNTERS,                  false },
+    { CAL_EXTCAP_PRIVATE_RUNTIME_CONFIG,                    CAL_PRIVATE_EXT_RUNTIME_CONFIG,                     false },
+    { CAL_EXTCAP_PRIVATE_RESOURCES,                         CAL_PRIVATE_EXT_RESOURCES,                          false },
+    { CAL_EXTCAP_PRIVATE_SYNC_OBJECT,                       CAL_PRIVATE_EXT_SYNC_OBJECT,                        false },
+    { CAL_EXTCAP_PRIVATE_DEVICE_CLOCKUP,                    CAL_PRIVATE_EXT_DEVICE_CLOCKUP,                     false },
+    { CAL_EXTCAP_PRIVATE_MEMCOPY_RAW,                       CAL_PRIVATE_EXT_MEMCOPY_RAW,                        false },
+    { CAL_EXTCAP_PRIVATE_EXTENDED_RUNPROGRAMGRID,           CAL_PRIVATE_EXT_EXTENDED_RUNPROGRAMGRID,            false },
+    { CAL_EXTCAP_PRIVATE_OPENGL,                            CAL_PRIVATE_EXT_OPENGL,                             false },
+    { CAL_EXTCAP_PRIVATE_RES_ALLOC,                         CAL_PRIVATE_EXT_RES_ALLOC,                          false },
+    { CAL_EXTCAP_PRIVATE_RES_ALLOC_SLICE_VIEW,              CAL_PRIVATE_EXT_RES_ALLOC_SLICE_VIEW,               false },
+    { CAL_EXTCAP_PRIVATE_HEAP,                              CAL_PRIVATE_EXT_HEAP,                               false },
+    { CAL_EXTCAP_PRIVATE_ATOMIC_COUNTER,                    CAL_PRIVATE_EXT_ATOMIC_COUNTER,                     false },
+    { CAL_EXTCAP_PRIVATE_VIDEO,                             CAL_PRIVATE_EXT_VIDEO,                              false },
+    { CAL_EXTCAP_PRIVATE_COMPILER,                          CAL_PRIVATE_EXT_COMPILER,                           false },
+    { CAL_EXTCAP_PRIVATE_EXTENDED_RUNPROGRAMGRID_CB_OFFSET, CAL_PRIVATE_EXT_EXTENDED_RUNPROGRAMGRID_CB_OFFSET,  false },
+    { CAL_EXTCAP_PRIVATE_EXTENDED_DEVICEATTRIBS,            CAL_PRIVATE_EXT_EXTENDED_DEVICEATTRIBS,             false },
+    { CAL_EXTCAP_PRIVATE_FLUSH_CACHE,                       CAL_PRIVATE_EXT_FLUSH_CACHE,                        false },
+    { CAL_EXTCAP_PRIVATE_MEMCOPY_PARTIAL,                   CAL_PRIVATE_EXT_MEMCOPY_PARTIAL,                    false },
+    { CAL_EXTCAP_CL_COMPILER_CONFIG,                        CALCL_PRIVATE_EXT_COMPILER_CONFIG,                  true  },
+    { CAL_EXTCAP_CL_ISA_FUNCTIONS,                          CALCL_PRIVATE_EXT_ISA_FUNCTIONS,                    true  },
+};
+
+#define CAL_PROC(cap, name, member) { cap, name, offsetof(CALextTable, member) }
+
+const ProcDesc s_procs[] = {
+    CAL_PROC(CAL_EXTCAP_COUNTERS,                       "calCtxCreateCounter",                  ctxCreateCounter),
+    CAL_PROC(CAL_EXTCAP_COUNTERS,                       "calCtxDestroyCounter",                 ctxDestroyCounter),
+    CAL_PROC(CAL_EXTCAP_COUNTERS,                       "calCtxBeginCounter",                   ctxBeginCounter),
+    CAL_PROC(CAL_EXTCAP_COUNTERS,                       "calCtxEndCounter",                     ctxEndCounter),
+    CAL_PROC(CAL_EXTCAP_COUNTERS,                       "calCtxGetCounter",                     ctxGetCounter),
+    CAL_PROC(CAL_EXTCAP_DOMAIN_PARAMS,                  "calCtxRunProgramParams",               ctxRunProgramParams),
+    CAL_PROC(CAL_EXTCAP_RES_CREATE,                     "calResCreate2D",                       resCreate2D),
+    CAL_PROC(CAL_EXTCAP_RES_CREATE,                     "calResCreate1D",                       resCreate1D),
+    CAL_PROC(CAL_EXTCAP_COMPUTE_SHADER,                 "calCtxRunProgramGrid",                 ctxRunProgramGrid),
+    CAL_PROC(CAL_EXTCAP_COMPUTE_SHADER,                 "calModuleGetFuncInfo",                 moduleGetFuncInfo),
+    CAL_PROC(CAL_EXTCAP_COMPUTE_SHADER,                 "calCtxRunProgramGridArray",            ctxRunProgramGridArray),
+    CAL_PROC(CAL_EXTCAP_SAMPLER_PARAM,                  "calCtxSetSamplerParameter",            ctxSetSamplerParams),
+    CAL_PROC(CAL_EXTCAP_SAMPLER_PARAM,                  "calCtxGetSamplerParameter",            ctxGetSamplerParams),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_PM4CAP,                 "calEnableLogging",                     enableLogging),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_PM4CAP,                 "calLoggingCaptureMem",                 loggingCaptureMem),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_SAMPLER_PARAM,          "calCtxSetSamplerParameter",            ctxSetSamplerParameter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_INTERNAL_COUNTERS,      "calCtxCreatePrivateCounter",           ctxCreatePrivateCounter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_INTERNAL_COUNTERS,      "calCtxConfigPrivateCounter",           ctxConfigPrivateCounter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_INTERNAL_COUNTERS,      "calCtxGetPrivateCounter",              ctxGetPrivateCounter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_RUNTIME_CONFIG,         "calConfig",                            config),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_RUNTIME_CONFIG,         "calClearConfig",                       clearConfig),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_RESOURCES,              "calResAllocView",                      resAllocView),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_RESOURCES,              "calResQueryInfo",                      resQueryInfo),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_RESOURCES,              "calResMemCopy",                        resMemCopy),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_SYNC_OBJECT,            "calCtxWaitForEvents",                  ctxWaitForEvents),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_DEVICE_CLOCKUP,         "calDeviceClockUp",                     deviceClockUp),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_MEMCOPY_RAW,            "calMemCopyRaw",                        memCopyRaw),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_RES_ALLOC,              "calResAlloc",                          resAlloc),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_RES_ALLOC_SLICE_VIEW,   "calResAllocSliceView",                 resAllocSliceView),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_HEAP,                   "calResGetHeap",                        resGetHeap),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_ATOMIC_COUNTER,         "calReadAtomicCounter",                 readAtomicCounter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_ATOMIC_COUNTER,         "calWriteAtomicCounter",                writeAtomicCounter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_ATOMIC_COUNTER,         "calBindAtomicCounter",                 bindAtomicCounter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_ATOMIC_COUNTER,         "calSyncAtomicCounter",                 syncAtomicCounter),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calCtxCreateProperties",               ctxCreateProperties),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calCtxRunProgramVideo",                ctxRunProgramVideo),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calDeviceGetVideoAttribs",             deviceGetVideoAttribs),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calDeviceGetCtxProperties",            deviceGetCtxProperties),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calGetCtxProperties",                  getCtxProperties),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeCreateVCE",                   encodeCreateVCE),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeDestroyVCE",                  encodeDestroyVCE),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetDeviceInfo",               encodeGetDeviceInfo),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetNumberOfModes",            encodeGetNumberOfModes),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetModes",                    encodeGetModes),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetDeviceCAP",                encodeGetDeviceCAP),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeCreateSession",               encodeCreateSession),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeCloseSession",                encodeCloseSession),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeSetState",                    encodeSetState),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetPictureControlConfig",     encodeGetPictureControlConfig),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetRateControlConfig",        encodeGetRateControlConfig),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetMotionEstimationConfig",   encodeGetMotionEstimationConfig),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeGetRDOControlConfig",         encodeGetRDOControlConfig),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeSendConfig",                  encodeSendConfig),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodePicture",                     encodePicture),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeQueryTaskDescription",        encodeQueryTaskDescription),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_VIDEO,                  "calEncodeReleaseOutputResource",       encodeReleaseOutputResource),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_COMPILER,               "calGetFuncInfoFromImage",              getFuncInfoFromImage),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_COMPILER,               "calConvertTextToBinary",               convertTextToBinary),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_COMPILER,               "calConvertBinaryToText",               convertBinaryToText),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_COMPILER,               "calFreeTextBinary",                    freeTextBinary),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_EXTENDED_DEVICEATTRIBS, "calDeviceGetAttribsExt",               deviceGetAttribsExt),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_FLUSH_CACHE,            "calCtxFlushCache",                     ctxFlushCache),
+    CAL_PROC(CAL_EXTCAP_PRIVATE_MEMCOPY_PARTIAL,        "calMemCopyPartial",                    memCopyPartial),
+    CAL_PROC(CAL_EXTCAP_CL_COMPILER_CONFIG,             "calclConfig",                          clConfig),
+    CAL_PROC(CAL_EXTCAP_CL_COMPILER_CONFIG,             "calclClearConfig",                     clClearConfig),
+    CAL_PROC(CAL_EXTCAP_CL_ISA_FUNCTIONS,               "calclAssemble",                        clAssemble),
+    CAL_PROC(CAL_EXTCAP_CL_ISA_FUNCTIONS,               "calclDisassemble",                     clDisassemble),
+};
+
+#undef CAL_PROC
+
+// Every table calExtTableInit resolved, never modified once published.
+// Readers may hold any of them, so they live as long as the process; a
+// deque does not move them as it grows.
+std::mutex                      s_tableLock;
+std::deque<CALextTable>         s_tables;
+const CALextTable               s_emptyTable = CALextTable();
+std::atomic<const CALextTable*> s_table(&s_emptyTable);
+
+} // anonymous namespace
+
+extern "C" {
+
+CALAPI CALresult CALAPIENTRY
+calExtTableLoad(CALextTable* table)
+{
+    if (!table)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    std::memset(table, 0, sizeof(*table));
+
+    const ExtDesc* exts[CAL_EXTCAP_COUNT] = { 0 };
+    for (size_t i = 0; i < sizeof(s_exts) / sizeof(s_exts[0]); ++i)
+    {
+        const ExtDesc& ext = s_exts[i];
+        exts[ext.cap] = &ext;
+
+        CALresult result = ext.compiler ? calclExtSupported(static_cast<CALCLextid>(ext.extid))
+                                        : calExtSupported(static_cast<CALextid>(ext.extid));
+        if (result != CAL_RESULT_OK)
+        {
+            continue;
+        }
+
+        // The compiler library has no version query, report 1.0
+        CALextVersion& version = table->version[ext.cap];
+        version.major = 1;
+        version.minor = 0;
+        if (!ext.compiler && calExtGetVersion(&version.major, &version.minor, static_cast<CALextid>(ext.extid)) != CAL_RESULT_OK)
+        {
+            version.major = 1;
+            version.minor = 0;
+        }
+        table->caps |= static_cast<CALuint64>(1) << ext.cap;
+    }
+
+    for (size_t i = 0; i < sizeof(s_procs) / sizeof(s_procs[0]); ++i)
+    {
+        const ProcDesc& proc = s_procs[i];
+        if (!CAL_EXT_TABLE_HAS(table, proc.cap))
+        {
+            continue;
+        }
+
+        CALvoid* address = 0;
+        const ExtDesc& ext = *exts[proc.cap];
+        if (ext.compiler)
+        {
+            CALCLextproc p = 0;
+            address = (calclExtGetProc(&p, static_cast<CALCLextid>(ext.extid), proc.name) == CAL_RESULT_OK) ? p : 0;
+        }
+        else
+        {
+            CALextproc p = 0;
+            address = (calExtGetProc(&p, static_cast<CALextid>(ext.extid), proc.name) == CAL_RESULT_OK) ? p : 0;
+        }
+        std::memcpy(reinterpret_cast<CALubyte*>(table) + proc.offset, &address, sizeof(address));
+    }
+    return CAL_RESULT_OK;
+}
+
+CALAPI CALresult CALAPIENTRY
+calExtTableInit(void)
+{
+    CALresult result = calInit();
+    if (result == CAL_RESULT_ALREADY)
+    {
+        result = CAL_RESULT_OK;
+    }
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    CALextTable table;
+    calExtTableLoad(&table);
+
+    std::lock_guard<std::mutex> guard(s_tableLock);
+    s_tables.push_back(table);
+    s_table.store(&s_tables.back(), std::memory_order_release);
+    return CAL_RESULT_OK;
+}
+
+CALAPI const CALextTable* CALAPIENTRY
+calExtTableGet(void)
+{
+    return s_table.load(std::memory_order_acquire);
+}
+
+} // extern "C"
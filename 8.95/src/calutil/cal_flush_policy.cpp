@@ -0,0 +1,306 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_flush_policy.h"
+
+#include <algorithm>
+
+namespace cal {
+
+FlushPolicy::FlushPolicy(CALcontext ctx, const FlushPolicyParams& params)
+    : m_ctx(ctx),
+      m_params(params),
+      m_stop(false)
+{
+    resetStats();
+}
+
+FlushPolicy::~FlushPolicy()
+{
+    stopTimer();
+}
+
+void
+FlushPolicy::setContext(CALcontext ctx)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_ctx = ctx;
+    m_queued.clear();
+}
+
+CALcontext
+FlushPolicy::context() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_ctx;
+}
+
+void
+FlushPolicy::setParams(const FlushPolicyParams& params)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_params = params;
+    }
+    m_wake.notify_one();
+}
+
+FlushPolicyParams
+FlushPolicy::params() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_params;
+}
+
+CALresult
+FlushPolicy::submitted(CALevent event)
+{
+    Clock::time_point now = Clock::now();
+    bool armed;
+    CALcontext flushCtx;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        ++m_commands;
+        armed = m_queued.empty();
+        if (armed)
+        {
+            m_firstQueued = now;
+        }
+        m_lastQueued = now;
+        m_queued.push_back(event);
+
+        if (m_params.maxCommands != 0 && m_queued.size() >= m_params.maxCommands)
+        {
+            flushCtx = takeLocked(FlushCommands);
+            armed = false;
+        }
+        else
+        {
+            flushCtx = dueLocked(now);
+        }
+    }
+    if (armed)
+    {
+        m_wake.notify_one();
+    }
+    return flushContext(flushCtx);
+}
+
+CALresult
+FlushPolicy::aboutToWait(CALevent event)
+{
+    CALcontext ctx;
+    return aboutToWait(event, ctx);
+}
+
+CALresult
+FlushPolicy::isEventDone(CALevent event)
+{
+    CALcontext ctx;
+    CALresult result = aboutToWait(event, ctx);
+    return (result == CAL_RESULT_OK) ? calCtxIsEventDone(ctx, event) : result;
+}
+
+CALresult
+FlushPolicy::flush()
+{
+    CALcontext flushCtx = 0;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (!m_queued.empty())
+        {
+            flushCtx = takeLocked(FlushExplicit);
+        }
+    }
+    return flushContext(flushCtx);
+}
+
+CALresult
+FlushPolicy::poll()
+{
+    CALcontext flushCtx;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        flushCtx = dueLocked(Clock::now());
+    }
+    return flushContext(flushCtx);
+}
+
+void
+FlushPolicy::startTimer()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (!m_timer.joinable())
+    {
+        m_stop = false;
+        m_timer = std::thread(&FlushPolicy::timerMain, this);
+    }
+}
+
+void
+FlushPolicy::stopTimer()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_timer.joinable())
+    {
+        m_timer.join();
+    }
+}
+
+FlushStats
+FlushPolicy::stats() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    FlushStats stats;
+    stats.flushes  = m_flushes;
+    stats.commands = m_commands;
+    std::copy(m_byReason, m_byReason + FlushReasonCount, stats.byReason);
+    stats.seconds  = std::chrono::duration<double>(Clock::now() - m_statsStart).count();
+    stats.flushesPerSecond = (stats.seconds > 0) ? m_flushes / stats.seconds : 0;
+    stats.commandsPerFlush = (m_flushes != 0) ? static_cast<double>(m_commands) / m_flushes : 0;
+    return stats;
+}
+
+void
+FlushPolicy::resetStats()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_statsStart = Clock::now();
+    m_flushes    = 0;
+    m_commands   = 0;
+    std::fill(m_byReason, m_byReason + FlushReasonCount, 0);
+}
+
+//
+// The queue is taken and counted under the lock; the caller flushes the
+// context returned after releasing it, so a slow calCtxFlush never holds
+// up submitters, waiters or the timer.
+//
+CALresult
+FlushPolicy::aboutToWait(CALevent event, CALcontext& ctx)
+{
+    CALcontext flushCtx;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        ctx = m_ctx;
+        if (m_params.flushOnWait && std::find(m_queued.begin(), m_queued.end(), event) != m_queued.end())
+        {
+            flushCtx = takeLocked(FlushWait);
+        }
+        else
+        {
+            flushCtx = dueLocked(Clock::now());
+        }
+    }
+    return flushContext(flushCtx);
+}
+
+CALcontext
+FlushPolicy::takeLocked(FlushReason reason)
+{
+    m_queued.clear();
+    ++m_flushes;
+    ++m_byReason[reason];
+    return m_ctx;
+}
+
+// Context to flush for a time based trigger, 0 if none fired
+CALcontext
+FlushPolicy::dueLocked(Clock::time_point now)
+{
+    if (m_queued.empty())
+    {
+        return 0;
+    }
+    if (m_params.maxDelayUs != 0 && now - m_firstQueued >= std::chrono::microseconds(m_params.maxDelayUs))
+    {
+        return takeLocked(FlushDelay);
+    }
+    if (m_params.idleUs != 0 && now - m_lastQueued >= std::chrono::microseconds(m_params.idleUs))
+    {
+        return takeLocked(FlushIdle);
+    }
+    return 0;
+}
+
+CALresult
+FlushPolicy::flushContext(CALcontext ctx)
+{
+    return (ctx != 0) ? calCtxFlush(ctx) : CAL_RESULT_OK;
+}
+
+//
+// Earliest time a time based trigger fires, time_point::max() if none can
+//
+FlushPolicy::Clock::time_point
+FlushPolicy::deadlineLocked() const
+{
+    Clock::time_point deadline = Clock::time_point::max();
+    if (!m_queued.empty())
+    {
+        if (m_params.maxDelayUs != 0)
+        {
+            deadline = std::min(deadline, m_firstQueued + std::chrono::microseconds(m_params.maxDelayUs));
+        }
+        if (m_params.idleUs != 0)
+        {
+            deadline = std::min(deadline, m_lastQueued + std::chrono::microseconds(m_params.idleUs));
+        }
+    }
+    return deadline;
+}
+
+void
+FlushPolicy::timerMain()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    while (!m_stop)
+    {
+        Clock::time_point deadline = deadlineLocked();
+        if (deadline == Clock::time_point::max())
+        {
+            m_wake.wait(guard);
+        }
+        else
+        {
+            m_wake.wait_until(guard, deadline);
+        }
+        if (!m_stop)
+        {
+            CALcontext flushCtx = dueLocked(Clock::now());
+            if (flushCtx != 0)
+            {
+                guard.unlock();
+                calCtxFlush(flushCtx);
+                guard.lock();
+            }
+        }
+    }
+}
+
+} // namespace cal
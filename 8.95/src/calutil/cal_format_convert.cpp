@@ -0,0 +1,779 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_format_convert.h"
+#include "cal_thread_pool.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CAL_CONVERT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CAL_CONVERT_TARGET(isa)
+#else
+#define CAL_CONVERT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace cal {
+
+namespace {
+
+enum Kind
+{
+    KindNorm,           // unorm and snorm, scaled by the largest value
+    KindInt,            // unnormalized integers
+    KindFloat32,
+    KindFloat64,
+    KindFloat16,
+    KindPacked565,
+    KindPacked555,
+    KindPacked1010102
+};
+
+// How the components of a format are stored
+struct Layout
+{
+    Kind    kind;
+    CALuint bits;       // per component for KindNorm and KindInt
+    bool    isSigned;
+};
+
+// From the format traits; values that are not formats convert as unsigned 32 bit integers
+Layout
+layoutOf(CALformat format)
+{
+    const FormatTraits& traits = formatTraits(format);
+    Layout l = { KindInt, traits.componentBits, traits.type == FormatSnorm || traits.type == FormatSigned };
+    switch (traits.type)
+    {
+    case FormatUnorm:
+    case FormatSnorm:
+        l.kind = KindNorm;
+        break;
+    case FormatFloat:
+        l.kind = (l.bits == 16) ? KindFloat16 : (l.bits == 64) ? KindFloat64 : KindFloat32;
+        break;
+    case FormatPacked:
+        l.kind = (format == CAL_FORMAT_UNORM_SHORT_565) ? KindPacked565 :
+                 (format == CAL_FORMAT_UNORM_SHORT_555) ? KindPacked555 : KindPacked1010102;
+        break;
+    case FormatInvalid:
+        l.bits = 32;
+        break;
+    default:
+        break;
+    }
+    return l;
+}
+
+// value = clamp(x * scale, lo, hi) rounded to nearest even, as the SIMD
+// kernels compute it; NaN becomes lo
+struct Range
+{
+    float   scale;
+    float   lo;
+    float   hi;
+};
+
+Range
+rangeOf(const Layout& l)
+{
+    float top = static_cast<float>((1u << (l.bits - (l.isSigned ? 1 : 0))) - 1);
+    Range r;
+    r.scale = (l.kind == KindNorm) ? top : 1.0f;
+    r.hi    = top;
+    r.lo    = !l.isSigned ? 0.0f : (l.kind == KindNorm) ? -top : -top - 1.0f;
+    return r;
+}
+
+inline CALint
+narrow(float x, const Range& r)
+{
+    float v = x * r.scale;
+    v = (v > r.lo) ? v : r.lo;
+    v = (v < r.hi) ? v : r.hi;
+    return static_cast<CALint>(std::lrint(v));
+}
+
+// 32 bit components do not fit a float mantissa; go through double
+inline CALint64
+narrow32(float x, const Layout& l)
+{
+    double top = l.isSigned ? 2147483647.0 : 4294967295.0;
+    double lo  = !l.isSigned ? 0.0 : (l.kind == KindNorm) ? -top : -top - 1.0;
+    double v   = static_cast<double>(x) * ((l.kind == KindNorm) ? top : 1.0);
+    v = (v > lo) ? v : lo;
+    v = (v < top) ? v : top;
+    return std::llrint(v);
+}
+
+CALushort
+floatToHalf(float value)
+{
+    CALuint bits;
+    std::memcpy(&bits, &value, 4);
+    CALuint sign     = (bits >> 16) & 0x8000u;
+    CALuint exponent = (bits >> 23) & 0xffu;
+    CALuint mantissa = bits & 0x7fffffu;
+
+    if (exponent == 0xff)
+    {
+        // Inf stays Inf, NaN stays a quiet NaN
+        return static_cast<CALushort>(sign | 0x7c00u | (mantissa ? 0x200u | (mantissa >> 13) : 0));
+    }
+    int e = static_cast<int>(exponent) - 127 + 15;
+    if (e >= 31)
+    {
+        return static_cast<CALushort>(sign | 0x7c00u);
+    }
+    if (e <= 0)
+    {
+        // Subnormal half, or zero
+        if (e < -10)
+        {
+            return static_cast<CALushort>(sign);
+        }
+        mantissa |= 0x800000u;
+        CALuint shift = static_cast<CALuint>(14 - e);
+        CALuint half  = mantissa >> shift;
+        CALuint rest  = mantissa & ((1u << shift) - 1);
+        CALuint mid   = 1u << (shift - 1);
+        if (rest > mid || (rest == mid && (half & 1)))
+        {
+            ++half;
+        }
+        return static_cast<CALushort>(sign | half);
+    }
+    CALuint half = sign | (static_cast<CALuint>(e) << 10) | (mantissa >> 13);
+    CALuint rest = mantissa & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1)))
+    {
+        ++half;     // may carry into the exponent, up to Inf, which is right
+    }
+    return static_cast<CALushort>(half);
+}
+
+float
+halfToFloat(CALushort value)
+{
+    CALuint sign     = static_cast<CALuint>(value & 0x8000u) << 16;
+    CALuint exponent = (value >> 10) & 0x1fu;
+    CALuint mantissa = value & 0x3ffu;
+    CALuint bits;
+    if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0)
+    {
+        bits = sign;
+    }
+    else
+    {
+        // Normalize the subnormal
+        int e = -1;
+        do
+        {
+            mantissa <<= 1;
+            ++e;
+        } while (!(mantissa & 0x400u));
+        bits = sign | (static_cast<CALuint>(127 - 15 - e) << 23) | ((mantissa & 0x3ffu) << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, 4);
+    return result;
+}
+
+// Fields of the packed formats, most significant first
+struct Packing
+{
+    CALuint fields;
+    CALuint shift[4];
+    CALuint max[4];
+};
+
+const Packing Packing565     = { 3, { 11, 5, 0, 0 },      { 31, 63, 31, 0 } };
+const Packing Packing555     = { 4, { 15, 10, 5, 0 },     { 1, 31, 31, 31 } };
+const Packing Packing1010102 = { 4, { 30, 20, 10, 0 },    { 3, 1023, 1023, 1023 } };
+
+const Packing&
+packingOf(Kind kind)
+{
+    return (kind == KindPacked565) ? Packing565 : (kind == KindPacked555) ? Packing555 : Packing1010102;
+}
+
+inline CALuint
+packPixel(const float* src, const Packing& p)
+{
+    CALuint word = 0;
+    for (CALuint f = 0; f < p.fields; ++f)
+    {
+        Range r = { static_cast<float>(p.max[f]), 0.0f, static_cast<float>(p.max[f]) };
+        word |= static_cast<CALuint>(narrow(src[f], r)) << p.shift[f];
+    }
+    return word;
+}
+
+/*---- Scalar ----*/
+
+void
+fromFloatScalar(CALubyte* dst, const float* src, size_t count, const Layout& l)
+{
+    switch (l.kind)
+    {
+    case KindFloat32:
+        std::memcpy(dst, src, count * 4);
+        return;
+    case KindFloat64:
+        for (size_t i = 0; i < count; ++i)
+        {
+            double v = src[i];
+            std::memcpy(dst + i * 8, &v, 8);
+        }
+        return;
+    case KindFloat16:
+        for (size_t i = 0; i < count; ++i)
+        {
+            CALushort h = floatToHalf(src[i]);
+            std::memcpy(dst + i * 2, &h, 2);
+        }
+        return;
+    case KindPacked565:
+    case KindPacked555:
+    case KindPacked1010102:
+    {
+        const Packing& p = packingOf(l.kind);
+        for (size_t i = 0; i + p.fields <= count; i += p.fields)
+        {
+            CALuint word = packPixel(src + i, p);
+            if (l.kind == KindPacked1010102)
+            {
+                std::memcpy(dst + i, &word, 4);
+            }
+            else
+            {
+                CALushort w16 = static_cast<CALushort>(word);
+                std::memcpy(dst + i / p.fields * 2, &w16, 2);
+            }
+        }
+        return;
+    }
+    default:
+        break;
+    }
+
+    if (l.bits == 32)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            CALuint v = static_cast<CALuint>(narrow32(src[i], l));
+            std::memcpy(dst + i * 4, &v, 4);
+        }
+        return;
+    }
+    Range r = rangeOf(l);
+    if (l.bits == 8)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            dst[i] = static_cast<CALubyte>(narrow(src[i], r));
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        CALushort v = static_cast<CALushort>(narrow(src[i], r));
+        std::memcpy(dst + i * 2, &v, 2);
+    }
+}
+
+void
+toFloatScalar(float* dst, const CALubyte* src, size_t count, const Layout& l)
+{
+    switch (l.kind)
+    {
+    case KindFloat32:
+        std::memcpy(dst, src, count * 4);
+        return;
+    case KindFloat64:
+        for (size_t i = 0; i < count; ++i)
+        {
+            double v;
+            std::memcpy(&v, src + i * 8, 8);
+            dst[i] = static_cast<float>(v);
+        }
+        return;
+    case KindFloat16:
+        for (size_t i = 0; i < count; ++i)
+        {
+            CALushort h;
+            std::memcpy(&h, src + i * 2, 2);
+            dst[i] = halfToFloat(h);
+        }
+        return;
+    case KindPacked565:
+    case KindPacked555:
+    case KindPacked1010102:
+    {
+        const Packing& p = packingOf(l.kind);
+        for (size_t i = 0; i + p.fields <= count; i += p.fields)
+        {
+            CALuint word;
+            if (l.kind == KindPacked1010102)
+            {
+                std::memcpy(&word, src + i, 4);
+            }
+            else
+            {
+                CALushort w16;
+                std::memcpy(&w16, src + i / p.fields * 2, 2);
+                word = w16;
+            }
+            for (CALuint f = 0; f < p.fields; ++f)
+            {
+                dst[i + f] = static_cast<float>((word >> p.shift[f]) & p.max[f]) / static_cast<float>(p.max[f]);
+            }
+        }
+        return;
+    }
+    default:
+        break;
+    }
+
+    if (l.bits == 32)
+    {
+        double top = l.isSigned ? 2147483647.0 : 4294967295.0;
+        double inv = (l.kind == KindNorm) ? 1.0 / top : 1.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            CALuint u;
+            std::memcpy(&u, src + i * 4, 4);
+            double v = (l.isSigned ? static_cast<double>(static_cast<CALint>(u)) : u) * inv;
+            // The most negative snorm value also means -1
+            dst[i] = static_cast<float>((l.kind == KindNorm && v < -1.0) ? -1.0 : v);
+        }
+        return;
+    }
+
+    // Single precision, as the SIMD kernels compute it
+    float top = static_cast<float>((1u << (l.bits - (l.isSigned ? 1 : 0))) - 1);
+    float inv = (l.kind == KindNorm) ? 1.0f / top : 1.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        CALint raw;
+        if (l.bits == 8)
+        {
+            raw = l.isSigned ? static_cast<signed char>(src[i]) : src[i];
+        }
+        else
+        {
+            CALushort u;
+            std::memcpy(&u, src + i * 2, 2);
+            raw = l.isSigned ? static_cast<CALshort>(u) : u;
+        }
+        float v = static_cast<float>(raw) * inv;
+        dst[i] = (l.kind == KindNorm && v < -1.0f) ? -1.0f : v;
+    }
+}
+
+#ifdef CAL_CONVERT_X86
+
+/*---- AVX2 with F16C ----*/
+
+// Narrow 32 floats to 8 or 16 bit integers after clamping
+CAL_CONVERT_TARGET("avx2")
+inline __m256i
+clampToInt(__m256 x, __m256 scale, __m256 lo, __m256 hi)
+{
+    // max(x, lo) returns lo for NaN, like narrow()
+    return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(x, scale), lo), hi));
+}
+
+CAL_CONVERT_TARGET("avx2,f16c")
+size_t
+fromFloatAvx2(CALubyte* dst, const float* src, size_t count, const Layout& l)
+{
+    size_t i = 0;
+    if (l.kind == KindFloat16)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), h);
+        }
+        return i;
+    }
+    if (l.kind == KindFloat64)
+    {
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm256_storeu_pd(reinterpret_cast<double*>(dst + i * 8), _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+        }
+        return i;
+    }
+    if (l.kind == KindPacked555 || l.kind == KindPacked1010102)
+    {
+        // Eight 4 component pixels per step: shift every field into place,
+        // OR the four fields of each pixel together inside its 128 bit lane,
+        // then gather one word per pixel
+        const Packing& p = packingOf(l.kind);
+        __m256  scale = _mm256_setr_ps(float(p.max[0]), float(p.max[1]), float(p.max[2]), float(p.max[3]),
+                                       float(p.max[0]), float(p.max[1]), float(p.max[2]), float(p.max[3]));
+        __m256  zero  = _mm256_setzero_ps();
+        __m256i shift = _mm256_setr_epi32(p.shift[0], p.shift[1], p.shift[2], p.shift[3],
+                                          p.shift[0], p.shift[1], p.shift[2], p.shift[3]);
+        __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i t[4];
+            for (int k = 0; k < 4; ++k)
+            {
+                __m256i v = _mm256_sllv_epi32(clampToInt(_mm256_loadu_ps(src + i + 8 * k), scale, zero, scale), shift);
+                v = _mm256_or_si256(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+                t[k] = _mm256_or_si256(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+            }
+            __m256i words = _mm256_blend_epi32(t[0], t[1], 0x22);
+            words = _mm256_blend_epi32(words, t[2], 0x44);
+            words = _mm256_blend_epi32(words, t[3], 0x88);
+            words = _mm256_permutevar8x32_epi32(words, order);
+            if (l.kind == KindPacked1010102)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), words);
+            }
+            else
+            {
+                __m128i w16 = _mm_packus_epi32(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i / 2), w16);
+            }
+        }
+        return i;
+    }
+    if ((l.kind != KindNorm && l.kind != KindInt) || l.bits == 32)
+    {
+        return 0;
+    }
+
+    Range  r     = rangeOf(l);
+    __m256 scale = _mm256_set1_ps(r.scale);
+    __m256 lo    = _mm256_set1_ps(r.lo);
+    __m256 hi    = _mm256_set1_ps(r.hi);
+    if (l.bits == 16)
+    {
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i a = clampToInt(_mm256_loadu_ps(src + i), scale, lo, hi);
+            __m256i b = clampToInt(_mm256_loadu_ps(src + i + 8), scale, lo, hi);
+            __m256i packed = l.isSigned ? _mm256_packs_epi32(a, b) : _mm256_packus_epi32(a, b);
+            packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), packed);
+        }
+        return i;
+    }
+
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i a = clampToInt(_mm256_loadu_ps(src + i), scale, lo, hi);
+        __m256i b = clampToInt(_mm256_loadu_ps(src + i + 8), scale, lo, hi);
+        __m256i c = clampToInt(_mm256_loadu_ps(src + i + 16), scale, lo, hi);
+        __m256i d = clampToInt(_mm256_loadu_ps(src + i + 24), scale, lo, hi);
+        __m256i ab = _mm256_packs_epi32(a, b);      // values already fit 8 bits
+        __m256i cd = _mm256_packs_epi32(c, d);
+        __m256i bytes = l.isSigned ? _mm256_packs_epi16(ab, cd) : _mm256_packus_epi16(ab, cd);
+        bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), bytes);
+    }
+    return i;
+}
+
+CAL_CONVERT_TARGET("avx2,f16c")
+size_t
+toFloatAvx2(float* dst, const CALubyte* src, size_t count, const Layout& l)
+{
+    size_t i = 0;
+    if (l.kind == KindFloat16)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2))));
+        }
+        return i;
+    }
+    if ((l.kind != KindNorm && l.kind != KindInt) || l.bits == 32)
+    {
+        return 0;
+    }
+
+    float  top = static_cast<float>((1u << (l.bits - (l.isSigned ? 1 : 0))) - 1);
+    __m256 inv = _mm256_set1_ps((l.kind == KindNorm) ? 1.0f / top : 1.0f);
+    __m256 lo  = _mm256_set1_ps((l.kind == KindNorm) ? -1.0f : -3.0e38f);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v;
+        if (l.bits == 8)
+        {
+            __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+            v = l.isSigned ? _mm256_cvtepi8_epi32(b) : _mm256_cvtepu8_epi32(b);
+        }
+        else
+        {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+            v = l.isSigned ? _mm256_cvtepi16_epi32(s) : _mm256_cvtepu16_epi32(s);
+        }
+        _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v), inv), lo));
+    }
+    return i;
+}
+
+/*---- AVX-512 ----*/
+
+// GCC's unmasked narrowing conversions (_mm512_cvtps_ph, _mm512_cvtepi32_epi8
+// and _epi16) pass _mm*_undefined_si*() as the pass-through source, which
+// -Wmaybe-uninitialized reports once inlined, masked forms included. Every
+// lane is written, so the warning is off for this function only.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+CAL_CONVERT_TARGET("avx512f")
+size_t
+fromFloatAvx512(CALubyte* dst, const float* src, size_t count, const Layout& l)
+{
+    size_t i = 0;
+    if (l.kind == KindFloat16)
+    {
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), h);
+        }
+        return i;
+    }
+    if (l.kind == KindFloat64)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm512_storeu_pd(dst + i * 8, _mm512_cvtps_pd(_mm256_loadu_ps(src + i)));
+        }
+        return i;
+    }
+    if ((l.kind != KindNorm && l.kind != KindInt) || l.bits == 32)
+    {
+        return 0;
+    }
+
+    Range  r     = rangeOf(l);
+    __m512 scale = _mm512_set1_ps(r.scale);
+    __m512 lo    = _mm512_set1_ps(r.lo);
+    __m512 hi    = _mm512_set1_ps(r.hi);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512  x = _mm512_mul_ps(_mm512_loadu_ps(src + i), scale);
+        __m512i v = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(x, lo), hi));
+        if (l.bits == 8)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm512_cvtepi32_epi8(v));
+        }
+        else
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), _mm512_cvtepi32_epi16(v));
+        }
+    }
+    return i;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+bool
+detectF16c()
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    return (regs[2] & (1 << 29)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("f16c");
+#endif
+}
+
+bool
+hasF16c()
+{
+    static const bool f16c = detectF16c();
+    return f16c;
+}
+
+#endif // CAL_CONVERT_X86
+
+size_t
+elementBytes(const Layout& l)
+{
+    switch (l.kind)
+    {
+    case KindFloat32:   return 4;
+    case KindFloat64:   return 8;
+    case KindFloat16:   return 2;
+    default:            return l.bits / 8;
+    }
+}
+
+// Position in the destination of component i; packed formats advance per pixel
+size_t
+dstOffset(const Layout& l, size_t i)
+{
+    switch (l.kind)
+    {
+    case KindPacked565:     return i / 3 * 2;
+    case KindPacked555:     return i / 4 * 2;
+    case KindPacked1010102: return i;
+    default:                return i * elementBytes(l);
+    }
+}
+
+void
+fromFloat(CALubyte* dst, const float* src, size_t count, const Layout& l)
+{
+    size_t done = 0;
+#ifdef CAL_CONVERT_X86
+    CopyIsa isa = copyIsa();
+    if (isa >= CopyIsaAvx512)
+    {
+        done = fromFloatAvx512(dst, src, count, l);
+    }
+    if (isa >= CopyIsaAvx2 && hasF16c())
+    {
+        done += fromFloatAvx2(dst + dstOffset(l, done), src + done, count - done, l);
+    }
+#endif
+    fromFloatScalar(dst + dstOffset(l, done), src + done, count - done, l);
+}
+
+void
+toFloat(float* dst, const CALubyte* src, size_t count, const Layout& l)
+{
+    size_t done = 0;
+#ifdef CAL_CONVERT_X86
+    if (copyIsa() >= CopyIsaAvx2 && hasF16c())
+    {
+        done = toFloatAvx2(dst, src, count, l);
+    }
+#endif
+    toFloatScalar(dst + done, src + dstOffset(l, done), count - done, l);
+}
+
+// Run fn over row ranges, split over the shared pool for CopyParallel
+template <typename Fn>
+void
+forRows(CALuint rows, size_t rowBytes, CALuint flags, const Fn& fn)
+{
+    const size_t MinPiece = 256 * 1024;
+    size_t total = rowBytes * rows;
+    CALuint pieces = 1;
+    if ((flags & CopyParallel) && rows > 1 && total >= 2 * MinPiece)
+    {
+        size_t byBytes  = total / MinPiece;
+        size_t byThread = (static_cast<size_t>(ThreadPool::shared().threadCount()) + 1) * 4;
+        pieces = static_cast<CALuint>(byBytes < byThread ? byBytes : byThread);
+        pieces = (pieces > rows) ? rows : pieces;
+    }
+    if (pieces <= 1)
+    {
+        fn(0u, rows);
+        return;
+    }
+    ThreadPool::shared().parallelFor(pieces, [&](CALuint i) {
+        fn(static_cast<CALuint>(static_cast<CALuint64>(rows) * i / pieces),
+           static_cast<CALuint>(static_cast<CALuint64>(rows) * (i + 1) / pieces));
+    });
+}
+
+} // anonymous namespace
+
+void
+convertFromFloat(CALvoid* dst, const float* src, size_t count, CALformat format)
+{
+    fromFloat(static_cast<CALubyte*>(dst), src, count, layoutOf(format));
+}
+
+void
+convertToFloat(float* dst, const CALvoid* src, size_t count, CALformat format)
+{
+    toFloat(dst, static_cast<const CALubyte*>(src), count, layoutOf(format));
+}
+
+CALresult
+convertToSurface(CALvoid* surface, CALuint pitch, const float* host, CALuint width, CALuint height,
+                 CALformat format, CALuint flags)
+{
+    if (!surface || !host || pitch < width)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    Layout    l          = layoutOf(format);
+    size_t    rowCount   = static_cast<size_t>(width) * formatComponents(format);
+    size_t    pitchBytes = static_cast<size_t>(pitch) * formatElementSize(format);
+    CALubyte* base       = static_cast<CALubyte*>(surface);
+    forRows(height ? height : 1, pitchBytes, flags, [&](CALuint begin, CALuint end) {
+        for (CALuint row = begin; row < end; ++row)
+        {
+            fromFloat(base + row * pitchBytes, host + row * rowCount, rowCount, l);
+        }
+    });
+    return CAL_RESULT_OK;
+}
+
+CALresult
+convertFromSurface(float* host, const CALvoid* surface, CALuint pitch, CALuint width, CALuint height,
+                   CALformat format, CALuint flags)
+{
+    if (!surface || !host || pitch < width)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    Layout          l          = layoutOf(format);
+    size_t          rowCount   = static_cast<size_t>(width) * formatComponents(format);
+    size_t          pitchBytes = static_cast<size_t>(pitch) * formatElementSize(format);
+    const CALubyte* base       = static_cast<const CALubyte*>(surface);
+    forRows(height ? height : 1, pitchBytes, flags, [&](CALuint begin, CALuint end) {
+        for (CALuint row = begin; row < end; ++row)
+        {
+            toFloat(host + row * rowCount, base + row * pitchBytes, rowCount, l);
+        }
+    });
+    return CAL_RESULT_OK;
+}
+
+} // namespace cal
@@ -0,0 +1,577 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_graph.h"
+#include "cal_event_waiter.h"
+#include "cal_ext_table.h"
+
+#include <algorithm>
+
+namespace cal {
+
+/*----------------------------------------------------------------------------
+ * Graph
+ *----------------------------------------------------------------------------*/
+
+Graph::NodeId
+Graph::kernel(CALimage image, const std::string& entry, const CALdomain3D& gridBlock, const CALdomain3D& gridSize,
+              const std::vector<GraphBinding>& bindings, CALuint flags)
+{
+    Node node = Node();
+    node.type      = Kernel;
+    node.image     = image;
+    node.entry     = entry;
+    node.gridBlock = gridBlock;
+    node.gridSize  = gridSize;
+    node.bindings  = bindings;
+    node.flags     = flags;
+    NodeId id = add(node);
+    for (size_t i = 0; i < bindings.size(); ++i)
+    {
+        use(id, bindings[i].res, bindings[i].access);
+    }
+    return id;
+}
+
+Graph::NodeId
+Graph::copy(CALresource src, CALresource dst, CALuint flags)
+{
+    Node node = Node();
+    node.type  = Copy;
+    node.src   = src;
+    node.dst   = dst;
+    node.flags = flags;
+    NodeId id = add(node);
+    use(id, src, GraphRead);
+    use(id, dst, GraphWrite);
+    return id;
+}
+
+Graph::NodeId
+Graph::copyRaw(CALresource src, CALuint srcOffset, CALresource dst, CALuint dstOffset, CALuint size, CALuint flags)
+{
+    Node node = Node();
+    node.type      = CopyRaw;
+    node.src       = src;
+    node.dst       = dst;
+    node.srcOffset = srcOffset;
+    node.dstOffset = dstOffset;
+    node.bytes     = size;
+    node.flags     = flags;
+    NodeId id = add(node);
+    use(id, src, GraphRead);
+    use(id, dst, GraphWrite);
+    return id;
+}
+
+Graph::NodeId
+Graph::map(CALresource res, GraphAccess access, const std::function<void(CALvoid* ptr, CALuint pitch)>& fn)
+{
+    Node node = Node();
+    node.type = Map;
+    node.src  = res;
+    node.fn   = fn;
+    NodeId id = add(node);
+    use(id, res, access);
+    return id;
+}
+
+void
+Graph::depend(NodeId node, NodeId before)
+{
+    if (node < m_nodes.size() && before < node)
+    {
+        std::vector<NodeId>& deps = m_nodes[node].deps;
+        if (std::find(deps.begin(), deps.end(), before) == deps.end())
+        {
+            deps.push_back(before);
+        }
+    }
+}
+
+void
+Graph::clear()
+{
+    m_nodes.clear();
+    m_resources.clear();
+}
+
+Graph::NodeId
+Graph::add(const Node& node)
+{
+    m_nodes.push_back(node);
+    return static_cast<NodeId>(m_nodes.size() - 1);
+}
+
+void
+Graph::use(NodeId id, CALresource res, GraphAccess access)
+{
+    ResourceState& state = m_resources[res];
+    if (state.lastWriter != 0)
+    {
+        depend(id, state.lastWriter - 1);
+    }
+    if (access & GraphWrite)
+    {
+        for (size_t i = 0; i < state.readers.size(); ++i)
+        {
+            depend(id, state.readers[i]);
+        }
+        state.readers.clear();
+        state.lastWriter = id + 1;
+    }
+    else
+    {
+        state.readers.push_back(id);
+    }
+}
+
+/*----------------------------------------------------------------------------
+ * GraphExecutor
+ *----------------------------------------------------------------------------*/
+
+namespace {
+
+enum NodeStatus
+{
+    Waiting,
+    Submitted,
+    Done,
+    Failed
+};
+
+struct NodeState
+{
+    NodeStatus              status;
+    CALint                  context;        // index, -1 for maps and nodes not placed yet
+    CALevent                event;
+    CALuint                 unsubmitted;    // predecessors not submitted, completed or failed
+    std::vector<Graph::NodeId> successors;
+};
+
+} // anonymous namespace
+
+GraphExecutor::GraphExecutor()
+    : m_dev(0),
+      m_waves(0),
+      m_flushes(0),
+      m_crossWaits(0)
+{
+}
+
+GraphExecutor::~GraphExecutor()
+{
+    close();
+}
+
+CALresult
+GraphExecutor::open(CALdevice dev, CALuint contextCount)
+{
+    close();
+    if (contextCount == 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    m_dev = dev;
+    m_contexts.resize(contextCount);
+    for (CALuint i = 0; i < contextCount; ++i)
+    {
+        m_contexts[i].load = 0;
+        CALresult result = calCtxCreate(&m_contexts[i].ctx, dev);
+        if (result != CAL_RESULT_OK)
+        {
+            m_contexts.resize(i);
+            close();
+            return result;
+        }
+    }
+    return CAL_RESULT_OK;
+}
+
+void
+GraphExecutor::close()
+{
+    for (size_t i = 0; i < m_contexts.size(); ++i)
+    {
+        Context& context = m_contexts[i];
+        for (std::unordered_map<CALresource, CALmem>::iterator it = context.mems.begin(); it != context.mems.end(); ++it)
+        {
+            calCtxReleaseMem(context.ctx, it->second);
+        }
+        for (std::map<CALimage, CALmodule>::iterator it = context.modules.begin(); it != context.modules.end(); ++it)
+        {
+            calModuleUnload(context.ctx, it->second);
+        }
+        calCtxDestroy(context.ctx);
+    }
+    m_contexts.clear();
+}
+
+CALresult
+GraphExecutor::run(const Graph& graph)
+{
+    if (m_contexts.empty())
+    {
+        return CAL_RESULT_ERROR;
+    }
+
+    const CALuint count = graph.size();
+    std::vector<NodeState> nodes(count);
+    std::vector<Graph::NodeId> candidates;
+    for (CALuint i = 0; i < count; ++i)
+    {
+        nodes[i].status      = Waiting;
+        nodes[i].context     = -1;
+        nodes[i].event       = 0;
+        nodes[i].unsubmitted = static_cast<CALuint>(graph.m_nodes[i].deps.size());
+        for (size_t d = 0; d < graph.m_nodes[i].deps.size(); ++d)
+        {
+            nodes[graph.m_nodes[i].deps[d]].successors.push_back(i);
+        }
+        if (nodes[i].unsubmitted == 0)
+        {
+            candidates.push_back(i);
+        }
+    }
+    for (size_t c = 0; c < m_contexts.size(); ++c)
+    {
+        m_contexts[c].load = 0;
+    }
+
+    std::vector<EventWaiter> waiters(m_contexts.size());
+    for (size_t c = 0; c < m_contexts.size(); ++c)
+    {
+        waiters[c].setContext(m_contexts[c].ctx);
+    }
+
+    CALresult firstError = CAL_RESULT_OK;
+
+    // Completed, polling submitted nodes; a failed event fails the node
+    auto isDone = [&](Graph::NodeId id) -> bool
+    {
+        NodeState& node = nodes[id];
+        if (node.status == Submitted)
+        {
+            CALresult result = calCtxIsEventDone(m_contexts[node.context].ctx, node.event);
+            if (result == CAL_RESULT_OK)
+            {
+                node.status = Done;
+            }
+            else if (result != CAL_RESULT_PENDING)
+            {
+                node.status = Failed;
+                firstError = (firstError == CAL_RESULT_OK) ? result : firstError;
+            }
+        }
+        return node.status == Done;
+    };
+
+    CALuint settled = 0;    // submitted, completed or failed
+    while (settled < count)
+    {
+        std::vector<Graph::NodeId> worklist;
+        worklist.swap(candidates);
+        std::vector<bool> touched(m_contexts.size(), false);
+        bool progress = false;
+
+        for (size_t w = 0; w < worklist.size(); ++w)
+        {
+            Graph::NodeId id = worklist[w];
+            NodeState& node = nodes[id];
+            const Graph::Node& desc = graph.m_nodes[id];
+
+            bool predFailed = false;
+            for (size_t d = 0; d < desc.deps.size(); ++d)
+            {
+                isDone(desc.deps[d]);
+                predFailed = predFailed || (nodes[desc.deps[d]].status == Failed);
+            }
+
+            if (!predFailed && desc.type == Graph::Map)
+            {
+                bool ready = true;
+                for (size_t d = 0; d < desc.deps.size() && ready; ++d)
+                {
+                    ready = isDone(desc.deps[d]);
+                }
+                if (!ready)
+                {
+                    candidates.push_back(id);
+                    continue;
+                }
+                CALresult result = runMap(desc);
+                node.status = (result == CAL_RESULT_OK) ? Done : Failed;
+                firstError = (firstError == CAL_RESULT_OK) ? result : firstError;
+            }
+            else if (!predFailed)
+            {
+                // Stay on the context of a predecessor still in flight
+                CALint placed = -1;
+                for (size_t d = 0; d < desc.deps.size() && placed < 0; ++d)
+                {
+                    const NodeState& pred = nodes[desc.deps[d]];
+                    if (pred.context >= 0 && !isDone(desc.deps[d]))
+                    {
+                        placed = pred.context;
+                    }
+                }
+                if (placed < 0)
+                {
+                    placed = 0;
+                    for (size_t c = 1; c < m_contexts.size(); ++c)
+                    {
+                        if (m_contexts[c].load < m_contexts[placed].load)
+                        {
+                            placed = static_cast<CALint>(c);
+                        }
+                    }
+                }
+
+                bool ready = true;
+                CALuint crossed = 0;
+                for (size_t d = 0; d < desc.deps.size() && ready; ++d)
+                {
+                    const NodeState& pred = nodes[desc.deps[d]];
+                    if (pred.context >= 0 && pred.context != placed)
+                    {
+                        ready = isDone(desc.deps[d]);
+                        ++crossed;
+                    }
+                }
+                if (!ready)
+                {
+                    candidates.push_back(id);
+                    continue;
+                }
+                m_crossWaits += crossed;
+
+                Context& context = m_contexts[placed];
+                CALresult result = submit(context, desc, &node.event);
+                node.context = placed;
+                node.status  = (result == CAL_RESULT_OK) ? Submitted : Failed;
+                firstError   = (firstError == CAL_RESULT_OK) ? result : firstError;
+                if (result == CAL_RESULT_OK)
+                {
+                    touched[placed] = true;
+                    ++context.load;
+                    waiters[placed].submitted(node.event, 0);
+                }
+            }
+            else
+            {
+                node.status = Failed;
+            }
+
+            ++settled;
+            progress = true;
+            for (size_t s = 0; s < node.successors.size(); ++s)
+            {
+                if (--nodes[node.successors[s]].unsubmitted == 0)
+                {
+                    worklist.push_back(node.successors[s]);
+                }
+            }
+        }
+
+        bool flushed = false;
+        for (size_t c = 0; c < m_contexts.size(); ++c)
+        {
+            if (touched[c])
+            {
+                calCtxFlush(m_contexts[c].ctx);
+                ++m_flushes;
+                flushed = true;
+            }
+        }
+        m_waves += flushed ? 1 : 0;
+
+        if (!progress && !candidates.empty())
+        {
+            // Every candidate waits on another context; block on the oldest such dependency
+            Graph::NodeId blocker = count;
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                const Graph::Node& desc = graph.m_nodes[candidates[i]];
+                for (size_t d = 0; d < desc.deps.size(); ++d)
+                {
+                    if (nodes[desc.deps[d]].status == Submitted && !isDone(desc.deps[d]))
+                    {
+                        blocker = std::min(blocker, desc.deps[d]);
+                    }
+                }
+            }
+            if (blocker < count)
+            {
+                NodeState& pred = nodes[blocker];
+                CALresult result = waiters[pred.context].wait(pred.event);
+                pred.status = (result == CAL_RESULT_OK) ? Done : Failed;
+                firstError  = (firstError == CAL_RESULT_OK) ? result : firstError;
+            }
+        }
+    }
+
+    for (CALuint i = 0; i < count; ++i)
+    {
+        if (nodes[i].status == Submitted)
+        {
+            CALresult result = waiters[nodes[i].context].wait(nodes[i].event);
+            firstError = (firstError == CAL_RESULT_OK) ? result : firstError;
+        }
+    }
+    return firstError;
+}
+
+CALresult
+GraphExecutor::mem(Context& context, CALresource res, CALmem* mem)
+{
+    std::unordered_map<CALresource, CALmem>::iterator it = context.mems.find(res);
+    if (it != context.mems.end())
+    {
+        *mem = it->second;
+        return CAL_RESULT_OK;
+    }
+    CALresult result = calCtxGetMem(mem, context.ctx, res);
+    if (result == CAL_RESULT_OK)
+    {
+        context.mems[res] = *mem;
+    }
+    return result;
+}
+
+CALresult
+GraphExecutor::func(Context& context, CALimage image, const std::string& entry, CALmodule* module, CALfunc* func)
+{
+    std::map<CALimage, CALmodule>::iterator loaded = context.modules.find(image);
+    if (loaded == context.modules.end())
+    {
+        CALresult result = calModuleLoad(module, context.ctx, image);
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        loaded = context.modules.insert(std::make_pair(image, *module)).first;
+    }
+    *module = loaded->second;
+
+    std::pair<CALimage, std::string> key(image, entry);
+    std::map<std::pair<CALimage, std::string>, CALfunc>::iterator it = context.funcs.find(key);
+    if (it != context.funcs.end())
+    {
+        *func = it->second;
+        return CAL_RESULT_OK;
+    }
+    CALresult result = calModuleGetEntry(func, context.ctx, *module, entry.c_str());
+    if (result == CAL_RESULT_OK)
+    {
+        context.funcs[key] = *func;
+    }
+    return result;
+}
+
+CALresult
+GraphExecutor::submit(Context& context, const Graph::Node& node, CALevent* event)
+{
+    CALresult result;
+    switch (node.type)
+    {
+    case Graph::Kernel:
+    {
+        CALprogramGrid grid;
+        CALmodule module;
+        result = func(context, node.image, node.entry, &module, &grid.func);
+        for (size_t i = 0; i < node.bindings.size() && result == CAL_RESULT_OK; ++i)
+        {
+            std::pair<CALmodule, std::string> key(module, node.bindings[i].name);
+            std::map<std::pair<CALmodule, std::string>, CALname>::iterator it = context.names.find(key);
+            if (it == context.names.end())
+            {
+                CALname name;
+                result = calModuleGetName(&name, context.ctx, module, key.second.c_str());
+                if (result != CAL_RESULT_OK)
+                {
+                    break;
+                }
+                it = context.names.insert(std::make_pair(key, name)).first;
+            }
+            CALmem bound;
+            result = mem(context, node.bindings[i].res, &bound);
+            if (result == CAL_RESULT_OK)
+            {
+                result = calCtxSetMem(context.ctx, it->second, bound);
+            }
+        }
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        grid.gridBlock = node.gridBlock;
+        grid.gridSize  = node.gridSize;
+        grid.flags     = node.flags;
+        return calCtxRunProgramGrid(event, context.ctx, &grid);
+    }
+    case Graph::Copy:
+    case Graph::CopyRaw:
+    {
+        CALmem src, dst;
+        result = mem(context, node.src, &src);
+        if (result == CAL_RESULT_OK)
+        {
+            result = mem(context, node.dst, &dst);
+        }
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        if (node.type == Graph::Copy)
+        {
+            return calMemCopy(event, context.ctx, src, dst, node.flags);
+        }
+        PFNCALMEMCOPYRAW memCopyRaw = calExtTableGet()->memCopyRaw;
+        if (!memCopyRaw)
+        {
+            return CAL_RESULT_NOT_SUPPORTED;
+        }
+        return memCopyRaw(event, context.ctx, src, node.srcOffset, dst, node.dstOffset, node.bytes, node.flags);
+    }
+    default:
+        return CAL_RESULT_ERROR;
+    }
+}
+
+CALresult
+GraphExecutor::runMap(const Graph::Node& node)
+{
+    CALvoid* ptr;
+    CALuint pitch;
+    CALresult result = calResMap(&ptr, &pitch, node.src, 0);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    node.fn(ptr, pitch);
+    return calResUnmap(node.src);
+}
+
+} // namespace cal
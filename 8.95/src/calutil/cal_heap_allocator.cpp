@@ -0,0 +1,354 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_heap_allocator.h"
+#include "cal_ext_table.h"
+#include "cal_format.h"
+
+#include <cstring>
+
+namespace cal {
+
+namespace {
+
+// Smallest shift with (1 << shift) >= value
+CALuint
+ceilLog2(CALuint64 value)
+{
+    CALuint shift = 0;
+    while ((static_cast<CALuint64>(1) << shift) < value)
+    {
+        ++shift;
+    }
+    return shift;
+}
+
+} // anonymous namespace
+
+/*---- HeapBuffer ----*/
+
+HeapBuffer::HeapBuffer(HeapBuffer&& other)
+    : m_heap(other.m_heap),
+      m_res(other.m_res),
+      m_offset(other.m_offset),
+      m_bytes(other.m_bytes),
+      m_width(other.m_width),
+      m_format(other.m_format)
+{
+    other.m_heap = 0;
+    other.m_res  = 0;
+}
+
+HeapBuffer&
+HeapBuffer::operator=(HeapBuffer&& other)
+{
+    if (this != &other)
+    {
+        reset();
+        m_heap       = other.m_heap;
+        m_res        = other.m_res;
+        m_offset     = other.m_offset;
+        m_bytes      = other.m_bytes;
+        m_width      = other.m_width;
+        m_format     = other.m_format;
+        other.m_heap = 0;
+        other.m_res  = 0;
+    }
+    return *this;
+}
+
+void
+HeapBuffer::reset()
+{
+    if (m_heap && m_res)
+    {
+        calResFree(m_res);
+        m_heap->release(m_offset, static_cast<CALuint64>(m_width) * formatElementSize(m_format));
+    }
+    m_heap = 0;
+    m_res  = 0;
+}
+
+/*---- HeapAllocator ----*/
+
+HeapAllocator::HeapAllocator()
+    : m_dev(0),
+      m_heap(0),
+      m_heapElementSize(4),
+      m_pitchAlignment(1),
+      m_minShift(8),
+      m_heapBytes(0),
+      m_usedBytes(0),
+      m_requestedBytes(0),
+      m_peakBytes(0),
+      m_allocs(0),
+      m_failures(0)
+{
+}
+
+HeapAllocator::~HeapAllocator()
+{
+    close();
+}
+
+CALresult
+HeapAllocator::open(CALdevice dev, CALuint ordinal, CALuint64 bytes)
+{
+    const CALextTable* ext = calExtTableGet();
+    if (!ext->resGetHeap || !ext->resAllocView || !ext->resQueryInfo)
+    {
+        return CAL_RESULT_NOT_SUPPORTED;
+    }
+
+    CALdeviceattribs attribs;
+    std::memset(&attribs, 0, sizeof(attribs));
+    attribs.struct_size = sizeof(attribs);
+    CALresult result = calDeviceGetAttribs(&attribs, ordinal);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    CALresource heap = 0;
+    CALdeviceDesc desc;
+    desc.dev      = &dev;
+    desc.devCount = 1;
+    result = ext->resGetHeap(&heap, &desc, CAL_HEAP_GLOBAL, 0);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    CALresInfo info;
+    std::memset(&info, 0, sizeof(info));
+    result = ext->resQueryInfo(heap, &info);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    CALuint   elementSize = formatElementSize(info.format);
+    CALuint64 heapBytes   = static_cast<CALuint64>(info.pitch ? info.pitch : info.width) *
+                            (info.height ? info.height : 1) * elementSize;
+    if (bytes == 0 || bytes > heapBytes)
+    {
+        bytes = heapBytes;
+    }
+
+    // Blocks must start on a surface and on a heap element boundary
+    CALuint minShift = ceilLog2(attribs.surface_alignment > 16 ? attribs.surface_alignment : 16);
+    CALuint64 minBlock = static_cast<CALuint64>(1) << minShift;
+    if (bytes < minBlock)
+    {
+        return CAL_RESULT_ERROR;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_dev             = dev;
+    m_heap            = heap;
+    m_heapElementSize = elementSize;
+    m_pitchAlignment  = attribs.pitch_alignment ? attribs.pitch_alignment : 1;
+    m_minShift        = minShift;
+
+    // Seed the free lists with the largest power of two chunks that fit;
+    // each chunk starts at a multiple of its size, so buddies stay inside
+    CALuint orders = ceilLog2(bytes + 1) - minShift;
+    m_free.assign(orders, std::set<CALuint64>());
+    m_live.clear();
+    CALuint64 start = 0;
+    for (CALuint order = orders; order-- > 0;)
+    {
+        CALuint64 size = minBlock << order;
+        if (bytes - start >= size)
+        {
+            m_free[order].insert(start);
+            start += size;
+        }
+    }
+
+    m_heapBytes      = start;
+    m_usedBytes      = 0;
+    m_requestedBytes = 0;
+    m_peakBytes      = 0;
+    m_allocs         = 0;
+    m_failures       = 0;
+    return CAL_RESULT_OK;
+}
+
+void
+HeapAllocator::close()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_free.clear();
+    m_live.clear();
+    m_heap      = 0;
+    m_heapBytes = 0;
+    m_usedBytes = 0;
+}
+
+CALresult
+HeapAllocator::alloc(HeapBuffer& out, CALformat format, CALuint width, CALuint flags)
+{
+    if (!m_heap || width == 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    CALuint   elementSize = formatElementSize(format);
+    CALuint64 padded      = (static_cast<CALuint64>(width) + m_pitchAlignment - 1) / m_pitchAlignment * m_pitchAlignment;
+    CALuint64 requested   = padded * elementSize;
+    CALuint   shift       = ceilLog2(requested);
+    CALuint   order       = (shift > m_minShift) ? shift - m_minShift : 0;
+
+    CALuint64 offset;
+    if (!reserve(order, offset))
+    {
+        return CAL_RESULT_ERROR;
+    }
+
+    CALdomain3D size;
+    size.width  = static_cast<CALuint>(padded);
+    size.height = 1;
+    size.depth  = 1;
+    CALdomain origin;
+    origin.x      = static_cast<CALuint>(offset / m_heapElementSize);
+    origin.y      = 0;
+    origin.width  = 0;
+    origin.height = 0;
+
+    CALresource view = 0;
+    CALresult result = calExtTableGet()->resAllocView(&view, m_heap, m_dev, size, origin, format,
+                                                      CAL_CHANNEL_ORDER_UNSPECIFIED, CAL_DIM_BUFFER, flags);
+    if (result != CAL_RESULT_OK)
+    {
+        release(offset, 0);
+        return result;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_requestedBytes += requested;
+    }
+
+    HeapBuffer buffer;
+    buffer.m_heap   = this;
+    buffer.m_res    = view;
+    buffer.m_offset = offset;
+    buffer.m_bytes  = static_cast<CALuint64>(1) << (m_minShift + order);
+    buffer.m_width  = static_cast<CALuint>(padded);
+    buffer.m_format = format;
+    out = std::move(buffer);
+    return CAL_RESULT_OK;
+}
+
+//
+// Take the lowest free block of the smallest order that fits and split it
+// down to order, putting the upper halves on the free lists.
+//
+bool
+HeapAllocator::reserve(CALuint order, CALuint64& offset)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    CALuint from = order;
+    while (from < m_free.size() && m_free[from].empty())
+    {
+        ++from;
+    }
+    if (from >= m_free.size())
+    {
+        ++m_failures;
+        return false;
+    }
+
+    offset = *m_free[from].begin();
+    m_free[from].erase(m_free[from].begin());
+    for (CALuint k = from; k > order; --k)
+    {
+        m_free[k - 1].insert(offset + (static_cast<CALuint64>(1) << (m_minShift + k - 1)));
+    }
+
+    m_live[offset] = order;
+    m_usedBytes += static_cast<CALuint64>(1) << (m_minShift + order);
+    m_peakBytes  = (m_usedBytes > m_peakBytes) ? m_usedBytes : m_peakBytes;
+    ++m_allocs;
+    return true;
+}
+
+void
+HeapAllocator::release(CALuint64 offset, CALuint64 requested)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::unordered_map<CALuint64, CALuint>::iterator it = m_live.find(offset);
+    if (it == m_live.end())
+    {
+        // Allocator was closed or reopened meanwhile
+        return;
+    }
+    CALuint order = it->second;
+    m_live.erase(it);
+    m_usedBytes      -= static_cast<CALuint64>(1) << (m_minShift + order);
+    m_requestedBytes -= requested;
+
+    // Merge with free buddies as far as possible
+    while (order + 1 < m_free.size())
+    {
+        CALuint64 buddy = offset ^ (static_cast<CALuint64>(1) << (m_minShift + order));
+        std::set<CALuint64>::iterator b = m_free[order].find(buddy);
+        if (b == m_free[order].end())
+        {
+            break;
+        }
+        m_free[order].erase(b);
+        offset = (buddy < offset) ? buddy : offset;
+        ++order;
+    }
+    m_free[order].insert(offset);
+}
+
+HeapAllocatorStats
+HeapAllocator::stats() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    HeapAllocatorStats s;
+    s.heapBytes      = m_heapBytes;
+    s.usedBytes      = m_usedBytes;
+    s.requestedBytes = m_requestedBytes;
+    s.peakBytes      = m_peakBytes;
+    s.largestFree    = 0;
+    for (size_t order = m_free.size(); order-- > 0;)
+    {
+        if (!m_free[order].empty())
+        {
+            s.largestFree = static_cast<CALuint64>(1) << (m_minShift + order);
+            break;
+        }
+    }
+    s.allocs    = m_allocs;
+    s.failures  = m_failures;
+    s.liveViews = static_cast<CALuint>(m_live.size());
+    return s;
+}
+
+} // namespace cal
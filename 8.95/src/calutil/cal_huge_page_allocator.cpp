@@ -0,0 +1,403 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_huge_page_allocator.h"
+#include "cal_ext_table.h"
+#include "cal_format.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace cal {
+
+namespace {
+
+const size_t Page2M = static_cast<size_t>(1) << 21;
+const size_t Page1G = static_cast<size_t>(1) << 30;
+
+size_t
+roundUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// bytes on explicit huge pages of pageBytes, 0 when the pool has none
+void*
+mapHuge(size_t bytes, size_t pageBytes)
+{
+#if defined(_WIN32)
+    // Windows has a single large page size
+    if (GetLargePageMinimum() != pageBytes)
+    {
+        return 0;
+    }
+    return VirtualAlloc(0, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#elif defined(MAP_HUGETLB)
+    int shift = (pageBytes == Page1G) ? 30 : 21;
+    void* ptr = mmap(0, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+    return (ptr == MAP_FAILED) ? 0 : ptr;
+#else
+    (void)bytes;
+    (void)pageBytes;
+    return 0;
+#endif
+}
+
+// Size of a regular page, which every mapping is a multiple of
+size_t
+smallPageBytes()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    long page = sysconf(_SC_PAGESIZE);
+    return (page > 0) ? static_cast<size_t>(page) : 4096;
+#endif
+}
+
+// bytes of regular pages, a multiple of smallPageBytes(). With transparent
+// set they are 2 MB aligned and, on Linux, advised for transparent huge
+// pages, which sets advised.
+void*
+mapRegular(size_t bytes, bool transparent, bool& advised)
+{
+    advised = false;
+#if defined(_WIN32)
+    (void)transparent;
+    return VirtualAlloc(0, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    if (!transparent)
+    {
+        void* ptr = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (ptr == MAP_FAILED) ? 0 : ptr;
+    }
+
+    // Over-reserve by a huge page and trim both ends to the aligned range
+    size_t span = bytes + Page2M;
+    void* raw = mmap(0, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        return 0;
+    }
+    char* begin   = static_cast<char*>(raw);
+    char* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<size_t>(begin), Page2M));
+    if (aligned > begin)
+    {
+        munmap(begin, aligned - begin);
+    }
+    size_t tail = (begin + span) - (aligned + bytes);
+    if (tail)
+    {
+        munmap(aligned + bytes, tail);
+    }
+#if defined(MADV_HUGEPAGE)
+    advised = (madvise(aligned, bytes, MADV_HUGEPAGE) == 0);
+#endif
+    return aligned;
+#endif
+}
+
+void
+unmap(void* ptr, size_t bytes)
+{
+#if defined(_WIN32)
+    (void)bytes;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, bytes);
+#endif
+}
+
+} // anonymous namespace
+
+bool
+HugePageAllocator::Registration::operator<(const Registration& other) const
+{
+    if (offset != other.offset)
+    {
+        return offset < other.offset;
+    }
+    if (width != other.width)
+    {
+        return width < other.width;
+    }
+    if (height != other.height)
+    {
+        return height < other.height;
+    }
+    return format < other.format;
+}
+
+HugePageAllocator::HugePageAllocator()
+    : m_dev(0),
+      m_alignment(1)
+{
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+HugePageAllocator::~HugePageAllocator()
+{
+    close();
+}
+
+CALresult
+HugePageAllocator::open(CALdevice dev, CALuint ordinal)
+{
+    const CALextTable* ext = calExtTableGet();
+    if (!ext->resCreate1D || !ext->resCreate2D)
+    {
+        return CAL_RESULT_NOT_SUPPORTED;
+    }
+
+    CALdeviceattribs attribs;
+    std::memset(&attribs, 0, sizeof(attribs));
+    attribs.struct_size = sizeof(attribs);
+    CALresult result = calDeviceGetAttribs(&attribs, ordinal);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    close();
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_dev       = dev;
+    m_alignment = attribs.surface_alignment ? attribs.surface_alignment : 1;
+    return CAL_RESULT_OK;
+}
+
+void
+HugePageAllocator::close()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    while (!m_buffers.empty())
+    {
+        release(m_buffers.begin());
+    }
+    m_dev = 0;
+}
+
+//
+// Try the explicit huge page sizes from maxPage down; 1 GB pages only for
+// buffers that fill at least one, since the whole last page is committed.
+//
+CALresult
+HugePageAllocator::alloc(CALvoid** ptr, size_t bytes, HostPageKind maxPage)
+{
+    if (!ptr || bytes == 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    *ptr = 0;
+
+    void*        mem    = 0;
+    size_t       mapped = 0;
+    HostPageKind kind   = HostPageSmall;
+    if (maxPage >= HostPage1G && bytes >= Page1G)
+    {
+        mapped = roundUp(bytes, Page1G);
+        mem    = mapHuge(mapped, Page1G);
+        kind   = HostPage1G;
+    }
+    if (!mem && maxPage >= HostPage2M)
+    {
+        mapped = roundUp(bytes, Page2M);
+        mem    = mapHuge(mapped, Page2M);
+        kind   = HostPage2M;
+    }
+    if (!mem)
+    {
+        // munmap() of the trimmed tail needs a page multiple, and so
+        // does the size of the mapping kept for free()
+        bool transparent = (maxPage >= HostPageTransparent);
+        bool advised     = false;
+        mapped = transparent ? roundUp(bytes, Page2M) : roundUp(bytes, smallPageBytes());
+        mem    = mapRegular(mapped, transparent, advised);
+        kind   = advised ? HostPageTransparent : HostPageSmall;
+    }
+    if (!mem)
+    {
+        return CAL_RESULT_ERROR;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    Mapping& mapping = m_buffers[reinterpret_cast<size_t>(mem)];
+    mapping.bytes = mapped;
+    mapping.kind  = kind;
+    m_stats.bytes += mapped;
+    ++m_stats.buffers;
+    ++m_stats.allocs[kind];
+    *ptr = mem;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+HugePageAllocator::free(CALvoid* ptr)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    MappingMap::iterator it = m_buffers.find(reinterpret_cast<size_t>(ptr));
+    if (it == m_buffers.end())
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    release(it);
+    return CAL_RESULT_OK;
+}
+
+HostPageKind
+HugePageAllocator::pageKind(const CALvoid* ptr) const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    size_t addr = reinterpret_cast<size_t>(ptr);
+    MappingMap::const_iterator it = m_buffers.upper_bound(addr);
+    if (it == m_buffers.begin())
+    {
+        return HostPageSmall;
+    }
+    --it;
+    return (addr < it->first + it->second.bytes) ? it->second.kind : HostPageSmall;
+}
+
+CALresult
+HugePageAllocator::resource1D(CALresource* res, CALvoid* ptr, CALuint width, CALformat format)
+{
+    return resource(res, ptr, width, 0, format);
+}
+
+CALresult
+HugePageAllocator::resource2D(CALresource* res, CALvoid* ptr, CALuint width, CALuint height, CALformat format)
+{
+    if (height == 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    return resource(res, ptr, width, height, format);
+}
+
+CALresult
+HugePageAllocator::resource(CALresource* res, CALvoid* ptr, CALuint width, CALuint height, CALformat format)
+{
+    if (!res || width == 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    *res = 0;
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    MappingMap::iterator it = find(ptr);
+    if (it == m_buffers.end())
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    // Resources cover whole elements inside the buffer; the size argument
+    // of calResCreate1D/2D limits a registration to 4 GB
+    size_t    offset = reinterpret_cast<size_t>(ptr) - it->first;
+    CALuint64 bytes  = static_cast<CALuint64>(width) * (height ? height : 1) * formatElementSize(format);
+    if (offset % m_alignment || offset + bytes > it->second.bytes || bytes > 0xffffffffu)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    Registration key;
+    key.offset = offset;
+    key.width  = width;
+    key.height = height;
+    key.format = format;
+    std::map<Registration, CALresource>::iterator cached = it->second.resources.find(key);
+    if (cached != it->second.resources.end())
+    {
+        ++m_stats.cacheHits;
+        *res = cached->second;
+        return CAL_RESULT_OK;
+    }
+
+    const CALextTable* ext = calExtTableGet();
+    CALresource created = 0;
+    CALresult result = height
+        ? ext->resCreate2D(&created, m_dev, ptr, width, height, format, static_cast<CALuint>(bytes), 0)
+        : ext->resCreate1D(&created, m_dev, ptr, width, format, static_cast<CALuint>(bytes), 0);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    it->second.resources[key] = created;
+    ++m_stats.registrations;
+    ++m_stats.liveResources;
+    *res = created;
+    return CAL_RESULT_OK;
+}
+
+// The buffer that holds ptr
+HugePageAllocator::MappingMap::iterator
+HugePageAllocator::find(const CALvoid* ptr)
+{
+    size_t addr = reinterpret_cast<size_t>(ptr);
+    MappingMap::iterator it = m_buffers.upper_bound(addr);
+    if (it == m_buffers.begin())
+    {
+        return m_buffers.end();
+    }
+    --it;
+    return (addr < it->first + it->second.bytes) ? it : m_buffers.end();
+}
+
+// Free the resources of a buffer, then unmap it; m_lock is held
+void
+HugePageAllocator::release(MappingMap::iterator it)
+{
+    Mapping& mapping = it->second;
+    for (std::map<Registration, CALresource>::iterator r = mapping.resources.begin(); r != mapping.resources.end(); ++r)
+    {
+        calResFree(r->second);
+    }
+    m_stats.liveResources -= static_cast<CALuint>(mapping.resources.size());
+    m_stats.bytes         -= mapping.bytes;
+    --m_stats.buffers;
+    unmap(reinterpret_cast<void*>(it->first), mapping.bytes);
+    m_buffers.erase(it);
+}
+
+HugePageStats
+HugePageAllocator::stats() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_stats;
+}
+
+} // namespace cal
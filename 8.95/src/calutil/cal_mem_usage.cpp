@@ -0,0 +1,199 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_mem_usage.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace cal {
+
+namespace {
+
+// Variables CAL IL can declare: prefix and count
+struct NameRange
+{
+    const char* prefix;
+    CALuint     count;
+};
+
+const NameRange NameRanges[] =
+{
+    { "i",   128 },
+    { "o",   8 },
+    { "cb",  16 },
+    { "uav", 12 }
+};
+
+} // anonymous namespace
+
+void
+MemUsageTracker::setContext(CALcontext ctx)
+{
+    m_ctx = ctx;
+    m_bound.clear();
+    m_modules.clear();
+}
+
+CALresult
+MemUsageTracker::setMem(CALname name, CALmem mem)
+{
+    CALresult result = calCtxSetMem(m_ctx, name, mem);
+    if (result == CAL_RESULT_OK)
+    {
+        if (mem)
+        {
+            m_bound[name] = mem;
+        }
+        else
+        {
+            m_bound.erase(name);
+        }
+    }
+    return result;
+}
+
+void
+MemUsageTracker::forgetMem(CALmem mem)
+{
+    for (std::unordered_map<CALname, CALmem>::iterator it = m_bound.begin(); it != m_bound.end();)
+    {
+        if (it->second == mem)
+        {
+            it = m_bound.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void
+MemUsageTracker::forgetModule(CALmodule module)
+{
+    std::unordered_map<CALmodule, ModuleUsage>::iterator it = m_modules.find(module);
+    if (it == m_modules.end())
+    {
+        return;
+    }
+    for (size_t i = 0; i < it->second.names.size(); ++i)
+    {
+        m_bound.erase(it->second.names[i]);
+    }
+    m_modules.erase(it);
+}
+
+//
+// Resolve the names of module once, probing calModuleGetName with every
+// variable name IL allows
+//
+CALresult
+MemUsageTracker::lookup(CALmodule module, ModuleUsage** usage)
+{
+    std::unordered_map<CALmodule, ModuleUsage>::iterator it = m_modules.find(module);
+    if (it != m_modules.end())
+    {
+        *usage = &it->second;
+        return CAL_RESULT_OK;
+    }
+
+    ModuleUsage probed;
+    char variable[16];
+    CALname name;
+    for (size_t r = 0; r < sizeof(NameRanges) / sizeof(NameRanges[0]); ++r)
+    {
+        for (CALuint i = 0; i < NameRanges[r].count; ++i)
+        {
+            std::snprintf(variable, sizeof(variable), "%s%u", NameRanges[r].prefix, i);
+            CALresult result = calModuleGetName(&name, m_ctx, module, variable);
+            if (result == CAL_RESULT_OK)
+            {
+                probed.names.push_back(name);
+            }
+            else if (result == CAL_RESULT_BAD_HANDLE)
+            {
+                return result;
+            }
+        }
+    }
+    if (calModuleGetName(&name, m_ctx, module, "g[]") == CAL_RESULT_OK)
+    {
+        probed.names.push_back(name);
+    }
+
+    probed.mems.reserve(probed.names.size());
+    probed.usage.mem      = 0;
+    probed.usage.memCount = 0;
+    *usage = &(m_modules[module] = probed);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+MemUsageTracker::names(CALmodule module, const std::vector<CALname>** names)
+{
+    ModuleUsage* usage;
+    CALresult result = lookup(module, &usage);
+    if (result == CAL_RESULT_OK && names)
+    {
+        *names = &usage->names;
+    }
+    return result;
+}
+
+CALresult
+MemUsageTracker::prepare(CALprogramGridExtended& grid, CALmodule module)
+{
+    ModuleUsage* usage;
+    CALresult result = lookup(module, &usage);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    // Distinct mems; one buffer bound to several names is paged in once
+    usage->mems.clear();
+    for (size_t i = 0; i < usage->names.size(); ++i)
+    {
+        std::unordered_map<CALname, CALmem>::const_iterator it = m_bound.find(usage->names[i]);
+        if (it != m_bound.end() && std::find(usage->mems.begin(), usage->mems.end(), it->second) == usage->mems.end())
+        {
+            usage->mems.push_back(it->second);
+        }
+    }
+    usage->usage.mem      = usage->mems.empty() ? 0 : &usage->mems[0];
+    usage->usage.memCount = static_cast<CALuint>(usage->mems.size());
+
+    grid.programGrid.flags |= CAL_RUNPROGRAMGRID_EXTENDED_STRUCTURE;
+    grid.extendedFlags     |= CAL_RUNPROGRAMGRID_EXTENDED_MEMORY_USAGE;
+    grid.memUsage           = &usage->usage;
+    if (grid.struct_size == 0)
+    {
+        grid.struct_size = sizeof(grid);
+    }
+    return CAL_RESULT_OK;
+}
+
+} // namespace cal
@@ -0,0 +1,493 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_numa.h"
+#include "cal_format.h"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace cal {
+
+namespace {
+
+#if defined(__linux__)
+
+// From linux/mempolicy.h
+const int       MpolPreferred = 1;
+const unsigned  MpolMfMove    = 1 << 1;
+
+const CALuint   MaxNodes      = 1024;
+const CALuint   SamplePages   = 64;
+
+typedef unsigned long NodeMask[MaxNodes / (8 * sizeof(unsigned long))];
+
+void
+nodeMask(NodeMask& mask, CALint node)
+{
+    std::memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+}
+
+// Integer in a sysfs file, fallback when it cannot be read
+long
+readSysfsLong(const char* path, long fallback)
+{
+    FILE* file = std::fopen(path, "r");
+    if (!file)
+    {
+        return fallback;
+    }
+    long value;
+    if (std::fscanf(file, "%ld", &value) != 1)
+    {
+        value = fallback;
+    }
+    std::fclose(file);
+    return value;
+}
+
+// CPUs of a node from its cpulist, e.g. "0-3,8-11"
+std::vector<CALuint>
+nodeCpus(CALint node)
+{
+    std::vector<CALuint> cpus;
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* file = std::fopen(path, "r");
+    if (!file)
+    {
+        return cpus;
+    }
+    unsigned first, last;
+    while (std::fscanf(file, "%u", &first) == 1)
+    {
+        last = first;
+        int separator = std::fgetc(file);
+        if (separator == '-')
+        {
+            if (std::fscanf(file, "%u", &last) != 1)
+            {
+                break;
+            }
+            separator = std::fgetc(file);
+        }
+        for (unsigned cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+        if (separator != ',')
+        {
+            break;
+        }
+    }
+    std::fclose(file);
+    return cpus;
+}
+
+// Node of the CPU the calling thread runs on, -1 when unknown
+CALint
+currentNode()
+{
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, 0) != 0)
+    {
+        return -1;
+    }
+    return static_cast<CALint>(node);
+}
+
+#endif
+
+//
+// Prefers node for the calling thread's allocations while in scope and
+// then restores the policy it had before; active() is false when no node
+// is given or the policy could not be read or set
+//
+class PreferNode
+{
+public:
+    explicit PreferNode(CALint node)
+        : m_active(false)
+    {
+#if defined(__linux__)
+        m_mode = 0;
+        if (node < 0 || syscall(SYS_get_mempolicy, &m_mode, m_mask, MaxNodes, 0, 0) != 0)
+        {
+            return;
+        }
+        NodeMask mask;
+        nodeMask(mask, node);
+        m_active = (syscall(SYS_set_mempolicy, MpolPreferred, mask, MaxNodes) == 0);
+#else
+        (void)node;
+#endif
+    }
+
+    ~PreferNode()
+    {
+#if defined(__linux__)
+        if (m_active)
+        {
+            syscall(SYS_set_mempolicy, m_mode, m_mask, MaxNodes);
+        }
+#endif
+    }
+
+    PreferNode(const PreferNode&) = delete;
+    PreferNode& operator=(const PreferNode&) = delete;
+
+    bool active() const { return m_active; }
+
+private:
+    bool        m_active;
+#if defined(__linux__)
+    int         m_mode;         // with its mode flags, as get_mempolicy reports it
+    NodeMask    m_mask;
+#endif
+};
+
+} // anonymous namespace
+
+NumaPlacement::NumaPlacement()
+    : m_node(-1)
+{
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+NumaPlacement::~NumaPlacement()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    for (std::map<CALresource, Placed>::iterator it = m_placed.begin(); it != m_placed.end(); ++it)
+    {
+        calResFree(it->first);
+    }
+}
+
+//
+// Devices are matched by bus, device and function in any PCI domain;
+// sysfs reports -1 on hosts without NUMA information.
+//
+CALint
+NumaPlacement::deviceNode(CALuint ordinal)
+{
+    CALdeviceattribs attribs;
+    std::memset(&attribs, 0, sizeof(attribs));
+    attribs.struct_size = sizeof(attribs);
+    if (calDeviceGetAttribs(&attribs, ordinal) != CAL_RESULT_OK)
+    {
+        return -1;
+    }
+
+#if defined(__linux__)
+    // 00:00.0 is the host bridge; a zero field means the runtime left it empty
+    if (attribs.pciTopologyInformation == 0)
+    {
+        return -1;
+    }
+    PciLocation location = pciLocation(attribs.pciTopologyInformation);
+    DIR* dir = opendir("/sys/bus/pci/devices");
+    if (!dir)
+    {
+        return -1;
+    }
+    CALint node = -1;
+    while (struct dirent* entry = readdir(dir))
+    {
+        unsigned domain, bus, device, function;
+        if (std::sscanf(entry->d_name, "%x:%x:%x.%x", &domain, &bus, &device, &function) == 4 &&
+            bus == location.bus && device == location.device && function == location.function)
+        {
+            char path[320];
+            std::snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/numa_node", entry->d_name);
+            node = static_cast<CALint>(readSysfsLong(path, -1));
+            break;
+        }
+    }
+    closedir(dir);
+    return (node >= 0 && node < static_cast<CALint>(MaxNodes)) ? node : -1;
+#else
+    return -1;
+#endif
+}
+
+CALresult
+NumaPlacement::open(CALuint ordinal)
+{
+    CALdeviceattribs attribs;
+    std::memset(&attribs, 0, sizeof(attribs));
+    attribs.struct_size = sizeof(attribs);
+    CALresult result = calDeviceGetAttribs(&attribs, ordinal);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    setNode(deviceNode(ordinal));
+    return CAL_RESULT_OK;
+}
+
+void
+NumaPlacement::setNode(CALint node)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+#if defined(__linux__)
+    m_node = (node >= 0 && node < static_cast<CALint>(MaxNodes)) ? node : -1;
+    m_cpus = (m_node >= 0) ? nodeCpus(m_node) : std::vector<CALuint>();
+#else
+    (void)node;
+#endif
+}
+
+CALint
+NumaPlacement::node() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_node;
+}
+
+CALresult
+NumaPlacement::allocRemote1D(CALresource* res, CALdevice dev, CALuint width, CALformat format, CALuint flags)
+{
+    bool preferred;
+    CALresult result;
+    {
+        PreferNode prefer(node());
+        preferred = prefer.active();
+        result    = calResAllocRemote1D(res, &dev, 1, width, format, flags);
+    }
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    return place(*res, 1, format, preferred);
+}
+
+CALresult
+NumaPlacement::allocRemote2D(CALresource* res, CALdevice dev, CALuint width, CALuint height,
+                             CALformat format, CALuint flags)
+{
+    bool preferred;
+    CALresult result;
+    {
+        PreferNode prefer(node());
+        preferred = prefer.active();
+        result    = calResAllocRemote2D(res, &dev, 1, width, height, format, flags);
+    }
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    return place(*res, height, format, preferred);
+}
+
+//
+// Remote memory stays at the address of its first map, so the range is
+// looked up once. When the allocation ran without the preferred policy,
+// mbind moves the pages over as a fallback. It often fails on memory the
+// driver pinned, and is limited to the whole pages inside the resource so
+// it never moves a neighbouring allocation that shares a page.
+//
+CALresult
+NumaPlacement::place(CALresource res, CALuint64 height, CALformat format, bool preferred)
+{
+    CALvoid* ptr;
+    CALuint  pitch;
+    CALresult result = calResMap(&ptr, &pitch, res, 0);
+    if (result != CAL_RESULT_OK)
+    {
+        calResFree(res);
+        return result;
+    }
+    calResUnmap(res);
+
+    Placed placed;
+    placed.ptr   = ptr;
+    placed.bytes = static_cast<CALuint64>(pitch) * height * formatElementSize(format);
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_placed[res] = placed;
+    ++m_stats.allocs;
+
+#if defined(__linux__)
+    if (m_node >= 0 && !preferred)
+    {
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t begin    = (reinterpret_cast<size_t>(ptr) + pageSize - 1) / pageSize * pageSize;
+        size_t end      = (reinterpret_cast<size_t>(ptr) + placed.bytes) / pageSize * pageSize;
+        NodeMask mask;
+        nodeMask(mask, m_node);
+        if (end <= begin ||
+            syscall(SYS_mbind, begin, end - begin, MpolPreferred, mask, MaxNodes, MpolMfMove) != 0)
+        {
+            ++m_stats.bindFailures;
+        }
+    }
+#else
+    (void)preferred;
+#endif
+    return CAL_RESULT_OK;
+}
+
+CALresult
+NumaPlacement::free(CALresource res)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::map<CALresource, Placed>::iterator it = m_placed.find(res);
+        if (it == m_placed.end())
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        m_placed.erase(it);
+    }
+    return calResFree(res);
+}
+
+CALresult
+NumaPlacement::bindThread()
+{
+#if defined(__linux__)
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (m_node < 0 || m_cpus.empty())
+    {
+        return CAL_RESULT_OK;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < m_cpus.size(); ++i)
+    {
+        CPU_SET(m_cpus[i], &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        return CAL_RESULT_ERROR;
+    }
+    NodeMask mask;
+    nodeMask(mask, m_node);
+    syscall(SYS_set_mempolicy, MpolPreferred, mask, MaxNodes);
+#endif
+    return CAL_RESULT_OK;
+}
+
+//
+// Node of up to SamplePages pages spread over the resource; move_pages
+// without target nodes only reports where the pages are.
+//
+bool
+NumaPlacement::pageNodes(const Placed& placed, CALuint& local, CALuint& cross, CALuint& unplaced) const
+{
+    local = cross = unplaced = 0;
+#if defined(__linux__)
+    size_t   pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t   begin    = reinterpret_cast<size_t>(placed.ptr) / pageSize * pageSize;
+    CALuint64 pages   = (reinterpret_cast<size_t>(placed.ptr) + placed.bytes - begin + pageSize - 1) / pageSize;
+    CALuint  count    = static_cast<CALuint>(pages < SamplePages ? pages : SamplePages);
+    if (count == 0)
+    {
+        return false;
+    }
+
+    void* addresses[SamplePages];
+    int   status[SamplePages];
+    for (CALuint i = 0; i < count; ++i)
+    {
+        addresses[i] = reinterpret_cast<void*>(begin + pages * i / count * pageSize);
+    }
+    if (syscall(SYS_move_pages, 0, count, addresses, 0, status, 0) != 0)
+    {
+        return false;
+    }
+    for (CALuint i = 0; i < count; ++i)
+    {
+        if (status[i] < 0)
+        {
+            ++unplaced;
+        }
+        else if (status[i] == m_node)
+        {
+            ++local;
+        }
+        else
+        {
+            ++cross;
+        }
+    }
+    return true;
+#else
+    (void)placed;
+    return false;
+#endif
+}
+
+CALresult
+NumaPlacement::record(CALresource res, CALuint64 bytes)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<CALresource, Placed>::iterator it = m_placed.find(res);
+    if (it == m_placed.end())
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    if (m_node < 0)
+    {
+        return CAL_RESULT_OK;
+    }
+
+    CALuint local, cross, unplaced;
+    if (pageNodes(it->second, local, cross, unplaced))
+    {
+        // Split bytes by the sampled fractions, rounding into local
+        CALuint   samples    = local + cross + unplaced;
+        CALuint64 crossPart  = bytes * cross / samples;
+        CALuint64 unplacPart = bytes * unplaced / samples;
+        m_stats.crossBytes    += crossPart;
+        m_stats.unplacedBytes += unplacPart;
+        m_stats.localBytes    += bytes - crossPart - unplacPart;
+    }
+#if defined(__linux__)
+    CALint current = currentNode();
+    if (current >= 0 && current != m_node)
+    {
+        m_stats.crossThreadBytes += bytes;
+    }
+#endif
+    return CAL_RESULT_OK;
+}
+
+NumaTrafficStats
+NumaPlacement::stats() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_stats;
+}
+
+} // namespace cal
@@ -0,0 +1,482 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_region_copy.h"
+#include "cal_ext_table.h"
+#include "cal_format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace cal {
+
+namespace {
+
+// calMemCopyRaw offsets and sizes are CALuint
+const CALuint64 RawLimit = 0xffffffffu;
+
+} // anonymous namespace
+
+RegionCopier::RegionCopier()
+    : m_elementSize(4),
+      m_raw(false),
+      m_partial(false)
+{
+    std::memset(&m_src, 0, sizeof(m_src));
+    std::memset(&m_dst, 0, sizeof(m_dst));
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+RegionCopier::~RegionCopier()
+{
+    close();
+}
+
+CALresult
+RegionCopier::surface(Surface& out, CALresource res, CALuint sliceRows, CALuint& elementSize)
+{
+    CALresInfo info;
+    std::memset(&info, 0, sizeof(info));
+    CALresult result = calExtTableGet()->resQueryInfo(res, &info);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    out.width     = info.width;
+    out.height    = info.height ? info.height : 1;
+    out.pitch     = info.pitch ? info.pitch : info.width;
+    out.sliceRows = sliceRows ? sliceRows : out.height;
+    out.linear    = (info.tilingFormat == CAL_MEMORY_TILING_LINEAR_ALIGNED ||
+                     info.tilingFormat == CAL_MEMORY_TILING_LINEAR_GENERAL);
+    elementSize   = formatElementSize(info.format);
+    return (out.sliceRows > out.height) ? CAL_RESULT_INVALID_PARAMETER : CAL_RESULT_OK;
+}
+
+CALresult
+RegionCopier::open(const CALcontext* ctxs, CALuint ctxCount, CALresource src, CALresource dst,
+                   const RegionCopyParams& params)
+{
+    const CALextTable* ext = calExtTableGet();
+    if (!ext->resQueryInfo || (!ext->memCopyRaw && !ext->memCopyPartial))
+    {
+        return CAL_RESULT_NOT_SUPPORTED;
+    }
+    if (!ctxs || ctxCount == 0 || params.depth == 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    close();
+
+    CALuint srcElementSize, dstElementSize;
+    CALresult result = surface(m_src, src, params.srcSliceRows, srcElementSize);
+    if (result == CAL_RESULT_OK)
+    {
+        result = surface(m_dst, dst, params.dstSliceRows, dstElementSize);
+    }
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    if (srcElementSize != dstElementSize)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    m_params      = params;
+    m_elementSize = srcElementSize;
+    m_partial     = (ext->memCopyPartial != 0);
+    m_raw         = ext->memCopyRaw && m_src.linear && m_dst.linear &&
+                    static_cast<CALuint64>(m_src.pitch) * m_src.height * m_elementSize <= RawLimit &&
+                    static_cast<CALuint64>(m_dst.pitch) * m_dst.height * m_elementSize <= RawLimit;
+    if (!m_raw && !m_partial)
+    {
+        return CAL_RESULT_NOT_SUPPORTED;
+    }
+
+    m_lanes.resize(ctxCount);
+    for (CALuint i = 0; i < ctxCount; ++i)
+    {
+        Lane& lane = m_lanes[i];
+        lane.ctx = ctxs[i];
+        lane.src = 0;
+        lane.dst = 0;
+        lane.waiter.setContext(ctxs[i]);
+        result = calCtxGetMem(&lane.src, lane.ctx, src);
+        if (result == CAL_RESULT_OK)
+        {
+            result = calCtxGetMem(&lane.dst, lane.ctx, dst);
+        }
+        if (result != CAL_RESULT_OK)
+        {
+            close();
+            return result;
+        }
+    }
+    return CAL_RESULT_OK;
+}
+
+void
+RegionCopier::close()
+{
+    for (size_t i = 0; i < m_lanes.size(); ++i)
+    {
+        if (m_lanes[i].src)
+        {
+            calCtxReleaseMem(m_lanes[i].ctx, m_lanes[i].src);
+        }
+        if (m_lanes[i].dst)
+        {
+            calCtxReleaseMem(m_lanes[i].ctx, m_lanes[i].dst);
+        }
+    }
+    m_lanes.clear();
+}
+
+// Byte span of a rectangle that is contiguous in both surfaces
+bool
+RegionCopier::spanOf(const Rect& rect, Span& span) const
+{
+    bool srcContiguous = (rect.h == 1 || (rect.sx == 0 && rect.w == m_src.pitch));
+    bool dstContiguous = (rect.h == 1 || (rect.dx == 0 && rect.w == m_dst.pitch));
+    if (!srcContiguous || !dstContiguous)
+    {
+        return false;
+    }
+    span.src   = (static_cast<CALuint64>(rect.sy) * m_src.pitch + rect.sx) * m_elementSize;
+    span.dst   = (static_cast<CALuint64>(rect.dy) * m_dst.pitch + rect.dx) * m_elementSize;
+    span.bytes = static_cast<CALuint64>(rect.w) * rect.h * m_elementSize;
+    return true;
+}
+
+//
+// Join rectangles side by side within the same rows, then rectangles
+// stacked in the same columns; both need the same displacement.
+//
+void
+RegionCopier::mergeRects(std::vector<Rect>& rects)
+{
+    if (rects.size() < 2)
+    {
+        return;
+    }
+
+    std::sort(rects.begin(), rects.end(), [](const Rect& a, const Rect& b) {
+        return (a.sy != b.sy) ? a.sy < b.sy : a.sx < b.sx;
+    });
+    size_t out = 0;
+    for (size_t i = 1; i < rects.size(); ++i)
+    {
+        Rect& a = rects[out];
+        const Rect& b = rects[i];
+        if (b.sy == a.sy && b.h == a.h && b.dy == a.dy && b.sx == a.sx + a.w && b.dx == a.dx + a.w)
+        {
+            a.w += b.w;
+            ++m_stats.merged;
+        }
+        else
+        {
+            rects[++out] = b;
+        }
+    }
+    rects.resize(out + 1);
+
+    std::sort(rects.begin(), rects.end(), [](const Rect& a, const Rect& b) {
+        return (a.sx != b.sx) ? a.sx < b.sx : a.sy < b.sy;
+    });
+    out = 0;
+    for (size_t i = 1; i < rects.size(); ++i)
+    {
+        Rect& a = rects[out];
+        const Rect& b = rects[i];
+        if (b.sx == a.sx && b.w == a.w && b.dx == a.dx && b.sy == a.sy + a.h && b.dy == a.dy + a.h)
+        {
+            a.h += b.h;
+            ++m_stats.merged;
+        }
+        else
+        {
+            rects[++out] = b;
+        }
+    }
+    rects.resize(out + 1);
+}
+
+//
+// Join spans with the same displacement that overlap, touch, or are at
+// most mergeGapBytes apart; the gap is copied along.
+//
+void
+RegionCopier::mergeSpans(std::vector<Span>& spans)
+{
+    if (spans.size() < 2)
+    {
+        return;
+    }
+
+    std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.src < b.src; });
+    size_t out = 0;
+    for (size_t i = 1; i < spans.size(); ++i)
+    {
+        Span& a = spans[out];
+        const Span& b = spans[i];
+        if (b.dst - b.src == a.dst - a.src && b.src <= a.src + a.bytes + m_params.mergeGapBytes)
+        {
+            a.bytes = std::max(a.src + a.bytes, b.src + b.bytes) - a.src;
+            ++m_stats.merged;
+        }
+        else
+        {
+            spans[++out] = b;
+        }
+    }
+    spans.resize(out + 1);
+}
+
+// Bands of rows of at most chunkBytes; rows above it in pieces
+void
+RegionCopier::chunkRect(const Rect& rect, std::vector<CopyChunk>& chunks) const
+{
+    CopyChunk chunk;
+    std::memset(&chunk, 0, sizeof(chunk));
+    chunk.size[2] = 1;
+
+    CALuint64 rowBytes = static_cast<CALuint64>(rect.w) * m_elementSize;
+    if (rowBytes <= m_params.chunkBytes)
+    {
+        // Clamped before narrowing: a chunkBytes of 4 GB rows or more
+        // would otherwise truncate to a band of 0 rows
+        CALuint64 band = std::min<CALuint64>(std::max<CALuint64>(m_params.chunkBytes / rowBytes, 1), rect.h);
+        for (CALuint y = 0; y < rect.h; y += static_cast<CALuint>(band))
+        {
+            chunk.srcOffset[0] = rect.sx;
+            chunk.srcOffset[1] = rect.sy + y;
+            chunk.dstOffset[0] = rect.dx;
+            chunk.dstOffset[1] = rect.dy + y;
+            chunk.size[0]      = rect.w;
+            chunk.size[1]      = static_cast<CALuint>(std::min<CALuint64>(band, rect.h - y));
+            chunks.push_back(chunk);
+        }
+        return;
+    }
+
+    CALuint piece = static_cast<CALuint>(std::max<CALuint64>(m_params.chunkBytes / m_elementSize, 1));
+    for (CALuint y = 0; y < rect.h; ++y)
+    {
+        for (CALuint x = 0; x < rect.w; x += piece)
+        {
+            chunk.srcOffset[0] = rect.sx + x;
+            chunk.srcOffset[1] = rect.sy + y;
+            chunk.dstOffset[0] = rect.dx + x;
+            chunk.dstOffset[1] = rect.dy + y;
+            chunk.size[0]      = std::min(piece, rect.w - x);
+            chunk.size[1]      = 1;
+            chunks.push_back(chunk);
+        }
+    }
+}
+
+// Pieces of at most chunkBytes, whole elements each
+void
+RegionCopier::chunkSpan(const Span& span, std::vector<CopyChunk>& chunks) const
+{
+    CopyChunk chunk;
+    std::memset(&chunk, 0, sizeof(chunk));
+    chunk.raw = true;
+
+    CALuint64 piece = std::max<CALuint64>(m_params.chunkBytes / m_elementSize, 1) * m_elementSize;
+    for (CALuint64 offset = 0; offset < span.bytes; offset += piece)
+    {
+        chunk.srcOffset[0] = static_cast<CALuint>(span.src + offset);
+        chunk.dstOffset[0] = static_cast<CALuint>(span.dst + offset);
+        chunk.size[0]      = static_cast<CALuint>(std::min(piece, span.bytes - offset));
+        chunks.push_back(chunk);
+    }
+}
+
+CALresult
+RegionCopier::plan(const CopyRegion* regions, CALuint count, std::vector<CopyChunk>& chunks)
+{
+    chunks.clear();
+    if (m_lanes.empty() || (count && !regions))
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    // One rectangle per z slice
+    std::vector<Rect> rects;
+    for (CALuint i = 0; i < count; ++i)
+    {
+        const CopyRegion& r = regions[i];
+        CALuint w = r.size[0];
+        CALuint h = r.size[1] ? r.size[1] : 1;
+        CALuint d = r.size[2] ? r.size[2] : 1;
+        if (w == 0 ||
+            static_cast<CALuint64>(r.srcOffset[0]) + w > m_src.width ||
+            static_cast<CALuint64>(r.dstOffset[0]) + w > m_dst.width ||
+            static_cast<CALuint64>(r.srcOffset[1]) + h > m_src.sliceRows ||
+            static_cast<CALuint64>(r.dstOffset[1]) + h > m_dst.sliceRows ||
+            (static_cast<CALuint64>(r.srcOffset[2]) + d) * m_src.sliceRows > m_src.height ||
+            (static_cast<CALuint64>(r.dstOffset[2]) + d) * m_dst.sliceRows > m_dst.height)
+        {
+            return CAL_RESULT_INVALID_PARAMETER;
+        }
+        for (CALuint z = 0; z < d; ++z)
+        {
+            Rect rect;
+            rect.sx = r.srcOffset[0];
+            rect.sy = r.srcOffset[1] + (r.srcOffset[2] + z) * m_src.sliceRows;
+            rect.dx = r.dstOffset[0];
+            rect.dy = r.dstOffset[1] + (r.dstOffset[2] + z) * m_dst.sliceRows;
+            rect.w  = w;
+            rect.h  = h;
+            rects.push_back(rect);
+        }
+    }
+    m_stats.regions += rects.size();
+    mergeRects(rects);
+
+    // Contiguous rectangles become raw spans; without calMemCopyPartial
+    // every row is one
+    std::vector<Span> spans;
+    std::vector<Rect> partial;
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        Span span;
+        if (!m_partial)
+        {
+            Rect row = rects[i];
+            row.h = 1;
+            for (CALuint y = 0; y < rects[i].h; ++y, ++row.sy, ++row.dy)
+            {
+                spanOf(row, span);
+                spans.push_back(span);
+            }
+        }
+        else if (m_raw && spanOf(rects[i], span))
+        {
+            spans.push_back(span);
+        }
+        else
+        {
+            partial.push_back(rects[i]);
+        }
+    }
+    mergeSpans(spans);
+
+    for (size_t i = 0; i < spans.size(); ++i)
+    {
+        chunkSpan(spans[i], chunks);
+    }
+    for (size_t i = 0; i < partial.size(); ++i)
+    {
+        chunkRect(partial[i], chunks);
+    }
+    return CAL_RESULT_OK;
+}
+
+CALresult
+RegionCopier::issue(Lane& lane, const CopyChunk& chunk)
+{
+    const CALextTable* ext = calExtTableGet();
+    CopyChunk args = chunk;
+    CALevent event = 0;
+    CALresult result = chunk.raw
+        ? ext->memCopyRaw(&event, lane.ctx, lane.src, args.srcOffset[0], lane.dst, args.dstOffset[0], args.size[0], 0)
+        : ext->memCopyPartial(&event, lane.ctx, lane.src, args.srcOffset, lane.dst, args.dstOffset, args.size, 0);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    lane.waiter.submitted(event, 0);
+    lane.inFlight.push_back(event);
+    calCtxFlush(lane.ctx);
+
+    if (chunk.raw)
+    {
+        ++m_stats.rawCopies;
+        m_stats.bytes += chunk.size[0];
+    }
+    else
+    {
+        ++m_stats.partialCopies;
+        m_stats.bytes += static_cast<CALuint64>(chunk.size[0]) * chunk.size[1] * m_elementSize;
+    }
+    return CAL_RESULT_OK;
+}
+
+// Wait for every chunk in flight, returning the first error
+CALresult
+RegionCopier::drain()
+{
+    CALresult first = CAL_RESULT_OK;
+    for (size_t i = 0; i < m_lanes.size(); ++i)
+    {
+        Lane& lane = m_lanes[i];
+        std::vector<CALevent> events(lane.inFlight.begin(), lane.inFlight.end());
+        lane.inFlight.clear();
+        CALresult result = events.empty()
+            ? CAL_RESULT_OK
+            : lane.waiter.waitAll(&events[0], static_cast<CALuint>(events.size()));
+        if (first == CAL_RESULT_OK)
+        {
+            first = result;
+        }
+    }
+    return first;
+}
+
+//
+// Chunk i goes to context i % contexts; a context with depth chunks in
+// flight waits for its oldest before taking the next.
+//
+CALresult
+RegionCopier::copy(const CopyRegion* regions, CALuint count)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<CopyChunk> chunks;
+    CALresult result = plan(regions, count, chunks);
+    for (size_t i = 0; result == CAL_RESULT_OK && i < chunks.size(); ++i)
+    {
+        Lane& lane = m_lanes[i % m_lanes.size()];
+        if (lane.inFlight.size() >= m_params.depth)
+        {
+            result = lane.waiter.wait(lane.inFlight.front());
+            lane.inFlight.pop_front();
+        }
+        if (result == CAL_RESULT_OK)
+        {
+            result = issue(lane, chunks[i]);
+        }
+    }
+
+    CALresult drained = drain();
+    m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (result != CAL_RESULT_OK) ? result : drained;
+}
+
+} // namespace cal
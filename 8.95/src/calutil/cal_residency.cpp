@@ -0,0 +1,505 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_residency.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cal {
+
+namespace {
+
+const CALuint64 MB = 1024 * 1024;
+
+// Devices that report no largest block are taken to have no fragmentation
+CALuint64
+largestOf(CALuint availMB, CALuint largestMB)
+{
+    return static_cast<CALuint64>((largestMB != 0 && largestMB <= availMB) ? largestMB : availMB) * MB;
+}
+
+ResidencyHeap
+otherRemote(ResidencyHeap heap)
+{
+    return (heap == ResidencyRemote) ? ResidencyRemoteCached : ResidencyRemote;
+}
+
+} // anonymous namespace
+
+ResidencyManager::ResidencyManager(const ResidencyParams& params)
+    : m_params(params),
+      m_ctx(0),
+      m_dev(0),
+      m_nextId(1),
+      m_clock(0),
+      m_sincePoll(0)
+{
+    std::memset(m_heaps, 0, sizeof(m_heaps));
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+ResidencyManager::~ResidencyManager()
+{
+    close();
+}
+
+CALresult
+ResidencyManager::open(CALcontext ctx, CALdevice dev, CALuint ordinal)
+{
+    close();
+
+    CALdeviceattribs attribs;
+    std::memset(&attribs, 0, sizeof(attribs));
+    attribs.struct_size = sizeof(attribs);
+    CALresult result = calDeviceGetAttribs(&attribs, ordinal);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    m_ctx = ctx;
+    m_dev = dev;
+    m_waiter.setContext(ctx);
+    std::memset(m_heaps, 0, sizeof(m_heaps));
+    std::memset(&m_stats, 0, sizeof(m_stats));
+    m_heaps[ResidencyLocal].totalBytes        = static_cast<CALuint64>(attribs.localRAM) * MB;
+    m_heaps[ResidencyRemote].totalBytes       = static_cast<CALuint64>(attribs.uncachedRemoteRAM) * MB;
+    m_heaps[ResidencyRemoteCached].totalBytes = static_cast<CALuint64>(attribs.cachedRemoteRAM) * MB;
+
+    result = poll();
+    if (result != CAL_RESULT_OK)
+    {
+        m_ctx = 0;
+    }
+    return result;
+}
+
+void
+ResidencyManager::close()
+{
+    for (std::unordered_map<ResidentId, Resident>::iterator it = m_residents.begin(); it != m_residents.end(); ++it)
+    {
+        calResFree(it->second.res);
+    }
+    m_residents.clear();
+    for (CALuint i = 0; i < ResidencyHeapCount; ++i)
+    {
+        m_heaps[i].trackedBytes = 0;
+        m_heaps[i].trackedCount = 0;
+    }
+    m_ctx = 0;
+    m_dev = 0;
+}
+
+CALresult
+ResidencyManager::poll()
+{
+    CALdevicestatus status;
+    std::memset(&status, 0, sizeof(status));
+    status.struct_size = sizeof(status);
+    CALresult result = calDeviceGetStatus(&status, m_dev);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+    ++m_stats.polls;
+
+    CALuint localLargest = std::max(status.largestBlockVisibleHeap, status.largestBlockInvisibleHeap);
+    m_heaps[ResidencyLocal].availBytes          = static_cast<CALuint64>(status.availLocalRAM) * MB;
+    m_heaps[ResidencyLocal].largestBlock        = largestOf(status.availLocalRAM, localLargest);
+    m_heaps[ResidencyRemote].availBytes         = static_cast<CALuint64>(status.availUncachedRemoteRAM) * MB;
+    m_heaps[ResidencyRemote].largestBlock       = largestOf(status.availUncachedRemoteRAM, status.largestBlockRemoteHeap);
+    m_heaps[ResidencyRemoteCached].availBytes   = static_cast<CALuint64>(status.availCachedRemoteRAM) * MB;
+    m_heaps[ResidencyRemoteCached].largestBlock = largestOf(status.availCachedRemoteRAM, status.largestBlockCachedRemoteHeap);
+
+    m_sincePoll = 0;
+    m_lastPoll  = Clock::now();
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ResidencyManager::maybePoll()
+{
+    if (m_sincePoll >= m_params.pollInterval ||
+        Clock::now() - m_lastPoll >= std::chrono::milliseconds(m_params.pollMs))
+    {
+        return poll();
+    }
+    return CAL_RESULT_OK;
+}
+
+bool
+ResidencyManager::fits(ResidencyHeap heap, CALuint64 bytes) const
+{
+    CALuint64 headroom = (heap == ResidencyLocal) ? static_cast<CALuint64>(m_params.headroomMB) * MB : 0;
+    return m_heaps[heap].largestBlock >= bytes && m_heaps[heap].availBytes >= bytes + headroom;
+}
+
+//
+// Remote heap for shape: the one its flags ask for when it asked for remote
+// memory, else the one with the largest free block
+//
+ResidencyHeap
+ResidencyManager::remoteHeap(const ResourceShape& shape) const
+{
+    if (shape.remote)
+    {
+        return (shape.flags & CAL_RESALLOC_CACHEABLE) ? ResidencyRemoteCached : ResidencyRemote;
+    }
+    return (m_heaps[ResidencyRemoteCached].largestBlock > m_heaps[ResidencyRemote].largestBlock)
+        ? ResidencyRemoteCached : ResidencyRemote;
+}
+
+CALresult
+ResidencyManager::allocate(const ResourceShape& shape, ResidencyHeap heap, CALresource& res)
+{
+    res = 0;
+    CALuint flags = shape.flags & ~static_cast<CALuint>(CAL_RESALLOC_CACHEABLE);
+    if (heap == ResidencyLocal)
+    {
+        return shape.height
+            ? calResAllocLocal2D(&res, m_dev, shape.width, shape.height, shape.format, flags)
+            : calResAllocLocal1D(&res, m_dev, shape.width, shape.format, flags);
+    }
+
+    CALdevice dev = m_dev;
+    flags |= (heap == ResidencyRemoteCached) ? CAL_RESALLOC_CACHEABLE : 0;
+    return shape.height
+        ? calResAllocRemote2D(&res, &dev, 1, shape.width, shape.height, shape.format, flags)
+        : calResAllocRemote1D(&res, &dev, 1, shape.width, shape.format, flags);
+}
+
+CALresult
+ResidencyManager::place(const ResourceShape& shape, CALuint64 bytes, ResidencyHeap& heap, CALresource& res)
+{
+    if (shape.remote)
+    {
+        heap = remoteHeap(shape);
+        return allocate(shape, heap, res);
+    }
+
+    // Local memory, evicting the shortfall; a failed allocation means the
+    // status was off or the free space too fragmented, so the second round
+    // polls and evicts at least the request. When the unpinned residents
+    // cannot cover the shortfall, evicting them would only slow down the
+    // remote fallback.
+    CALuint64 headroom = static_cast<CALuint64>(m_params.headroomMB) * MB;
+    CALuint64 force    = 0;
+    CALresult result   = CAL_RESULT_ERROR;
+    for (CALuint round = 0; round < 2; ++round)
+    {
+        if (force != 0 || !fits(ResidencyLocal, bytes))
+        {
+            const ResidencyHeapStatus& local = m_heaps[ResidencyLocal];
+            CALuint64 shortfall = (local.availBytes < bytes + headroom) ? bytes + headroom - local.availBytes : 0;
+            if (local.largestBlock < bytes)
+            {
+                shortfall = std::max(shortfall, bytes - local.largestBlock);
+            }
+            CALuint64 need = std::max(shortfall, force);
+            if (evictable() < need)
+            {
+                break;
+            }
+            CALuint64 evicted = 0;
+            evict(need, &evicted);
+            if (evicted != 0)
+            {
+                poll();
+            }
+        }
+        if (!fits(ResidencyLocal, bytes))
+        {
+            break;
+        }
+        result = allocate(shape, ResidencyLocal, res);
+        if (result == CAL_RESULT_OK)
+        {
+            heap = ResidencyLocal;
+            return CAL_RESULT_OK;
+        }
+        poll();
+        force = bytes;
+    }
+
+    if (!m_params.remoteFallback)
+    {
+        return result;
+    }
+    ResidencyHeap first = remoteHeap(shape);
+    ResidencyHeap order[2] = { first, otherRemote(first) };
+    for (CALuint i = 0; i < 2; ++i)
+    {
+        result = allocate(shape, order[i], res);
+        if (result == CAL_RESULT_OK)
+        {
+            heap = order[i];
+            ++m_stats.fallbacks;
+            return CAL_RESULT_OK;
+        }
+    }
+    return result;
+}
+
+CALresult
+ResidencyManager::alloc(ResidentId* id, const ResourceShape& shape)
+{
+    if (!id)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    *id = 0;
+    if (!m_ctx)
+    {
+        return CAL_RESULT_NOT_INITIALIZED;
+    }
+
+    Resident r;
+    r.shape     = shape;
+    r.shape.dev = m_dev;
+    r.bytes     = r.shape.bytes();
+    r.lastUse   = ++m_clock;
+    r.pins      = 0;
+    maybePoll();
+    CALresult result = place(r.shape, r.bytes, r.heap, r.res);
+    if (result != CAL_RESULT_OK)
+    {
+        ++m_stats.failures;
+        return result;
+    }
+    track(r.heap, r.bytes);
+    ++m_stats.allocs;
+
+    while (m_nextId == 0 || m_residents.count(m_nextId))
+    {
+        ++m_nextId;
+    }
+    *id = m_nextId++;
+    m_residents[*id] = r;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ResidencyManager::free(ResidentId id)
+{
+    std::unordered_map<ResidentId, Resident>::iterator it = m_residents.find(id);
+    if (it == m_residents.end())
+    {
+        return CAL_RESULT_BAD_HANDLE;
+    }
+    if (it->second.pins != 0)
+    {
+        return CAL_RESULT_BUSY;
+    }
+    calResFree(it->second.res);
+    untrack(it->second.heap, it->second.bytes);
+    m_residents.erase(it);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ResidencyManager::pin(ResidentId id, CALresource* res)
+{
+    std::unordered_map<ResidentId, Resident>::iterator it = m_residents.find(id);
+    if (it == m_residents.end() || !res)
+    {
+        return it == m_residents.end() ? CAL_RESULT_BAD_HANDLE : CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    Resident& r = it->second;
+    r.lastUse = ++m_clock;
+    if (r.pins == 0 && r.heap != ResidencyLocal && !r.shape.remote)
+    {
+        maybePoll();
+        if (fits(ResidencyLocal, r.bytes) && move(r, ResidencyLocal) == CAL_RESULT_OK)
+        {
+            ++m_stats.pageIns;
+        }
+    }
+    ++r.pins;
+    *res = r.res;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ResidencyManager::unpin(ResidentId id)
+{
+    std::unordered_map<ResidentId, Resident>::iterator it = m_residents.find(id);
+    if (it == m_residents.end() || it->second.pins == 0)
+    {
+        return CAL_RESULT_BAD_HANDLE;
+    }
+    --it->second.pins;
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ResidencyManager::evict(CALuint64 bytes, CALuint64* evicted)
+{
+    if (evicted)
+    {
+        *evicted = 0;
+    }
+
+    std::vector<std::pair<CALuint64, Resident*> > cold;
+    for (std::unordered_map<ResidentId, Resident>::iterator it = m_residents.begin(); it != m_residents.end(); ++it)
+    {
+        if (it->second.heap == ResidencyLocal && it->second.pins == 0)
+        {
+            cold.push_back(std::make_pair(it->second.lastUse, &it->second));
+        }
+    }
+    std::sort(cold.begin(), cold.end());
+
+    CALuint64 moved = 0;
+    for (size_t i = 0; i < cold.size() && moved < bytes; ++i)
+    {
+        Resident& r = *cold[i].second;
+        ResidencyHeap to = remoteHeap(r.shape);
+        CALresult result = move(r, to);
+        if (result != CAL_RESULT_OK)
+        {
+            result = move(r, otherRemote(to));
+        }
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        moved += r.bytes;
+        ++m_stats.evictions;
+        m_stats.evictedBytes += r.bytes;
+        if (evicted)
+        {
+            *evicted = moved;
+        }
+    }
+    return CAL_RESULT_OK;
+}
+
+// Bytes evict() could move out of local memory
+CALuint64
+ResidencyManager::evictable() const
+{
+    CALuint64 bytes = 0;
+    for (std::unordered_map<ResidentId, Resident>::const_iterator it = m_residents.begin(); it != m_residents.end(); ++it)
+    {
+        if (it->second.heap == ResidencyLocal && it->second.pins == 0)
+        {
+            bytes += it->second.bytes;
+        }
+    }
+    return bytes;
+}
+
+//
+// Copy r into a new resource in heap to and free the old one
+//
+CALresult
+ResidencyManager::move(Resident& r, ResidencyHeap to)
+{
+    CALresource dst;
+    CALresult result = allocate(r.shape, to, dst);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    CALmem srcMem = 0;
+    CALmem dstMem = 0;
+    CALevent event = 0;
+    result = calCtxGetMem(&srcMem, m_ctx, r.res);
+    if (result == CAL_RESULT_OK)
+    {
+        result = calCtxGetMem(&dstMem, m_ctx, dst);
+    }
+    if (result == CAL_RESULT_OK)
+    {
+        result = calMemCopy(&event, m_ctx, srcMem, dstMem, 0);
+    }
+    if (result == CAL_RESULT_OK)
+    {
+        calCtxFlush(m_ctx);
+        result = m_waiter.wait(event);
+    }
+    if (srcMem)
+    {
+        calCtxReleaseMem(m_ctx, srcMem);
+    }
+    if (dstMem)
+    {
+        calCtxReleaseMem(m_ctx, dstMem);
+    }
+    if (result != CAL_RESULT_OK)
+    {
+        calResFree(dst);
+        return result;
+    }
+
+    calResFree(r.res);
+    untrack(r.heap, r.bytes);
+    track(to, r.bytes);
+    r.res  = dst;
+    r.heap = to;
+    return CAL_RESULT_OK;
+}
+
+void
+ResidencyManager::track(ResidencyHeap heap, CALuint64 bytes)
+{
+    ResidencyHeapStatus& h = m_heaps[heap];
+    h.trackedBytes += bytes;
+    ++h.trackedCount;
+    h.availBytes   -= std::min(h.availBytes, bytes);
+    h.largestBlock  = std::min(h.largestBlock, h.availBytes);
+    ++m_sincePoll;
+}
+
+//
+// Freed bytes count as free at once; whether they joined the largest block
+// is left to the next poll
+//
+void
+ResidencyManager::untrack(ResidencyHeap heap, CALuint64 bytes)
+{
+    ResidencyHeapStatus& h = m_heaps[heap];
+    h.trackedBytes -= std::min(h.trackedBytes, bytes);
+    h.trackedCount -= (h.trackedCount != 0) ? 1 : 0;
+    h.availBytes   += bytes;
+    if (h.totalBytes != 0)
+    {
+        h.availBytes = std::min(h.availBytes, h.totalBytes);
+    }
+    ++m_sincePoll;
+}
+
+ResidencyHeap
+ResidencyManager::heapOf(ResidentId id) const
+{
+    std::unordered_map<ResidentId, Resident>::const_iterator it = m_residents.find(id);
+    return (it == m_residents.end()) ? ResidencyHeapCount : it->second.heap;
+}
+
+} // namespace cal
@@ -0,0 +1,507 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_resource_pool.h"
+#include "cal_format.h"
+
+#include <cstring>
+
+namespace cal {
+
+namespace {
+
+const CALuint64 MB = 1024 * 1024;
+
+} // anonymous namespace
+
+/*---- ResourceShape ----*/
+
+CALuint64
+ResourceShape::bytes() const
+{
+    return static_cast<CALuint64>(width) * (height ? height : 1) * formatElementSize(format);
+}
+
+bool
+ResourceShape::operator<(const ResourceShape& other) const
+{
+    if (dev != other.dev)       return dev < other.dev;
+    if (remote != other.remote) return remote < other.remote;
+    if (format != other.format) return format < other.format;
+    if (width != other.width)   return width < other.width;
+    if (height != other.height) return height < other.height;
+    return flags < other.flags;
+}
+
+bool
+ResourceShape::operator==(const ResourceShape& other) const
+{
+    return dev == other.dev && remote == other.remote && format == other.format &&
+           width == other.width && height == other.height && flags == other.flags;
+}
+
+/*---- PooledResource ----*/
+
+PooledResource::PooledResource(PooledResource&& other)
+    : m_pool(other.m_pool), m_res(other.m_res), m_shape(other.m_shape)
+{
+    other.m_pool = 0;
+    other.m_res  = 0;
+}
+
+PooledResource&
+PooledResource::operator=(PooledResource&& other)
+{
+    if (this != &other)
+    {
+        reset();
+        m_pool       = other.m_pool;
+        m_res        = other.m_res;
+        m_shape      = other.m_shape;
+        other.m_pool = 0;
+        other.m_res  = 0;
+    }
+    return *this;
+}
+
+void
+PooledResource::reset()
+{
+    if (m_pool && m_res)
+    {
+        m_pool->release(m_shape, m_res);
+    }
+    m_pool = 0;
+    m_res  = 0;
+}
+
+CALresource
+PooledResource::detach()
+{
+    CALresource res = m_res;
+    if (m_pool && m_res)
+    {
+        m_pool->forget(m_shape);
+    }
+    m_pool = 0;
+    m_res  = 0;
+    return res;
+}
+
+/*---- ResourcePool ----*/
+
+ResourcePool::ResourcePool(const ResourcePoolParams& params)
+    : m_params(params),
+      m_stamp(0),
+      m_cachedBytes(0),
+      m_cachedCount(0),
+      m_outstanding(0),
+      m_sinceCheck(0),
+      m_hits(0),
+      m_misses(0),
+      m_retries(0),
+      m_trims(0)
+{
+}
+
+ResourcePool::~ResourcePool()
+{
+    clear();
+}
+
+void
+ResourcePool::setParams(const ResourcePoolParams& params)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_params = params;
+    }
+    // Apply lowered limits right away
+    trim(params.maxCachedMB ? params.maxCachedMB * MB : ~static_cast<CALuint64>(0));
+}
+
+ResourcePoolParams
+ResourcePool::params() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_params;
+}
+
+CALresult
+ResourcePool::allocate(const ResourceShape& shape, CALresource& res)
+{
+    res = 0;
+    if (shape.remote)
+    {
+        CALdevice dev = shape.dev;
+        return shape.height
+            ? calResAllocRemote2D(&res, &dev, 1, shape.width, shape.height, shape.format, shape.flags)
+            : calResAllocRemote1D(&res, &dev, 1, shape.width, shape.format, shape.flags);
+    }
+    return shape.height
+        ? calResAllocLocal2D(&res, shape.dev, shape.width, shape.height, shape.format, shape.flags)
+        : calResAllocLocal1D(&res, shape.dev, shape.width, shape.format, shape.flags);
+}
+
+CALresult
+ResourcePool::acquire(PooledResource& out, const ResourceShape& shape)
+{
+    CALresource res = 0;
+    bool check = false;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        Buckets::iterator it = m_idle.find(shape);
+        if (it != m_idle.end() && !it->second.empty())
+        {
+            res = it->second.back().res;
+            it->second.pop_back();
+            m_cachedBytes -= shape.bytes();
+            --m_cachedCount;
+            ++m_outstanding;
+            ++m_hits;
+        }
+        else
+        {
+            ++m_misses;
+            if (m_params.checkInterval && ++m_sinceCheck >= m_params.checkInterval)
+            {
+                m_sinceCheck = 0;
+                check = true;
+            }
+        }
+    }
+    if (res)
+    {
+        // Assign outside the lock: dropping the old resource releases it
+        out = PooledResource(this, shape, res);
+        return CAL_RESULT_OK;
+    }
+
+    if (check)
+    {
+        checkPressure(shape.dev);
+    }
+
+    CALresult result = allocate(shape, res);
+    if (result != CAL_RESULT_OK)
+    {
+        // Give the device back everything idle of the same kind and retry once
+        std::vector<std::pair<ResourceShape, Idle> > victims;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            takeLocked(~static_cast<CALuint64>(0), [&shape](const ResourceShape& s) {
+                return s.dev == shape.dev && s.remote == shape.remote;
+            }, victims);
+        }
+        if (!victims.empty())
+        {
+            freeVictims(victims);
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                ++m_retries;
+            }
+            result = allocate(shape, res);
+        }
+    }
+    if (result != CAL_RESULT_OK)
+    {
+        out.reset();
+        return result;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        ++m_outstanding;
+    }
+    out = PooledResource(this, shape, res);
+    return CAL_RESULT_OK;
+}
+
+CALresult
+ResourcePool::local1D(PooledResource& out, CALdevice dev, CALuint width, CALformat format, CALuint flags)
+{
+    return acquire(out, ResourceShape(dev, false, format, width, 0, flags));
+}
+
+CALresult
+ResourcePool::local2D(PooledResource& out, CALdevice dev, CALuint width, CALuint height, CALformat format, CALuint flags)
+{
+    return acquire(out, ResourceShape(dev, false, format, width, height, flags));
+}
+
+CALresult
+ResourcePool::remote1D(PooledResource& out, CALdevice dev, CALuint width, CALformat format, CALuint flags)
+{
+    return acquire(out, ResourceShape(dev, true, format, width, 0, flags));
+}
+
+CALresult
+ResourcePool::remote2D(PooledResource& out, CALdevice dev, CALuint width, CALuint height, CALformat format, CALuint flags)
+{
+    return acquire(out, ResourceShape(dev, true, format, width, height, flags));
+}
+
+CALresult
+ResourcePool::prewarm(const ResourceShape& shape, CALuint count)
+{
+    CALuint have;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_params.maxPerShape && count > m_params.maxPerShape)
+        {
+            count = m_params.maxPerShape;
+        }
+        Buckets::const_iterator it = m_idle.find(shape);
+        have = (it != m_idle.end()) ? static_cast<CALuint>(it->second.size()) : 0;
+    }
+
+    // Bounded by count so the cache limits cannot make this spin
+    for (CALuint i = have; i < count; ++i)
+    {
+        CALresource res;
+        CALresult result = allocate(shape, res);
+        if (result != CAL_RESULT_OK)
+        {
+            return result;
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            ++m_outstanding;
+        }
+        release(shape, res);
+    }
+    return CAL_RESULT_OK;
+}
+
+void
+ResourcePool::release(const ResourceShape& shape, CALresource res)
+{
+    std::vector<std::pair<ResourceShape, Idle> > victims;
+    CALuint64 bytes = shape.bytes();
+    bool keep;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        --m_outstanding;
+
+        CALuint64 limit = m_params.maxCachedMB * MB;
+        keep = !(limit && bytes > limit);
+        if (keep)
+        {
+            std::vector<Idle>& idle = m_idle[shape];
+            if (m_params.maxPerShape && idle.size() >= m_params.maxPerShape)
+            {
+                victims.push_back(std::make_pair(shape, idle.front()));
+                idle.erase(idle.begin());
+                m_cachedBytes -= bytes;
+                --m_cachedCount;
+            }
+            Idle entry;
+            entry.res   = res;
+            entry.stamp = ++m_stamp;
+            idle.push_back(entry);
+            m_cachedBytes += bytes;
+            ++m_cachedCount;
+
+            if (limit && m_cachedBytes > limit)
+            {
+                takeLocked(m_cachedBytes - limit, ShapeFilter(), victims);
+            }
+        }
+    }
+
+    if (!keep)
+    {
+        calResFree(res);
+        std::lock_guard<std::mutex> guard(m_lock);
+        ++m_trims;
+    }
+    freeVictims(victims);
+}
+
+void
+ResourcePool::forget(const ResourceShape&)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    --m_outstanding;
+}
+
+//
+// Move idle resources accepted by filter (all when empty) to victims, least
+// recently released first, until at least bytes are taken.
+//
+CALuint64
+ResourcePool::takeLocked(CALuint64 bytes, const ShapeFilter& filter, std::vector<std::pair<ResourceShape, Idle> >& victims)
+{
+    CALuint64 taken = 0;
+    while (taken < bytes)
+    {
+        Buckets::iterator oldest = m_idle.end();
+        for (Buckets::iterator it = m_idle.begin(); it != m_idle.end(); ++it)
+        {
+            if (it->second.empty() || (filter && !filter(it->first)))
+            {
+                continue;
+            }
+            if (oldest == m_idle.end() || it->second.front().stamp < oldest->second.front().stamp)
+            {
+                oldest = it;
+            }
+        }
+        if (oldest == m_idle.end())
+        {
+            break;
+        }
+
+        CALuint64 size = oldest->first.bytes();
+        victims.push_back(std::make_pair(oldest->first, oldest->second.front()));
+        oldest->second.erase(oldest->second.begin());
+        if (oldest->second.empty())
+        {
+            m_idle.erase(oldest);
+        }
+        m_cachedBytes -= size;
+        --m_cachedCount;
+        taken += size;
+    }
+    return taken;
+}
+
+//
+// calResFree outside the lock. A resource the runtime refuses to free (still
+// mapped or bound) goes back to the cache as the oldest of its shape.
+//
+void
+ResourcePool::freeVictims(std::vector<std::pair<ResourceShape, Idle> >& victims)
+{
+    CALuint64 freed = 0;
+    std::vector<std::pair<ResourceShape, Idle> > busy;
+    for (size_t i = 0; i < victims.size(); ++i)
+    {
+        if (calResFree(victims[i].second.res) == CAL_RESULT_OK)
+        {
+            ++freed;
+        }
+        else
+        {
+            busy.push_back(victims[i]);
+        }
+    }
+    victims.clear();
+    if (!freed && busy.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_trims += freed;
+    for (size_t i = 0; i < busy.size(); ++i)
+    {
+        std::vector<Idle>& idle = m_idle[busy[i].first];
+        idle.insert(idle.begin(), busy[i].second);
+        m_cachedBytes += busy[i].first.bytes();
+        ++m_cachedCount;
+    }
+}
+
+CALuint64
+ResourcePool::trim(CALuint64 targetBytes)
+{
+    std::vector<std::pair<ResourceShape, Idle> > victims;
+    CALuint64 taken = 0;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_cachedBytes > targetBytes)
+        {
+            taken = takeLocked(m_cachedBytes - targetBytes, ShapeFilter(), victims);
+        }
+    }
+    freeVictims(victims);
+    return taken;
+}
+
+CALresult
+ResourcePool::checkPressure(CALdevice dev)
+{
+    CALdevicestatus status;
+    std::memset(&status, 0, sizeof(status));
+    status.struct_size = sizeof(status);
+    CALresult result = calDeviceGetStatus(&status, dev);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    std::vector<std::pair<ResourceShape, Idle> > victims;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        CALuint minLocal  = m_params.minFreeLocalMB;
+        CALuint minRemote = m_params.minFreeRemoteMB;
+
+        if (status.availLocalRAM < minLocal)
+        {
+            takeLocked((minLocal - status.availLocalRAM) * MB, [dev](const ResourceShape& s) {
+                return s.dev == dev && !s.remote;
+            }, victims);
+        }
+        // Cacheable remote resources come out of the cached remote heap
+        if (status.availUncachedRemoteRAM < minRemote)
+        {
+            takeLocked((minRemote - status.availUncachedRemoteRAM) * MB, [dev](const ResourceShape& s) {
+                return s.dev == dev && s.remote && !(s.flags & CAL_RESALLOC_CACHEABLE);
+            }, victims);
+        }
+        if (status.availCachedRemoteRAM < minRemote)
+        {
+            takeLocked((minRemote - status.availCachedRemoteRAM) * MB, [dev](const ResourceShape& s) {
+                return s.dev == dev && s.remote && (s.flags & CAL_RESALLOC_CACHEABLE);
+            }, victims);
+        }
+    }
+    freeVictims(victims);
+    return CAL_RESULT_OK;
+}
+
+void
+ResourcePool::clear()
+{
+    trim(0);
+}
+
+ResourcePoolStats
+ResourcePool::stats() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    ResourcePoolStats s;
+    s.hits        = m_hits;
+    s.misses      = m_misses;
+    s.retries     = m_retries;
+    s.trims       = m_trims;
+    s.cachedBytes = m_cachedBytes;
+    s.cachedCount = m_cachedCount;
+    s.outstanding = m_outstanding;
+    return s;
+}
+
+} // namespace cal
@@ -0,0 +1,379 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_staging_ring.h"
+#include "cal_ext_table.h"
+#include "cal_private.h"
+
+#include <cstring>
+#include <thread>
+
+namespace cal {
+
+namespace {
+
+const CALuint    PositionBits = 40;
+const CALuint64  PositionMask = (static_cast<CALuint64>(1) << PositionBits) - 1;
+const CALuint    TicketMask   = (1u << (64 - PositionBits)) - 1;
+const CALuint    MaxCapacity  = 1u << 31;
+
+enum SlotState
+{
+    SlotFree = 0,       // not reserved, or reclaimed
+    SlotReserved,       // producer is writing
+    SlotCommitted,      // ready to copy
+    SlotCancelled,      // reclaim without a copy
+    SlotIssued          // copy queued, waiting for its event
+};
+
+CALuint
+roundUpPow2(CALuint value)
+{
+    CALuint p = 1;
+    while (p < value && p < MaxCapacity)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+} // anonymous namespace
+
+struct StagingSlot
+{
+    std::atomic<CALuint>    state;
+    CALuint64               end;        // ring position after the range, padding included
+    CALuint                 offset;
+    CALuint                 size;
+    CALmem                  dstMem;
+    CALuint                 dstOffset;
+    CALevent                event;      // 0 for cancelled and failed ranges
+
+    StagingSlot() : state(SlotFree), end(0), offset(0), size(0), dstMem(0), dstOffset(0), event(0) {}
+};
+
+StagingRing::StagingRing()
+    : m_ctx(0),
+      m_res(0),
+      m_mem(0),
+      m_base(0),
+      m_capacity(0),
+      m_alignment(1),
+      m_slotCount(0),
+      m_head(0),
+      m_tail(0),
+      m_reclaimed(0),
+      m_issued(0),
+      m_lastEvent(0),
+      m_reserves(0),
+      m_full(0),
+      m_padding(0),
+      m_copies(0),
+      m_bytes(0)
+{
+}
+
+StagingRing::~StagingRing()
+{
+    close();
+}
+
+CALresult
+StagingRing::open(CALcontext ctx, CALdevice dev, CALuint bytes, CALuint slots, CALuint alignment)
+{
+    if (!calExtTableGet()->memCopyRaw)
+    {
+        return CAL_RESULT_NOT_SUPPORTED;
+    }
+    if (bytes == 0 || bytes > MaxCapacity || slots == 0 || slots > (TicketMask + 1) / 2 ||
+        alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    close();
+
+    CALuint capacity = roundUpPow2(bytes < alignment ? alignment : bytes);
+    CALresource res = 0;
+    CALresult result = calResAllocRemote1D(&res, &dev, 1, capacity / 4, CAL_FORMAT_UNSIGNED_INT32_1,
+                                           CAL_RESALLOC_GLOBAL_BUFFER | CAL_RESALLOC_PERSISTENT);
+    if (result != CAL_RESULT_OK)
+    {
+        return result;
+    }
+
+    CALvoid* ptr = 0;
+    CALuint pitch;
+    result = calResMap(&ptr, &pitch, res, 0);
+    if (result != CAL_RESULT_OK)
+    {
+        calResFree(res);
+        return result;
+    }
+
+    CALmem mem = 0;
+    result = calCtxGetMem(&mem, ctx, res);
+    if (result != CAL_RESULT_OK)
+    {
+        calResUnmap(res);
+        calResFree(res);
+        return result;
+    }
+
+    m_ctx       = ctx;
+    m_res       = res;
+    m_mem       = mem;
+    m_base      = static_cast<CALubyte*>(ptr);
+    m_capacity  = capacity;
+    m_alignment = alignment;
+    m_slotCount = roundUpPow2(slots);
+    m_slots.reset(new StagingSlot[m_slotCount]);
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    m_reclaimed.store(0, std::memory_order_relaxed);
+    m_issued    = 0;
+    m_lastEvent = 0;
+    return CAL_RESULT_OK;
+}
+
+void
+StagingRing::close()
+{
+    if (!m_res)
+    {
+        return;
+    }
+
+    // Copy what was committed; ranges still reserved are dropped
+    flush();
+    reclaimRanges(true);
+
+    calCtxReleaseMem(m_ctx, m_mem);
+    calResUnmap(m_res);
+    calResFree(m_res);
+    m_slots.reset();
+    m_ctx      = 0;
+    m_res      = 0;
+    m_mem      = 0;
+    m_base     = 0;
+    m_capacity = 0;
+}
+
+//
+// Claim [start, start + size) by advancing the packed head with one CAS.
+// A range that would run past the end of the ring starts over at the
+// beginning; the skipped bytes belong to it and are reclaimed with it.
+//
+CALresult
+StagingRing::reserve(CALuint size, StagingRange& range)
+{
+    if (size == 0 || size > m_capacity)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+
+    CALuint64 head = m_head.load(std::memory_order_relaxed);
+    CALuint64 start, end, padding;
+    CALuint   ticket;
+    for (;;)
+    {
+        CALuint64 position = head & PositionMask;
+        ticket = static_cast<CALuint>(head >> PositionBits);
+
+        start   = (position + m_alignment - 1) & ~static_cast<CALuint64>(m_alignment - 1);
+        padding = 0;
+        if ((start & (m_capacity - 1)) + size > m_capacity)
+        {
+            CALuint64 lap = (position + m_capacity - 1) & ~static_cast<CALuint64>(m_capacity - 1);
+            padding = lap - start;
+            start   = lap;
+        }
+        end = start + size;
+
+        if (((ticket - m_reclaimed.load(std::memory_order_acquire)) & TicketMask) >= m_slotCount ||
+            ((end - m_tail.load(std::memory_order_acquire)) & PositionMask) > m_capacity)
+        {
+            m_full.fetch_add(1, std::memory_order_relaxed);
+            return CAL_RESULT_BUSY;
+        }
+
+        CALuint64 next = (static_cast<CALuint64>((ticket + 1) & TicketMask) << PositionBits) | (end & PositionMask);
+        if (m_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    m_padding.fetch_add(padding, std::memory_order_relaxed);
+
+    StagingSlot& slot = m_slots[ticket & (m_slotCount - 1)];
+    slot.end    = end & PositionMask;
+    slot.offset = static_cast<CALuint>(start & (m_capacity - 1));
+    slot.size   = size;
+    slot.event  = 0;
+    slot.state.store(SlotReserved, std::memory_order_release);
+
+    range.ptr    = m_base + slot.offset;
+    range.offset = slot.offset;
+    range.size   = size;
+    range.ticket = ticket;
+    m_reserves.fetch_add(1, std::memory_order_relaxed);
+    return CAL_RESULT_OK;
+}
+
+void
+StagingRing::commit(const StagingRange& range, CALmem dstMem, CALuint dstOffset)
+{
+    StagingSlot& slot = m_slots[range.ticket & (m_slotCount - 1)];
+    slot.dstMem    = dstMem;
+    slot.dstOffset = dstOffset;
+    slot.state.store(SlotCommitted, std::memory_order_release);
+}
+
+void
+StagingRing::cancel(const StagingRange& range)
+{
+    m_slots[range.ticket & (m_slotCount - 1)].state.store(SlotCancelled, std::memory_order_release);
+}
+
+CALresult
+StagingRing::upload(const CALvoid* data, CALuint size, CALmem dstMem, CALuint dstOffset)
+{
+    StagingRange range;
+    CALresult result = reserve(size, range);
+    if (result == CAL_RESULT_OK)
+    {
+        std::memcpy(range.ptr, data, size);
+        commit(range, dstMem, dstOffset);
+    }
+    return result;
+}
+
+CALresult
+StagingRing::flush()
+{
+    if (!m_res)
+    {
+        return CAL_RESULT_OK;
+    }
+
+    PFNCALMEMCOPYRAW memCopyRaw = calExtTableGet()->memCopyRaw;
+    CALresult first = CAL_RESULT_OK;
+    bool issued = false;
+    for (;;)
+    {
+        StagingSlot& slot = m_slots[m_issued & (m_slotCount - 1)];
+        CALuint state = slot.state.load(std::memory_order_acquire);
+        if (state == SlotCommitted)
+        {
+            CALevent event = 0;
+            CALresult result = memCopyRaw(&event, m_ctx, m_mem, slot.offset, slot.dstMem, slot.dstOffset, slot.size, CAL_MEMCOPY_ASYNC);
+            if (result == CAL_RESULT_OK)
+            {
+                slot.event  = event;
+                m_lastEvent = event;
+                issued      = true;
+                m_copies.fetch_add(1, std::memory_order_relaxed);
+                m_bytes.fetch_add(slot.size, std::memory_order_relaxed);
+            }
+            else if (first == CAL_RESULT_OK)
+            {
+                first = result;
+            }
+        }
+        else if (state != SlotCancelled)
+        {
+            // Not reserved yet, or the producer is still writing
+            break;
+        }
+        slot.state.store(SlotIssued, std::memory_order_relaxed);
+        m_issued = (m_issued + 1) & TicketMask;
+    }
+
+    if (issued)
+    {
+        calCtxFlush(m_ctx);
+    }
+    reclaimRanges(false);
+    return first;
+}
+
+CALuint64
+StagingRing::reclaim()
+{
+    return m_res ? reclaimRanges(false) : 0;
+}
+
+//
+// Retire issued ranges in ticket order while their events are done; with
+// wait set, wait for every issued range.
+//
+CALuint64
+StagingRing::reclaimRanges(bool wait)
+{
+    CALuint64 before = m_tail.load(std::memory_order_relaxed);
+    CALuint   ticket = m_reclaimed.load(std::memory_order_relaxed);
+    while (ticket != m_issued)
+    {
+        StagingSlot& slot = m_slots[ticket & (m_slotCount - 1)];
+        if (slot.event)
+        {
+            CALresult done;
+            while ((done = calCtxIsEventDone(m_ctx, slot.event)) == CAL_RESULT_PENDING && wait)
+            {
+                std::this_thread::yield();
+            }
+            if (done == CAL_RESULT_PENDING)
+            {
+                break;
+            }
+        }
+
+        CALuint64 end = slot.end;
+        slot.state.store(SlotFree, std::memory_order_relaxed);
+        ticket = (ticket + 1) & TicketMask;
+        m_tail.store(end, std::memory_order_release);
+        m_reclaimed.store(ticket, std::memory_order_release);
+    }
+    return (m_tail.load(std::memory_order_relaxed) - before) & PositionMask;
+}
+
+CALuint64
+StagingRing::used() const
+{
+    return ((m_head.load(std::memory_order_acquire) & PositionMask) - m_tail.load(std::memory_order_acquire)) & PositionMask;
+}
+
+StagingRingStats
+StagingRing::stats() const
+{
+    StagingRingStats s;
+    s.reserves     = m_reserves.load(std::memory_order_relaxed);
+    s.full         = m_full.load(std::memory_order_relaxed);
+    s.copies       = m_copies.load(std::memory_order_relaxed);
+    s.bytes        = m_bytes.load(std::memory_order_relaxed);
+    s.paddingBytes = m_padding.load(std::memory_order_relaxed);
+    return s;
+}
+
+} // namespace cal
@@ -0,0 +1,412 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_stream_pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cal {
+
+StreamPipeline::StreamPipeline()
+    : m_ctx(0)
+{
+    std::memset(m_busy, 0, sizeof(m_busy));
+    std::memset(m_itemSeconds, 0, sizeof(m_itemSeconds));
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+StreamPipeline::~StreamPipeline()
+{
+    close();
+}
+
+CALresult
+StreamPipeline::open(CALcontext ctx, CALdevice dev, const PipelineConfig& config)
+{
+    if (config.depth < 2)
+    {
+        return CAL_RESULT_INVALID_PARAMETER;
+    }
+    close();
+
+    m_ctx    = ctx;
+    m_config = config;
+    m_config.input.dev  = dev;
+    m_config.output.dev = dev;
+    m_waiter.setContext(ctx);
+
+    ResourceShape readback = m_config.output;
+    readback.remote = true;
+
+    m_slots.resize(config.depth);
+    for (CALuint i = 0; i < config.depth; ++i)
+    {
+        Slot& slot = m_slots[i];
+        slot.state    = SlotFree;
+        slot.event    = 0;
+        slot.finished = false;
+        std::memset(&slot.buffers, 0, sizeof(slot.buffers));
+        slot.buffers.index = i;
+
+        CALresult result = m_pool.acquire(slot.input, m_config.input);
+        if (result == CAL_RESULT_OK)
+        {
+            result = m_pool.acquire(slot.output, m_config.output);
+        }
+        if (result == CAL_RESULT_OK)
+        {
+            result = m_pool.acquire(slot.readback, readback);
+        }
+        if (result == CAL_RESULT_OK)
+        {
+            slot.buffers.input    = slot.input.get();
+            slot.buffers.output   = slot.output.get();
+            slot.buffers.readback = slot.readback.get();
+            result = calCtxGetMem(&slot.buffers.inputMem, ctx, slot.buffers.input);
+        }
+        if (result == CAL_RESULT_OK)
+        {
+            result = calCtxGetMem(&slot.buffers.outputMem, ctx, slot.buffers.output);
+        }
+        if (result == CAL_RESULT_OK)
+        {
+            result = calCtxGetMem(&slot.buffers.readbackMem, ctx, slot.buffers.readback);
+        }
+        if (result != CAL_RESULT_OK)
+        {
+            close();
+            return result;
+        }
+    }
+    return CAL_RESULT_OK;
+}
+
+void
+StreamPipeline::close()
+{
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        PipelineSlot& b = m_slots[i].buffers;
+        CALmem mems[] = { b.inputMem, b.outputMem, b.readbackMem };
+        for (CALuint m = 0; m < 3; ++m)
+        {
+            if (mems[m])
+            {
+                calCtxReleaseMem(m_ctx, mems[m]);
+            }
+        }
+    }
+    m_slots.clear();
+    m_pool.clear();
+    m_ctx = 0;
+}
+
+//
+// Add an item that spent since..until in stage. Items enter a stage in
+// order, so the time the stage was busy grows by the part of the interval
+// past the latest item to leave before it.
+//
+void
+StreamPipeline::leave(PipelineStage stage, Clock::time_point since, Clock::time_point until)
+{
+    m_itemSeconds[stage] += std::chrono::duration<double>(until - since).count();
+    Clock::time_point from = std::max(since, m_lastLeave[stage]);
+    if (until > from)
+    {
+        m_busy[stage] += std::chrono::duration<double>(until - from).count();
+        m_lastLeave[stage] = until;
+    }
+}
+
+// Start the device stage of slot, whose event was just issued
+void
+StreamPipeline::issued(Slot& slot, SlotState state)
+{
+    slot.state    = state;
+    slot.finished = false;
+    slot.since    = Clock::now();
+    slot.pending  = slot.since;
+}
+
+//
+// Poll the event of slot once; a completion is dated halfway between the
+// previous poll and this one
+//
+CALresult
+StreamPipeline::poll(Slot& slot)
+{
+    if (slot.finished)
+    {
+        return CAL_RESULT_OK;
+    }
+    CALresult result = calCtxIsEventDone(m_ctx, slot.event);
+    Clock::time_point now = Clock::now();
+    if (result == CAL_RESULT_PENDING)
+    {
+        slot.pending = now;
+        return CAL_RESULT_OK;
+    }
+    if (result == CAL_RESULT_OK)
+    {
+        slot.finished   = true;
+        slot.finishedAt = slot.pending + (now - slot.pending) / 2;
+    }
+    return result;
+}
+
+// Poll every event in flight
+CALresult
+StreamPipeline::observe()
+{
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        if (m_slots[i].state == SlotComputing || m_slots[i].state == SlotDownloading)
+        {
+            CALresult result = poll(m_slots[i]);
+            if (result != CAL_RESULT_OK)
+            {
+                return result;
+            }
+        }
+    }
+    return CAL_RESULT_OK;
+}
+
+// finished is set when the slot's event is done
+CALresult
+StreamPipeline::done(Slot& slot, bool& finished)
+{
+    CALresult result = poll(slot);
+    finished = slot.finished;
+    return result;
+}
+
+// Wait for the events in flight after an error
+CALresult
+StreamPipeline::drain()
+{
+    std::vector<CALevent> events;
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        if (m_slots[i].state == SlotComputing || m_slots[i].state == SlotDownloading)
+        {
+            events.push_back(m_slots[i].event);
+        }
+        m_slots[i].state = SlotFree;
+    }
+    calCtxFlush(m_ctx);
+    return events.empty() ? CAL_RESULT_OK : m_waiter.waitAll(&events[0], static_cast<CALuint>(events.size()));
+}
+
+//
+// One pass per iteration, oldest item first: consume finished readbacks,
+// start readbacks of finished computes, issue computes of filled slots and
+// flush, then fill the next free slot while the device works.
+//
+CALresult
+StreamPipeline::run(const PipelineFill& fill, const PipelineCompute& compute, const PipelineConsume& consume)
+{
+    if (m_slots.empty())
+    {
+        return CAL_RESULT_ERROR;
+    }
+
+    const CALuint64 depth = m_slots.size();
+    CALuint64 filled = 0, computed = 0, downloaded = 0, consumed = 0;
+    bool ended = false;
+    double waitSeconds = 0;
+
+    std::memset(m_busy, 0, sizeof(m_busy));
+    std::memset(m_itemSeconds, 0, sizeof(m_itemSeconds));
+    Clock::time_point start = Clock::now();
+    std::fill(m_lastLeave, m_lastLeave + StageCount, start);
+
+    CALresult result = CAL_RESULT_OK;
+    while (result == CAL_RESULT_OK && !(ended && consumed == filled))
+    {
+        bool progress  = false;
+        bool submitted = false;
+        bool finished;
+
+        // Consume
+        if (consumed < downloaded)
+        {
+            Slot& slot = m_slots[consumed % depth];
+            result = done(slot, finished);
+            if (result != CAL_RESULT_OK)
+            {
+                break;
+            }
+            if (finished)
+            {
+                leave(StageDownload, slot.since, slot.finishedAt);
+                CALvoid* ptr;
+                CALuint  pitch;
+                result = calResMap(&ptr, &pitch, slot.buffers.readback, 0);
+                if (result != CAL_RESULT_OK)
+                {
+                    break;
+                }
+                Clock::time_point since = Clock::now();
+                consume(slot.buffers, ptr, pitch);
+                leave(StageConsume, since, Clock::now());
+                calResUnmap(slot.buffers.readback);
+                slot.state = SlotFree;
+                ++consumed;
+                progress = true;
+            }
+        }
+
+        // Download
+        if (downloaded < computed)
+        {
+            Slot& slot = m_slots[downloaded % depth];
+            result = done(slot, finished);
+            if (result != CAL_RESULT_OK)
+            {
+                break;
+            }
+            if (finished)
+            {
+                leave(StageCompute, slot.since, slot.finishedAt);
+                result = calMemCopy(&slot.event, m_ctx, slot.buffers.outputMem, slot.buffers.readbackMem, 0);
+                if (result != CAL_RESULT_OK)
+                {
+                    slot.state = SlotFree;
+                    break;
+                }
+                m_waiter.submitted(slot.event, 0);
+                issued(slot, SlotDownloading);
+                ++downloaded;
+                progress  = true;
+                submitted = true;
+            }
+        }
+
+        // Compute
+        while (computed < filled)
+        {
+            Slot& slot = m_slots[computed % depth];
+            result = compute(slot.buffers, slot.event);
+            if (result != CAL_RESULT_OK)
+            {
+                slot.state = SlotFree;
+                break;
+            }
+            m_waiter.submitted(slot.event, m_config.func);
+            issued(slot, SlotComputing);
+            ++computed;
+            progress  = true;
+            submitted = true;
+        }
+        if (result != CAL_RESULT_OK)
+        {
+            break;
+        }
+        if (submitted)
+        {
+            calCtxFlush(m_ctx);
+        }
+
+        // Fill
+        if (!ended && filled - consumed < depth)
+        {
+            Slot& slot = m_slots[filled % depth];
+            CALvoid* ptr;
+            CALuint  pitch;
+            result = calResMap(&ptr, &pitch, slot.buffers.input, 0);
+            if (result != CAL_RESULT_OK)
+            {
+                break;
+            }
+            slot.buffers.item = filled;
+
+            // Bracket the fill with polls so device work finishing meanwhile
+            // is not charged the whole fill
+            bool more = false;
+            result = observe();
+            if (result == CAL_RESULT_OK)
+            {
+                Clock::time_point since = Clock::now();
+                more = fill(slot.buffers, ptr, pitch);
+                leave(StageFill, since, Clock::now());
+                result = observe();
+            }
+            calResUnmap(slot.buffers.input);
+            if (result != CAL_RESULT_OK)
+            {
+                break;
+            }
+            if (more)
+            {
+                slot.state = SlotFilled;
+                ++filled;
+            }
+            else
+            {
+                ended = true;
+            }
+            progress = true;
+        }
+
+        if (!progress)
+        {
+            // Nothing to do on the host until the oldest device stage finishes
+            Slot& oldest = m_slots[(consumed < downloaded ? consumed : downloaded) % depth];
+            Clock::time_point before = Clock::now();
+            result = m_waiter.wait(oldest.event);
+            Clock::time_point after = Clock::now();
+            waitSeconds += std::chrono::duration<double>(after - before).count();
+            if (result == CAL_RESULT_OK)
+            {
+                oldest.finished   = true;
+                oldest.finishedAt = after;
+            }
+        }
+    }
+
+    if (result != CAL_RESULT_OK)
+    {
+        drain();
+    }
+
+    m_stats.items       = consumed;
+    m_stats.seconds     = std::chrono::duration<double>(Clock::now() - start).count();
+    m_stats.waitSeconds = waitSeconds;
+    m_stats.bottleneck  = StageFill;
+    for (CALuint s = 0; s < StageCount; ++s)
+    {
+        m_stats.occupancy[s] = (m_stats.seconds > 0) ? m_busy[s] / m_stats.seconds : 0;
+        m_stats.meanItems[s] = (m_stats.seconds > 0) ? m_itemSeconds[s] / m_stats.seconds : 0;
+        if (m_stats.occupancy[s] > m_stats.occupancy[m_stats.bottleneck])
+        {
+            m_stats.bottleneck = static_cast<PipelineStage>(s);
+        }
+    }
+    return result;
+}
+
+} // namespace cal
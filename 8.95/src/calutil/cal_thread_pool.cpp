@@ -0,0 +1,183 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+#include "cal_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+namespace cal {
+
+struct ThreadPool::Job
+{
+    const std::function<void(CALuint)>* fn;
+    CALuint                             count;
+    CALuint                             grain;
+    std::atomic<CALuint>                next;
+    std::atomic<CALuint>                done;
+    CALuint                             active;     // workers inside runChunks, guarded by m_lock
+};
+
+ThreadPool::ThreadPool(CALuint threadCount)
+    : m_exit(false)
+{
+    if (threadCount == 0)
+    {
+        CALuint hw = std::thread::hardware_concurrency();
+        threadCount = (hw > 1) ? hw - 1 : 0;
+    }
+
+    m_workers.reserve(threadCount);
+    for (CALuint i = 0; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::workerMain, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_exit = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void
+ThreadPool::runChunks(Job& job)
+{
+    for (;;)
+    {
+        CALuint begin = job.next.fetch_add(job.grain, std::memory_order_relaxed);
+        if (begin >= job.count)
+        {
+            break;
+        }
+
+        CALuint end = std::min(job.count, begin + job.grain);
+        for (CALuint i = begin; i < end; ++i)
+        {
+            (*job.fn)(i);
+        }
+        job.done.fetch_add(end - begin, std::memory_order_release);
+    }
+}
+
+void
+ThreadPool::workerMain()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    for (;;)
+    {
+        m_wake.wait(lock, [this] { return m_exit || !m_jobs.empty(); });
+        if (m_exit)
+        {
+            return;
+        }
+
+        Job* job = m_jobs.front();
+        if (job->next.load(std::memory_order_relaxed) >= job->count)
+        {
+            // Every index is claimed, only the owner still waits on it.
+            m_jobs.pop_front();
+            continue;
+        }
+
+        job->active++;
+        lock.unlock();
+        runChunks(*job);
+        lock.lock();
+        job->active--;
+
+        if (job->active == 0)
+        {
+            m_wake.notify_all();
+        }
+    }
+}
+
+void
+ThreadPool::parallelFor(CALuint count, const std::function<void(CALuint)>& fn, CALuint grain)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    grain = std::max<CALuint>(grain, 1);
+    if (m_workers.empty() || count <= grain)
+    {
+        for (CALuint i = 0; i < count; ++i)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    Job job;
+    job.fn     = &fn;
+    job.count  = count;
+    job.grain  = grain;
+    job.next.store(0, std::memory_order_relaxed);
+    job.done.store(0, std::memory_order_relaxed);
+    job.active = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_jobs.push_back(&job);
+    }
+    m_wake.notify_all();
+
+    runChunks(job);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_wake.wait(lock, [&job] {
+        return job.active == 0 && job.done.load(std::memory_order_acquire) == job.count;
+    });
+
+    std::deque<Job*>::iterator it = std::find(m_jobs.begin(), m_jobs.end(), &job);
+    if (it != m_jobs.end())
+    {
+        m_jobs.erase(it);
+    }
+}
+
+ThreadPool&
+ThreadPool::shared()
+{
+    static ThreadPool pool([]() -> CALuint {
+        const char* env = std::getenv("CAL_THREAD_POOL_SIZE");
+        return env ? static_cast<CALuint>(std::strtoul(env, 0, 10)) : 0;
+    }());
+    return pool;
+}
+
+} // namespace cal
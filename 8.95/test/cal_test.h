@@ -0,0 +1,108 @@
+/**
+ *  @file     cal_test.h
+ *  @brief    Helpers of the calsw smoke tests
+ *  @version  1.00.0 Beta
+ */
+
+
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#ifndef __CAL_TEST_H__
+#define __CAL_TEST_H__
+
+#include "cal.h"
+#include "cal_ext_table.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+/** Fail the test with the location and expression when cond is false. */
+#define CAL_CHECK(cond)                                                         \
+    do                                                                          \
+    {                                                                           \
+        if (!(cond))                                                            \
+        {                                                                       \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            std::fflush(stderr);                                                \
+            std::_Exit(1);                                                      \
+        }                                                                       \
+    } while (0)
+
+/** As CAL_CHECK for a call that must return CAL_RESULT_OK. */
+#define CAL_CHECK_OK(call)                                                      \
+    do                                                                          \
+    {                                                                           \
+        CALresult calCheckResult_ = (call);                                     \
+        if (calCheckResult_ != CAL_RESULT_OK)                                   \
+        {                                                                       \
+            std::fprintf(stderr, "%s:%d: %s returned %d: %s\n", __FILE__, __LINE__, #call, \
+                         static_cast<int>(calCheckResult_), calGetErrorString()); \
+            std::fflush(stderr);                                                \
+            std::_Exit(1);                                                      \
+        }                                                                       \
+    } while (0)
+
+/**
+ * @brief calInit, calExtTableInit and device 0 for the lifetime of a test.
+ */
+class TestDevice
+{
+public:
+    TestDevice() : m_dev(0)
+    {
+        CAL_CHECK_OK(calInit());
+        CAL_CHECK_OK(calExtTableInit());
+        CAL_CHECK_OK(calDeviceOpen(&m_dev, 0));
+    }
+
+    ~TestDevice()
+    {
+        calDeviceClose(m_dev);
+        calShutdown();
+    }
+
+    TestDevice(const TestDevice&) = delete;
+    TestDevice& operator=(const TestDevice&) = delete;
+
+    CALdevice dev() const { return m_dev; }
+
+private:
+    CALdevice m_dev;
+};
+
+/** Wait for event on ctx by polling. */
+inline CALresult
+testWait(CALcontext ctx, CALevent event)
+{
+    CALresult result;
+    while ((result = calCtxIsEventDone(ctx, event)) == CAL_RESULT_PENDING)
+    {
+    }
+    return result;
+}
+
+#endif // __CAL_TEST_H__
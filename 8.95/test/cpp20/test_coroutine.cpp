@@ -0,0 +1,158 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_coroutine.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+const CALuint Size   = 512;     // large enough that a copy is still running when awaited
+const CALuint Copies = 4;
+
+struct CopyFixture
+{
+    CALcontext  ctx;
+    CALresource src;
+    CALresource dst;
+    CALmem      srcMem;
+    CALmem      dstMem;
+
+    explicit CopyFixture(CALdevice dev)
+    {
+        CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+        CAL_CHECK_OK(calResAllocLocal2D(&src, dev, Size, Size, CAL_FORMAT_FLOAT32_4, 0));
+        CAL_CHECK_OK(calResAllocLocal2D(&dst, dev, Size, Size, CAL_FORMAT_FLOAT32_4, 0));
+        CAL_CHECK_OK(calCtxGetMem(&srcMem, ctx, src));
+        CAL_CHECK_OK(calCtxGetMem(&dstMem, ctx, dst));
+    }
+
+    ~CopyFixture()
+    {
+        calCtxReleaseMem(ctx, srcMem);
+        calCtxReleaseMem(ctx, dstMem);
+        calResFree(src);
+        calResFree(dst);
+        calCtxDestroy(ctx);
+    }
+};
+
+struct Progress
+{
+    std::thread::id         caller;
+    std::atomic<CALuint>    completed;
+    std::atomic<CALuint>    failed;
+    std::atomic<CALuint>    resumedElsewhere;   // on the poller thread
+    std::atomic<bool>       finished;
+
+    Progress() : caller(std::this_thread::get_id()), completed(0), failed(0), resumedElsewhere(0), finished(false) {}
+};
+
+// Chains Copies copies, each awaited before the next is issued
+cal::Task
+copyChain(cal::AsyncContext& async, CALmem src, CALmem dst, Progress& progress)
+{
+    for (CALuint i = 0; i < Copies; ++i)
+    {
+        CALresult result = co_await async.copy(src, dst);
+        if (std::this_thread::get_id() != progress.caller)
+        {
+            progress.resumedElsewhere.fetch_add(1);
+        }
+        if (result == CAL_RESULT_OK)
+        {
+            progress.completed.fetch_add(1);
+        }
+        else
+        {
+            progress.failed.fetch_add(1);
+        }
+    }
+    progress.finished.store(true);
+}
+
+void
+testAwait(CopyFixture& fixture, CALdevice dev, cal::CompletionService& service)
+{
+    cal::AsyncContext async(service, fixture.ctx, dev);
+    CAL_CHECK_OK(async.attachResult());
+
+    Progress progress;
+    copyChain(async, fixture.srcMem, fixture.dstMem, progress);
+    for (CALuint i = 0; i < 10000 && !progress.finished.load(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CAL_CHECK(progress.finished.load());
+    CAL_CHECK(progress.completed.load() == Copies && progress.failed.load() == 0);
+
+    // Awaits of running copies suspend and resume from the poller thread
+    CAL_CHECK(progress.resumedElsewhere.load() != 0);
+    CAL_CHECK(service.dispatchCount() >= progress.resumedElsewhere.load());
+
+    // A failed submission resumes at once with its error
+    Progress failing;
+    copyChain(async, fixture.srcMem, 0, failing);
+    CAL_CHECK(failing.finished.load() && failing.failed.load() == Copies);
+    CAL_CHECK(failing.resumedElsewhere.load() == 0);
+}
+
+// Destroying the AsyncContext while a resumption is pending waits for the
+// whole chain, including the awaits registered from the poller thread
+void
+testDetachPending(CopyFixture& fixture, CALdevice dev, cal::CompletionService& service)
+{
+    Progress progress;
+    {
+        cal::AsyncContext async(service, fixture.ctx, dev);
+        CAL_CHECK_OK(async.attachResult());
+        copyChain(async, fixture.srcMem, fixture.dstMem, progress);
+    }
+    CAL_CHECK(progress.finished.load());
+    CAL_CHECK(progress.completed.load() == Copies && progress.failed.load() == 0);
+    CAL_CHECK(progress.resumedElsewhere.load() != 0);
+
+    // The context can be attached again once detached
+    cal::AsyncContext again(service, fixture.ctx, dev);
+    CAL_CHECK_OK(again.attachResult());
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    CopyFixture fixture(device.dev());
+    cal::CompletionService service;
+    testAwait(fixture, device.dev(), service);
+    testDetachPending(fixture, device.dev(), service);
+    service.shutdown();
+    std::printf("test_coroutine passed\n");
+    return 0;
+}
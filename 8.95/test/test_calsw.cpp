@@ -0,0 +1,113 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+
+#include <cstring>
+
+namespace {
+
+// Data written through a map arrives in another resource after calMemCopy
+void
+testCopy(CALdevice dev)
+{
+    const CALuint width  = 300;
+    const CALuint height = 40;
+
+    CALcontext ctx;
+    CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+    CALresource src, dst;
+    CAL_CHECK_OK(calResAllocRemote2D(&src, &dev, 1, width, height, CAL_FORMAT_FLOAT32_1, 0));
+    CAL_CHECK_OK(calResAllocLocal2D(&dst, dev, width, height, CAL_FORMAT_FLOAT32_1, 0));
+
+    CALvoid* ptr;
+    CALuint  pitch;
+    CAL_CHECK_OK(calResMap(&ptr, &pitch, src, 0));
+    CAL_CHECK(pitch >= width);
+    for (CALuint y = 0; y < height; ++y)
+    {
+        for (CALuint x = 0; x < width; ++x)
+        {
+            static_cast<float*>(ptr)[y * pitch + x] = static_cast<float>(y * width + x);
+        }
+    }
+    CAL_CHECK_OK(calResUnmap(src));
+
+    CALmem srcMem, dstMem;
+    CAL_CHECK_OK(calCtxGetMem(&srcMem, ctx, src));
+    CAL_CHECK_OK(calCtxGetMem(&dstMem, ctx, dst));
+    CALevent event;
+    CAL_CHECK_OK(calMemCopy(&event, ctx, srcMem, dstMem, 0));
+    calCtxFlush(ctx);
+    CAL_CHECK_OK(testWait(ctx, event));
+
+    CAL_CHECK_OK(calResMap(&ptr, &pitch, dst, 0));
+    CALuint wrong = 0;
+    for (CALuint y = 0; y < height; ++y)
+    {
+        for (CALuint x = 0; x < width; ++x)
+        {
+            wrong += (static_cast<float*>(ptr)[y * pitch + x] != static_cast<float>(y * width + x));
+        }
+    }
+    calResUnmap(dst);
+    CAL_CHECK(wrong == 0);
+
+    // Stale and made up handles are refused
+    CAL_CHECK(calMemCopy(&event, ctx, 12345, dstMem, 0) == CAL_RESULT_BAD_HANDLE);
+    calCtxReleaseMem(ctx, srcMem);
+    CAL_CHECK(calMemCopy(&event, ctx, srcMem, dstMem, 0) == CAL_RESULT_BAD_HANDLE);
+
+    calCtxReleaseMem(ctx, dstMem);
+    calResFree(src);
+    calResFree(dst);
+    calCtxDestroy(ctx);
+}
+
+void
+testAttribs()
+{
+    CALuint count = 0;
+    CAL_CHECK_OK(calDeviceGetCount(&count));
+    CAL_CHECK(count >= 1);
+
+    CALdeviceattribs attribs;
+    std::memset(&attribs, 0, sizeof(attribs));
+    attribs.struct_size = sizeof(attribs);
+    CAL_CHECK_OK(calDeviceGetAttribs(&attribs, 0));
+    CAL_CHECK(attribs.localRAM != 0);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testAttribs();
+    testCopy(device.dev());
+    std::printf("test_calsw passed\n");
+    return 0;
+}
@@ -0,0 +1,210 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_completion_service.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct CopyFixture
+{
+    CALcontext  ctx;
+    CALresource src;
+    CALresource dst;
+    CALmem      srcMem;
+    CALmem      dstMem;
+
+    explicit CopyFixture(CALdevice dev)
+    {
+        CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+        CAL_CHECK_OK(calResAllocLocal2D(&src, dev, 256, 256, CAL_FORMAT_FLOAT32_4, 0));
+        CAL_CHECK_OK(calResAllocLocal2D(&dst, dev, 256, 256, CAL_FORMAT_FLOAT32_4, 0));
+        CAL_CHECK_OK(calCtxGetMem(&srcMem, ctx, src));
+        CAL_CHECK_OK(calCtxGetMem(&dstMem, ctx, dst));
+    }
+
+    ~CopyFixture()
+    {
+        calCtxReleaseMem(ctx, srcMem);
+        calCtxReleaseMem(ctx, dstMem);
+        calResFree(src);
+        calResFree(dst);
+        calCtxDestroy(ctx);
+    }
+
+    CALevent copy()
+    {
+        CALevent event;
+        CAL_CHECK_OK(calMemCopy(&event, ctx, srcMem, dstMem, 0));
+        return event;
+    }
+};
+
+// What the callbacks saw, in dispatch order
+struct Record
+{
+    std::mutex                  lock;
+    std::vector<CALcontext>     contexts;
+    std::vector<CALevent>       events;
+    std::vector<std::thread::id> threads;
+    CALuint                     failures;
+
+    Record() : failures(0) {}
+
+    cal::EventCallback callback(CALcontext ctx)
+    {
+        return [this, ctx](CALevent event, CALresult result)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            contexts.push_back(ctx);
+            events.push_back(event);
+            threads.push_back(std::this_thread::get_id());
+            failures += (result != CAL_RESULT_OK) ? 1 : 0;
+        };
+    }
+};
+
+// Contexts of one device share its poller thread, every registration runs
+// once and detach waits for them
+void
+testNotify(CALdevice dev)
+{
+    const CALuint perContext = 8;
+    CopyFixture a(dev);
+    CopyFixture b(dev);
+    cal::CompletionService service;
+    CAL_CHECK_OK(service.attach(a.ctx, dev));
+    CAL_CHECK_OK(service.attach(b.ctx, dev));
+    CAL_CHECK_OK(service.attach(a.ctx, dev));
+
+    Record record;
+    std::vector<CALevent> issuedA;
+    std::vector<CALevent> issuedB;
+    for (CALuint i = 0; i < perContext; ++i)
+    {
+        issuedA.push_back(a.copy());
+        issuedB.push_back(b.copy());
+        CAL_CHECK_OK(service.notify(a.ctx, issuedA.back(), record.callback(a.ctx)));
+        CAL_CHECK_OK(service.notify(b.ctx, issuedB.back(), record.callback(b.ctx)));
+    }
+    calCtxFlush(a.ctx);
+    calCtxFlush(b.ctx);
+    CAL_CHECK_OK(service.detach(a.ctx));
+    CAL_CHECK_OK(service.detach(b.ctx));
+    CAL_CHECK(service.detach(a.ctx) == CAL_RESULT_BAD_HANDLE);
+
+    std::lock_guard<std::mutex> guard(record.lock);
+    CAL_CHECK(record.events.size() == 2 * perContext && record.failures == 0);
+    CAL_CHECK(service.dispatchCount() == 2 * perContext);
+    CAL_CHECK(service.sweepCount() > 0);
+
+    std::vector<CALevent> seenA;
+    std::vector<CALevent> seenB;
+    for (size_t i = 0; i < record.events.size(); ++i)
+    {
+        CAL_CHECK(record.threads[i] != std::this_thread::get_id());
+        CAL_CHECK(record.threads[i] == record.threads[0]);
+        ((record.contexts[i] == a.ctx) ? seenA : seenB).push_back(record.events[i]);
+    }
+    std::sort(seenA.begin(), seenA.end());
+    std::sort(seenB.begin(), seenB.end());
+    CAL_CHECK(seenA == issuedA && seenB == issuedB);
+}
+
+// A callback that registers the next one keeps its context attached until
+// the chain ends
+void
+testChain(CALdevice dev)
+{
+    const CALuint links = 5;
+    CopyFixture fixture(dev);
+    cal::CompletionService service;
+    CAL_CHECK_OK(service.attach(fixture.ctx, dev));
+
+    std::atomic<CALuint> ran(0);
+    std::function<void(CALevent, CALresult)> link = [&](CALevent, CALresult result)
+    {
+        CAL_CHECK_OK(result);
+        if (ran.fetch_add(1) + 1 < links)
+        {
+            CALevent next = fixture.copy();
+            calCtxFlush(fixture.ctx);
+            CAL_CHECK_OK(service.notify(fixture.ctx, next, link));
+        }
+    };
+    CALevent first = fixture.copy();
+    calCtxFlush(fixture.ctx);
+    CAL_CHECK_OK(service.notify(fixture.ctx, first, link));
+    CAL_CHECK_OK(service.detach(fixture.ctx));
+    CAL_CHECK(ran.load() == links);
+}
+
+void
+testErrors(CALdevice dev)
+{
+    CopyFixture fixture(dev);
+    cal::CompletionService service;
+    Record record;
+
+    CAL_CHECK(service.attach(0, dev) == CAL_RESULT_INVALID_PARAMETER);
+    CAL_CHECK(service.notify(fixture.ctx, 1, record.callback(fixture.ctx)) == CAL_RESULT_BAD_HANDLE);
+    CAL_CHECK(service.detach(fixture.ctx) == CAL_RESULT_BAD_HANDLE);
+
+    CAL_CHECK_OK(service.attach(fixture.ctx, dev));
+    CAL_CHECK(service.attach(fixture.ctx, dev + 1) == CAL_RESULT_INVALID_PARAMETER);
+    CAL_CHECK(service.notify(fixture.ctx, 0, record.callback(fixture.ctx)) == CAL_RESULT_INVALID_PARAMETER);
+    CAL_CHECK(service.notify(fixture.ctx, 1, cal::EventCallback()) == CAL_RESULT_INVALID_PARAMETER);
+
+    // shutdown() still runs what was registered, then refuses new work
+    service.setPollInterval(10);
+    CAL_CHECK_OK(service.notify(fixture.ctx, fixture.copy(), record.callback(fixture.ctx)));
+    service.shutdown();
+    {
+        std::lock_guard<std::mutex> guard(record.lock);
+        CAL_CHECK(record.events.size() == 1 && record.failures == 0);
+    }
+    CAL_CHECK(service.attach(fixture.ctx, dev) == CAL_RESULT_ERROR);
+    CAL_CHECK(service.notify(fixture.ctx, fixture.copy(), record.callback(fixture.ctx)) == CAL_RESULT_BAD_HANDLE);
+    calCtxFlush(fixture.ctx);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testNotify(device.dev());
+    testChain(device.dev());
+    testErrors(device.dev());
+    std::printf("test_completion_service passed\n");
+    return 0;
+}
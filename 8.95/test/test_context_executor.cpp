@@ -0,0 +1,182 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_context_executor.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void
+testCopy(const TestDevice& device)
+{
+    const CALuint width = 256;
+    CALdevice   dev = device.dev();
+    CALresource src, dst;
+    CAL_CHECK_OK(calResAllocRemote1D(&src, &dev, 1, width, CAL_FORMAT_FLOAT32_1, 0));
+    CAL_CHECK_OK(calResAllocLocal1D(&dst, dev, width, CAL_FORMAT_FLOAT32_1, 0));
+
+    CALvoid* ptr;
+    CALuint  pitch;
+    CAL_CHECK_OK(calResMap(&ptr, &pitch, src, 0));
+    for (CALuint i = 0; i < width; ++i)
+    {
+        static_cast<float*>(ptr)[i] = static_cast<float>(i);
+    }
+    CAL_CHECK_OK(calResUnmap(src));
+
+    cal::ContextExecutor executor;
+    CAL_CHECK_OK(executor.open(device.dev()));
+
+    CALmem srcMem = 0, dstMem = 0;
+    CAL_CHECK_OK(executor.invoke([&](CALcontext ctx) { return calCtxGetMem(&srcMem, ctx, src); }).wait());
+    CAL_CHECK_OK(executor.invoke([&](CALcontext ctx) { return calCtxGetMem(&dstMem, ctx, dst); }).wait());
+
+    cal::Completion copy = executor.memCopy(srcMem, dstMem);
+    CAL_CHECK_OK(copy.wait());
+    CAL_CHECK(copy.done() && copy.event() != 0);
+
+    CAL_CHECK_OK(calResMap(&ptr, &pitch, dst, 0));
+    CAL_CHECK(static_cast<float*>(ptr)[width - 1] == static_cast<float>(width - 1));
+    CAL_CHECK_OK(calResUnmap(dst));
+
+    CAL_CHECK_OK(executor.invoke([&](CALcontext ctx) {
+        calCtxReleaseMem(ctx, srcMem);
+        return calCtxReleaseMem(ctx, dstMem);
+    }).wait());
+    executor.close();
+
+    // Work queued after close fails instead of hanging
+    CAL_CHECK(executor.flush().wait() == CAL_RESULT_ERROR);
+
+    calResFree(src);
+    calResFree(dst);
+}
+
+// Producers on several threads; every item runs once and in producer order
+void
+testProducers(const TestDevice& device)
+{
+    cal::ContextExecutor executor;
+    CAL_CHECK_OK(executor.open(device.dev()));
+
+    const CALuint threads = 4;
+    const CALuint items   = 2000;
+    std::vector<CALuint> last(threads, 0);
+    std::atomic<CALuint> ran(0);
+    std::atomic<bool> outOfOrder(false);
+
+    std::vector<std::thread> producers;
+    for (CALuint t = 0; t < threads; ++t)
+    {
+        producers.push_back(std::thread([&, t] {
+            cal::Completion completion;
+            for (CALuint i = 1; i <= items; ++i)
+            {
+                completion = executor.invoke([&, t, i](CALcontext) {
+                    // Runs on the executor thread only, so last needs no lock
+                    if (last[t] + 1 != i)
+                    {
+                        outOfOrder = true;
+                    }
+                    last[t] = i;
+                    ++ran;
+                    return CAL_RESULT_OK;
+                });
+            }
+            CAL_CHECK_OK(completion.wait());
+        }));
+    }
+    for (size_t t = 0; t < producers.size(); ++t)
+    {
+        producers[t].join();
+    }
+    CAL_CHECK(ran == threads * items);
+    CAL_CHECK(!outOfOrder);
+
+    // Counted at the end of a batch, after its completions fired
+    executor.close();
+    CAL_CHECK(executor.workCount() >= threads * items);
+}
+
+// close() while producers enqueue: accepted work runs, the rest fails, none hangs
+void
+testCloseRace(const TestDevice& device)
+{
+    for (CALuint round = 0; round < 50; ++round)
+    {
+        cal::ContextExecutor executor;
+        CAL_CHECK_OK(executor.open(device.dev()));
+
+        const CALuint threads = 4;
+        std::atomic<CALuint> ran(0);
+        std::atomic<CALuint> succeeded(0);
+        std::atomic<bool> started(false);
+        std::vector<std::thread> producers;
+        for (CALuint t = 0; t < threads; ++t)
+        {
+            producers.push_back(std::thread([&] {
+                std::vector<cal::Completion> completions;
+                for (CALuint i = 0; i < 500; ++i)
+                {
+                    completions.push_back(executor.invoke([&](CALcontext) { ++ran; return CAL_RESULT_OK; }));
+                    started = true;
+                }
+                for (const cal::Completion& completion : completions)
+                {
+                    CALresult result = completion.wait();
+                    CAL_CHECK(result == CAL_RESULT_OK || result == CAL_RESULT_ERROR);
+                    succeeded += (result == CAL_RESULT_OK) ? 1 : 0;
+                }
+            }));
+        }
+        while (!started)
+        {
+            std::this_thread::yield();
+        }
+        executor.close();
+        for (size_t t = 0; t < producers.size(); ++t)
+        {
+            producers[t].join();
+        }
+        CAL_CHECK(ran == succeeded);
+    }
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testCopy(device);
+    testProducers(device);
+    testCloseRace(device);
+    std::printf("test_context_executor passed\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+
+#include "cal_test.h"
+#include "cal_error.h"
+
+#include <cstring>
+#include <dlfcn.h>
+
+namespace {
+
+// The driver keeps its own records; read them through its calErrorGetLast
+// rather than the copy linked into the test from calutil
+const CALerrorRecord*
+driverLast()
+{
+    typedef const CALerrorRecord* (CALAPIENTRY *GetLast)(void);
+    void* lib = dlopen("libaticaldd.so", RTLD_NOW | RTLD_NOLOAD);
+    CAL_CHECK(lib != 0);
+    GetLast getLast = reinterpret_cast<GetLast>(dlsym(lib, "calErrorGetLast"));
+    CAL_CHECK(getLast != 0);
+    dlclose(lib);
+    return getLast();
+}
+
+// calsw names the first handle that did not resolve, and the entry point
+void
+testOffendingHandle(const TestDevice& device)
+{
+    CALcontext  ctx;
+    CALresource res;
+    CALmem      mem;
+    CAL_CHECK_OK(calCtxCreate(&ctx, device.dev()));
+    CAL_CHECK_OK(calResAllocLocal1D(&res, device.dev(), 64, CAL_FORMAT_FLOAT32_1, 0));
+    CAL_CHECK_OK(calCtxGetMem(&mem, ctx, res));
+
+    CAL_CHECK(calCtxSetMem(ctx, 12345, mem) == CAL_RESULT_BAD_HANDLE);
+    const CALerrorRecord* last = driverLast();
+    CAL_CHECK(last->result == CAL_RESULT_BAD_HANDLE);
+    CAL_CHECK(last->api == CAL_API_CTX_SET_MEM);
+    CAL_CHECK(last->handle == 12345);
+
+    // Both memories are bad; the source comes first
+    CALevent event;
+    CAL_CHECK(calMemCopy(&event, ctx, 777, 888, 0) == CAL_RESULT_BAD_HANDLE);
+    CAL_CHECK(last->api == CAL_API_MEM_COPY);
+    CAL_CHECK(last->handle == 777);
+
+    // A bad context is named before the memory that cannot be looked up in it
+    CAL_CHECK(calMemCopy(&event, 999, 777, 888, 0) == CAL_RESULT_BAD_HANDLE);
+    CAL_CHECK(last->handle == 999);
+
+    calCtxReleaseMem(ctx, mem);
+    calResFree(res);
+    calCtxDestroy(ctx);
+}
+
+// Only records raised after the sequence passed in are amended
+void
+testAnnotate()
+{
+    calErrorSet(CAL_RESULT_ERROR, CAL_API_NONE, 0, "inner");
+    CALuint64 before = calErrorSequence();
+    const CALerrorRecord* last = calErrorGetLast();
+    CAL_CHECK(last->sequence == before);
+
+    // Same result, but raised before the call: a new record
+    calErrorAnnotate(before, CAL_RESULT_ERROR, CAL_API_RES_MAP, 5, "from runtime");
+    CAL_CHECK(last->sequence == before + 1);
+    CAL_CHECK(last->api == CAL_API_RES_MAP && last->handle == 5);
+    CAL_CHECK(std::strcmp(last->message, "from runtime") == 0);
+
+    // Raised during the call: amended, message kept
+    CALuint64 since = calErrorSequence();
+    calErrorSet(CAL_RESULT_INVALID_PARAMETER, CAL_API_NONE, 0, "inner %d", 2);
+    calErrorAnnotate(since, CAL_RESULT_INVALID_PARAMETER, CAL_API_RES_UNMAP, 6, "ignored");
+    CAL_CHECK(last->sequence == since + 1);
+    CAL_CHECK(last->api == CAL_API_RES_UNMAP && last->handle == 6);
+    CAL_CHECK(std::strcmp(last->message, "inner 2") == 0);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testOffendingHandle(device);
+    testAnnotate();
+    std::printf("test_error passed\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_event_waiter.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct CopyFixture
+{
+    CALcontext  ctx;
+    CALresource src;
+    CALresource dst;
+    CALmem      srcMem;
+    CALmem      dstMem;
+
+    explicit CopyFixture(CALdevice dev, CALuint size = 512)
+    {
+        CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+        CAL_CHECK_OK(calResAllocLocal2D(&src, dev, size, size, CAL_FORMAT_FLOAT32_4, 0));
+        CAL_CHECK_OK(calResAllocLocal2D(&dst, dev, size, size, CAL_FORMAT_FLOAT32_4, 0));
+        CAL_CHECK_OK(calCtxGetMem(&srcMem, ctx, src));
+        CAL_CHECK_OK(calCtxGetMem(&dstMem, ctx, dst));
+    }
+
+    ~CopyFixture()
+    {
+        calCtxReleaseMem(ctx, srcMem);
+        calCtxReleaseMem(ctx, dstMem);
+        calResFree(src);
+        calResFree(dst);
+        calCtxDestroy(ctx);
+    }
+
+    CALevent copy(cal::EventWaiter& waiter)
+    {
+        CALevent event;
+        CAL_CHECK_OK(calMemCopy(&event, ctx, srcMem, dstMem, 0));
+        waiter.submitted(event, 0);
+        return event;
+    }
+};
+
+void
+testWait(CopyFixture& fixture)
+{
+    cal::EventWaiter waiter(fixture.ctx);
+    for (CALuint round = 0; round < 8; ++round)
+    {
+        CALevent event = fixture.copy(waiter);
+        calCtxFlush(fixture.ctx);
+        CAL_CHECK_OK(waiter.wait(event));
+        CAL_CHECK(calCtxIsEventDone(fixture.ctx, event) == CAL_RESULT_OK);
+    }
+    // Copies share one estimate once one was seen pending; a wait that
+    // found its copy already done learns nothing
+    CAL_CHECK(waiter.blocks() + waiter.spinHits() == 0 || waiter.estimate(0) > 0);
+}
+
+void
+testWaitAllAny(CopyFixture& fixture)
+{
+    cal::EventWaiter waiter(fixture.ctx);
+    std::vector<CALevent> events;
+    for (CALuint i = 0; i < 6; ++i)
+    {
+        events.push_back(fixture.copy(waiter));
+    }
+    calCtxFlush(fixture.ctx);
+
+    CALuint index = ~0u;
+    CAL_CHECK_OK(waiter.waitAny(&events[0], static_cast<CALuint>(events.size()), &index));
+    CAL_CHECK(index < events.size());
+    CAL_CHECK(calCtxIsEventDone(fixture.ctx, events[index]) == CAL_RESULT_OK);
+
+    CAL_CHECK_OK(waiter.waitAll(&events[0], static_cast<CALuint>(events.size())));
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        CAL_CHECK(calCtxIsEventDone(fixture.ctx, events[i]) == CAL_RESULT_OK);
+    }
+
+    // Without spinning waitAny polls the whole list while it sleeps
+    waiter.setSpinLimit(0);
+    events.clear();
+    for (CALuint i = 0; i < 6; ++i)
+    {
+        events.push_back(fixture.copy(waiter));
+    }
+    calCtxFlush(fixture.ctx);
+    index = ~0u;
+    CAL_CHECK_OK(waiter.waitAny(&events[0], static_cast<CALuint>(events.size()), &index));
+    CAL_CHECK(index < events.size());
+    CAL_CHECK(calCtxIsEventDone(fixture.ctx, events[index]) == CAL_RESULT_OK);
+    CAL_CHECK_OK(waiter.waitAll(&events[0], static_cast<CALuint>(events.size())));
+
+    CAL_CHECK(waiter.waitAny(0, 1, &index) == CAL_RESULT_INVALID_PARAMETER);
+    CAL_CHECK(waiter.waitAny(&events[0], 0, &index) == CAL_RESULT_INVALID_PARAMETER);
+}
+
+// Waits that come long after the work finished must not teach the waiter
+// to stop spinning
+void
+testLateWaits(CALdevice dev)
+{
+    CopyFixture fixture(dev, 8);
+    cal::EventWaiter waiter(fixture.ctx);
+    waiter.setSpinLimit(200000);
+
+    for (CALuint round = 0; round < 8; ++round)
+    {
+        CALevent event = fixture.copy(waiter);
+        calCtxFlush(fixture.ctx);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        CAL_CHECK_OK(waiter.wait(event));
+    }
+    CAL_CHECK(waiter.estimate(0) < waiter.spinLimit());
+
+    // Prompt waits that find the copy pending still spin before they block
+    for (CALuint round = 0; round < 16; ++round)
+    {
+        CALevent event = fixture.copy(waiter);
+        calCtxFlush(fixture.ctx);
+        CAL_CHECK_OK(waiter.wait(event));
+    }
+    CAL_CHECK(waiter.blocks() == 0 || waiter.spinTime() > 0);
+    CAL_CHECK(waiter.estimate(0) < waiter.spinLimit());
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    CopyFixture fixture(device.dev());
+    testWait(fixture);
+    testWaitAllAny(fixture);
+    testLateWaits(device.dev());
+    std::printf("test_event_waiter passed\n");
+    return 0;
+}
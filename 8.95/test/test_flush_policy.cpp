@@ -0,0 +1,205 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_flush_policy.h"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+struct CopyFixture
+{
+    CALcontext  ctx;
+    CALresource src;
+    CALresource dst;
+    CALmem      srcMem;
+    CALmem      dstMem;
+
+    explicit CopyFixture(CALdevice dev)
+    {
+        CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+        CAL_CHECK_OK(calResAllocLocal1D(&src, dev, 256, CAL_FORMAT_FLOAT32_1, 0));
+        CAL_CHECK_OK(calResAllocLocal1D(&dst, dev, 256, CAL_FORMAT_FLOAT32_1, 0));
+        CAL_CHECK_OK(calCtxGetMem(&srcMem, ctx, src));
+        CAL_CHECK_OK(calCtxGetMem(&dstMem, ctx, dst));
+    }
+
+    ~CopyFixture()
+    {
+        calCtxReleaseMem(ctx, srcMem);
+        calCtxReleaseMem(ctx, dstMem);
+        calResFree(src);
+        calResFree(dst);
+        calCtxDestroy(ctx);
+    }
+
+    CALevent copy(cal::FlushPolicy& policy)
+    {
+        CALevent event;
+        CAL_CHECK_OK(calMemCopy(&event, ctx, srcMem, dstMem, 0));
+        CAL_CHECK_OK(policy.submitted(event));
+        return event;
+    }
+};
+
+cal::FlushPolicyParams
+onlyParams(CALuint maxCommands, CALuint maxDelayUs, CALuint idleUs, bool flushOnWait)
+{
+    cal::FlushPolicyParams params;
+    params.maxCommands = maxCommands;
+    params.maxDelayUs  = maxDelayUs;
+    params.idleUs      = idleUs;
+    params.flushOnWait = flushOnWait;
+    return params;
+}
+
+void
+testCommandTrigger(CopyFixture& fixture)
+{
+    cal::FlushPolicy policy(fixture.ctx, onlyParams(4, 0, 0, false));
+    CALevent last = 0;
+    for (CALuint i = 0; i < 4; ++i)
+    {
+        last = fixture.copy(policy);
+    }
+    cal::FlushStats stats = policy.stats();
+    CAL_CHECK(stats.flushes == 1 && stats.byReason[cal::FlushCommands] == 1);
+    CAL_CHECK(stats.commands == 4);
+    CAL_CHECK_OK(testWait(fixture.ctx, last));
+
+    for (CALuint i = 0; i < 3; ++i)
+    {
+        last = fixture.copy(policy);
+    }
+    CAL_CHECK(policy.stats().flushes == 1);
+    CAL_CHECK_OK(policy.flush());
+    CAL_CHECK_OK(policy.flush());
+    stats = policy.stats();
+    CAL_CHECK(stats.flushes == 2 && stats.byReason[cal::FlushExplicit] == 1);
+    CAL_CHECK_OK(testWait(fixture.ctx, last));
+}
+
+// Waiting on a queued event flushes once; polling it again does not
+void
+testWaitTrigger(CopyFixture& fixture)
+{
+    cal::FlushPolicy policy(fixture.ctx, onlyParams(0, 0, 0, true));
+    CALevent event = fixture.copy(policy);
+    CALresult result;
+    while ((result = policy.isEventDone(event)) == CAL_RESULT_PENDING)
+    {
+    }
+    CAL_CHECK_OK(result);
+    cal::FlushStats stats = policy.stats();
+    CAL_CHECK(stats.flushes == 1 && stats.byReason[cal::FlushWait] == 1);
+
+    // Without flushOnWait the wait leaves the queue alone
+    policy.setParams(onlyParams(0, 0, 0, false));
+    event = fixture.copy(policy);
+    CAL_CHECK_OK(policy.aboutToWait(event));
+    CAL_CHECK(policy.stats().flushes == 1);
+    CAL_CHECK_OK(policy.flush());
+    CAL_CHECK_OK(testWait(fixture.ctx, event));
+}
+
+void
+testTimeTriggers(CopyFixture& fixture)
+{
+    cal::FlushPolicy delay(fixture.ctx, onlyParams(0, 1000, 0, false));
+    CALevent event = fixture.copy(delay);
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    CAL_CHECK_OK(delay.poll());
+    cal::FlushStats stats = delay.stats();
+    CAL_CHECK(stats.flushes == 1 && stats.byReason[cal::FlushDelay] == 1);
+    CAL_CHECK_OK(delay.poll());
+    CAL_CHECK(delay.stats().flushes == 1);
+    CAL_CHECK_OK(testWait(fixture.ctx, event));
+
+    cal::FlushPolicy idle(fixture.ctx, onlyParams(0, 0, 1000, false));
+    event = fixture.copy(idle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    CAL_CHECK_OK(idle.poll());
+    stats = idle.stats();
+    CAL_CHECK(stats.flushes == 1 && stats.byReason[cal::FlushIdle] == 1);
+    CAL_CHECK_OK(testWait(fixture.ctx, event));
+}
+
+// The timer thread applies the delay trigger without being polled
+void
+testTimer(CopyFixture& fixture)
+{
+    cal::FlushPolicy policy(fixture.ctx, onlyParams(0, 1000, 0, false));
+    policy.startTimer();
+    CALevent event = fixture.copy(policy);
+    for (CALuint i = 0; i < 2000 && policy.stats().flushes == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    policy.stopTimer();
+    cal::FlushStats stats = policy.stats();
+    CAL_CHECK(stats.flushes == 1 && stats.byReason[cal::FlushDelay] == 1);
+    CAL_CHECK_OK(testWait(fixture.ctx, event));
+}
+
+// Switching contexts drops the queue of the old one, and waits check
+// events on the new one
+void
+testSetContext(CALdevice dev, CopyFixture& fixture)
+{
+    CopyFixture other(dev);
+    cal::FlushPolicy policy(fixture.ctx, onlyParams(0, 0, 0, true));
+    CALevent event = fixture.copy(policy);
+    policy.setContext(other.ctx);
+    CAL_CHECK(policy.context() == other.ctx);
+    CAL_CHECK_OK(policy.flush());
+    CAL_CHECK(policy.stats().flushes == 0);
+    CAL_CHECK_OK(testWait(fixture.ctx, event));
+
+    event = other.copy(policy);
+    CALresult result;
+    while ((result = policy.isEventDone(event)) == CAL_RESULT_PENDING)
+    {
+    }
+    CAL_CHECK_OK(result);
+    CAL_CHECK(policy.stats().byReason[cal::FlushWait] == 1);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    CopyFixture fixture(device.dev());
+    testCommandTrigger(fixture);
+    testWaitTrigger(fixture);
+    testTimeTriggers(fixture);
+    testTimer(fixture);
+    testSetContext(device.dev(), fixture);
+    std::printf("test_flush_policy passed\n");
+    return 0;
+}
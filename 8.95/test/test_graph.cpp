@@ -0,0 +1,214 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_graph.h"
+
+#include <vector>
+
+namespace {
+
+const CALuint Width  = 64;
+const CALuint Height = 64;
+
+struct Surfaces
+{
+    std::vector<CALresource> res;
+
+    Surfaces(CALdevice dev, CALuint count) : res(count, 0)
+    {
+        for (CALuint i = 0; i < count; ++i)
+        {
+            CAL_CHECK_OK(calResAllocLocal2D(&res[i], dev, Width, Height, CAL_FORMAT_FLOAT32_1, 0));
+        }
+    }
+
+    ~Surfaces()
+    {
+        for (size_t i = 0; i < res.size(); ++i)
+        {
+            calResFree(res[i]);
+        }
+    }
+};
+
+// Host map that fills the surface with value + x
+std::function<void(CALvoid*, CALuint)>
+fill(float value)
+{
+    return [value](CALvoid* ptr, CALuint pitch)
+    {
+        for (CALuint y = 0; y < Height; ++y)
+        {
+            float* row = static_cast<float*>(ptr) + y * pitch;
+            for (CALuint x = 0; x < Width; ++x)
+            {
+                row[x] = value + x;
+            }
+        }
+    };
+}
+
+// Host map that reports whether the surface holds value + x
+std::function<void(CALvoid*, CALuint)>
+expect(float value, bool& matched)
+{
+    return [value, &matched](CALvoid* ptr, CALuint pitch)
+    {
+        matched = true;
+        for (CALuint y = 0; y < Height; ++y)
+        {
+            const float* row = static_cast<const float*>(ptr) + y * pitch;
+            for (CALuint x = 0; x < Width; ++x)
+            {
+                matched = matched && (row[x] == value + x);
+            }
+        }
+    };
+}
+
+// A chain follows a predecessor in flight onto its context; only one that
+// already completed lets its successor move to the other context. Every
+// wave flushes each context it touched once
+void
+testChain(CALdevice dev)
+{
+    Surfaces s(dev, 3);
+    cal::GraphExecutor executor;
+    CAL_CHECK_OK(executor.open(dev, 2));
+
+    bool matched = false;
+    cal::Graph graph;
+    graph.map(s.res[0], cal::GraphWrite, fill(3.0f));
+    graph.copy(s.res[0], s.res[1]);
+    graph.copy(s.res[1], s.res[2]);
+    graph.map(s.res[2], cal::GraphRead, expect(3.0f, matched));
+    CAL_CHECK(graph.size() == 4);
+
+    CAL_CHECK_OK(executor.run(graph));
+    CAL_CHECK(matched);
+    CAL_CHECK(executor.crossWaitCount() <= 1);
+    CAL_CHECK(executor.waveCount() >= 1);
+    CAL_CHECK(executor.flushCount() >= executor.waveCount());
+    CAL_CHECK(executor.flushCount() <= executor.waveCount() * executor.contextCount());
+
+    // The executor keeps its CALmem across runs
+    matched = false;
+    CAL_CHECK_OK(executor.run(graph));
+    CAL_CHECK(matched);
+    executor.close();
+}
+
+// Independent copies spread over both contexts in one wave; a copy that
+// joins them depends on an event of the other context
+void
+testCrossContext(CALdevice dev)
+{
+    Surfaces s(dev, 4);
+    cal::GraphExecutor executor;
+    CAL_CHECK_OK(executor.open(dev, 2));
+
+    bool matched = false;
+    cal::Graph graph;
+    graph.map(s.res[0], cal::GraphWrite, fill(1.0f));
+    graph.map(s.res[2], cal::GraphWrite, fill(100.0f));
+    graph.copy(s.res[0], s.res[1]);
+    graph.copy(s.res[2], s.res[3]);
+    graph.copy(s.res[1], s.res[3]);     // after both: reads 1, writes 3
+    graph.map(s.res[3], cal::GraphRead, expect(1.0f, matched));
+
+    CAL_CHECK_OK(executor.run(graph));
+    CAL_CHECK(matched);
+    CAL_CHECK(executor.crossWaitCount() == 1);
+    CAL_CHECK(executor.flushCount() >= 2);
+    CAL_CHECK(executor.flushCount() <= executor.waveCount() * executor.contextCount());
+    executor.close();
+}
+
+// An explicit edge makes a host map of an unrelated resource wait for a
+// copy; edges to later nodes are ignored
+void
+testDepend(CALdevice dev)
+{
+    Surfaces s(dev, 3);
+    CALvoid* ptr;
+    CALuint  pitch;
+    CAL_CHECK_OK(calResMap(&ptr, &pitch, s.res[0], 0));
+    fill(7.0f)(ptr, pitch);
+    CAL_CHECK_OK(calResUnmap(s.res[0]));
+
+    cal::GraphExecutor executor;
+    CAL_CHECK_OK(executor.open(dev, 1));
+
+    bool matched = false;
+    cal::Graph graph;
+    cal::Graph::NodeId copy  = graph.copy(s.res[0], s.res[1]);
+    cal::Graph::NodeId check = graph.map(s.res[2], cal::GraphRead, [&](CALvoid*, CALuint)
+    {
+        CALvoid* copied;
+        CALuint  copiedPitch;
+        CAL_CHECK_OK(calResMap(&copied, &copiedPitch, s.res[1], 0));
+        expect(7.0f, matched)(copied, copiedPitch);
+        CAL_CHECK_OK(calResUnmap(s.res[1]));
+    });
+    graph.depend(check, copy);
+    graph.depend(copy, check);
+    CAL_CHECK_OK(executor.run(graph));
+    CAL_CHECK(matched);
+    executor.close();
+}
+
+// A failed node fails its dependents without running them
+void
+testFailure(CALdevice dev)
+{
+    Surfaces s(dev, 1);
+    cal::GraphExecutor executor;
+    CAL_CHECK(executor.run(cal::Graph()) == CAL_RESULT_ERROR);
+    CAL_CHECK(executor.open(dev, 0) == CAL_RESULT_INVALID_PARAMETER);
+    CAL_CHECK_OK(executor.open(dev, 2));
+
+    bool ran = false;
+    cal::Graph graph;
+    graph.copy(static_cast<CALresource>(12345), s.res[0]);
+    graph.map(s.res[0], cal::GraphRead, [&ran](CALvoid*, CALuint) { ran = true; });
+    CAL_CHECK(executor.run(graph) == CAL_RESULT_BAD_HANDLE);
+    CAL_CHECK(!ran);
+    executor.close();
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testChain(device.dev());
+    testCrossContext(device.dev());
+    testDepend(device.dev());
+    testFailure(device.dev());
+    std::printf("test_graph passed\n");
+    return 0;
+}
@@ -0,0 +1,172 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_handle_table.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef cal::HandleTable<CALuint64> Table;
+
+void
+testAddGetRemove()
+{
+    Table table;
+    CALuint h1 = table.add(11);
+    CALuint h2 = table.add(22);
+    CAL_CHECK(h1 != 0 && h2 != 0 && h1 != h2);
+
+    CALuint64 value = 0;
+    CAL_CHECK_OK(table.get(h1, value));
+    CAL_CHECK(value == 11);
+    CAL_CHECK(table.find(h2) == 22);
+    CAL_CHECK(table.get(0, value) == CAL_RESULT_BAD_HANDLE);
+
+    CAL_CHECK_OK(table.remove(h1, &value));
+    CAL_CHECK(value == 11);
+    CAL_CHECK(table.remove(h1) == CAL_RESULT_BAD_HANDLE);
+    CAL_CHECK(table.get(h1, value) == CAL_RESULT_BAD_HANDLE);
+
+    // The slot is reused under a new generation; the old handle stays stale
+    CALuint h3 = table.add(33);
+    CAL_CHECK(h3 != h1);
+    CAL_CHECK(table.get(h1, value) == CAL_RESULT_BAD_HANDLE);
+    CAL_CHECK(table.find(h3) == 33);
+    CAL_CHECK(table.handles().size() == 2);
+
+    table.clear();
+    CAL_CHECK(table.handles().empty());
+}
+
+// Threads add, look up and remove their own handles while readers probe
+// everyone's; every lookup must see the right value or BAD_HANDLE. Fewer
+// adds than generations in total, so no stale handle can match again
+// after its generation wrapped.
+void
+testConcurrent()
+{
+    Table table;
+    const CALuint threads = 4;
+    const CALuint rounds  = 1000;
+    std::atomic<CALuint> shared[threads];
+    std::atomic<bool> wrong(false);
+    for (CALuint t = 0; t < threads; ++t)
+    {
+        shared[t].store(0);
+    }
+
+    std::vector<std::thread> workers;
+    for (CALuint t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&, t] {
+            for (CALuint i = 0; i < rounds; ++i)
+            {
+                CALuint64 mine = (static_cast<CALuint64>(t) << 32) | i;
+                CALuint handle = table.add(mine);
+                if (handle == 0)
+                {
+                    wrong = true;
+                    return;
+                }
+                shared[t].store(handle);
+
+                CALuint64 value;
+                CALuint other = shared[(t + 1) % threads].load();
+                if (table.get(other, value) == CAL_RESULT_OK && (value >> 32) != (t + 1) % threads)
+                {
+                    wrong = true;
+                }
+                if (table.get(handle, value) != CAL_RESULT_OK || value != mine ||
+                    table.remove(handle) != CAL_RESULT_OK)
+                {
+                    wrong = true;
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+    {
+        workers[t].join();
+    }
+    CAL_CHECK(!wrong);
+    CAL_CHECK(table.handles().empty());
+}
+
+// Threads fill a fresh table across several slabs at once; every slot is
+// handed out exactly once
+void
+testConcurrentFill()
+{
+    typedef cal::HandleTable<CALuint64, CALuint, 12> SmallTable;
+    SmallTable table;
+    const CALuint threads = 4;
+    const CALuint each    = SmallTable::Capacity / threads;
+    std::vector<std::vector<CALuint> > handles(threads);
+
+    std::vector<std::thread> workers;
+    for (CALuint t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&, t] {
+            for (CALuint i = 0; i < each; ++i)
+            {
+                handles[t].push_back(table.add((static_cast<CALuint64>(t) << 32) | i));
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+    {
+        workers[t].join();
+    }
+
+    std::vector<bool> seen(SmallTable::Capacity, false);
+    for (CALuint t = 0; t < threads; ++t)
+    {
+        for (CALuint i = 0; i < each; ++i)
+        {
+            CALuint handle = handles[t][i];
+            CAL_CHECK(handle != 0);
+            CAL_CHECK(!seen[handle & (SmallTable::Capacity - 1)]);
+            seen[handle & (SmallTable::Capacity - 1)] = true;
+            CAL_CHECK(table.find(handle) == ((static_cast<CALuint64>(t) << 32) | i));
+        }
+    }
+    CAL_CHECK(table.add(0) == 0);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    testAddGetRemove();
+    testConcurrent();
+    testConcurrentFill();
+    std::printf("test_handle_table passed\n");
+    return 0;
+}
@@ -0,0 +1,140 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_heap_allocator.h"
+
+#include <vector>
+
+namespace {
+
+const CALuint64 HeapBytes = 1 << 20;
+const CALuint   Block     = 256;        // calsw surface alignment, the smallest block
+
+void
+testSplitMerge(CALdevice dev)
+{
+    cal::HeapAllocator heap;
+    CAL_CHECK_OK(heap.open(dev, 0, HeapBytes));
+    CAL_CHECK(heap.heap() != 0);
+    cal::HeapAllocatorStats stats = heap.stats();
+    CAL_CHECK(stats.heapBytes == HeapBytes && stats.largestFree == HeapBytes);
+
+    // Splitting the heap down to the smallest block leaves one free block
+    // of every larger order
+    cal::HeapBuffer a;
+    cal::HeapBuffer b;
+    cal::HeapBuffer c;
+    CAL_CHECK_OK(heap.alloc(a, CAL_FORMAT_FLOAT32_1, 64));
+    CAL_CHECK_OK(heap.alloc(b, CAL_FORMAT_FLOAT32_1, 64));
+    CAL_CHECK_OK(heap.alloc(c, CAL_FORMAT_FLOAT32_1, 100));
+    CAL_CHECK(a.offset() == 0 && a.capacity() == Block);
+    CAL_CHECK(b.offset() == Block && b.capacity() == Block);
+    CAL_CHECK(c.offset() == 2 * Block && c.capacity() == 2 * Block && c.width() == 128);
+    stats = heap.stats();
+    CAL_CHECK(stats.usedBytes == 4 * Block && stats.requestedBytes == 4 * Block);
+    CAL_CHECK(stats.largestFree == HeapBytes / 2 && stats.liveViews == 3);
+
+    // Freeing b alone cannot merge past its buddy a; freeing a then merges
+    // both into the block a new 512 byte view takes
+    b.reset();
+    cal::HeapBuffer d;
+    CAL_CHECK_OK(heap.alloc(d, CAL_FORMAT_FLOAT32_1, 128));
+    CAL_CHECK(d.offset() == 4 * Block);
+    d.reset();
+    a.reset();
+    CAL_CHECK_OK(heap.alloc(d, CAL_FORMAT_FLOAT32_1, 128));
+    CAL_CHECK(d.offset() == 0);
+
+    d.reset();
+    c.reset();
+    stats = heap.stats();
+    CAL_CHECK(stats.usedBytes == 0 && stats.requestedBytes == 0 && stats.liveViews == 0);
+    CAL_CHECK(stats.largestFree == HeapBytes && stats.peakBytes == 5 * Block);
+}
+
+// Views of neighbouring blocks hold their own data
+void
+testViews(CALdevice dev)
+{
+    cal::HeapAllocator heap;
+    CAL_CHECK_OK(heap.open(dev, 0, HeapBytes));
+    std::vector<cal::HeapBuffer> views(4);
+    for (size_t i = 0; i < views.size(); ++i)
+    {
+        CAL_CHECK_OK(heap.alloc(views[i], CAL_FORMAT_UNSIGNED_INT32_1, 64));
+        CALuint* data;
+        CALuint  pitch;
+        CAL_CHECK_OK(calResMap(reinterpret_cast<CALvoid**>(&data), &pitch, views[i].get(), 0));
+        for (CALuint x = 0; x < 64; ++x)
+        {
+            data[x] = static_cast<CALuint>(i * 1000 + x);
+        }
+        CAL_CHECK_OK(calResUnmap(views[i].get()));
+    }
+    for (size_t i = 0; i < views.size(); ++i)
+    {
+        CALuint* data;
+        CALuint  pitch;
+        CAL_CHECK_OK(calResMap(reinterpret_cast<CALvoid**>(&data), &pitch, views[i].get(), 0));
+        CAL_CHECK(data[0] == i * 1000 && data[63] == i * 1000 + 63);
+        CAL_CHECK_OK(calResUnmap(views[i].get()));
+    }
+}
+
+void
+testExhaustion(CALdevice dev)
+{
+    cal::HeapAllocator heap;
+    cal::HeapBuffer unopened;
+    CAL_CHECK(heap.alloc(unopened, CAL_FORMAT_FLOAT32_1, 64) == CAL_RESULT_INVALID_PARAMETER);
+    CAL_CHECK_OK(heap.open(dev, 0, HeapBytes));
+
+    cal::HeapBuffer all;
+    CAL_CHECK_OK(heap.alloc(all, CAL_FORMAT_FLOAT32_1, static_cast<CALuint>(HeapBytes / 4)));
+    CAL_CHECK(all.capacity() == HeapBytes && heap.stats().largestFree == 0);
+
+    cal::HeapBuffer more;
+    CAL_CHECK(heap.alloc(more, CAL_FORMAT_FLOAT32_1, 64) == CAL_RESULT_ERROR);
+    CAL_CHECK(!more && heap.stats().failures == 1);
+    CAL_CHECK(heap.alloc(more, CAL_FORMAT_FLOAT32_1, 0) == CAL_RESULT_INVALID_PARAMETER);
+
+    all.reset();
+    CAL_CHECK_OK(heap.alloc(more, CAL_FORMAT_FLOAT32_1, 64));
+    CAL_CHECK(more.offset() == 0);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testSplitMerge(device.dev());
+    testViews(device.dev());
+    testExhaustion(device.dev());
+    std::printf("test_heap_allocator passed\n");
+    return 0;
+}
@@ -0,0 +1,248 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_mem_usage.h"
+#include "calcl.h"
+#include "calsw.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const CALuint Width = 64;
+
+// Declares i0, i1, uav0 and cb0; the kernel only reads the first two and
+// writes the third
+const CALchar* const Source =
+    "il_cs_2_0\n"
+    "; @calsw kernel mem_usage_add\n"
+    "dcl_num_thread_per_group 64\n"
+    "dcl_resource_id(0)_type(2d,unnorm)_fmtx(uint)_fmty(uint)_fmtz(uint)_fmtw(uint)\n"
+    "dcl_resource_id(1)_type(2d,unnorm)_fmtx(uint)_fmty(uint)_fmtz(uint)_fmtw(uint)\n"
+    "dcl_uav_id(0)_type(2d)_fmtx(uint)\n"
+    "dcl_cb cb0[1]\n"
+    "end\n";
+
+CALvoid
+addKernel(const CALswDispatch* dispatch, CALvoid* userData)
+{
+    (void)userData;
+    const CALswBinding* a   = calswFindBinding(dispatch, "i0");
+    const CALswBinding* b   = calswFindBinding(dispatch, "i1");
+    const CALswBinding* out = calswFindBinding(dispatch, "uav0");
+    for (CALuint x = 0; x < out->width; ++x)
+    {
+        static_cast<CALuint*>(out->data)[x] = static_cast<const CALuint*>(a->data)[x] + static_cast<const CALuint*>(b->data)[x];
+    }
+}
+
+struct Buffer
+{
+    CALresource res;
+    CALmem      mem;
+    CALcontext  ctx;
+
+    Buffer(CALdevice dev, CALcontext context, CALuint value) : ctx(context)
+    {
+        CAL_CHECK_OK(calResAllocLocal2D(&res, dev, Width, 1, CAL_FORMAT_UNSIGNED_INT32_1, 0));
+        CAL_CHECK_OK(calCtxGetMem(&mem, ctx, res));
+        fill(value);
+    }
+
+    ~Buffer()
+    {
+        calCtxReleaseMem(ctx, mem);
+        calResFree(res);
+    }
+
+    void fill(CALuint value)
+    {
+        CALuint* data;
+        CALuint  pitch;
+        CAL_CHECK_OK(calResMap(reinterpret_cast<CALvoid**>(&data), &pitch, res, 0));
+        std::fill(data, data + Width, value);
+        CAL_CHECK_OK(calResUnmap(res));
+    }
+
+    CALuint first()
+    {
+        CALuint* data;
+        CALuint  pitch;
+        CAL_CHECK_OK(calResMap(reinterpret_cast<CALvoid**>(&data), &pitch, res, 0));
+        CALuint value = data[0];
+        CAL_CHECK_OK(calResUnmap(res));
+        return value;
+    }
+};
+
+struct ModuleFixture
+{
+    CALcontext  ctx;
+    CALimage    image;
+    CALmodule   module;
+    CALfunc     func;
+
+    explicit ModuleFixture(CALdevice dev)
+    {
+        CALdeviceattribs attribs;
+        attribs.struct_size = sizeof(attribs);
+        CAL_CHECK_OK(calDeviceGetAttribs(&attribs, 0));
+        CALobject obj;
+        CAL_CHECK_OK(calclCompile(&obj, CAL_LANGUAGE_IL, Source, attribs.target));
+        CAL_CHECK_OK(calclLink(&image, &obj, 1));
+        calclFreeObject(obj);
+
+        CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+        CAL_CHECK_OK(calModuleLoad(&module, ctx, image));
+        CAL_CHECK_OK(calModuleGetEntry(&func, ctx, module, "main"));
+    }
+
+    ~ModuleFixture()
+    {
+        calModuleUnload(ctx, module);
+        calclFreeImage(image);
+        calCtxDestroy(ctx);
+    }
+
+    CALname name(const CALchar* variable)
+    {
+        CALname n;
+        CAL_CHECK_OK(calModuleGetName(&n, ctx, module, variable));
+        return n;
+    }
+
+    CALprogramGridExtended grid()
+    {
+        CALprogramGridExtended g = {};
+        g.programGrid.func             = func;
+        g.programGrid.gridBlock.width  = Width;
+        g.programGrid.gridBlock.height = 1;
+        g.programGrid.gridBlock.depth  = 1;
+        g.programGrid.gridSize.width   = 1;
+        g.programGrid.gridSize.height  = 1;
+        g.programGrid.gridSize.depth   = 1;
+        return g;
+    }
+
+    void run(CALprogramGridExtended& g)
+    {
+        CALevent event;
+        CAL_CHECK_OK(calExtTableGet()->ctxRunProgramGrid(&event, ctx, &g.programGrid));
+        testWait(ctx, event);
+    }
+};
+
+bool
+lists(const CALmemusage* usage, CALmem mem)
+{
+    return std::find(usage->mem, usage->mem + usage->memCount, mem) != usage->mem + usage->memCount;
+}
+
+// The tracker finds exactly the names the IL declares
+void
+testNames(ModuleFixture& fixture)
+{
+    cal::MemUsageTracker tracker(fixture.ctx);
+    const std::vector<CALname>* names = 0;
+    CAL_CHECK_OK(tracker.names(fixture.module, &names));
+    CAL_CHECK(names && names->size() == 4);
+    const CALchar* const declared[] = { "i0", "i1", "uav0", "cb0" };
+    for (CALuint i = 0; i < 4; ++i)
+    {
+        CAL_CHECK(std::count(names->begin(), names->end(), fixture.name(declared[i])) == 1);
+    }
+    CAL_CHECK(tracker.names(fixture.module + 1000, &names) == CAL_RESULT_BAD_HANDLE);
+}
+
+// memUsage lists each bound buffer once, skips unbound names and never
+// names buffers the module cannot see; the dispatch accepts the list.
+// calsw only dispatches with every variable bound, so cb0 gets a buffer
+// the kernel does not read.
+void
+testPrepare(CALdevice dev, ModuleFixture& fixture)
+{
+    cal::MemUsageTracker tracker(fixture.ctx);
+    Buffer a(dev, fixture.ctx, 3);
+    Buffer b(dev, fixture.ctx, 4);
+    Buffer out(dev, fixture.ctx, 0);
+    Buffer constants(dev, fixture.ctx, 0);
+    Buffer unused(dev, fixture.ctx, 0);
+    CAL_CHECK_OK(tracker.setMem(fixture.name("cb0"), constants.mem));
+
+    // One buffer behind two names is paged in once
+    CAL_CHECK_OK(tracker.setMem(fixture.name("i0"), a.mem));
+    CAL_CHECK_OK(tracker.setMem(fixture.name("i1"), a.mem));
+    CAL_CHECK_OK(tracker.setMem(fixture.name("uav0"), out.mem));
+    CALprogramGridExtended grid = fixture.grid();
+    CAL_CHECK_OK(tracker.prepare(grid, fixture.module));
+    CAL_CHECK(grid.struct_size == sizeof(grid));
+    CAL_CHECK(grid.programGrid.flags & CAL_RUNPROGRAMGRID_EXTENDED_STRUCTURE);
+    CAL_CHECK(grid.extendedFlags & CAL_RUNPROGRAMGRID_EXTENDED_MEMORY_USAGE);
+    CAL_CHECK(grid.memUsage && grid.memUsage->memCount == 3);
+    CAL_CHECK(lists(grid.memUsage, a.mem) && lists(grid.memUsage, out.mem) && lists(grid.memUsage, constants.mem));
+    CAL_CHECK(!lists(grid.memUsage, unused.mem));
+    fixture.run(grid);
+    CAL_CHECK(out.first() == 6);
+
+    // Rebinding refills the list on the next prepare
+    CAL_CHECK_OK(tracker.setMem(fixture.name("i1"), b.mem));
+    CAL_CHECK_OK(tracker.prepare(grid, fixture.module));
+    CAL_CHECK(grid.memUsage->memCount == 4 && lists(grid.memUsage, b.mem));
+    fixture.run(grid);
+    CAL_CHECK(out.first() == 7);
+
+    // Unbound and forgotten buffers drop out
+    CAL_CHECK_OK(tracker.setMem(fixture.name("i1"), 0));
+    CAL_CHECK_OK(tracker.prepare(grid, fixture.module));
+    CAL_CHECK(grid.memUsage->memCount == 3 && !lists(grid.memUsage, b.mem));
+    tracker.forgetMem(out.mem);
+    CAL_CHECK_OK(tracker.prepare(grid, fixture.module));
+    CAL_CHECK(grid.memUsage->memCount == 2 && !lists(grid.memUsage, out.mem));
+    tracker.forgetMem(constants.mem);
+    CAL_CHECK_OK(tracker.prepare(grid, fixture.module));
+    CAL_CHECK(grid.memUsage->memCount == 1 && grid.memUsage->mem[0] == a.mem);
+
+    // A module forgotten before unload loses its bindings and is probed again
+    tracker.forgetModule(fixture.module);
+    CAL_CHECK_OK(tracker.prepare(grid, fixture.module));
+    CAL_CHECK(grid.memUsage->memCount == 0 && grid.memUsage->mem == 0);
+    CAL_CHECK(tracker.prepare(grid, fixture.module + 1000) == CAL_RESULT_BAD_HANDLE);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    CAL_CHECK_OK(calswRegisterKernel("mem_usage_add", addKernel, 0));
+    TestDevice device;
+    ModuleFixture fixture(device.dev());
+    testNames(fixture);
+    testPrepare(device.dev(), fixture);
+    std::printf("test_mem_usage passed\n");
+    return 0;
+}
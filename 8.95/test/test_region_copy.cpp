@@ -0,0 +1,213 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_region_copy.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const CALuint SrcWidth  = 1000;
+const CALuint SrcHeight = 600;
+const CALuint DstWidth  = 777;
+const CALuint DstHeight = 800;
+
+// Expected destination contents after copying region
+void
+apply(std::vector<float>& expected, const cal::CopyRegion& r, CALuint srcSliceRows, CALuint dstSliceRows)
+{
+    CALuint h = r.size[1] ? r.size[1] : 1;
+    CALuint d = r.size[2] ? r.size[2] : 1;
+    for (CALuint z = 0; z < d; ++z)
+    {
+        for (CALuint y = 0; y < h; ++y)
+        {
+            CALuint sy = r.srcOffset[1] + y + (r.srcOffset[2] + z) * srcSliceRows;
+            CALuint dy = r.dstOffset[1] + y + (r.dstOffset[2] + z) * dstSliceRows;
+            for (CALuint x = 0; x < r.size[0]; ++x)
+            {
+                expected[dy * DstWidth + r.dstOffset[0] + x] = static_cast<float>(sy * SrcWidth + r.srcOffset[0] + x + 1);
+            }
+        }
+    }
+}
+
+cal::CopyRegion
+region(CALuint sx, CALuint sy, CALuint sz, CALuint dx, CALuint dy, CALuint dz, CALuint w, CALuint h, CALuint d)
+{
+    cal::CopyRegion r = { { sx, sy, sz }, { dx, dy, dz }, { w, h, d } };
+    return r;
+}
+
+// Regions of every kind between surfaces of different pitches, over two contexts
+void
+testRegions(CALdevice dev)
+{
+    CALcontext ctxs[2];
+    CAL_CHECK_OK(calCtxCreate(&ctxs[0], dev));
+    CAL_CHECK_OK(calCtxCreate(&ctxs[1], dev));
+
+    CALresource src, dst;
+    CAL_CHECK_OK(calResAllocRemote2D(&src, &dev, 1, SrcWidth, SrcHeight, CAL_FORMAT_FLOAT32_1, 0));
+    CAL_CHECK_OK(calResAllocLocal2D(&dst, dev, DstWidth, DstHeight, CAL_FORMAT_FLOAT32_1, 0));
+
+    CALvoid* ptr;
+    CALuint  srcPitch, dstPitch;
+    CAL_CHECK_OK(calResMap(&ptr, &srcPitch, src, 0));
+    for (CALuint y = 0; y < SrcHeight; ++y)
+    {
+        for (CALuint x = 0; x < SrcWidth; ++x)
+        {
+            static_cast<float*>(ptr)[y * srcPitch + x] = static_cast<float>(y * SrcWidth + x + 1);
+        }
+    }
+    calResUnmap(src);
+    CAL_CHECK_OK(calResMap(&ptr, &dstPitch, dst, 0));
+    std::memset(ptr, 0, static_cast<size_t>(dstPitch) * DstHeight * 4);
+    calResUnmap(dst);
+    CAL_CHECK(srcPitch != dstPitch);
+
+    cal::RegionCopyParams params;
+    params.chunkBytes   = 64 * 1024;
+    params.srcSliceRows = 100;
+    params.dstSliceRows = 200;
+    cal::RegionCopier copier;
+    CAL_CHECK_OK(copier.open(ctxs, 2, src, dst, params));
+
+    std::vector<cal::CopyRegion> regions;
+    for (CALuint i = 0; i < 8; ++i)
+    {
+        regions.push_back(region(10 + i * 10, 5, 0, 20 + i * 10, 7, 0, 10, 1, 0));     // side by side
+    }
+    for (CALuint i = 0; i < 4; ++i)
+    {
+        regions.push_back(region(300, 10 + i * 5, 0, 400, 30 + i * 5, 0, 50, 5, 1));   // stacked
+    }
+    regions.push_back(region(0, 0, 2, 0, 0, 1, 700, 90, 0));                           // chunked
+    regions.push_back(region(500, 20, 3, 100, 150, 2, 60, 40, 2));                     // 3D
+    regions.push_back(region(0, 99, 0, 0, 199, 0, DstWidth, 1, 0));                    // one row
+
+    std::vector<cal::CopyChunk> chunks;
+    CAL_CHECK_OK(copier.plan(&regions[0], static_cast<CALuint>(regions.size()), chunks));
+    CAL_CHECK(chunks.size() == 9);
+
+    CAL_CHECK_OK(copier.copy(&regions[0], static_cast<CALuint>(regions.size())));
+    cal::RegionCopyStats stats = copier.stats();
+    CAL_CHECK(stats.rawCopies == 2 && stats.partialCopies == 7);
+
+    std::vector<float> expected(static_cast<size_t>(DstWidth) * DstHeight, 0.0f);
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        apply(expected, regions[i], params.srcSliceRows, params.dstSliceRows);
+    }
+    CAL_CHECK_OK(calResMap(&ptr, &dstPitch, dst, 0));
+    CALuint wrong = 0;
+    for (CALuint y = 0; y < DstHeight; ++y)
+    {
+        for (CALuint x = 0; x < DstWidth; ++x)
+        {
+            wrong += (static_cast<float*>(ptr)[y * dstPitch + x] != expected[y * DstWidth + x]);
+        }
+    }
+    calResUnmap(dst);
+    CAL_CHECK(wrong == 0);
+
+    cal::CopyRegion outside = region(990, 0, 0, 0, 0, 0, 20, 1, 1);
+    CAL_CHECK(copier.copy(&outside, 1) == CAL_RESULT_INVALID_PARAMETER);
+    copier.close();
+
+    calResFree(src);
+    calResFree(dst);
+    calCtxDestroy(ctxs[0]);
+    calCtxDestroy(ctxs[1]);
+}
+
+// Full rows of equal pitch and a following partial row join into one raw span
+void
+testSpans(CALdevice dev)
+{
+    CALcontext ctx;
+    CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+    CALresource a, b;
+    CAL_CHECK_OK(calResAllocLocal2D(&a, dev, 512, 64, CAL_FORMAT_FLOAT32_1, 0));
+    CAL_CHECK_OK(calResAllocLocal2D(&b, dev, 512, 64, CAL_FORMAT_FLOAT32_1, 0));
+
+    cal::RegionCopier copier;
+    CAL_CHECK_OK(copier.open(&ctx, 1, a, b));
+    cal::CopyRegion rows[3] = {
+        region(0, 3, 0, 0, 3, 0, 512, 2, 0),
+        region(0, 5, 0, 0, 5, 0, 512, 4, 0),
+        region(0, 9, 0, 0, 9, 0, 100, 1, 0)
+    };
+    std::vector<cal::CopyChunk> chunks;
+    CAL_CHECK_OK(copier.plan(rows, 3, chunks));
+    CAL_CHECK(chunks.size() == 1 && chunks[0].raw);
+    CAL_CHECK(chunks[0].srcOffset[0] == 3 * 512 * 4 && chunks[0].size[0] == (6 * 512 + 100) * 4);
+    copier.close();
+
+    calResFree(a);
+    calResFree(b);
+    calCtxDestroy(ctx);
+}
+
+// A chunk limit of 2^32 rows or more plans a rectangle as one band
+void
+testHugeChunks(CALdevice dev)
+{
+    CALcontext ctx;
+    CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+    CALresource a, b;
+    CAL_CHECK_OK(calResAllocLocal2D(&a, dev, 512, 64, CAL_FORMAT_FLOAT32_1, 0));
+    CAL_CHECK_OK(calResAllocLocal2D(&b, dev, 300, 64, CAL_FORMAT_FLOAT32_1, 0));
+
+    cal::RegionCopyParams params;
+    params.chunkBytes = static_cast<CALuint64>(100 * 4) << 32;
+    cal::RegionCopier copier;
+    CAL_CHECK_OK(copier.open(&ctx, 1, a, b, params));
+    cal::CopyRegion rect = region(0, 0, 0, 0, 0, 0, 100, 10, 0);
+    std::vector<cal::CopyChunk> chunks;
+    CAL_CHECK_OK(copier.plan(&rect, 1, chunks));
+    CAL_CHECK(chunks.size() == 1 && !chunks[0].raw && chunks[0].size[1] == 10);
+    copier.close();
+
+    calResFree(a);
+    calResFree(b);
+    calCtxDestroy(ctx);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testRegions(device.dev());
+    testSpans(device.dev());
+    testHugeChunks(device.dev());
+    std::printf("test_region_copy passed\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_residency.h"
+
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const CALuint LocalRAMMB = 64;      // calsw local RAM, small enough to run out of
+const CALuint Side       = 1024;    // 4 MB of UNSIGNED_INT32_1
+
+cal::ResourceShape
+shape(bool remote = false)
+{
+    return cal::ResourceShape(0, remote, CAL_FORMAT_UNSIGNED_INT32_1, Side, Side);
+}
+
+cal::ResidencyParams
+params(bool remoteFallback)
+{
+    cal::ResidencyParams p;
+    p.pollInterval   = 1;
+    p.headroomMB     = 8;
+    p.remoteFallback = remoteFallback;
+    return p;
+}
+
+// Write or check value in the first and last element of id's resource
+bool
+touch(cal::ResidencyManager& manager, cal::ResidentId id, CALuint value, bool write)
+{
+    CALresource res;
+    CAL_CHECK_OK(manager.pin(id, &res));
+    CALuint* data;
+    CALuint  pitch;
+    CAL_CHECK_OK(calResMap(reinterpret_cast<CALvoid**>(&data), &pitch, res, 0));
+    CALuint* last = data + (Side - 1) * pitch + Side - 1;
+    if (write)
+    {
+        data[0] = value;
+        *last   = value;
+    }
+    bool matched = data[0] == value && *last == value;
+    CAL_CHECK_OK(calResUnmap(res));
+    CAL_CHECK_OK(manager.unpin(id));
+    return matched;
+}
+
+// Filling local memory evicts the least recently pinned resources with
+// their data, never a pinned one; pin() brings them back once there is room
+void
+testEviction(CALdevice dev, CALcontext ctx)
+{
+    cal::ResidencyManager manager(params(true));
+    cal::ResidentId none;
+    CAL_CHECK(manager.alloc(&none, shape()) == CAL_RESULT_NOT_INITIALIZED);
+    CAL_CHECK_OK(manager.open(ctx, dev, 0));
+
+    std::vector<cal::ResidentId> ids(12);
+    for (CALuint i = 0; i < ids.size(); ++i)
+    {
+        CAL_CHECK_OK(manager.alloc(&ids[i], shape()));
+        CAL_CHECK(ids[i] != 0 && manager.heapOf(ids[i]) == cal::ResidencyLocal);
+        CAL_CHECK(touch(manager, ids[i], 1000 + i, true));
+    }
+    CAL_CHECK(manager.stats().evictions == 0);
+
+    // ids[0] is the coldest but pinned; ids[1] and on go first
+    CALresource hot;
+    CAL_CHECK_OK(manager.pin(ids[0], &hot));
+    std::vector<cal::ResidentId> more(6);
+    for (CALuint i = 0; i < more.size(); ++i)
+    {
+        CAL_CHECK_OK(manager.alloc(&more[i], shape()));
+        CAL_CHECK(manager.heapOf(more[i]) == cal::ResidencyLocal);
+    }
+    cal::ResidencyStats stats = manager.stats();
+    CAL_CHECK(stats.evictions >= 2 && stats.fallbacks == 0);
+    CAL_CHECK(stats.evictedBytes == stats.evictions * shape().bytes());
+    CAL_CHECK(manager.heapOf(ids[0]) == cal::ResidencyLocal);
+    CAL_CHECK(manager.heapOf(ids[1]) != cal::ResidencyLocal);
+    CAL_CHECK(manager.heapOf(ids[ids.size() - 1]) == cal::ResidencyLocal);
+    CAL_CHECK(manager.free(ids[0]) == CAL_RESULT_BUSY);
+    CAL_CHECK_OK(manager.unpin(ids[0]));
+    CAL_CHECK(manager.unpin(ids[0]) == CAL_RESULT_BAD_HANDLE);
+
+    // Freeing the new resources makes room to page evicted ones back in
+    for (CALuint i = 0; i < more.size(); ++i)
+    {
+        CAL_CHECK_OK(manager.free(more[i]));
+    }
+    CAL_CHECK(touch(manager, ids[1], 1001, false));
+    CAL_CHECK(manager.heapOf(ids[1]) == cal::ResidencyLocal && manager.stats().pageIns >= 1);
+    for (CALuint i = 0; i < ids.size(); ++i)
+    {
+        CAL_CHECK(touch(manager, ids[i], 1000 + i, false));
+    }
+    manager.close();
+}
+
+// With every local resource pinned a local request lands in remote memory,
+// or fails without the fallback
+void
+testFallback(CALdevice dev, CALcontext ctx)
+{
+    cal::ResidencyManager manager(params(true));
+    CAL_CHECK_OK(manager.open(ctx, dev, 0));
+
+    std::vector<cal::ResidentId> ids;
+    for (CALuint i = 0; i < 16; ++i)
+    {
+        cal::ResidentId id;
+        CAL_CHECK_OK(manager.alloc(&id, shape()));
+        if (manager.heapOf(id) != cal::ResidencyLocal)
+        {
+            ids.push_back(id);
+            break;
+        }
+        CALresource res;
+        CAL_CHECK_OK(manager.pin(id, &res));
+        ids.push_back(id);
+    }
+    cal::ResidencyStats stats = manager.stats();
+    CAL_CHECK(stats.fallbacks == 1 && stats.evictions == 0);
+    CAL_CHECK(touch(manager, ids.back(), 7, true));
+
+    cal::ResidencyParams strict = params(false);
+    manager.setParams(strict);
+    cal::ResidentId failed = 1;
+    CAL_CHECK(manager.alloc(&failed, shape()) != CAL_RESULT_OK);
+    CAL_CHECK(failed == 0 && manager.stats().failures == 1);
+
+    // Remote requests go to remote memory either way
+    cal::ResidentId remote;
+    CAL_CHECK_OK(manager.alloc(&remote, shape(true)));
+    CAL_CHECK(manager.heapOf(remote) == cal::ResidencyRemote);
+    CAL_CHECK(manager.heapStatus(cal::ResidencyRemote).trackedCount >= 1);
+
+    for (size_t i = 0; i + 1 < ids.size(); ++i)
+    {
+        CAL_CHECK_OK(manager.unpin(ids[i]));
+    }
+    CAL_CHECK(manager.heapOf(12345) == cal::ResidencyHeapCount);
+    CAL_CHECK(manager.free(12345) == CAL_RESULT_BAD_HANDLE);
+    manager.close();
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    char localRAM[32];
+    std::snprintf(localRAM, sizeof(localRAM), "%u", LocalRAMMB);
+    setenv("CALSW_LOCAL_RAM_MB", localRAM, 1);
+
+    TestDevice device;
+    CALcontext ctx;
+    CAL_CHECK_OK(calCtxCreate(&ctx, device.dev()));
+    testEviction(device.dev(), ctx);
+    testFallback(device.dev(), ctx);
+    calCtxDestroy(ctx);
+    std::printf("test_residency passed\n");
+    return 0;
+}
@@ -0,0 +1,207 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_resource_pool.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const CALuint LocalRAMMB = 64;      // calsw local RAM, small enough to run out of
+
+// 1 MB and 4 MB local shapes
+cal::ResourceShape
+small(CALdevice dev)
+{
+    return cal::ResourceShape(dev, false, CAL_FORMAT_UNSIGNED_INT8_4, 512, 512);
+}
+
+cal::ResourceShape
+large(CALdevice dev)
+{
+    return cal::ResourceShape(dev, false, CAL_FORMAT_UNSIGNED_INT8_4, 1024, 1024);
+}
+
+cal::ResourcePoolParams
+unlimited()
+{
+    cal::ResourcePoolParams params;
+    params.maxCachedMB     = 0;
+    params.maxPerShape     = 0;
+    params.minFreeLocalMB  = 0;
+    params.minFreeRemoteMB = 0;
+    params.checkInterval   = 0;
+    return params;
+}
+
+CALuint
+availLocalMB(CALdevice dev)
+{
+    CALdevicestatus status;
+    std::memset(&status, 0, sizeof(status));
+    status.struct_size = sizeof(status);
+    CAL_CHECK_OK(calDeviceGetStatus(&status, dev));
+    return status.availLocalRAM;
+}
+
+// Take count resources of shape and give them all back to the cache
+void
+cache(cal::ResourcePool& pool, const cal::ResourceShape& shape, CALuint count)
+{
+    std::vector<cal::PooledResource> held(count);
+    for (CALuint i = 0; i < count; ++i)
+    {
+        CAL_CHECK_OK(pool.acquire(held[i], shape));
+    }
+}
+
+void
+testReuse(CALdevice dev)
+{
+    cal::ResourcePool pool(unlimited());
+    CALresource first;
+    {
+        cal::PooledResource res;
+        CAL_CHECK_OK(pool.local2D(res, dev, 512, 512, CAL_FORMAT_UNSIGNED_INT8_4));
+        first = res.get();
+        CAL_CHECK(pool.stats().outstanding == 1);
+    }
+    cal::ResourcePoolStats stats = pool.stats();
+    CAL_CHECK(stats.cachedCount == 1 && stats.cachedBytes == small(dev).bytes() && stats.outstanding == 0);
+
+    cal::PooledResource again;
+    CAL_CHECK_OK(pool.acquire(again, small(dev)));
+    CAL_CHECK(again.get() == first);
+    stats = pool.stats();
+    CAL_CHECK(stats.hits == 1 && stats.misses == 1 && stats.cachedCount == 0);
+
+    // A detached resource is the caller's
+    CALresource owned = again.detach();
+    CAL_CHECK(!again && pool.stats().outstanding == 0);
+    CAL_CHECK_OK(calResFree(owned));
+
+    CAL_CHECK_OK(pool.prewarm(small(dev), 3));
+    CAL_CHECK(pool.stats().cachedCount == 3);
+    pool.clear();
+    CAL_CHECK(pool.stats().cachedCount == 0 && pool.stats().cachedBytes == 0);
+}
+
+void
+testLimits(CALdevice dev)
+{
+    cal::ResourcePoolParams params = unlimited();
+    params.maxPerShape = 2;
+    cal::ResourcePool pool(params);
+    cache(pool, small(dev), 3);
+    cal::ResourcePoolStats stats = pool.stats();
+    CAL_CHECK(stats.cachedCount == 2 && stats.trims == 1);
+
+    // 3 MB across shapes: the least recently released go first
+    params.maxPerShape = 0;
+    params.maxCachedMB = 3;
+    pool.setParams(params);
+    cache(pool, small(dev), 3);
+    stats = pool.stats();
+    CAL_CHECK(stats.cachedCount == 3 && stats.cachedBytes == 3 * small(dev).bytes());
+
+    // A resource above the whole limit is never cached
+    cache(pool, large(dev), 1);
+    stats = pool.stats();
+    CAL_CHECK(stats.cachedCount == 3 && stats.trims == 2);
+
+    // Lowering the limit trims at once, as does trim()
+    params.maxCachedMB = 2;
+    pool.setParams(params);
+    CAL_CHECK(pool.stats().cachedCount == 2);
+    CAL_CHECK(pool.trim(small(dev).bytes()) == small(dev).bytes());
+    CAL_CHECK(pool.stats().cachedCount == 1 && pool.stats().trims == 4);
+}
+
+// Too little free local RAM trims the idle local resources of the device
+void
+testPressure(CALdevice dev)
+{
+    cal::ResourcePool pool(unlimited());
+    cache(pool, large(dev), 4);
+    CAL_CHECK(pool.stats().cachedCount == 4);
+
+    // Ask for 8 MB more than is free: two of the 4 MB resources go
+    cal::ResourcePoolParams params = unlimited();
+    params.minFreeLocalMB = availLocalMB(dev) + 8;
+    pool.setParams(params);
+    CAL_CHECK_OK(pool.checkPressure(dev));
+    cal::ResourcePoolStats stats = pool.stats();
+    CAL_CHECK(stats.cachedCount == 2 && stats.trims == 2);
+
+    // Every checkInterval misses check on their own
+    params.minFreeLocalMB = availLocalMB(dev) + 64;
+    params.checkInterval  = 1;
+    pool.setParams(params);
+    cal::PooledResource res;
+    CAL_CHECK_OK(pool.acquire(res, small(dev)));
+    CAL_CHECK(pool.stats().cachedCount == 0);
+}
+
+// An allocation that fails while the cache holds the memory frees the idle
+// resources of the device and tries again
+void
+testRetry(CALdevice dev)
+{
+    cal::ResourcePool pool(unlimited());
+    CALuint count = availLocalMB(dev) / 4;
+    cache(pool, large(dev), count);
+    CAL_CHECK(pool.stats().cachedCount == count && availLocalMB(dev) < 16);
+
+    cal::PooledResource big;
+    CAL_CHECK_OK(pool.local2D(big, dev, 2048, 2048, CAL_FORMAT_UNSIGNED_INT8_4));
+    cal::ResourcePoolStats stats = pool.stats();
+    CAL_CHECK(stats.retries == 1 && stats.cachedCount == 0 && stats.trims == count);
+
+    // Nothing left to trim: the failure comes back
+    cal::PooledResource tooBig;
+    CAL_CHECK(pool.local2D(tooBig, dev, 8192, 8192, CAL_FORMAT_UNSIGNED_INT8_4) != CAL_RESULT_OK);
+    CAL_CHECK(!tooBig && pool.stats().retries == 1);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    char localRAM[32];
+    std::snprintf(localRAM, sizeof(localRAM), "%u", LocalRAMMB);
+    setenv("CALSW_LOCAL_RAM_MB", localRAM, 1);
+
+    TestDevice device;
+    testReuse(device.dev());
+    testLimits(device.dev());
+    testPressure(device.dev());
+    testRetry(device.dev());
+    std::printf("test_resource_pool passed\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_staging_ring.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Producers upload interleaved blocks through a small ring; the
+// destination must hold every block once the ring is closed
+void
+testUploads(CALdevice dev)
+{
+    const CALuint blockFloats = 1000;
+    const CALuint blocks      = 256;
+
+    CALcontext ctx;
+    CAL_CHECK_OK(calCtxCreate(&ctx, dev));
+    CALresource dst;
+    CAL_CHECK_OK(calResAllocLocal2D(&dst, dev, blockFloats, blocks, CAL_FORMAT_FLOAT32_1, 0));
+    CALmem dstMem;
+    CAL_CHECK_OK(calCtxGetMem(&dstMem, ctx, dst));
+
+    CALvoid* ptr;
+    CALuint  pitch;
+    CAL_CHECK_OK(calResMap(&ptr, &pitch, dst, 0));
+    calResUnmap(dst);
+    const CALuint rowBytes = pitch * 4;
+
+    cal::StagingRing ring;
+    CAL_CHECK_OK(ring.open(ctx, dev, 64 * 1024, 64));
+    CAL_CHECK(ring.capacity() == 64 * 1024);
+
+    std::vector<float> data(blockFloats);
+    for (CALuint b = 0; b < blocks; ++b)
+    {
+        for (CALuint i = 0; i < blockFloats; ++i)
+        {
+            data[i] = static_cast<float>(b * blockFloats + i);
+        }
+        CALresult result;
+        while ((result = ring.upload(&data[0], blockFloats * 4, dstMem, b * rowBytes)) == CAL_RESULT_BUSY)
+        {
+            CAL_CHECK_OK(ring.flush());
+            std::this_thread::yield();
+        }
+        CAL_CHECK_OK(result);
+    }
+
+    // A reservation larger than the ring is refused
+    cal::StagingRange range;
+    CAL_CHECK(ring.reserve(128 * 1024, range) == CAL_RESULT_INVALID_PARAMETER);
+
+    CAL_CHECK_OK(ring.flush());
+    cal::StagingRingStats stats = ring.stats();
+    CAL_CHECK(stats.reserves == blocks);
+    CAL_CHECK(stats.copies >= 1 && stats.bytes == static_cast<CALuint64>(blocks) * blockFloats * 4);
+    ring.close();
+
+    CAL_CHECK_OK(calResMap(&ptr, &pitch, dst, 0));
+    for (CALuint b = 0; b < blocks; ++b)
+    {
+        const float* row = static_cast<const float*>(ptr) + static_cast<size_t>(b) * pitch;
+        CAL_CHECK(row[0] == static_cast<float>(b * blockFloats));
+        CAL_CHECK(row[blockFloats - 1] == static_cast<float>(b * blockFloats + blockFloats - 1));
+    }
+    calResUnmap(dst);
+
+    calCtxReleaseMem(ctx, dstMem);
+    calResFree(dst);
+    calCtxDestroy(ctx);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testUploads(device.dev());
+    std::printf("test_staging_ring passed\n");
+    return 0;
+}
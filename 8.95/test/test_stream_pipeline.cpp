@@ -0,0 +1,162 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_stream_pipeline.h"
+
+#include <vector>
+
+namespace {
+
+const CALuint Width = 1024;
+
+struct Stream
+{
+    CALuint                 items;
+    CALuint64               failAt;     // item whose compute fails, items for none
+    CALuint64               filled;
+    std::vector<CALuint64>  consumed;
+    bool                    slotsMatch;
+    bool                    dataMatch;
+
+    Stream(CALuint n, CALuint64 fail) : items(n), failAt(fail), filled(0), slotsMatch(true), dataMatch(true) {}
+};
+
+// Items pass through a pipeline whose compute stage copies input to output
+CALresult
+runStream(cal::StreamPipeline& pipeline, CALcontext ctx, Stream& stream)
+{
+    const CALuint depth = pipeline.config().depth;
+    return pipeline.run(
+        [&stream, depth](cal::PipelineSlot& slot, CALvoid* ptr, CALuint)
+        {
+            if (stream.filled == stream.items)
+            {
+                return false;
+            }
+            stream.slotsMatch = stream.slotsMatch && slot.item == stream.filled && slot.index == slot.item % depth;
+            CALuint* data = static_cast<CALuint*>(ptr);
+            for (CALuint x = 0; x < Width; ++x)
+            {
+                data[x] = static_cast<CALuint>(slot.item * 100000 + x);
+            }
+            ++stream.filled;
+            return true;
+        },
+        [&stream, ctx](cal::PipelineSlot& slot, CALevent& event)
+        {
+            if (slot.item == stream.failAt)
+            {
+                return CAL_RESULT_ERROR;
+            }
+            return calMemCopy(&event, ctx, slot.inputMem, slot.outputMem, 0);
+        },
+        [&stream](const cal::PipelineSlot& slot, const CALvoid* ptr, CALuint)
+        {
+            const CALuint* data = static_cast<const CALuint*>(ptr);
+            stream.dataMatch = stream.dataMatch && data[0] == slot.item * 100000 &&
+                               data[Width - 1] == slot.item * 100000 + Width - 1;
+            stream.consumed.push_back(slot.item);
+        });
+}
+
+cal::PipelineConfig
+config(CALuint depth)
+{
+    cal::PipelineConfig c;
+    c.depth  = depth;
+    c.input  = cal::ResourceShape(0, true, CAL_FORMAT_UNSIGNED_INT32_1, Width);
+    c.output = cal::ResourceShape(0, false, CAL_FORMAT_UNSIGNED_INT32_1, Width);
+    return c;
+}
+
+// Items are consumed once each, in fill order, with their own data, for
+// every depth
+void
+testOrder(CALdevice dev, CALcontext ctx)
+{
+    for (CALuint depth = 2; depth <= 4; ++depth)
+    {
+        cal::StreamPipeline pipeline;
+        CAL_CHECK_OK(pipeline.open(ctx, dev, config(depth)));
+
+        Stream stream(10, ~static_cast<CALuint64>(0));
+        CAL_CHECK_OK(runStream(pipeline, ctx, stream));
+        CAL_CHECK(stream.slotsMatch && stream.dataMatch);
+        CAL_CHECK(stream.consumed.size() == stream.items);
+        for (size_t i = 0; i < stream.consumed.size(); ++i)
+        {
+            CAL_CHECK(stream.consumed[i] == i);
+        }
+
+        cal::PipelineStats stats = pipeline.stats();
+        CAL_CHECK(stats.items == stream.items && stats.seconds > 0);
+        for (CALuint s = 0; s < cal::StageCount; ++s)
+        {
+            CAL_CHECK(stats.occupancy[s] >= 0 && stats.occupancy[s] <= 1);
+        }
+        CAL_CHECK(stats.bottleneck < cal::StageCount);
+
+        // The slots are reused by the next run
+        Stream again(3, ~static_cast<CALuint64>(0));
+        CAL_CHECK_OK(runStream(pipeline, ctx, again));
+        CAL_CHECK(again.consumed.size() == 3 && again.dataMatch);
+        pipeline.close();
+    }
+}
+
+// A failing compute ends the run with its result; nothing from it on is
+// consumed and what was consumed stays in order
+void
+testFailure(CALdevice dev, CALcontext ctx)
+{
+    cal::StreamPipeline pipeline;
+    CAL_CHECK(pipeline.open(ctx, dev, config(1)) == CAL_RESULT_INVALID_PARAMETER);
+    CAL_CHECK_OK(pipeline.open(ctx, dev, config(3)));
+
+    Stream stream(10, 4);
+    CAL_CHECK(runStream(pipeline, ctx, stream) == CAL_RESULT_ERROR);
+    CAL_CHECK(stream.dataMatch && stream.consumed.size() <= 4);
+    for (size_t i = 0; i < stream.consumed.size(); ++i)
+    {
+        CAL_CHECK(stream.consumed[i] == i);
+    }
+    pipeline.close();
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    CALcontext ctx;
+    CAL_CHECK_OK(calCtxCreate(&ctx, device.dev()));
+    testOrder(device.dev(), ctx);
+    testFailure(device.dev(), ctx);
+    calCtxDestroy(ctx);
+    std::printf("test_stream_pipeline passed\n");
+    return 0;
+}
@@ -0,0 +1,143 @@
+/* ============================================================
+
+Copyright (c) 2016-2019 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+============================================================ */
+
+
+#include "cal_test.h"
+#include "cal_typed_resource.h"
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+typedef cal::Vector<CALubyte, 4> Rgba8;
+
+static_assert(cal::Buffer<float>::format == CAL_FORMAT_FLOAT32_1, "Buffer<float> is FLOAT32_1");
+static_assert(cal::Image2D<Rgba8>::format == CAL_FORMAT_UNSIGNED_INT8_4, "Image2D<Rgba8> is UNSIGNED_INT8_4");
+static_assert(std::is_same<cal::FormatType<CAL_FORMAT_UNSIGNED_INT8_4>::type, Rgba8>::value, "UNSIGNED_INT8_4 maps back");
+
+void
+testBuffer(CALdevice dev)
+{
+    const CALuint count = 1000;
+    std::vector<float> values(count);
+    for (CALuint i = 0; i < count; ++i)
+    {
+        values[i] = 0.5f * i - 17.0f;
+    }
+
+    cal::Buffer<float> local;
+    CAL_CHECK(!local);
+    CAL_CHECK_OK(local.allocLocal(dev, count));
+    CAL_CHECK(local && local.size() == count && local.height() == 1);
+    CAL_CHECK(local.bytes() == count * sizeof(float));
+    CAL_CHECK_OK(local.write(&values[0]));
+
+    std::vector<float> back(count, 0.0f);
+    CAL_CHECK_OK(local.read(&back[0]));
+    CAL_CHECK(back == values);
+
+    // Remote resources take streaming stores
+    cal::Buffer<float> remote;
+    CAL_CHECK_OK(remote.allocRemote(dev, count));
+    CAL_CHECK_OK(remote.write(&values[0], cal::CopyStreaming));
+    std::vector<float> remoteBack(count, 0.0f);
+    CAL_CHECK_OK(remote.read(&remoteBack[0]));
+    CAL_CHECK(remoteBack == values);
+
+    // Moving hands over the resource, reset frees it
+    CALresource res = local.get();
+    cal::Buffer<float> moved(std::move(local));
+    CAL_CHECK(!local && moved.get() == res);
+    moved.reset();
+    CAL_CHECK(!moved && moved.size() == 0);
+    CAL_CHECK(calResFree(res) == CAL_RESULT_BAD_HANDLE);
+}
+
+// A width off the pitch alignment exercises the row padding
+void
+testImage(CALdevice dev)
+{
+    const CALuint width  = 37;
+    const CALuint height = 19;
+    std::vector<Rgba8> pixels(width * height);
+    for (CALuint y = 0; y < height; ++y)
+    {
+        for (CALuint x = 0; x < width; ++x)
+        {
+            Rgba8& p = pixels[y * width + x];
+            p[0] = static_cast<CALubyte>(x);
+            p[1] = static_cast<CALubyte>(y);
+            p[2] = static_cast<CALubyte>(x * y);
+            p[3] = 255;
+        }
+    }
+
+    cal::Image2D<Rgba8> image;
+    CAL_CHECK_OK(image.allocLocal(dev, width, height));
+    CAL_CHECK(image.width() == width && image.height() == height);
+    CAL_CHECK_OK(image.write(&pixels[0]));
+
+    Rgba8*  data  = 0;
+    CALuint pitch = 0;
+    CAL_CHECK_OK(image.map(&data, &pitch));
+    CAL_CHECK(pitch >= width);
+    CAL_CHECK(data[5 * pitch + 7][0] == 7 && data[5 * pitch + 7][1] == 5 && data[5 * pitch + 7][2] == 35);
+    CAL_CHECK_OK(image.unmap());
+
+    std::vector<Rgba8> back(width * height);
+    CAL_CHECK_OK(image.read(&back[0]));
+    for (size_t i = 0; i < back.size(); ++i)
+    {
+        for (CALuint c = 0; c < 4; ++c)
+        {
+            CAL_CHECK(back[i][c] == pixels[i][c]);
+        }
+    }
+
+    cal::Image2D<Rgba8> remote;
+    CAL_CHECK_OK(remote.allocRemote(dev, width, height));
+    CAL_CHECK_OK(remote.write(&pixels[0], cal::CopyStreaming));
+    CAL_CHECK_OK(remote.read(&back[0]));
+    CAL_CHECK(back[width * height - 1][2] == pixels[width * height - 1][2]);
+
+    // Moving over a live image frees the old one
+    CALresource old = remote.get();
+    remote = std::move(image);
+    CAL_CHECK(!image && remote.width() == width);
+    CAL_CHECK(calResFree(old) == CAL_RESULT_BAD_HANDLE);
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    TestDevice device;
+    testBuffer(device.dev());
+    testImage(device.dev());
+    std::printf("test_typed_resource passed\n");
+    return 0;
+}